@@ -1,12 +1,13 @@
 /*
  * ternary_processor_full.v - Full Ternary Processor (Phase 4)
  *
- * Complete ternary processor supporting the full 36-opcode ISA.
+ * Complete ternary processor supporting the full 38-opcode ISA.
  * Designed for FPGA synthesis targeting Lattice iCE40 / Xilinx Artix-7.
  *
  * Features:
  *   - Two-stack architecture (operand + return stack, Setun-70 inspired)
- *   - 36 opcodes: arithmetic, stack manip, control flow, comparisons
+ *   - 38 opcodes: arithmetic, trit shifts, stack manip, control flow,
+ *     comparisons
  *   - 729-cell ternary memory (3^6)
  *   - 9-trit word (18-bit encoded), 6-trit tryte support
  *   - Structured control flow (BRZ/BRN/BRP, LOOP_BEGIN/END)
@@ -249,6 +250,60 @@ module ternary_processor_full(
         end
     endfunction
 
+    /* ---- Trit shift left: k low Z trits in, a*3^k ---- */
+    function [17:0] trit_shl;
+        input [17:0] val;
+        input [7:0]  k;
+        begin
+            trit_shl = (k > 8) ? 18'b0 : (val << (2 * k));
+        end
+    endfunction
+
+    /* ---- Trit shift right: a/3^k, truncated toward zero ----
+     * Dropping the low k trits rounds to nearest; when the dropped
+     * trits' sign opposes the value's, step the quotient toward zero. */
+    function [17:0] trit_shr;
+        input [17:0] val;
+        input [7:0]  k;
+        reg [17:0] out;
+        reg [1:0] sign, low, carry, t;
+        integer j;
+        begin
+            out = 18'b0;
+            sign = T_Z;
+            low = T_Z;
+            for (j = 0; j < 9; j = j + 1) begin
+                if (j + k < 9)
+                    out[2*j+1 -: 2] = val[2*(j+k)+1 -: 2];
+                /* Last nonzero trit seen is the most significant */
+                if (val[2*j+1 -: 2] != T_Z) begin
+                    sign = val[2*j+1 -: 2];
+                    if (j < k) low = val[2*j+1 -: 2];
+                end
+            end
+            if (low != T_Z && low != sign) begin
+                /* Add -sign at trit 0 and ripple the carry */
+                carry = (sign == T_P) ? T_N : T_P;
+                for (j = 0; j < 9; j = j + 1) begin
+                    t = out[2*j+1 -: 2];
+                    if (carry != T_Z) begin
+                        if (t == T_Z) begin
+                            out[2*j+1 -: 2] = carry;
+                            carry = T_Z;
+                        end else if (t != carry) begin
+                            out[2*j+1 -: 2] = T_Z;
+                            carry = T_Z;
+                        end else begin
+                            /* P+P = N carry P; N+N = P carry N */
+                            out[2*j+1 -: 2] = (carry == T_P) ? T_N : T_P;
+                        end
+                    end
+                end
+            end
+            trit_shr = out;
+        end
+    endfunction
+
     /* ---- State machine states ---- */
     parameter S_FETCH   = 3'd0;
     parameter S_DECODE  = 3'd1;
@@ -298,6 +353,8 @@ module ternary_processor_full(
     parameter OP_ACCEPT_ANY_OP = 8'd33;
     parameter OP_PUSH_TRYTE = 8'd34;
     parameter OP_PUSH_WORD = 8'd35;
+    parameter OP_TSHL      = 8'd36;
+    parameter OP_TSHR      = 8'd37;
 
     /* ---- Main FSM ---- */
 
@@ -329,7 +386,8 @@ module ternary_processor_full(
                 if (cur_instr == OP_PUSH || cur_instr == OP_JMP ||
                     cur_instr == OP_COND_JMP || cur_instr == OP_BRZ ||
                     cur_instr == OP_BRN || cur_instr == OP_BRP ||
-                    cur_instr == OP_CALL || cur_instr == OP_PUSH_TRYTE) begin
+                    cur_instr == OP_CALL || cur_instr == OP_PUSH_TRYTE ||
+                    cur_instr == OP_TSHL || cur_instr == OP_TSHR) begin
                     need_operand <= 1'b1;
                     operand_byte <= instr_data;
                     pc <= pc + 1;
@@ -550,6 +608,15 @@ module ternary_processor_full(
                     osp <= osp + 1;
                 end
 
+                /* --- Trit shifts --- */
+                OP_TSHL: begin
+                    ostack[osp-1] <= trit_shl(ostack[osp-1], operand_byte);
+                end
+
+                OP_TSHR: begin
+                    ostack[osp-1] <= trit_shr(ostack[osp-1], operand_byte);
+                end
+
                 OP_SYSCALL: begin
                     /* Stub: pop syscall number */
                     osp <= osp - 1;
@@ -19,12 +19,33 @@
  *   2. Constant fold (optimize pass)
  *   3. Emit ternary bytecode
  *   4. The emitted bytecode can tokenize C source
+ *
+ * Call convention:
+ *   - A program image is an entry stub, CALL main; HALT (the last
+ *     function if there is no main), followed by the functions.
+ *   - The caller pushes the arguments left to right and executes
+ *     CALL f; the callee leaves its return value in their place.
+ *   - Parameters and locals live in slots numbered per compile, which
+ *     recursion re-enters and separately compiled files reuse. So each
+ *     function saves its slots on the return stack (PUSH s; LOAD; TO_R
+ *     each) and restores them before RET.
+ *   - Callee: save, ENTER, pop the arguments into the parameter slots,
+ *     body; every return jumps to LEAVE, restore, RET. Falling off the
+ *     end returns 0.
+ *   - return f(args) is a tail call: push the arguments, LEAVE, then
+ *     JMP back to ENTER if f is the function itself, else restore and
+ *     JMP f. Tail recursion runs in constant return-stack space.
  */
 
 #ifndef BOOTSTRAP_H
 #define BOOTSTRAP_H
 
 #include "ir.h"
+#include "compact_ast.h"
+#include "intern.h"
+#include "symhash.h"
+#include "linker.h"
+#include "cache.h"
 #include "parser.h"
 #include "codegen.h"
 #include "vm.h"
@@ -32,9 +53,12 @@
 /* Maximum source size for bootstrap compilation */
 #define BOOTSTRAP_MAX_SRC 4096
 
+/* Bump whenever emitted bytecode changes; part of every compile cache key */
+#define BOOTSTRAP_CODEGEN_VERSION 12
+
 /* Symbol table entry for the bootstrap compiler */
 typedef struct {
-    char name[64];
+    int name_id;       /* Intern ID of the variable name */
     int stack_offset;  /* Offset from frame pointer in stack slots */
     int is_pointer;    /* 1 if the var is a pointer type */
 } BootstrapSymbol;
@@ -45,42 +69,148 @@ typedef struct {
     BootstrapSymbol symbols[MAX_SYMBOLS];
     int count;
     int next_offset;
+    SymHash index;     /* name_id -> symbols[] index, scoped */
 } BootstrapSymTab;
 
 /* Initialize a symbol table */
 static inline void symtab_init(BootstrapSymTab *tab) {
     tab->count = 0;
     tab->next_offset = 0;
+    symhash_init(&tab->index);
 }
 
-/* Add a symbol, return its stack offset */
-static inline int symtab_add(BootstrapSymTab *tab, const char *name, int is_ptr) {
+/* Drop all symbols, keep storage */
+static inline void symtab_clear(BootstrapSymTab *tab) {
+    tab->count = 0;
+    tab->next_offset = 0;
+    symhash_clear(&tab->index);
+}
+
+/* Release the hash index */
+static inline void symtab_free(BootstrapSymTab *tab) {
+    symhash_free(&tab->index);
+}
+
+/* Add a symbol by intern ID, return its stack offset */
+static inline int symtab_add_id(BootstrapSymTab *tab, int name_id, int is_ptr) {
     if (tab->count >= MAX_SYMBOLS) return -1;
+    symhash_insert(&tab->index, name_id, tab->count);
     BootstrapSymbol *s = &tab->symbols[tab->count++];
-    strncpy(s->name, name, 63);
-    s->name[63] = '\0';
+    s->name_id = name_id;
     s->is_pointer = is_ptr;
     s->stack_offset = tab->next_offset++;
     return s->stack_offset;
 }
 
+/* Add a symbol, return its stack offset */
+static inline int symtab_add(BootstrapSymTab *tab, const char *name, int is_ptr) {
+    return symtab_add_id(tab, intern(name), is_ptr);
+}
+
+/* Lookup a symbol by intern ID, return stack offset or -1 if not found */
+static inline int symtab_lookup_id(const BootstrapSymTab *tab, int name_id) {
+    int i = symhash_get(&tab->index, name_id, -1);
+    return i < 0 ? -1 : tab->symbols[i].stack_offset;
+}
+
 /* Lookup a symbol, return stack offset or -1 if not found */
 static inline int symtab_lookup(BootstrapSymTab *tab, const char *name) {
-    for (int i = 0; i < tab->count; i++) {
-        if (strcmp(tab->symbols[i].name, name) == 0)
-            return tab->symbols[i].stack_offset;
-    }
-    return -1;
+    int id = intern_find(name);
+    return id == INTERN_NONE ? -1 : symtab_lookup_id(tab, id);
 }
 
+/*
+ * Per-compilation state: AST arena, compact AST, symbol table and output
+ * cursor. Compilations on separate contexts share nothing but the locked
+ * intern table, so they may run concurrently on different threads.
+ * Reusing one context for many compiles keeps its storage warm.
+ */
+typedef struct {
+    IRArena arena;            /* Expr tree of the compile in progress */
+    CompactAST ast;           /* Flattened, folded AST being emitted */
+    BootstrapSymTab symtab;
+    SymHash funcs;            /* name_id -> entry offset + 1 if defined, 0 if only called */
+    unsigned char *out;       /* Output bytecode (buffer mode) */
+    ObjectModule *obj;        /* Output module (object mode), or NULL */
+    CompileCache *cache;      /* Consulted before compiling, or NULL */
+    int opt_level;            /* 0: direct emission; 1+: functions via SSA */
+    int pos;
+    int max;
+    int *calls;               /* Buffer mode: (operand offset, callee name_id) pairs */
+    int call_count;
+    int call_capacity;
+    int *returns;             /* Operand offsets of JMPs to the current epilogue */
+    int return_count;
+    int return_capacity;
+    int last_func;            /* Entry offset of the last function emitted, or -1 */
+    int frame_func;           /* Function being emitted directly, or INTERN_NONE */
+    int frame_at;             /* Its ENTER, where self tail calls jump */
+    int save_base;            /* Its saved slots [save_base, save_end) */
+    int save_end;
+    int failed;               /* Emission error (undefined function) */
+} BootstrapCtx;
+
+/* New contexts start with the process-wide cache (NULL by default) and
+ * optimization level (0 by default) */
+void bootstrap_ctx_init(BootstrapCtx *bc);
+void bootstrap_ctx_free(BootstrapCtx *bc);
+
+/*
+ * Set the cache used by contexts initialized afterwards, including the
+ * temporary one inside bootstrap_compile(). Call before starting threads.
+ */
+void bootstrap_set_cache(CompileCache *cache);
+
+/*
+ * Set the optimization level of contexts initialized afterwards. At
+ * level 1 and up small callees are first inlined (inline_calls()), as
+ * far as the -O0 image leaves room below 1-byte jump targets, and
+ * repeated subexpressions computed once (cse_exprs()), then each
+ * function is built into SSA form (ssa.h), run through ssa_optimize() at
+ * that level and lowered from there; functions the SSA path cannot
+ * handle yet (calls) are emitted directly. Inlined copies and CSE temps
+ * declare slots of their own, so a unit's slot_end depends on its level;
+ * units chained through slot_end still link.
+ * Call before starting threads.
+ */
+void bootstrap_set_opt_level(int level);
+
+/* bootstrap_compile() on an explicit context */
+int bootstrap_compile_ctx(BootstrapCtx *bc, const char *source,
+                          unsigned char *out_bytecode, int max_len);
+
+/*
+ * Compile source to a relocatable object module for linker_add_object(),
+ * entry stub included. Each function definition is exported at its
+ * entry offset; functions called but not defined in source become
+ * imports, and every CALL is relocated against its callee's symbol. The
+ * code buffer grows as needed. Returns the code length, or -1 on parse
+ * error.
+ */
+int bootstrap_compile_object(BootstrapCtx *bc, const char *source, ObjectModule *obj);
+
+/*
+ * Compile one function of a larger program as an object module with no
+ * entry stub. Its locals take slots from slot_base on, and *slot_end
+ * receives the first slot left free. An entry stub (CALL main; HALT,
+ * relocated against main) followed by the units of a program (in order,
+ * slot_base chained through slot_end) links to the same bytes as
+ * bootstrap_compile() on the whole program. Returns the code length, or
+ * -1 on parse error. Not cached.
+ */
+int bootstrap_compile_unit(BootstrapCtx *bc, const char *source, int slot_base,
+                           ObjectModule *obj, int *slot_end);
+
 /*
  * bootstrap_compile: Compile a seT5-C source string to bytecode.
- * Returns the bytecode length, or -1 on error.
+ * Returns the bytecode length, or -1 on error (parse error, or a call
+ * to a function the source does not define).
  *
  * The compilation uses the existing parser + IR + codegen pipeline:
  *   1. parse_program(source) -> AST
- *   2. optimize(AST) -> folded AST
- *   3. Emit bytecode from AST (using symbol table for var offsets)
+ *   2. Flatten to a compact AST and constant fold it
+ *   3. Emit bytecode from the compact AST (symbol table for var offsets)
+ * Reentrant: uses a private BootstrapCtx.
  */
 int bootstrap_compile(const char *source, unsigned char *out_bytecode, int max_len);
 
@@ -0,0 +1,73 @@
+/*
+ * cache.h - Content-addressed on-disk compilation cache
+ *
+ * Maps a 128-bit hash of (compiler version, compile mode, source text) to
+ * the compiled result: bytecode plus the object module's symbol and
+ * relocation tables, with names stored as strings so entries are valid
+ * in any process. A hit skips lexing, parsing and emission entirely.
+ *
+ * Layout: <dir>/<first 2 hex digits>/<32 hex digits>
+ *
+ * Entries are written to a temporary file and rename()d into place, so
+ * concurrent compilers sharing a directory only ever see complete
+ * entries. Each hit touches the entry's mtime; when the directory grows
+ * past max_bytes the least recently used entries are removed until it is
+ * back under 3/4 of the cap.
+ */
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "linker.h"
+
+#define CACHE_FORMAT_VERSION  1
+#define CACHE_DEFAULT_MAX     (64L * 1024 * 1024)
+
+/* Compile mode, part of the key */
+typedef enum {
+    CACHE_KIND_BUFFER = 1,    /* bootstrap_compile: flat bytecode */
+    CACHE_KIND_OBJECT         /* bootstrap_compile_object: relocatable */
+} CacheKind;
+
+/* The optimization level is or'ed into the kind at this bit */
+#define CACHE_KIND_OPT_SHIFT 8
+
+typedef struct {
+    uint64_t hi;
+    uint64_t lo;
+} CacheKey;
+
+typedef struct CompileCache {
+    char dir[512];
+    long max_bytes;
+    atomic_long bytes;        /* Approximate size on disk */
+    atomic_long hits;
+    atomic_long misses;
+    atomic_long stores;
+    atomic_long evictions;
+    pthread_mutex_t evict_lock;
+} CompileCache;
+
+/* Open (creating if needed) a cache directory. 0 on success, -1 on error */
+int cache_open(CompileCache *c, const char *dir, long max_bytes);
+void cache_close(CompileCache *c);
+
+CacheKey cache_key(const char *source, CacheKind kind);
+
+/*
+ * Look up key; on a hit obj receives the cached module (initialized and
+ * owned by the caller) and the code length is returned. -1 on a miss.
+ */
+int cache_get(CompileCache *c, CacheKey key, ObjectModule *obj);
+
+/* Store obj under key. 0 on success, -1 if the entry could not be written */
+int cache_put(CompileCache *c, CacheKey key, const ObjectModule *obj);
+
+/* Remove least recently used entries until the cache holds at most
+ * target bytes. Returns the number of entries removed. */
+int cache_evict(CompileCache *c, long target);
+
+#endif /* CACHE_H */
@@ -0,0 +1,93 @@
+/*
+ * compact_ast.h - Compact struct-of-arrays AST
+ *
+ * The pointer-based Expr tree spends ~100 bytes per node on child
+ * pointers that most node types never use. CompactAST stores the same
+ * tree as parallel arrays indexed by 32-bit node references:
+ *
+ *   kind[n], op[n], val[n], name[n]  - per-node payload (name = intern ID)
+ *   kids[kids_at[n] .. + nkids[n]]   - child references (side array)
+ *
+ * Nodes are appended in post-order, so every child has a smaller index
+ * than its parent: bottom-up passes are a single forward loop.
+ *
+ * Child slot layout per node type:
+ *   NODE_BINOP          [left, right]
+ *   NODE_RETURN/DEREF/ADDR_OF, *_VAR_DECL, ARRAY_ACCESS  [operand]
+ *   NODE_ASSIGN         [lhs, rhs]
+ *   NODE_ARRAY_ASSIGN   [index, value]
+ *   NODE_IF             [cond, body, else_body]
+ *   NODE_WHILE          [cond, body]
+ *   NODE_FOR            [init, cond, inc, body]
+ *   NODE_FUNC_DEF       [body, params/stmts...]
+ *   NODE_FUNC_CALL, PROGRAM, BLOCK, *_ARRAY_DECL  [list...]
+ * Absent children are CAST_NONE.
+ */
+
+#ifndef COMPACT_AST_H
+#define COMPACT_AST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "ir.h"
+#include "intern.h"
+
+typedef uint32_t NodeRef;
+
+#define CAST_NONE ((NodeRef)0xFFFFFFFFu)
+
+typedef struct {
+    /* Per-node parallel arrays */
+    uint8_t  *kind;      /* NodeType */
+    uint8_t  *op;        /* OpType (NODE_BINOP) */
+    uint16_t *nkids;     /* Number of child slots */
+    int32_t  *val;       /* NODE_CONST value, *_ARRAY_DECL size */
+    int32_t  *name;      /* Intern ID, or INTERN_NONE */
+    uint32_t *kids_at;   /* First child slot in kids[] */
+    uint32_t count;
+    uint32_t capacity;
+
+    /* Child reference side array */
+    NodeRef *kids;
+    uint32_t kid_count;
+    uint32_t kid_capacity;
+
+    NodeRef root;        /* Last node added by cast_from_expr */
+} CompactAST;
+
+/* Initialize an empty compact AST */
+void cast_init(CompactAST *ca);
+
+/* Free all arrays */
+void cast_free(CompactAST *ca);
+
+/* Drop all nodes but keep the allocated arrays */
+void cast_clear(CompactAST *ca);
+
+/* Append a node. kids may be NULL when nkids == 0. Returns its reference. */
+NodeRef cast_add(CompactAST *ca, NodeType kind, OpType op, int val,
+                 int name_id, const NodeRef *kids, int nkids);
+
+/* Flatten an Expr tree (post-order). Sets and returns ca->root. */
+NodeRef cast_from_expr(CompactAST *ca, const Expr *e);
+
+/* Rebuild a heap/arena Expr tree from node n */
+Expr *cast_to_expr(const CompactAST *ca, NodeRef n);
+
+/* Constant folding: one forward pass over the node arrays */
+void cast_optimize(CompactAST *ca);
+
+/* Bytes held by the node arrays (for memory comparisons) */
+size_t cast_memory_bytes(const CompactAST *ca);
+
+/* Child i of node n (CAST_NONE if absent) */
+static inline NodeRef cast_kid(const CompactAST *ca, NodeRef n, int i) {
+    return (i < ca->nkids[n]) ? ca->kids[ca->kids_at[n] + (uint32_t)i] : CAST_NONE;
+}
+
+/* Identifier of node n, or NULL */
+static inline const char *cast_name(const CompactAST *ca, NodeRef n) {
+    return intern_str(ca->name[n]);
+}
+
+#endif /* COMPACT_AST_H */
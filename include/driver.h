@@ -0,0 +1,60 @@
+/*
+ * driver.h - Parallel multi-file compilation driver
+ *
+ * Compiles many seT5-C sources to object modules on a pool of worker
+ * threads (one BootstrapCtx per worker), then links them in input order
+ * into one executable. Output is deterministic regardless of -j.
+ *
+ * Linked image layout:
+ *   [entry stub: CALL main; HALT] [module 0] [module 1] ...
+ *
+ * Command line (ternary_compiler --link ...):
+ *   -j N             worker threads (default: online CPUs)
+ *   -O N, -ON        optimization level: 0 (default), 1 (SSA passes) or
+ *                    2 (also strength reduction)
+ *   -o FILE          write linked bytecode to FILE
+ *   --manifest FILE  read source paths from FILE (also @FILE); one path
+ *                    per line, blank lines and '#' comments ignored
+ *   --time           print per-phase timing (and cache hit counts)
+ *   --cache DIR      reuse results from the on-disk compile cache in DIR
+ *   --cache-max MB   cache size cap (default 64 MB)
+ *   FILE...          source files
+ */
+
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "linker.h"
+
+/* Wall-clock time per phase, in seconds */
+typedef struct {
+    double read;
+    double compile;
+    double link;
+    double write;
+    double compile_cpu;   /* Sum of per-module compile times */
+    int jobs;             /* Worker threads actually used */
+} DriverTimes;
+
+/* Default worker count: number of online CPUs (at least 1) */
+int driver_default_jobs(void);
+
+/*
+ * Compile count sources with up to jobs workers and link them into lnk
+ * (which must be initialized). names[] label diagnostics and may be NULL.
+ * Returns 0 on success, else the number of failed modules plus linker
+ * errors. times may be NULL.
+ */
+int driver_compile(const char *const *sources, const char *const *names, int count,
+                   int jobs, Linker *lnk, DriverTimes *times);
+
+/*
+ * Read a manifest into a malloc'd array of malloc'd paths.
+ * Returns the path count, or -1 if the file cannot be read.
+ */
+int driver_read_manifest(const char *path, char ***out_paths);
+
+/* Entry point for `ternary_compiler --link`; argv excludes "--link" */
+int driver_main(int argc, char **argv);
+
+#endif /* DRIVER_H */
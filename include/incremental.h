@@ -0,0 +1,82 @@
+/*
+ * incremental.h - Function-granularity incremental recompilation
+ *
+ * An IncrBuild remembers, for each top-level function of the previous
+ * build, a fingerprint and the linker module holding its compiled code.
+ * A rebuild splits the new source at top-level braces (a character scan,
+ * no lexing, of only the region that differs from the previous source),
+ * fingerprints each function and recompiles only those whose fingerprint
+ * changed.
+ *
+ * Fingerprint: hash of the function text with whitespace runs collapsed,
+ * plus its first local slot. Locals are numbered program-wide, so a
+ * function depends on how many slots the functions before it used; it
+ * does not depend on their code or on its callees, because calls are
+ * resolved by the linker.
+ *
+ * Relinking: if the set of functions is unchanged and each recompiled
+ * function kept its size and exports, only the changed modules are
+ * copied and patched (linker_relink). Otherwise reused modules are moved
+ * into a fresh link in the new order.
+ *
+ * The linked image is [stub: CALL main; HALT] [fn 0] [fn 1] ... The stub
+ * is rebuilt on every build, since an edit may add or remove main. At -O0
+ * this is byte-identical to bootstrap_compile() of the same source. At
+ * -O1 and up each function is optimized alone, so calls are never
+ * inlined as in a whole-program compile, and the bytes differ.
+ */
+
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bootstrap.h"
+#include "linker.h"
+
+typedef struct {
+    uint64_t hash;            /* Whitespace-normalized text hash */
+    int slot_base;            /* First local slot */
+    int slot_end;             /* First slot left free */
+} IncrUnit;
+
+/* A top-level function's extent in the current source */
+typedef struct {
+    size_t start;
+    size_t len;
+    uint64_t hash;
+} IncrSpan;
+
+typedef struct {
+    BootstrapCtx bc;
+    Linker lnk;               /* Module 0 is the entry stub; module i + 1 holds unit i */
+    IncrUnit *units;
+    int unit_count;
+    int unit_capacity;
+    IncrSpan *spans;          /* Split of the source last built */
+    int span_count;
+    int span_capacity;
+    IncrSpan *old_spans;      /* Scratch: the split before that */
+    int old_span_capacity;
+    char *prev;               /* Source last built, to find the edited region */
+    size_t prev_len;
+    size_t prev_capacity;
+    char *text;               /* Scratch: NUL-terminated function text */
+    size_t text_capacity;
+    int compiled;             /* Functions compiled by the last build */
+    int reused;               /* Functions reused by the last build */
+    int partial_link;         /* Last build patched only changed modules */
+} IncrBuild;
+
+void incr_init(IncrBuild *ib);
+void incr_free(IncrBuild *ib);
+
+/*
+ * Build source, reusing what the previous build compiled. On success the
+ * image is in ib->lnk.output and its length is returned. Returns -1 if a
+ * function fails to compile (the previous build is kept) or the link
+ * fails (see ib->lnk errors).
+ */
+int incr_build(IncrBuild *ib, const char *source);
+
+#endif /* INCREMENTAL_H */
@@ -0,0 +1,39 @@
+/*
+ * intern.h - Identifier interning
+ *
+ * Maps each distinct identifier to a small integer ID. The lexer interns
+ * every identifier once; from then on the AST, type checker, bootstrap
+ * symbol table and linker carry and compare IDs instead of copying and
+ * strcmp'ing names.
+ *
+ * Interned strings are stored in fixed chunks that never move, so the
+ * pointer returned by intern_str() stays valid for the process lifetime.
+ * ID 0 (INTERN_NONE) means "no name".
+ *
+ * The table is process-global and thread-safe: interning and lookup are
+ * serialized by a mutex, intern_str() is lock-free.
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include <stddef.h>
+
+#define INTERN_NONE 0
+
+/* Intern a NUL-terminated string. Returns its ID (never INTERN_NONE). */
+int intern(const char *s);
+
+/* Intern len bytes of s (need not be NUL-terminated) */
+int intern_n(const char *s, size_t len);
+
+/* ID of s if already interned, INTERN_NONE otherwise (does not insert) */
+int intern_find(const char *s);
+
+/* String for an ID, or NULL for INTERN_NONE / out-of-range IDs */
+const char *intern_str(int id);
+
+/* Number of interned strings */
+int intern_count(void);
+
+#endif /* INTERN_H */
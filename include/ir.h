@@ -63,7 +63,8 @@ typedef struct Expr
 {
     NodeType type;
     int val;              /* For NODE_CONST */
-    char *name;           /* For NODE_VAR, NODE_FUNC_DEF, NODE_FUNC_CALL */
+    const char *name;     /* For NODE_VAR, NODE_FUNC_DEF, NODE_FUNC_CALL (interned) */
+    int name_id;          /* Intern ID of name (INTERN_NONE if unnamed) */
     OpType op;            /* For NODE_BINOP */
     struct Expr *left;    /* For NODE_BINOP left operand / NODE_RETURN expr */
     struct Expr *right;   /* For NODE_BINOP right operand */
@@ -76,8 +77,50 @@ typedef struct Expr
     struct Expr *increment; /* For NODE_FOR: increment expression */
     /* Phase 3: Arrays */
     int array_size; /* For NODE_ARRAY_DECL: number of elements */
+    /* Memory management */
+    int in_arena;   /* 1 if node (and its params) lives in an IRArena */
 } Expr;
 
+/*
+ * IRArena - bump allocator for AST nodes.
+ *
+ * While an arena is active (ir_arena_activate), every create_* constructor
+ * carves its node and child list out of large chunks instead of
+ * calling malloc per node. expr_free() on an arena node is a no-op; the
+ * whole tree is released at once by ir_arena_release(). Do not attach
+ * heap-allocated nodes to an arena tree or vice versa.
+ */
+#define IR_ARENA_CHUNK_SIZE (64 * 1024)
+
+typedef struct IRArenaChunk IRArenaChunk;
+
+typedef struct {
+    IRArenaChunk *chunks;  /* Most recent chunk first */
+    size_t chunk_size;     /* Default payload size of new chunks */
+    size_t bytes_used;     /* Total bytes handed out (stats) */
+    int chunk_count;       /* Number of chunks currently held */
+} IRArena;
+
+/* Initialize an arena. chunk_size 0 selects IR_ARENA_CHUNK_SIZE. */
+void ir_arena_init(IRArena *arena, size_t chunk_size);
+
+/* Allocate size bytes (8-byte aligned) from the arena. Never returns NULL. */
+void *ir_arena_alloc(IRArena *arena, size_t size);
+
+/* Route create_* constructors through arena (NULL = back to malloc).
+ * Returns the previously active arena so calls can be nested.
+ * The active arena is per thread. */
+IRArena *ir_arena_activate(IRArena *arena);
+
+/* Currently active arena, or NULL */
+IRArena *ir_arena_current(void);
+
+/* Free every chunk; all nodes allocated from the arena become invalid */
+void ir_arena_release(IRArena *arena);
+
+/* Drop all nodes but keep the first chunk for reuse by the next compile */
+void ir_arena_reset(IRArena *arena);
+
 /* Create a constant node */
 Expr *create_const(int val);
 
@@ -145,7 +188,82 @@ Expr *create_array_access(const char *name, Expr *index);
 /* Create an array assignment: arr[index] = value */
 Expr *create_array_assign(const char *name, Expr *index, Expr *value);
 
-/* Free an expression tree */
+/* Phase 3: Trit constructors */
+
+/* Create a trit variable declaration: trit x = expr */
+Expr *create_trit_var_decl(const char *name, Expr *init);
+
+/* Create a trit array declaration: trit arr[size] */
+Expr *create_trit_array_decl(const char *name, int size, Expr **init_values, int init_count);
+
+/* Free an expression tree (no-op for arena-owned nodes) */
 void expr_free(Expr *e);
 
+/* === Inlining === */
+
+/* Observed call count of one function, from a profiled run */
+typedef struct
+{
+    int name_id; /* Intern ID of the callee */
+    long calls;
+} InlineProfile;
+
+/*
+ * Cost model for inline_calls(). A call site's cost is the callee's size
+ * in AST nodes (about one VM instruction each) less the call it
+ * replaces; it is inlined if that is at most max_cost, or hot_cost when
+ * the site is hot: inside a loop, or calling a function the profile saw
+ * called at least hot_calls times.
+ */
+typedef struct
+{
+    int max_cost;
+    int hot_cost;
+    long hot_calls;
+    int slot_budget;              /* Max variable slots the program may declare, -1 for no limit */
+    int size_budget;              /* Max AST nodes inlining may add, -1 for no limit */
+    const InlineProfile *profile; /* May be NULL */
+    int profile_count;
+} InlineOptions;
+
+/* max_cost 16, hot_cost 48, hot_calls 100, no slot or size limit, no profile */
+void inline_options_default(InlineOptions *opts);
+
+/*
+ * Inline calls to small functions of a NODE_PROGRAM in place. A callee
+ * qualifies if it is defined once, calls nothing (so it cannot recurse)
+ * and ends in its only return statement, and it refers to nothing but
+ * its parameters and locals. Callees whose body is just a return
+ * expression are substituted wherever they are called; others only where
+ * their statements can be placed before the calling statement (not in
+ * loop conditions or for increments). Their locals, and parameters that
+ * cannot take the argument expression directly, become fresh variables
+ * named callee$N$name. Callers that become call-free are then inlined in
+ * turn. Definitions are left in place. New nodes come from the active
+ * arena, which must be the tree's own if it is arena-allocated. opts may
+ * be NULL for the defaults. Returns the number of calls inlined.
+ */
+int inline_calls(Expr *prog, const InlineOptions *opts);
+
+/* === Common subexpression elimination === */
+
+/*
+ * Local value numbering over the statements of each function and block.
+ * Pure subexpressions (arithmetic, comparisons and loads; not calls or
+ * DIV/MOD) are hash-consed, commutative operands in either order. A value
+ * a run of straight-line statements evaluates more than once, with no
+ * write to its operands in between, is computed once into a fresh
+ * variable cse$N declared before its first use, if that takes fewer VM
+ * instructions. A write retires the values reading what it writes,
+ * pointer loads included; array stores are taken to stay within their
+ * array. Calls and control flow end the run; if conditions take part,
+ * loop conditions and for increments do not. Each temp takes a slot; slot_budget limits the
+ * slots the program may declare (-1 for no limit). New nodes come from
+ * the active arena, as for inline_calls(). *ops_saved (may be NULL)
+ * receives the instructions saved per execution of the statements, as
+ * the direct emitter counts them. Returns the number of evaluations
+ * removed.
+ */
+int cse_exprs(Expr *prog, int slot_budget, int *ops_saved);
+
 #endif /* IR_H */
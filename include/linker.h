@@ -20,12 +20,9 @@
 #define LINKER_H
 
 #include <stddef.h>
+#include "symhash.h"
 
-/* Maximum limits */
-#define LINK_MAX_SYMBOLS   128
-#define LINK_MAX_MODULES   16
-#define LINK_MAX_RELOCS    256
-#define LINK_MAX_CODE      4096
+/* Module, code, symbol and relocation tables all grow on demand */
 
 /* Symbol visibility */
 typedef enum {
@@ -36,7 +33,7 @@ typedef enum {
 
 /* Linker symbol */
 typedef struct {
-    char name[64];
+    int name_id;          /* Intern ID of the symbol name */
     int address;          /* Bytecode address (absolute after linking) */
     int module_id;        /* Which module defines this symbol */
     SymVisibility vis;
@@ -45,46 +42,78 @@ typedef struct {
 /* Relocation entry: a place in bytecode that needs patching */
 typedef struct {
     int offset;           /* Byte offset in the module's bytecode */
-    char target_name[64]; /* Symbol name to resolve */
+    int target_id;        /* Intern ID of the symbol to resolve, or
+                             INTERN_NONE: module-relative address, the
+                             module base is added to the byte in place */
     int module_id;        /* Module containing this relocation */
 } Relocation;
 
-/* Object module */
+/* Object module: code plus its symbol and relocation tables (all owned) */
 typedef struct {
     int id;
-    unsigned char code[LINK_MAX_CODE];
+    unsigned char *code;
     int code_len;
-    LinkSymbol symbols[LINK_MAX_SYMBOLS];
+    int code_capacity;
+    LinkSymbol *symbols;
     int sym_count;
-    Relocation relocs[LINK_MAX_RELOCS];
+    int sym_capacity;
+    Relocation *relocs;
     int reloc_count;
+    int reloc_capacity;
     int base_addr;        /* Base address after linking */
+    int dirty;            /* Replaced since the last link */
 } ObjectModule;
 
 /* Linker state */
 typedef struct {
-    ObjectModule modules[LINK_MAX_MODULES];
+    ObjectModule *modules;
     int module_count;
+    int module_capacity;
 
     /* Global symbol table (merged) */
-    LinkSymbol globals[LINK_MAX_SYMBOLS];
+    LinkSymbol *globals;
     int global_count;
+    int global_capacity;
+    SymHash global_index; /* name_id -> globals[] index */
 
     /* Output executable */
-    unsigned char output[LINK_MAX_CODE];
+    unsigned char *output;
     int output_len;
+    int output_capacity;
+
+    int linked;           /* Output matches the current module layout */
 
     /* Error tracking */
     char errors[16][128];
     int error_count;
 } Linker;
 
+/* Standalone object modules, built by a compiler and handed to the linker */
+void object_init(ObjectModule *obj);
+void object_free(ObjectModule *obj);
+void object_emit(ObjectModule *obj, unsigned char byte);
+void object_add_symbol_id(ObjectModule *obj, int name_id, int address, SymVisibility vis);
+void object_add_reloc_id(ObjectModule *obj, int offset, int target_id);
+
 /* Initialize the linker */
 void linker_init(Linker *lnk);
 
-/* Add an object module. Returns the module ID or -1 on error. */
+/* Free modules, symbol/relocation tables, index and output */
+void linker_free(Linker *lnk);
+
+/* Add an object module (code is copied). Returns the module ID or -1 on error. */
 int linker_add_module(Linker *lnk, const unsigned char *code, int code_len);
 
+/* Add a compiled object module, taking ownership of its storage (obj is
+ * left empty). Returns the module ID. */
+int linker_add_object(Linker *lnk, ObjectModule *obj);
+
+/*
+ * Replace a module's contents with obj, taking ownership (obj is left
+ * empty). The module is relinked by the next linker_relink().
+ */
+int linker_replace_object(Linker *lnk, int module_id, ObjectModule *obj);
+
 /* Add a symbol to a module */
 int linker_add_symbol(Linker *lnk, int module_id, const char *name,
                       int address, SymVisibility vis);
@@ -93,13 +122,24 @@ int linker_add_symbol(Linker *lnk, int module_id, const char *name,
 int linker_add_reloc(Linker *lnk, int module_id, int offset,
                      const char *target_name);
 
-/* Link all modules. Returns 0 on success, error count on failure.
+/* Link all modules. Returns 0 on success, error count on failure; a
+ * patched address past 255 (the 1-byte operand) is an error.
  * On success, output is in lnk->output[0..lnk->output_len-1]. */
 int linker_link(Linker *lnk);
 
+/*
+ * Relink after linker_replace_object(). When every replaced module kept
+ * its size and exports, only those modules are copied and patched;
+ * otherwise this is a full linker_link(). Same return value.
+ */
+int linker_relink(Linker *lnk);
+
 /* Resolve a single symbol by name. Returns address or -1 if not found. */
 int linker_resolve(const Linker *lnk, const char *name);
 
+/* Same, by intern ID */
+int linker_resolve_id(const Linker *lnk, int name_id);
+
 /* Report linker errors to stderr */
 void linker_report_errors(const Linker *lnk);
 
@@ -1,6 +1,8 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <stddef.h>
+
 /*
  * Token types for the ternary compiler lexer.
  * Phase 1: Arithmetic expressions
@@ -48,14 +50,20 @@ typedef enum {
     TOK_IDENT,      /* identifier */
 
     /* Special */
-    TOK_EOF
+    TOK_EOF,
+    TOK_ERROR       /* Unexpected character (in .value) */
 } TokenType;
 
 typedef struct {
     TokenType type;
-    int value;
+    int value;      /* TOK_INT: literal value; TOK_IDENT: intern ID */
 } Token;
 
+/*
+ * Batch tokenizer: fills tokens[] up front. Used by the expression
+ * codegen path; input beyond MAX_TOKENS - 1 tokens is truncated.
+ * Not reentrant (global buffer); parse_program() does not use it.
+ */
 #define MAX_TOKENS 512
 
 extern Token tokens[MAX_TOKENS];
@@ -64,11 +72,61 @@ extern int token_idx;
 void tokenize(const char *source);
 void parse(void);
 
-#define MAX_TOKEN_NAME 64
-extern char token_names[MAX_TOKENS][MAX_TOKEN_NAME];
+/* Interned identifier text for TOK_IDENT tokens (see intern.h) */
+extern const char *token_names[MAX_TOKENS];
+
+/*
+ * Streaming lexer: scans tokens on demand into a small ring buffer, so
+ * memory is constant regardless of source size. parse_program() uses it.
+ */
+#define LEXER_LOOKAHEAD 4   /* Ring size (power of two); max peek is k < 4 */
+
+typedef struct {
+    const char *source;
+    size_t len;
+    size_t pos;                     /* Scan position in source */
+    Token ring[LEXER_LOOKAHEAD];
+    size_t ends[LEXER_LOOKAHEAD];   /* Offset just past each buffered token */
+    int head;                       /* Ring index of the current token */
+    int count;                      /* Tokens buffered */
+    int consumed;                   /* Tokens taken by lexer_next() */
+    size_t end;                     /* Offset just past the last consumed token */
+} Lexer;
+
+void lexer_init(Lexer *lx, const char *source);
+
+/* Start scanning at source[offset], which must be a token boundary */
+void lexer_init_at(Lexer *lx, const char *source, size_t offset);
+
+/* k-th upcoming token (0 = current) without consuming; EOF repeats */
+Token lexer_peek(Lexer *lx, int k);
+
+/* Consume and return the current token */
+Token lexer_next(Lexer *lx);
+
+/*
+ * Recursive descent parser state. Everything a parse touches lives here
+ * (the identifier intern table is shared and locked), so separate Parsers
+ * may run on separate threads.
+ */
+typedef struct {
+    Lexer lex;
+    int error;      /* Set on the first syntax error */
+} Parser;
 
-/* Function/expression parser — returns AST (TASK-004) */
 struct Expr;
+
+void parser_init(Parser *ps, const char *source);
+void parser_init_at(Parser *ps, const char *source, size_t offset);
+
+/* Parse a whole program from ps; NULL on syntax error */
+struct Expr *parser_parse_program(Parser *ps);
+
+/* Parse one function definition; NULL on syntax error. On success
+ * ps->lex.end is just past its closing brace. */
+struct Expr *parser_parse_function(Parser *ps);
+
+/* Function/expression parser — returns AST (TASK-004). Reentrant. */
 struct Expr *parse_program(const char *source);
 
 #endif
@@ -17,15 +17,20 @@
 #define POSTFIX_IR_H
 
 #include "ir.h"
+#include "compact_ast.h"
+#include "linker.h"
 
 /* Postfix instruction types */
 typedef enum {
     PF_PUSH_CONST,      /* Push integer constant */
     PF_PUSH_VAR,        /* Push variable (load from memory) */
     PF_STORE_VAR,       /* Store to variable */
+    PF_STORE,           /* Pop value, pop address; store */
     PF_ADD,             /* a + b */
     PF_SUB,             /* a - b */
     PF_MUL,             /* a * b */
+    PF_TSHL,            /* Trit shift left: a * 3^operand */
+    PF_TSHR,            /* Trit shift right: a / 3^operand, truncated */
     PF_CMP_EQ,          /* a == b */
     PF_CMP_LT,          /* a < b */
     PF_CMP_GT,          /* a > b */
@@ -46,25 +51,38 @@ typedef enum {
     PF_ADDR_OF,         /* Address-of */
     PF_DUP,             /* Duplicate TOS */
     PF_DROP,            /* Drop TOS */
+    PF_SWAP,            /* Swap top two */
+    PF_OVER,            /* Copy second: ( a b -- a b a ) */
+    PF_ROT,             /* Rotate third to top: ( a b c -- b c a ) */
     PF_HALT,            /* Halt execution */
     PF_NOP,             /* No operation (placeholder) */
-    PF_LABEL            /* Label (target for jumps, not emitted) */
+    PF_LABEL,           /* Label (target for jumps, not emitted) */
+    PF_OP_COUNT         /* Sentinel: number of ops */
 } PostfixOp;
 
 /* Single postfix instruction */
 typedef struct {
     PostfixOp op;
-    int operand;        /* For PUSH_CONST: value; for BRZ/JMP: target index;
-                           for PUSH_VAR/STORE_VAR: var offset; for LABEL: label id */
-    char *name;         /* For PUSH_VAR/STORE_VAR/CALL: variable/function name */
+    int operand;        /* For PUSH_CONST: value; for BRZ/JMP: target label;
+                           for PUSH_VAR/STORE_VAR/ADDR_OF: var offset (slot);
+                           for LABEL: label id; for TSHL/TSHR: trits shifted */
+    const char *name;   /* For PUSH_VAR/STORE_VAR/CALL: variable/function name (interned);
+                           NULL once the variable is resolved to a slot */
 } PostfixInstr;
 
-/* Postfix instruction sequence */
+/*
+ * Postfix instruction sequence. label_at maps a label id to the index
+ * of its PF_LABEL; pf_emit() and pf_optimize_with() keep it current,
+ * and pf_find_label() checks an entry before trusting it, so code that
+ * edits instrs directly costs only a scan on the next lookup.
+ */
 typedef struct {
     PostfixInstr *instrs;
     int count;
     int capacity;
     int next_label;     /* Label counter for control flow */
+    int *label_at;      /* Label id -> instruction index, -1 if not placed */
+    int label_capacity;
 } PostfixSeq;
 
 /* Initialize a postfix sequence */
@@ -79,15 +97,135 @@ void pf_emit(PostfixSeq *seq, PostfixOp op, int operand, const char *name);
 /* Allocate a new label and return its id */
 int pf_alloc_label(PostfixSeq *seq);
 
-/* Find the index of a label in the sequence */
-int pf_find_label(PostfixSeq *seq, int label_id);
+/* Find the index of a label in the sequence, or -1; O(1) unless
+ * instrs was edited behind the label table's back */
+int pf_find_label(const PostfixSeq *seq, int label_id);
 
 /* Convert an AST to a postfix instruction sequence */
 void pf_from_ast(PostfixSeq *seq, Expr *ast);
 
-/* Peephole optimization pass on postfix IR */
+/* Convert a compact AST subtree rooted at root */
+void pf_from_compact(PostfixSeq *seq, const CompactAST *ca, NodeRef root);
+
+/* ---- Peephole rules ---- */
+
+#define PF_RULE_MAX 4   /* Longest pattern */
+
+/* Operand constraint on one pattern instruction */
+typedef enum {
+    PF_ARG_ANY,         /* Any operand */
+    PF_ARG_EQ,          /* operand == value */
+    PF_ARG_NONZERO,     /* operand != 0 */
+    PF_ARG_SAME,        /* Same operand and name as pattern instruction value */
+    PF_ARG_POW3         /* operand == value * 3^k for some k >= 1 (value 1 or -1) */
+} PfArgKind;
+
+typedef struct {
+    PostfixOp op;
+    PfArgKind arg;
+    int value;
+} PfPattern;
+
+/* Where a replacement instruction's operand comes from */
+typedef enum {
+    PF_OUT_LIT,         /* value */
+    PF_OUT_COPY,        /* Operand and name of pattern instruction value */
+    PF_OUT_FOLD,        /* Result of running pattern[value..] on constants */
+    PF_OUT_LOG3         /* k, where pattern instruction value (a PF_ARG_POW3)
+                           matched +-3^k */
+} PfOutKind;
+
+typedef struct {
+    PostfixOp op;
+    PfOutKind out;
+    int value;
+} PfReplace;
+
+/*
+ * A peephole rule: a run of consecutive instructions (in program
+ * order) and what replaces it. A replacement is never longer than its
+ * pattern. When several rules match, the longest wins, then the first.
+ */
+typedef struct {
+    const char *name;
+    PfPattern match[PF_RULE_MAX];
+    int match_len;
+    PfReplace repl[PF_RULE_MAX];
+    int repl_len;
+} PfRule;
+
+/* The rules pf_optimize() applies: constant folds, algebraic
+ * identities, strength reductions (multiplies by +-3^k become trit
+ * shifts) and redundant stack traffic */
+extern const PfRule pf_default_rules[];
+extern const int pf_default_rule_count;
+
+/* Rules compiled to a trie over their ops, last instruction first */
+typedef struct PfMatcher PfMatcher;
+
+/* Compile rules; NULL if one is malformed (too long, growing, a bad
+ * reference or fold) */
+PfMatcher *pf_compile_rules(const PfRule *rules, int count);
+void pf_free_rules(PfMatcher *m);
+
+/*
+ * Apply the rules of m until none matches. Linear time: one pass,
+ * revisiting only the instructions around each rewrite. NOPs are
+ * removed. Returns the number of rewrites.
+ */
+int pf_optimize_with(PostfixSeq *seq, const PfMatcher *m);
+
+/* pf_optimize_with() the default rules (compiled once, thread-safe) */
 void pf_optimize(PostfixSeq *seq);
 
+/*
+ * Stack scheduling (Koopman): where a stretch of code loads a resolved
+ * slot soon after loading or storing it, the value stays on the
+ * operand stack, sunk below the code in between (DUP, SWAP, ROT) and
+ * picked up again (DUP, OVER, SWAP, ROT) instead of reloaded. A store
+ * whose value only those loads read is removed with them; slot
+ * liveness comes from a dataflow pass over the sequence, with no slot
+ * live after it ends if dead_at_exit is set. Only schedules adding no
+ * more instructions than they remove are used. Returns the number of
+ * loads and stores removed.
+ */
+int pf_schedule_stack(PostfixSeq *seq, int dead_at_exit);
+
+/*
+ * Append the bytecode for seq to obj. Variables must be resolved to
+ * slots (name NULL); branch targets are one-byte module-relative
+ * addresses with relocations, as the bootstrap emitter produces, and
+ * constants outside the PUSH byte range are built from smaller ones.
+ * Returns the number of bytes added, or -1 if seq holds unresolved
+ * variables or calls, or branches to a label it does not place.
+ */
+int pf_lower(const PostfixSeq *seq, ObjectModule *obj);
+
+/*
+ * Where each instruction of a lowered sequence landed: pc[i] is the
+ * offset of instruction i from the start of the code it was lowered to
+ * (instructions that emit nothing share the next one's), and
+ * pc[count] is the code length.
+ */
+typedef struct {
+    int *pc;
+    int count;
+} PfPcMap;
+
+/*
+ * pf_lower(), also filling map (if not NULL; free it with
+ * pf_pc_map_free()). Branches are relaxed: each is threaded through
+ * any JMPs at its target, and a branch to the code right after it is
+ * emitted as nothing (JMP) or a DROP of its condition, repeating until
+ * no more branches shrink.
+ */
+int pf_lower_map(const PostfixSeq *seq, ObjectModule *obj, PfPcMap *map);
+void pf_pc_map_free(PfPcMap *map);
+
+/* The instruction whose code covers offset pc, or -1 if pc is outside
+ * the code */
+int pf_pc_map_find(const PfPcMap *map, int pc);
+
 /* Dump postfix IR for debugging */
 void pf_dump(const PostfixSeq *seq);
 
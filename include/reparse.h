@@ -0,0 +1,59 @@
+/*
+ * reparse.h - Incremental reparsing for editor integration
+ *
+ * A ParseDoc owns a source text and its AST and applies text edits to
+ * both. After an edit only the region from the start of the first
+ * affected top-level function is re-lexed and reparsed, and only until
+ * the parse reaches the closing brace of a function that the edit did not
+ * touch; every function before and after that region keeps its subtree.
+ *
+ * Functions are the unit of reuse: they are the only top-level construct,
+ * and lexing restarted just past a function's closing brace yields the
+ * same tokens as lexing the whole text.
+ *
+ * An edit that leaves a syntax error (unexpected characters included)
+ * fails without touching the AST, so a host keeps the last tree that
+ * parsed until an edit fixes the text.
+ *
+ * ASTs are heap-allocated; do not edit while an IRArena is active.
+ */
+
+#ifndef REPARSE_H
+#define REPARSE_H
+
+#include <stddef.h>
+#include "ir.h"
+
+/* Source extent of one function: [start, end) */
+typedef struct {
+    size_t start;           /* Just past the previous function */
+    size_t end;             /* Just past this function's closing brace */
+} FuncExtent;
+
+typedef struct {
+    char *text;             /* Current text, NUL-terminated */
+    size_t len;
+    size_t capacity;
+    Expr *program;          /* AST of the last text that parsed; NULL if none has */
+    FuncExtent *extents;    /* extents[i] covers program->params[i] in that text */
+    int extent_capacity;
+    int reparsed;           /* Functions parsed by the last open or edit */
+    int reused;             /* Functions kept by the last edit */
+    int error;              /* Current text has a syntax error; program is stale */
+} ParseDoc;
+
+/* Parse source into doc; returns 0, or -1 on a syntax error (the text
+ * is still kept with program NULL, and later edits may fix it) */
+int parse_doc_open(ParseDoc *doc, const char *source);
+
+/*
+ * Replace removed bytes at offset with inserted (NUL-terminated) and
+ * update the AST. Returns 0, -1 on a syntax error (doc->error is then set
+ * and doc->program keeps the previous AST until an edit makes the text
+ * parse again), or -2 if the edit range is outside the text.
+ */
+int parse_doc_edit(ParseDoc *doc, size_t offset, size_t removed, const char *inserted);
+
+void parse_doc_free(ParseDoc *doc);
+
+#endif /* REPARSE_H */
@@ -0,0 +1,105 @@
+/*
+ * server.h - Persistent compile server over a Unix domain socket
+ *
+ * `ternary_compiler --server` stays resident so repeated compiles skip
+ * process startup, logger initialization and table setup. Each worker
+ * thread owns one BootstrapCtx and a code buffer that stay warm across
+ * requests; the intern table is shared by all of them. Workers accept
+ * connections concurrently; a connection may carry any number of
+ * requests.
+ *
+ * Wire format (host byte order, local socket only):
+ *   request:  ServerRequest header, then len bytes of seT5-C source
+ *   response: ServerResponse header, then len bytes of bytecode
+ *
+ * The VM is a single global instance, so SERVER_OP_RUN requests execute
+ * one at a time; compilation itself runs in parallel. Each run gets at
+ * most SERVER_MAX_STEPS instructions so a looping program cannot hold
+ * the VM.
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define SERVER_DEFAULT_SOCKET "/tmp/ternary_compiler.sock"
+#define SERVER_MAX_SOURCE     (1 << 20)
+#define SERVER_MAX_CODE       65536
+#define SERVER_MAX_STEPS      10000000L
+
+/* Request operations */
+enum {
+    SERVER_OP_COMPILE = 1,    /* Source -> bytecode */
+    SERVER_OP_RUN,            /* Source -> bytecode + VM result */
+    SERVER_OP_SHUTDOWN        /* Stop accepting; workers exit */
+};
+
+/* Response status */
+enum {
+    SERVER_OK = 0,
+    SERVER_ERR_COMPILE,       /* Source did not parse / compile */
+    SERVER_ERR_REQUEST,       /* Unknown op or oversized source */
+    SERVER_ERR_RUN            /* Run exceeded SERVER_MAX_STEPS */
+};
+
+typedef struct {
+    uint32_t op;
+    uint32_t len;             /* Source bytes that follow */
+} ServerRequest;
+
+typedef struct {
+    int32_t status;
+    int32_t result;           /* VM result for SERVER_OP_RUN, 0 on SERVER_ERR_RUN */
+    uint32_t len;             /* Bytecode bytes that follow */
+} ServerResponse;
+
+typedef struct {
+    int listen_fd;
+    int workers;
+    char path[108];           /* sockaddr_un.sun_path */
+    atomic_int stopping;
+    atomic_long requests;     /* Requests served so far */
+    pthread_mutex_t lock;     /* Guards active[] */
+    int *active;              /* Per worker: open connection fd or -1 */
+} Server;
+
+/*
+ * Bind and listen on path, replacing a stale socket there. 0 on success,
+ * -1 on error, including when path exists and is not a socket.
+ */
+int server_open(Server *s, const char *path, int workers);
+
+/* Serve on s->workers threads (the caller is one of them) until stopped */
+int server_serve(Server *s);
+
+/* Make server_serve return, dropping open connections; safe from any thread */
+void server_stop(Server *s);
+
+/* Close the listening socket and remove its path */
+void server_close(Server *s);
+
+/* ---- Client ---- */
+
+typedef struct {
+    int status;
+    int result;
+    unsigned char *code;      /* malloc'd, NULL when len is 0 */
+    int code_len;
+} ServerReply;
+
+/* Connect to a server socket. Returns the fd, or -1 */
+int client_connect(const char *path);
+
+/* Send one request on fd and read the reply. 0 on success, -1 on I/O error */
+int client_request(int fd, int op, const char *source, ServerReply *reply);
+
+void client_reply_free(ServerReply *reply);
+
+/* Entry points for `ternary_compiler --server` / `--client`; argv excludes the mode flag */
+int server_main(int argc, char **argv);
+int client_main(int argc, char **argv);
+
+#endif /* SERVER_H */
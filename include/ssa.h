@@ -0,0 +1,242 @@
+/*
+ * ssa.h - SSA-form mid-level IR
+ *
+ * Sits between the AST and the postfix IR. One SsaFunc holds one
+ * function as a control flow graph of basic blocks over SSA values:
+ * every instruction that produces a value defines it exactly once, and
+ * values from different paths meet in phi nodes at block entry.
+ *
+ * Instructions live in one array and are named by their index (value
+ * id). Each block lists its instructions in order: phis first, then
+ * the body, then exactly one terminator (JMP, BR or EXIT). Constants are
+ * not placed in any block (block == -1); they are rematerialized at
+ * every use.
+ *
+ * Variables:
+ *   - Scalars whose address is never taken are promoted: reads and
+ *     writes become SSA values and phis, and their slots are free for
+ *     the lowering to use as registers.
+ *   - Arrays and address-taken scalars stay in memory at their slot and
+ *     are accessed with LOAD / STORE.
+ * Slots are handed out exactly as the bootstrap emitter does, so an SSA
+ * compile of a function uses the same slot range as a direct one.
+ *
+ * Pipeline: ssa_build (Braun et al. construction from the compact AST,
+ * trivial phis removed) -> passes (ssa_opt.c) -> ssa_lower
+ * (ssa_lower.c) to a PostfixSeq, then pf_lower() to bytecode.
+ */
+
+#ifndef SSA_H
+#define SSA_H
+
+#include "ir.h"
+#include "compact_ast.h"
+#include "postfix_ir.h"
+
+typedef enum {
+    SSA_CONST,      /* imm */
+    SSA_ADD,        /* a + b */
+    SSA_SUB,        /* a - b */
+    SSA_MUL,        /* a * b */
+    SSA_CMP_EQ,     /* a == b: 1 or 0 */
+    SSA_CMP_LT,     /* a < b: 1, 0 or -1 */
+    SSA_CMP_GT,     /* a > b: 1, 0 or -1 */
+    SSA_PHI,        /* args[i] flows in from preds[i] */
+    SSA_LOAD,       /* memory[a] */
+    SSA_STORE,      /* memory[a] = b (no value) */
+    SSA_OUT,        /* Leave a on the operand stack as the return value */
+    SSA_JMP,        /* -> succs[0] */
+    SSA_BR,         /* a != 0 -> succs[0], else -> succs[1] */
+    SSA_EXIT,       /* Leave the function */
+    SSA_NOP         /* Deleted instruction */
+} SsaOp;
+
+typedef struct {
+    SsaOp op;
+    int block;      /* Owning block, -1 for constants and deleted instructions */
+    int imm;        /* SSA_CONST value */
+    int a, b;       /* Operand value ids, -1 if unused */
+    int *args;      /* SSA_PHI operands, one per predecessor */
+    int nargs;
+    int var;        /* Promoted variable this value was assigned to, or -1 */
+} SsaInstr;
+
+typedef struct {
+    int *code;      /* Instruction ids in execution order */
+    int count;
+    int capacity;
+    int *preds;
+    int npreds;
+    int pred_capacity;
+    int succs[2];
+    int nsuccs;
+    int idom;       /* Immediate dominator (ssa_dominators), -1 for the entry */
+    int rpo;        /* Reverse postorder number, -1 if unreachable */
+} SsaBlock;
+
+typedef struct {
+    int name_id;    /* Intern ID */
+    int slot;       /* Home slot (first element for arrays) */
+    int size;       /* Slots taken: 1, or the array length */
+    int in_memory;  /* 1 for arrays and address-taken scalars */
+} SsaVar;
+
+typedef struct {
+    int name_id;            /* Function name */
+    SsaInstr *instrs;
+    int count;
+    int capacity;
+    SsaBlock *blocks;       /* blocks[0] is the entry */
+    int block_count;
+    int block_capacity;
+    SsaVar *vars;
+    int var_count;
+    int var_capacity;
+    int slot_base;          /* First slot of this function's locals */
+    int slot_end;           /* First slot after them */
+
+    /* Filled by ssa_dominators */
+    int *rpo;               /* Reachable blocks in reverse postorder */
+    int rpo_count;
+
+    /* Filled by ssa_build_uses: users of value v are
+     * uses[use_start[v] .. use_start[v + 1]) (instruction ids, one
+     * entry per operand slot) */
+    int *use_start;
+    int *uses;
+} SsaFunc;
+
+void ssa_init(SsaFunc *f);
+void ssa_free(SsaFunc *f);
+
+/*
+ * Build f from the NODE_FUNC_DEF at func. Parameters are read from the
+ * first slots, where the caller's arguments are stored (bootstrap.h);
+ * each return is an SSA_OUT followed by an EXIT, and falling off the
+ * end returns 0. Locals take slots from slot_base on; declarations past slot_limit are dropped exactly as the
+ * bootstrap symbol table drops them. Returns 0, or -1 if the function
+ * uses a construct the SSA path does not handle yet (calls, DIV/MOD,
+ * NEG, address-of a non-variable, arrays crossing slot_limit); f is
+ * then unusable and the caller should emit the function directly.
+ */
+int ssa_build(SsaFunc *f, const CompactAST *ca, NodeRef func, int slot_base, int slot_limit);
+
+/* ssa_build on a NODE_FUNC_DEF Expr tree */
+int ssa_build_expr(SsaFunc *f, const Expr *func, int slot_base, int slot_limit);
+
+/* Append an instruction (not placed in a block); returns its id */
+int ssa_new_instr(SsaFunc *f, SsaOp op, int a, int b);
+
+/* Append a constant; returns its id */
+int ssa_const(SsaFunc *f, int imm);
+
+/* Rebuild the def-use index (after any change to operands) */
+void ssa_build_uses(SsaFunc *f);
+
+/* Number of uses of v (ssa_build_uses must be current) */
+static inline int ssa_use_count(const SsaFunc *f, int v) {
+    return f->use_start[v + 1] - f->use_start[v];
+}
+
+/* Replace every operand equal to from with to */
+void ssa_replace_uses(SsaFunc *f, int from, int to);
+
+/* Compute reverse postorder and immediate dominators */
+void ssa_dominators(SsaFunc *f);
+
+/* 1 if block a dominates block b (ssa_dominators must be current) */
+int ssa_dominates(const SsaFunc *f, int a, int b);
+
+/* Insert instruction v at position at of block b */
+void ssa_insert(SsaFunc *f, int b, int at, int v);
+
+/*
+ * Put a new block holding just a JMP on the edge from block from to its
+ * successor k; returns the new block. Phi operands keep their
+ * predecessor index.
+ */
+int ssa_split_edge(SsaFunc *f, int from, int k);
+
+/*
+ * Split every edge from a block with two successors to a block with
+ * two or more predecessors, so phi copies always have a block of their
+ * own to go in. Returns the number of blocks added.
+ */
+int ssa_split_critical_edges(SsaFunc *f);
+
+/* Remove phis whose operands are all one value (or the phi itself),
+ * repeating until none are left */
+void ssa_remove_trivial_phis(SsaFunc *f);
+
+/*
+ * Delete blocks not reachable from the entry, with the phi operands
+ * they supplied, and renumber the rest in order. Returns the number of
+ * blocks removed.
+ */
+int ssa_remove_unreachable(SsaFunc *f);
+
+/*
+ * Fold each block ending in a JMP to a block with no other predecessor
+ * into its successor's code. Returns the number of blocks merged away.
+ */
+int ssa_merge_blocks(SsaFunc *f);
+
+/*
+ * Check structural invariants: one terminator per block, phis first
+ * with one argument per predecessor, consistent pred/succ lists, and
+ * every use dominated by its definition. Returns 0, or -1 after
+ * printing the first violation to stderr.
+ */
+int ssa_verify(SsaFunc *f);
+
+/* ---- Optimization passes (ssa_opt.c) ---- */
+
+/*
+ * Sparse conditional constant propagation (Wegman & Zadeck): values
+ * proven constant along the executable paths are replaced by constants,
+ * branches on constants become jumps, and the blocks they no longer
+ * reach are deleted. Arithmetic folds exactly as the VM computes it.
+ * Returns the number of values and branches folded.
+ */
+int ssa_sccp(SsaFunc *f);
+
+/*
+ * Dead code elimination: deletes stores to a constant address that are
+ * overwritten later in the same block with no load in between, then
+ * every value that no store, output or branch depends on. Returns the
+ * number of instructions deleted.
+ */
+int ssa_dce(SsaFunc *f);
+
+/*
+ * Loop-invariant code motion: arithmetic whose operands are defined
+ * outside a loop, and loads of fixed addresses in loops that store
+ * nothing, move to the loop's preheader. Returns the number moved.
+ */
+int ssa_licm(SsaFunc *f);
+
+/*
+ * Induction-variable strength reduction: for each loop variable i
+ * stepped by a constant c, every i * k in the loop (k invariant) is
+ * replaced by a new variable starting at init * k and stepped by c * k.
+ * Returns the number of multiplications replaced.
+ */
+int ssa_strength_reduce(SsaFunc *f);
+
+/* Run the passes enabled at level (1: SCCP, DCE, block merging, LICM;
+ * 2: also strength reduction); returns the number of changes made */
+int ssa_optimize(SsaFunc *f, int level);
+
+/* Print f to stdout */
+void ssa_dump(const SsaFunc *f);
+
+/*
+ * Lower f to seq: ENTER, blocks in reverse postorder, LEAVE. Values
+ * used once within their block are evaluated in place; all others are
+ * given memory slots, coalesced with their variable and phi partners
+ * where possible, drawn first from f's promoted variable slots and then
+ * from [temp_base, temp_limit). Returns 0, or -1 if the slots run out.
+ */
+int ssa_lower(SsaFunc *f, PostfixSeq *seq, int temp_base, int temp_limit);
+
+#endif /* SSA_H */
@@ -0,0 +1,69 @@
+/*
+ * symhash.h - Scoped open-addressing symbol table
+ *
+ * Shared by the bootstrap symbol table, the type checker and the linker.
+ * Keys are intern IDs (see intern.h), values are caller-defined ints
+ * (typically an index into the caller's own symbol array).
+ *
+ * Bindings live on a stack in insertion order. Inserting a key that is
+ * already bound shadows the outer binding; symhash_pop_scope() drops every
+ * binding made since the matching symhash_push_scope() and un-shadows the
+ * outer ones. Lookup is O(1) expected regardless of scope depth.
+ */
+
+#ifndef SYMHASH_H
+#define SYMHASH_H
+
+#include <stdint.h>
+
+typedef struct {
+    int key;        /* Intern ID */
+    int value;
+    int shadowed;   /* Entry index of the outer binding of key, or -1 */
+} SymHashEntry;
+
+typedef struct {
+    SymHashEntry *entries;  /* Binding stack */
+    int count;
+    int capacity;
+
+    int *slots;             /* Hash slot -> innermost entry index + 1, 0 = empty */
+    uint32_t slot_mask;
+    int key_count;          /* Distinct keys currently bound */
+
+    int *scopes;            /* Binding-stack height at each push */
+    int depth;
+    int scope_capacity;
+} SymHash;
+
+/* Initialize an empty table (no allocation until first insert) */
+void symhash_init(SymHash *h);
+
+/* Free all storage */
+void symhash_free(SymHash *h);
+
+/* Drop all bindings and scopes, keep storage */
+void symhash_clear(SymHash *h);
+
+/* Bind key -> value in the current scope. Returns the entry index. */
+int symhash_insert(SymHash *h, int key, int value);
+
+/* Innermost binding of key: entry index, or -1 if unbound */
+int symhash_find(const SymHash *h, int key);
+
+/* Value of the innermost binding of key, or def if unbound */
+static inline int symhash_get(const SymHash *h, int key, int def) {
+    int e = symhash_find(h, key);
+    return e < 0 ? def : h->entries[e].value;
+}
+
+/* 1 if key is bound in the innermost scope */
+int symhash_in_scope(const SymHash *h, int key);
+
+/* Open a nested scope */
+void symhash_push_scope(SymHash *h);
+
+/* Close the innermost scope, dropping its bindings */
+void symhash_pop_scope(SymHash *h);
+
+#endif /* SYMHASH_H */
@@ -233,6 +233,62 @@ static inline void trit_word_sub(const trit *a, const trit *b, trit *res) {
     trit_word_add(a, neg_b, res);
 }
 
+/* Sign of the trits w[lo..hi): its most significant nonzero trit */
+static inline trit trit_word_sign(const trit *w, int lo, int hi) {
+    int i;
+    for (i = hi - 1; i >= lo; i--) {
+        if (w[i] != TRIT_Z) return w[i];
+    }
+    return TRIT_Z;
+}
+
+/* Shift left k trits (multiply by 3^k); trits past WORD_SIZE are lost */
+static inline void trit_word_shl(const trit *a, int k, trit *res) {
+    int i;
+    for (i = WORD_SIZE - 1; i >= 0; i--) {
+        res[i] = (i >= k) ? a[i - k] : TRIT_Z;
+    }
+}
+
+/*
+ * Shift right k trits: divide by 3^k, truncated toward zero like C
+ * division. Dropping the low trits alone rounds to nearest (balanced
+ * ternary has no sign bit to extend), so when the dropped part's sign
+ * opposes the value's the quotient is moved one step toward zero.
+ */
+static inline void trit_word_shr(const trit *a, int k, trit *res) {
+    trit unit[WORD_SIZE];
+    trit q[WORD_SIZE];
+    int i;
+    if (k > WORD_SIZE) k = WORD_SIZE;
+    for (i = 0; i < WORD_SIZE; i++) {
+        q[i] = (i + k < WORD_SIZE) ? a[i + k] : TRIT_Z;
+        unit[i] = TRIT_Z;
+    }
+    trit sign = trit_word_sign(a, 0, WORD_SIZE);
+    trit low = trit_word_sign(a, 0, k);
+    if (low != TRIT_Z && low != sign) {
+        unit[0] = (trit)(-(int)sign);
+        trit_word_add(q, unit, res);
+    } else {
+        for (i = 0; i < WORD_SIZE; i++) res[i] = q[i];
+    }
+}
+
+/* k >= 1 if |v| == 3^k, else 0 */
+static inline int trit_pow3_log(int v) {
+    int k = 0;
+    if (v < 0) {
+        if (v < -1162261467) return 0;  /* Below -3^19, INT_MIN included */
+        v = -v;
+    }
+    while (v > 1 && v % 3 == 0) {
+        v /= 3;
+        k++;
+    }
+    return v == 1 ? k : 0;
+}
+
 /* Consensus (AND) on two trit words, trit-by-trit */
 static inline void trit_word_consensus(const trit *a, const trit *b, trit *res) {
     int i;
@@ -15,6 +15,8 @@
 #define TYPECHECKER_H
 
 #include "ir.h"
+#include "compact_ast.h"
+#include "symhash.h"
 
 /* Type kinds */
 typedef enum {
@@ -33,17 +35,18 @@ typedef struct {
 
 /* Type symbol entry */
 typedef struct {
-    char name[64];
+    int name_id;     /* Intern ID of the symbol name */
     TypeDesc type;
     int is_param;    /* 1 if the symbol is a function parameter */
 } TypeSymbol;
 
-#define TYPE_MAX_SYMBOLS 128
-
-/* Type environment (scope-aware) */
+/* Type environment (scope-aware): symbols grow on demand, index maps
+ * name_id -> symbols[] slot with function scopes pushed/popped */
 typedef struct {
-    TypeSymbol symbols[TYPE_MAX_SYMBOLS];
+    TypeSymbol *symbols;
     int count;
+    int capacity;
+    SymHash index;
 } TypeEnv;
 
 /* Type error entry */
@@ -64,15 +67,24 @@ typedef struct {
 /* Initialize a type checker */
 void typechecker_init(TypeChecker *tc);
 
+/* Release the type environment */
+void typechecker_free(TypeChecker *tc);
+
 /* Run type checking on an AST. Returns 0 if no errors, error count otherwise. */
 int typechecker_check(TypeChecker *tc, Expr *ast);
 
+/* Same, on an already-flattened compact AST */
+int typechecker_check_compact(TypeChecker *tc, const CompactAST *ca, NodeRef root);
+
 /* Add a type symbol to the environment */
 void typechecker_add_symbol(TypeChecker *tc, const char *name, TypeDesc type);
 
 /* Look up a type symbol. Returns NULL if not found. */
 const TypeSymbol *typechecker_lookup(const TypeChecker *tc, const char *name);
 
+/* Look up a type symbol by intern ID. Returns NULL if not found. */
+const TypeSymbol *typechecker_lookup_id(const TypeChecker *tc, int name_id);
+
 /* Infer the type of an expression. Returns TYPE_UNKNOWN on error. */
 TypeDesc typechecker_infer(TypeChecker *tc, Expr *e);
 
@@ -28,6 +28,7 @@
  * Phase 1 (MVP):     OP_PUSH..OP_SYSCALL (original 10 opcodes)
  * Phase 3 (Setun70): Structured control flow, two-stack ops,
  *                    ternary logic, function call convention
+ * Phase 6:           Trit shifts (multiply/divide by 3^k)
  */
 enum Opcode {
     /* === Phase 1: Core arithmetic & memory === */
@@ -82,6 +83,10 @@ enum Opcode {
     OP_PUSH_TRYTE,  /* 34: Push 6-trit tryte value (next byte = tryte index) */
     OP_PUSH_WORD,   /* 35: Push 9-trit word (next 2 bytes = packed value) */
 
+    /* === Phase 6: Trit shifts === */
+    OP_TSHL,        /* 36: Shift left k trits: a*3^k (next byte = k) */
+    OP_TSHR,        /* 37: Shift right k trits: a/3^k, truncated (next byte = k) */
+
     OP_COUNT        /* Sentinel: total opcode count */
 };
 
@@ -93,6 +98,10 @@ extern const char *opcode_names[];
 /* Run bytecode on the ternary VM (two-stack model) */
 void vm_run(unsigned char *bytecode, size_t len);
 
+/* vm_run, stopping after max_steps instructions. 0 if the program
+ * finished, -1 if the budget ran out first */
+int vm_run_limit(unsigned char *bytecode, size_t len, long max_steps);
+
 /* Memory access for tests */
 int vm_memory_read(int addr);
 void vm_memory_write(int addr, int value);
@@ -104,4 +113,7 @@ int vm_rstack_depth(void);
 /* Get last execution result (TOS at halt) */
 int vm_get_result(void);
 
+/* Number of instructions the last vm_run executed */
+long vm_get_steps(void);
+
 #endif
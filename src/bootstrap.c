@@ -12,129 +12,496 @@
 #include <string.h>
 #include "../include/bootstrap.h"
 #include "../include/ir.h"
+#include "../include/compact_ast.h"
+#include "../include/ssa.h"
+#include "../include/postfix_ir.h"
 #include "../include/parser.h"
 #include "../include/codegen.h"
 #include "../include/vm.h"
+#include "../include/ternary.h"
 #include "../include/logger.h"
 
 /*
  * AST-to-bytecode emitter for the bootstrap compiler.
- * Walks the AST and emits stack-machine bytecode.
+ * Walks the compact AST and emits stack-machine bytecode.
+ * All emitter state lives in the BootstrapCtx passed as bc.
  */
-static int bc_pos;
-static unsigned char *bc_out;
-static int bc_max;
-static BootstrapSymTab symtab;
+#define KIND(n)   ((NodeType)bc->ast.kind[n])
+#define OPOF(n)   ((OpType)bc->ast.op[n])
+#define KID(n, i) cast_kid(&bc->ast, (n), (i))
+#define NAME(n)   cast_name(&bc->ast, (n))
+#define NAME_ID(n) (bc->ast.name[n])
+
+static void emit_node(BootstrapCtx *bc, NodeRef n);
+static int emit_program(BootstrapCtx *bc, int stub);
+static int bootstrap_front(BootstrapCtx *bc, const char *source);
+
+static void b_emit(BootstrapCtx *bc, unsigned char byte) {
+    if (bc->obj != NULL) {
+        object_emit(bc->obj, byte);
+        bc->pos = bc->obj->code_len;
+    } else if (bc->pos < bc->max) {
+        bc->out[bc->pos++] = byte;
+    }
+}
+
+/* Overwrite an already emitted byte (branch targets) */
+static void b_patch(BootstrapCtx *bc, int at, int value) {
+    if (at >= bc->pos) return;
+    if (bc->obj != NULL) {
+        /* Module-relative target: the linker adds the module base */
+        bc->obj->code[at] = (unsigned char)value;
+        object_add_reloc_id(bc->obj, at, INTERN_NONE);
+    } else {
+        bc->out[at] = (unsigned char)value;
+    }
+}
 
-static void b_emit(unsigned char byte) {
-    if (bc_pos < bc_max) {
-        bc_out[bc_pos++] = byte;
+static int *b_grow(int *list, int count, int *capacity) {
+    if (count < *capacity) return list;
+    *capacity = *capacity ? *capacity * 2 : 16;
+    list = (int *)realloc(list, (size_t)*capacity * sizeof(int));
+    if (list == NULL) {
+        fprintf(stderr, "bootstrap: realloc failed\n");
+        exit(1);
     }
+    return list;
 }
 
-/* Emit bytecode for an expression */
-static void emit_expr(Expr *e) {
-    if (e == NULL) return;
+/* Nodes that leave a value on the operand stack */
+static int is_value_node(NodeType kind) {
+    return kind == NODE_CONST || kind == NODE_VAR || kind == NODE_BINOP ||
+           kind == NODE_FUNC_CALL || kind == NODE_DEREF || kind == NODE_ADDR_OF ||
+           kind == NODE_ARRAY_ACCESS;
+}
 
-    switch (e->type) {
+/* Emit n as a statement: a bare expression's value is dropped, so every
+ * statement leaves the stack as it found it */
+static void emit_stmt(BootstrapCtx *bc, NodeRef n) {
+    if (n == CAST_NONE) return;
+    emit_node(bc, n);
+    if (is_value_node(KIND(n))) b_emit(bc, OP_DROP);
+}
+
+/* Parameters are the NODE_VAR kids leading a function's statements */
+static int func_params(const BootstrapCtx *bc, NodeRef fn) {
+    int np = 0;
+    while (1 + np < bc->ast.nkids[fn] && KIND(KID(fn, 1 + np)) == NODE_VAR) np++;
+    return np;
+}
+
+/* Slots the declarations under n take from the symbol table */
+static int decl_slots(const BootstrapCtx *bc, NodeRef n) {
+    if (n == CAST_NONE) return 0;
+    int slots = 0;
+    switch (KIND(n)) {
+        case NODE_VAR_DECL:
+        case NODE_TRIT_VAR_DECL:
+            slots = 1;
+            break;
+        case NODE_ARRAY_DECL:
+        case NODE_TRIT_ARRAY_DECL:
+            slots = bc->ast.val[n] > 1 ? bc->ast.val[n] : 1;
+            break;
+        default:
+            break;
+    }
+    for (int i = 0; i < bc->ast.nkids[n]; i++) slots += decl_slots(bc, KID(n, i));
+    return slots;
+}
+
+/* Save slots [base, end) on the return stack, and restore them */
+static void emit_save(BootstrapCtx *bc, int base, int end) {
+    for (int s = base; s < end; s++) {
+        b_emit(bc, OP_PUSH);
+        b_emit(bc, (unsigned char)s);
+        b_emit(bc, OP_LOAD);
+        b_emit(bc, OP_TO_R);
+    }
+}
+
+static void emit_restore(BootstrapCtx *bc, int base, int end) {
+    for (int s = end - 1; s >= base; s--) {
+        b_emit(bc, OP_PUSH);
+        b_emit(bc, (unsigned char)s);
+        b_emit(bc, OP_FROM_R);
+        b_emit(bc, OP_STORE);
+    }
+}
+
+/* Pop the arguments (last on top) into the parameter slots */
+static void emit_param_stores(BootstrapCtx *bc, const int *slots, int np) {
+    for (int i = np - 1; i >= 0; i--) {
+        if (slots[i] < 0) {
+            b_emit(bc, OP_DROP);
+            continue;
+        }
+        b_emit(bc, OP_PUSH);
+        b_emit(bc, (unsigned char)slots[i]);
+        b_emit(bc, OP_SWAP);
+        b_emit(bc, OP_STORE);
+    }
+}
+
+/* Normalize comparison results to boolean 0/1 for BRZ:
+ * CMP_LT/CMP_GT return ternary {-1,0,1} but BRZ only branches on 0. */
+static void emit_cond_normalize(BootstrapCtx *bc, NodeRef cond) {
+    if (cond != CAST_NONE && KIND(cond) == NODE_BINOP &&
+        (OPOF(cond) == OP_IR_CMP_LT || OPOF(cond) == OP_IR_CMP_GT)) {
+        b_emit(bc, OP_PUSH);
+        b_emit(bc, 1);
+        b_emit(bc, OP_CMP_EQ);
+    }
+}
+
+/* int arr[N] / trit arr[N]: allocate N contiguous slots, store initializers */
+static void emit_array_decl(BootstrapCtx *bc, NodeRef n) {
+    const char *name = NAME(n);
+    int size = bc->ast.val[n];
+    int base = symtab_add_id(&bc->symtab, NAME_ID(n), 0);
+    if (base < 0) return;
+
+    /* Reserve array_size - 1 additional slots */
+    for (int i = 1; i < size; i++) {
+        char slotname[72];
+        snprintf(slotname, sizeof(slotname), "%s[%d]", name, i);
+        symtab_add(&bc->symtab, slotname, 0);
+    }
+    /* Emit initializers if present */
+    for (int i = 0; i < bc->ast.nkids[n] && i < size; i++) {
+        b_emit(bc, OP_PUSH);
+        b_emit(bc, (unsigned char)(base + i));
+        emit_node(bc, KID(n, i));
+        b_emit(bc, OP_STORE);
+    }
+}
+
+/*
+ * -O1: build function n into SSA form, optimize it, lower it to postfix
+ * IR, run the peephole rules and stack scheduling over that, lower it
+ * to bytecode and append that. Its locals take the same slots as with
+ * direct emission; the lowering keeps values in the slots of promoted
+ * locals and in temporaries above MAX_SYMBOLS. None of them is read
+ * after the function returns (its caller restores the saved ones).
+ * Returns 0, or -1 with nothing emitted if the function needs the
+ * direct emitter.
+ */
+static int emit_func_ssa(BootstrapCtx *bc, NodeRef n) {
+    SsaFunc f;
+    PostfixSeq seq;
+    ObjectModule code;
+    int first = bc->symtab.next_offset;
+    int rc = ssa_build(&f, &bc->ast, n, first, MAX_SYMBOLS);
+    pf_init(&seq);
+    object_init(&code);
+    if (rc == 0) ssa_optimize(&f, bc->opt_level);
+    if (rc == 0) rc = ssa_lower(&f, &seq, MAX_SYMBOLS, 2 * MAX_SYMBOLS);
+    if (rc == 0) pf_optimize(&seq);
+    if (rc == 0) pf_schedule_stack(&seq, 1);
+    if (rc == 0) rc = pf_lower(&seq, &code) < 0 ? -1 : 0;
+    if (rc == 0) {
+        /* Temporaries need no saving: SSA functions make no calls */
+        emit_save(bc, first, f.slot_end);
+        /* Parameters are the first variables declared */
+        int np = func_params(bc, n);
+        int slots[MAX_SYMBOLS];
+        for (int i = 0; i < np && i < MAX_SYMBOLS; i++) {
+            slots[i] = i < f.var_count ? f.vars[i].slot : -1;
+        }
+        emit_param_stores(bc, slots, np < MAX_SYMBOLS ? np : MAX_SYMBOLS);
+
+        /* Branch targets are relative to the function: rebase them */
+        int at0 = bc->pos;
+        for (int i = 0; i < code.code_len; i++) b_emit(bc, code.code[i]);
+        for (int r = 0; r < code.reloc_count; r++) {
+            int at = code.relocs[r].offset;
+            b_patch(bc, at0 + at, at0 + code.code[at]);
+        }
+        emit_restore(bc, first, f.slot_end);
+        b_emit(bc, OP_RET);
+        bc->symtab.count = f.slot_end;
+        bc->symtab.next_offset = f.slot_end;
+    }
+    object_free(&code);
+    pf_free(&seq);
+    ssa_free(&f);
+    return rc;
+}
+
+/* OP_CALL or OP_JMP to function name_id; the address is filled in by
+ * emit_program() (buffer mode) or the linker (object mode) */
+static void emit_to_func(BootstrapCtx *bc, unsigned char op, int name_id) {
+    if (symhash_find(&bc->funcs, name_id) < 0) {
+        symhash_insert(&bc->funcs, name_id, 0);  /* called */
+    }
+    b_emit(bc, op);
+    int at = bc->pos;
+    b_emit(bc, 0);
+    if (bc->obj != NULL) {
+        object_add_reloc_id(bc->obj, at, name_id);
+    } else if (at < bc->pos) {
+        bc->calls = b_grow(bc->calls, bc->call_count + 1, &bc->call_capacity);
+        bc->calls[bc->call_count++] = at;
+        bc->calls = b_grow(bc->calls, bc->call_count + 1, &bc->call_capacity);
+        bc->calls[bc->call_count++] = name_id;
+    }
+}
+
+/* Arguments left to right, then CALL */
+static void emit_call(BootstrapCtx *bc, NodeRef n) {
+    for (int i = 0; i < bc->ast.nkids[n]; i++) {
+        emit_node(bc, KID(n, i));
+    }
+    emit_to_func(bc, OP_CALL, NAME_ID(n));
+}
+
+/* The call a return statement hands its result straight back from, or
+ * CAST_NONE. Every return leaves the function, so each such call is in
+ * tail position. */
+static NodeRef tail_call(const BootstrapCtx *bc, NodeRef ret) {
+    NodeRef v = KID(ret, 0);
+    return v != CAST_NONE && KIND(v) == NODE_FUNC_CALL ? v : CAST_NONE;
+}
+
+/*
+ * return f(args) without growing the return stack: the arguments are
+ * pushed and the frame is dropped (LEAVE). A self call then jumps back
+ * to ENTER, reusing the slots saved at entry. Any other callee is
+ * reached by JMP after restoring our slots, and returns straight to our
+ * caller.
+ */
+static void emit_tail_call(BootstrapCtx *bc, NodeRef call) {
+    for (int i = 0; i < bc->ast.nkids[call]; i++) {
+        emit_node(bc, KID(call, i));
+    }
+    b_emit(bc, OP_LEAVE);
+    if (NAME_ID(call) == bc->frame_func) {
+        b_emit(bc, OP_JMP);
+        int at = bc->pos;
+        b_emit(bc, 0);
+        b_patch(bc, at, bc->frame_at);
+        return;
+    }
+    emit_restore(bc, bc->save_base, bc->save_end);
+    emit_to_func(bc, OP_JMP, NAME_ID(call));
+}
+
+/* A function, following the call convention in bootstrap.h */
+static void emit_func(BootstrapCtx *bc, NodeRef n) {
+    int entry = bc->pos;
+    int e = symhash_find(&bc->funcs, NAME_ID(n));
+    if (e >= 0) bc->funcs.entries[e].value = entry + 1;
+    else symhash_insert(&bc->funcs, NAME_ID(n), entry + 1);
+    if (bc->obj != NULL) {
+        /* Function entry is an exported symbol of the module */
+        object_add_symbol_id(bc->obj, NAME_ID(n), entry, SYM_EXPORT);
+    }
+    bc->last_func = entry;
+    if (bc->opt_level > 0 && emit_func_ssa(bc, n) == 0) return;
+
+    int np = func_params(bc, n);
+    int base = bc->symtab.next_offset;
+    int end = base + np + decl_slots(bc, n);
+    if (end > MAX_SYMBOLS) end = MAX_SYMBOLS;
+    emit_save(bc, base, end);
+    bc->frame_func = NAME_ID(n);
+    bc->frame_at = bc->pos;
+    bc->save_base = base;
+    bc->save_end = end;
+
+    /* Locals go out of scope for lookup; their slots stay reserved */
+    symhash_push_scope(&bc->symtab.index);
+    b_emit(bc, OP_ENTER);
+    int slots[MAX_SYMBOLS];
+    if (np > MAX_SYMBOLS) np = MAX_SYMBOLS;
+    for (int i = 0; i < np; i++) {
+        slots[i] = symtab_add_id(&bc->symtab, NAME_ID(KID(n, 1 + i)), 0);
+    }
+    emit_param_stores(bc, slots, np);
+
+    bc->return_count = 0;
+    for (int i = 1 + np; i < bc->ast.nkids[n]; i++) {
+        emit_stmt(bc, KID(n, i));
+    }
+    /* A final return falls through to the epilogue */
+    NodeRef body = KID(n, 0);
+    if (body != CAST_NONE && KIND(body) == NODE_RETURN) {
+        if (tail_call(bc, body) != CAST_NONE) {
+            emit_tail_call(bc, tail_call(bc, body));
+        } else if (KID(body, 0) != CAST_NONE) {
+            emit_node(bc, KID(body, 0));
+        } else {
+            b_emit(bc, OP_PUSH);
+            b_emit(bc, 0);
+        }
+    } else {
+        emit_stmt(bc, body);
+        b_emit(bc, OP_PUSH);
+        b_emit(bc, 0);
+    }
+    for (int i = 0; i < bc->return_count; i++) {
+        b_patch(bc, bc->returns[i], bc->pos);
+    }
+    bc->return_count = 0;
+    b_emit(bc, OP_LEAVE);
+    emit_restore(bc, base, end);
+    b_emit(bc, OP_RET);
+    symhash_pop_scope(&bc->symtab.index);
+    bc->frame_func = INTERN_NONE;
+}
+
+/* Push value: one PUSH when it fits the signed operand byte, else
+ * built from smaller ones as pf_lower() does */
+static void emit_const(BootstrapCtx *bc, int value) {
+    if (value >= -128 && value <= 127) {
+        b_emit(bc, OP_PUSH);
+        b_emit(bc, (unsigned char)(value & 0xFF));
+        return;
+    }
+    emit_const(bc, value / 64);
+    b_emit(bc, OP_PUSH);
+    b_emit(bc, 64);
+    b_emit(bc, OP_MUL);
+    if (value % 64 != 0) {
+        emit_const(bc, value % 64);
+        b_emit(bc, OP_ADD);
+    }
+}
+
+/* k >= 1 if n is the constant +-3^k, else 0 */
+static int pow3_const(BootstrapCtx *bc, NodeRef n) {
+    if (n == CAST_NONE || KIND(n) != NODE_CONST) return 0;
+    return trit_pow3_log(bc->ast.val[n]);
+}
+
+/* Emit bytecode for a node */
+static void emit_node(BootstrapCtx *bc, NodeRef n) {
+    if (n == CAST_NONE) return;
+
+    switch (KIND(n)) {
         case NODE_CONST:
-            b_emit(OP_PUSH);
-            b_emit((unsigned char)(e->val & 0xFF));
+            emit_const(bc, bc->ast.val[n]);
             break;
 
         case NODE_VAR: {
             /* Load variable from memory using its stack offset as address */
-            int off = symtab_lookup(&symtab, e->name);
+            int off = symtab_lookup_id(&bc->symtab, NAME_ID(n));
             if (off >= 0) {
-                b_emit(OP_PUSH);
-                b_emit((unsigned char)off);
-                b_emit(OP_LOAD);
+                b_emit(bc, OP_PUSH);
+                b_emit(bc, (unsigned char)off);
+                b_emit(bc, OP_LOAD);
             } else {
                 /* Unknown variable — emit 0 */
-                b_emit(OP_PUSH);
-                b_emit(0);
+                b_emit(bc, OP_PUSH);
+                b_emit(bc, 0);
             }
             break;
         }
 
-        case NODE_BINOP:
-            emit_expr(e->left);
-            emit_expr(e->right);
-            switch (e->op) {
-                case OP_IR_ADD:    b_emit(OP_ADD); break;
-                case OP_IR_MUL:   b_emit(OP_MUL); break;
-                case OP_IR_SUB:   b_emit(OP_SUB); break;
-                case OP_IR_CMP_EQ: b_emit(OP_CMP_EQ); break;
-                case OP_IR_CMP_LT: b_emit(OP_CMP_LT); break;
-                case OP_IR_CMP_GT: b_emit(OP_CMP_GT); break;
-                case OP_IR_NEG:   b_emit(OP_NEG); break;
+        case NODE_BINOP: {
+            /* Multiplying or dividing by +-3^k shifts k trits (then
+             * negates): x * 3^k -> TSHL k, x / 3^k -> TSHR k */
+            NodeRef lhs = KID(n, 0), rhs = KID(n, 1);
+            if (OPOF(n) == OP_IR_MUL && pow3_const(bc, lhs) > 0) {
+                lhs = KID(n, 1);
+                rhs = KID(n, 0);
+            }
+            int k = OPOF(n) == OP_IR_MUL || OPOF(n) == OP_IR_DIV ? pow3_const(bc, rhs) : 0;
+            if (k > 0) {
+                emit_node(bc, lhs);
+                b_emit(bc, OPOF(n) == OP_IR_MUL ? OP_TSHL : OP_TSHR);
+                b_emit(bc, (unsigned char)k);
+                if (bc->ast.val[rhs] < 0) b_emit(bc, OP_NEG);
+                break;
+            }
+            emit_node(bc, lhs);
+            emit_node(bc, rhs);
+            switch (OPOF(n)) {
+                case OP_IR_ADD:    b_emit(bc, OP_ADD); break;
+                case OP_IR_MUL:    b_emit(bc, OP_MUL); break;
+                case OP_IR_SUB:    b_emit(bc, OP_SUB); break;
+                case OP_IR_CMP_EQ: b_emit(bc, OP_CMP_EQ); break;
+                case OP_IR_CMP_LT: b_emit(bc, OP_CMP_LT); break;
+                case OP_IR_CMP_GT: b_emit(bc, OP_CMP_GT); break;
+                case OP_IR_NEG:    b_emit(bc, OP_NEG); break;
+                default: break; /* DIV/MOD: no VM opcode yet */
             }
             break;
+        }
 
         case NODE_RETURN:
-            emit_expr(e->left);
+            if (tail_call(bc, n) != CAST_NONE && bc->frame_func != INTERN_NONE) {
+                emit_tail_call(bc, tail_call(bc, n));
+                break;
+            }
+            if (KID(n, 0) != CAST_NONE) {
+                emit_node(bc, KID(n, 0));
+            } else {
+                b_emit(bc, OP_PUSH);
+                b_emit(bc, 0);
+            }
+            b_emit(bc, OP_JMP);
+            bc->returns = b_grow(bc->returns, bc->return_count, &bc->return_capacity);
+            bc->returns[bc->return_count++] = bc->pos;
+            b_emit(bc, 0);  /* placeholder for the epilogue */
             break;
 
-        case NODE_VAR_DECL: {
+        case NODE_VAR_DECL:
+        case NODE_TRIT_VAR_DECL: {
             /* int x = expr; -> compute expr, store at x's offset */
-            int off = symtab_add(&symtab, e->name, 0);
-            if (off >= 0 && e->left) {
-                b_emit(OP_PUSH);
-                b_emit((unsigned char)off);
-                emit_expr(e->left);
-                b_emit(OP_STORE);
+            int off = symtab_add_id(&bc->symtab, NAME_ID(n), 0);
+            if (off >= 0 && KID(n, 0) != CAST_NONE) {
+                b_emit(bc, OP_PUSH);
+                b_emit(bc, (unsigned char)off);
+                emit_node(bc, KID(n, 0));
+                b_emit(bc, OP_STORE);
             }
             break;
         }
 
         case NODE_ASSIGN: {
             /* x = expr; -> compute expr, store at x's offset */
-            if (e->left && e->left->type == NODE_VAR) {
-                int off = symtab_lookup(&symtab, e->left->name);
+            NodeRef lhs = KID(n, 0);
+            if (lhs != CAST_NONE && KIND(lhs) == NODE_VAR) {
+                int off = symtab_lookup_id(&bc->symtab, NAME_ID(lhs));
                 if (off >= 0) {
-                    b_emit(OP_PUSH);
-                    b_emit((unsigned char)off);
-                    emit_expr(e->right);
-                    b_emit(OP_STORE);
+                    b_emit(bc, OP_PUSH);
+                    b_emit(bc, (unsigned char)off);
+                    emit_node(bc, KID(n, 1));
+                    b_emit(bc, OP_STORE);
                 }
             }
             break;
         }
 
         case NODE_DEREF:
-            emit_expr(e->left);
-            b_emit(OP_LOAD);
+            emit_node(bc, KID(n, 0));
+            b_emit(bc, OP_LOAD);
             break;
 
-        case NODE_ADDR_OF:
+        case NODE_ADDR_OF: {
             /* Push the address (stack offset) of the variable */
-            if (e->left && e->left->type == NODE_VAR) {
-                int off = symtab_lookup(&symtab, e->left->name);
-                b_emit(OP_PUSH);
-                b_emit((unsigned char)(off >= 0 ? off : 0));
+            NodeRef var = KID(n, 0);
+            if (var != CAST_NONE && KIND(var) == NODE_VAR) {
+                int off = symtab_lookup_id(&bc->symtab, NAME_ID(var));
+                b_emit(bc, OP_PUSH);
+                b_emit(bc, (unsigned char)(off >= 0 ? off : 0));
             }
             break;
+        }
 
         case NODE_FUNC_CALL:
-            /* Emit args, then a placeholder (stub for Phase 3 call convention) */
-            for (int i = 0; i < e->param_count; i++) {
-                emit_expr(e->params[i]);
-            }
+            emit_call(bc, n);
             break;
 
         case NODE_FUNC_DEF:
-            /* Emit ENTER for scope, body statements, then LEAVE */
-            b_emit(OP_ENTER);
-            for (int i = 0; i < e->param_count; i++) {
-                emit_expr(e->params[i]);
-            }
-            emit_expr(e->body);
-            b_emit(OP_LEAVE);
+            emit_func(bc, n);
             break;
 
         case NODE_PROGRAM:
-            for (int i = 0; i < e->param_count; i++) {
-                emit_expr(e->params[i]);
+        case NODE_BLOCK:
+            for (int i = 0; i < bc->ast.nkids[n]; i++) {
+                emit_stmt(bc, KID(n, i));
             }
             break;
 
@@ -146,44 +513,31 @@ static void emit_expr(Expr *e) {
              *
              * Emit: cond, [normalize], BRZ else_label, body,
              *       [JMP end_label, else_label: else_body], end_label:
-             *
-             * Normalization: CMP_LT/CMP_GT return ternary {-1,0,1}
-             * but BRZ only branches on 0. We normalize comparison
-             * results: emit PUSH 1, CMP_EQ after comparisons so that
-             * "true" (1) becomes 1 and "false" (-1 or 0) becomes 0.
              */
-            emit_expr(e->condition);
-
-            /* Normalize comparison results to boolean 0/1 for BRZ */
-            if (e->condition && e->condition->type == NODE_BINOP &&
-                (e->condition->op == OP_IR_CMP_LT ||
-                 e->condition->op == OP_IR_CMP_GT)) {
-                b_emit(OP_PUSH);
-                b_emit(1);
-                b_emit(OP_CMP_EQ);
-            }
+            emit_node(bc, KID(n, 0));
+            emit_cond_normalize(bc, KID(n, 0));
 
-            b_emit(OP_BRZ);
-            int patch_else = bc_pos;
-            b_emit(0);  /* placeholder for else/end target */
+            b_emit(bc, OP_BRZ);
+            int patch_else = bc->pos;
+            b_emit(bc, 0);  /* placeholder for else/end target */
 
-            emit_expr(e->body);
+            emit_stmt(bc, KID(n, 1));
 
-            if (e->else_body) {
-                b_emit(OP_JMP);
-                int patch_end = bc_pos;
-                b_emit(0);  /* placeholder for end target */
+            if (KID(n, 2) != CAST_NONE) {
+                b_emit(bc, OP_JMP);
+                int patch_end = bc->pos;
+                b_emit(bc, 0);  /* placeholder for end target */
 
                 /* Patch BRZ to jump here (else start) */
-                bc_out[patch_else] = (unsigned char)bc_pos;
+                b_patch(bc, patch_else, bc->pos);
 
-                emit_expr(e->else_body);
+                emit_stmt(bc, KID(n, 2));
 
                 /* Patch JMP to jump here (end) */
-                bc_out[patch_end] = (unsigned char)bc_pos;
+                b_patch(bc, patch_end, bc->pos);
             } else {
                 /* No else: BRZ jumps past body */
-                bc_out[patch_else] = (unsigned char)bc_pos;
+                b_patch(bc, patch_else, bc->pos);
             }
             break;
         }
@@ -194,34 +548,24 @@ static void emit_expr(Expr *e) {
              *
              * Emit: LOOP_BEGIN, cond, BRZ end, body, PUSH 1, LOOP_END, end:
              */
-            int loop_start = bc_pos;
-            b_emit(OP_LOOP_BEGIN);
-
-            emit_expr(e->condition);
-
-            /* Normalize comparison results for BRZ */
-            if (e->condition && e->condition->type == NODE_BINOP &&
-                (e->condition->op == OP_IR_CMP_LT ||
-                 e->condition->op == OP_IR_CMP_GT)) {
-                b_emit(OP_PUSH);
-                b_emit(1);
-                b_emit(OP_CMP_EQ);
-            }
+            b_emit(bc, OP_LOOP_BEGIN);
+
+            emit_node(bc, KID(n, 0));
+            emit_cond_normalize(bc, KID(n, 0));
 
-            b_emit(OP_BRZ);
-            int patch_end = bc_pos;
-            b_emit(0);  /* placeholder for end target */
+            b_emit(bc, OP_BRZ);
+            int patch_end = bc->pos;
+            b_emit(bc, 0);  /* placeholder for end target */
 
-            emit_expr(e->body);
+            emit_stmt(bc, KID(n, 1));
 
             /* Continue loop */
-            b_emit(OP_PUSH);
-            b_emit(1);
-            b_emit(OP_LOOP_END);
+            b_emit(bc, OP_PUSH);
+            b_emit(bc, 1);
+            b_emit(bc, OP_LOOP_END);
 
             /* Patch BRZ to jump past LOOP_END */
-            bc_out[patch_end] = (unsigned char)bc_pos;
-            (void)loop_start;
+            b_patch(bc, patch_end, bc->pos);
             break;
         }
 
@@ -231,161 +575,322 @@ static void emit_expr(Expr *e) {
              *
              * Emit: init, LOOP_BEGIN, cond, BRZ end, body, inc, PUSH 1, LOOP_END, end:
              */
-            emit_expr(e->left);  /* init */
+            emit_stmt(bc, KID(n, 0));  /* init */
 
-            b_emit(OP_LOOP_BEGIN);
+            b_emit(bc, OP_LOOP_BEGIN);
 
-            emit_expr(e->condition);
+            emit_node(bc, KID(n, 1));
+            emit_cond_normalize(bc, KID(n, 1));
 
-            /* Normalize comparison results for BRZ */
-            if (e->condition && e->condition->type == NODE_BINOP &&
-                (e->condition->op == OP_IR_CMP_LT ||
-                 e->condition->op == OP_IR_CMP_GT)) {
-                b_emit(OP_PUSH);
-                b_emit(1);
-                b_emit(OP_CMP_EQ);
-            }
-
-            b_emit(OP_BRZ);
-            int patch_end = bc_pos;
-            b_emit(0);
+            b_emit(bc, OP_BRZ);
+            int patch_end = bc->pos;
+            b_emit(bc, 0);
 
-            emit_expr(e->body);
-            emit_expr(e->increment);
+            emit_stmt(bc, KID(n, 3));  /* body */
+            emit_stmt(bc, KID(n, 2));  /* inc */
 
             /* Continue loop */
-            b_emit(OP_PUSH);
-            b_emit(1);
-            b_emit(OP_LOOP_END);
+            b_emit(bc, OP_PUSH);
+            b_emit(bc, 1);
+            b_emit(bc, OP_LOOP_END);
 
             /* Patch BRZ to end */
-            bc_out[patch_end] = (unsigned char)bc_pos;
+            b_patch(bc, patch_end, bc->pos);
             break;
         }
 
-        case NODE_BLOCK:
-            /* Emit all statements in the block */
-            for (int i = 0; i < e->param_count; i++) {
-                emit_expr(e->params[i]);
-            }
-            break;
-
         /* === Phase 3: Array support === */
 
-        case NODE_ARRAY_DECL: {
-            /* int arr[N]; allocate N contiguous memory slots */
-            int base = symtab_add(&symtab, e->name, 0);
-            if (base >= 0) {
-                /* Reserve array_size - 1 additional slots */
-                for (int i = 1; i < e->array_size; i++) {
-                    char slotname[72];
-                    snprintf(slotname, sizeof(slotname), "%s[%d]", e->name, i);
-                    symtab_add(&symtab, slotname, 0);
-                }
-                /* Emit initializers if present */
-                for (int i = 0; i < e->param_count && i < e->array_size; i++) {
-                    b_emit(OP_PUSH);
-                    b_emit((unsigned char)(base + i));
-                    emit_expr(e->params[i]);
-                    b_emit(OP_STORE);
-                }
-            }
+        case NODE_ARRAY_DECL:
+        case NODE_TRIT_ARRAY_DECL:
+            emit_array_decl(bc, n);
             break;
-        }
 
         case NODE_ARRAY_ACCESS: {
             /* arr[index] -> load from base + index */
-            int base = symtab_lookup(&symtab, e->name);
+            int base = symtab_lookup_id(&bc->symtab, NAME_ID(n));
             if (base >= 0) {
                 /* Push base, push index, add, load */
-                b_emit(OP_PUSH);
-                b_emit((unsigned char)base);
-                emit_expr(e->left);  /* index */
-                b_emit(OP_ADD);
-                b_emit(OP_LOAD);
+                b_emit(bc, OP_PUSH);
+                b_emit(bc, (unsigned char)base);
+                emit_node(bc, KID(n, 0));  /* index */
+                b_emit(bc, OP_ADD);
+                b_emit(bc, OP_LOAD);
             } else {
-                b_emit(OP_PUSH);
-                b_emit(0);
+                b_emit(bc, OP_PUSH);
+                b_emit(bc, 0);
             }
             break;
         }
 
         case NODE_ARRAY_ASSIGN: {
             /* arr[index] = expr -> store at base + index */
-            int base = symtab_lookup(&symtab, e->name);
+            int base = symtab_lookup_id(&bc->symtab, NAME_ID(n));
             if (base >= 0) {
                 /* Push base, push index, add => address on stack */
-                b_emit(OP_PUSH);
-                b_emit((unsigned char)base);
-                emit_expr(e->left);  /* index */
-                b_emit(OP_ADD);
-                emit_expr(e->right); /* value */
-                b_emit(OP_STORE);
+                b_emit(bc, OP_PUSH);
+                b_emit(bc, (unsigned char)base);
+                emit_node(bc, KID(n, 0));  /* index */
+                b_emit(bc, OP_ADD);
+                emit_node(bc, KID(n, 1));  /* value */
+                b_emit(bc, OP_STORE);
             }
             break;
         }
+    }
+}
 
-        case NODE_TRIT_VAR_DECL: {
-            /* trit x = expr; -> compute expr, store at x's offset */
-            int off = symtab_add(&symtab, e->name, 0);
-            if (off >= 0 && e->left) {
-                b_emit(OP_PUSH);
-                b_emit((unsigned char)off);
-                emit_expr(e->left);
-                b_emit(OP_STORE);
-            }
-            break;
-        }
+static CompileCache *default_cache;
+static int default_opt_level;
 
-        case NODE_TRIT_ARRAY_DECL: {
-            /* trit arr[N]; allocate N contiguous memory slots */
-            int base = symtab_add(&symtab, e->name, 0);
-            if (base >= 0) {
-                /* Reserve array_size - 1 additional slots */
-                for (int i = 1; i < e->array_size; i++) {
-                    char slotname[72];
-                    snprintf(slotname, sizeof(slotname), "%s[%d]", e->name, i);
-                    symtab_add(&symtab, slotname, 0);
-                }
-                /* Emit initializers if present */
-                for (int i = 0; i < e->param_count && i < e->array_size; i++) {
-                    b_emit(OP_PUSH);
-                    b_emit((unsigned char)(base + i));
-                    emit_expr(e->params[i]);
-                    b_emit(OP_STORE);
-                }
-            }
-            break;
-        }
-    }
+void bootstrap_set_cache(CompileCache *cache) {
+    default_cache = cache;
 }
 
-int bootstrap_compile(const char *source, unsigned char *out_bytecode, int max_len) {
-    LOG_INFO_MSG("Bootstrap", "TASK-018", "bootstrap_compile entered");
+void bootstrap_set_opt_level(int level) {
+    default_opt_level = level;
+}
+
+/* Optimized output is cached under its own keys */
+static CacheKind cache_kind(const BootstrapCtx *bc, CacheKind kind) {
+    return (CacheKind)(kind | bc->opt_level << CACHE_KIND_OPT_SHIFT);
+}
+
+void bootstrap_ctx_init(BootstrapCtx *bc) {
+    ir_arena_init(&bc->arena, 0);
+    cast_init(&bc->ast);
+    symtab_init(&bc->symtab);
+    symhash_init(&bc->funcs);
+    bc->out = NULL;
+    bc->obj = NULL;
+    bc->cache = default_cache;
+    bc->opt_level = default_opt_level;
+    bc->pos = 0;
+    bc->max = 0;
+    bc->calls = NULL;
+    bc->call_count = 0;
+    bc->call_capacity = 0;
+    bc->returns = NULL;
+    bc->return_count = 0;
+    bc->return_capacity = 0;
+    bc->last_func = -1;
+    bc->frame_func = INTERN_NONE;
+    bc->failed = 0;
+}
+
+void bootstrap_ctx_free(BootstrapCtx *bc) {
+    ir_arena_release(&bc->arena);
+    cast_free(&bc->ast);
+    symtab_free(&bc->symtab);
+    symhash_free(&bc->funcs);
+    free(bc->calls);
+    free(bc->returns);
+}
+
+/* Bytecode an AST node emits at most, near enough, for inline_headroom() */
+#define INLINE_BYTES_PER_NODE 4
+
+/*
+ * AST nodes inlining may add to source before its image could outgrow
+ * 1-byte jump targets: the room the -O0 image leaves below 256 bytes,
+ * at INLINE_BYTES_PER_NODE each. -1 (no limit) if it is already past.
+ */
+static int inline_headroom(BootstrapCtx *bc, const char *source) {
+    unsigned char scratch[256];
+    int level = bc->opt_level;
+    bc->opt_level = 0;
+    int ok = bootstrap_front(bc, source);
+    bc->opt_level = level;
+    if (ok < 0) return -1;
+
+    bc->out = scratch;
+    bc->obj = NULL;
+    bc->max = (int)sizeof(scratch);
+    emit_program(bc, 1);
+    bc->out = NULL;
+    if (bc->pos > 255) return -1;
+    return (255 - bc->pos) / INLINE_BYTES_PER_NODE;
+}
+
+/* Parse, flatten and fold source into bc->ast. Returns 0 or -1. */
+static int bootstrap_front(BootstrapCtx *bc, const char *source) {
+    int headroom = bc->opt_level > 0 ? inline_headroom(bc, source) : -1;
+
+    /* The whole AST lives in the context's arena and is dropped in one call */
+    IRArena *prev_arena = ir_arena_activate(&bc->arena);
 
     /* Parse */
-    Expr *ast = parse_program(source);
+    Parser ps;
+    parser_init(&ps, source);
+    Expr *ast = parser_parse_program(&ps);
     if (ast == NULL) {
         LOG_ERROR_MSG("Bootstrap", "TASK-018", "parse failed");
+        ir_arena_activate(prev_arena);
+        ir_arena_reset(&bc->arena);
         return -1;
     }
 
+    /* -O1 and up: inline small callees while the tree is still an Expr
+     * tree, leaving room in the symbol table for the copies' locals and
+     * in the image for their bytecode */
+    if (bc->opt_level > 0) {
+        InlineOptions io;
+        inline_options_default(&io);
+        io.slot_budget = MAX_SYMBOLS;
+        io.size_budget = headroom;
+        int n = inline_calls(ast, &io);
+        if (n > 0) LOG_DEBUG_MSG("Bootstrap", "TASK-050", "calls inlined");
+        /* Then share what inlining and the source compute twice */
+        if (cse_exprs(ast, MAX_SYMBOLS, NULL) > 0)
+            LOG_DEBUG_MSG("Bootstrap", "TASK-058", "common subexpressions eliminated");
+    }
+
+    /* Flatten to the compact layout; the Expr tree is no longer needed */
+    cast_clear(&bc->ast);
+    cast_from_expr(&bc->ast, ast);
+    ir_arena_activate(prev_arena);
+    ir_arena_reset(&bc->arena);
+
     /* Optimize */
-    optimize(ast);
+    cast_optimize(&bc->ast);
+
+    symtab_clear(&bc->symtab);
+    symhash_clear(&bc->funcs);
+    bc->pos = 0;
+    bc->call_count = 0;
+    bc->return_count = 0;
+    bc->last_func = -1;
+    bc->frame_func = INTERN_NONE;
+    bc->failed = 0;
+    return 0;
+}
 
-    /* Emit bytecode */
-    bc_out = out_bytecode;
-    bc_max = max_len;
-    bc_pos = 0;
-    symtab_init(&symtab);
+/*
+ * Emit bc->ast, preceded by the entry stub if stub is set. Calls are
+ * then resolved (buffer mode) and the stub pointed at main, or at the
+ * last function if there is no main. Returns 0, or -1 if a call names a
+ * function the source does not define (buffer mode).
+ */
+static int emit_program(BootstrapCtx *bc, int stub) {
+    int entry_at = -1;
+    if (stub && bc->ast.root != CAST_NONE && bc->ast.nkids[bc->ast.root] > 0) {
+        b_emit(bc, OP_CALL);
+        entry_at = bc->pos;
+        b_emit(bc, 0);
+        b_emit(bc, OP_HALT);
+    } else if (stub) {
+        b_emit(bc, OP_HALT);
+    }
+    emit_node(bc, bc->ast.root);
+
+    if (bc->obj == NULL) {
+        for (int i = 0; i < bc->call_count; i += 2) {
+            int addr = symhash_get(&bc->funcs, bc->calls[i + 1], 0) - 1;
+            if (addr < 0) {
+                LOG_ERROR_MSG("Bootstrap", "TASK-051", "call to undefined function");
+                bc->failed = 1;
+                continue;
+            }
+            b_patch(bc, bc->calls[i], addr);
+        }
+    }
+    if (entry_at >= 0) {
+        int main_id = intern_find("main");
+        int addr = main_id == INTERN_NONE ? -1 : symhash_get(&bc->funcs, main_id, 0) - 1;
+        b_patch(bc, entry_at, addr >= 0 ? addr : bc->last_func);
+    }
+    return bc->failed ? -1 : 0;
+}
 
-    emit_expr(ast);
-    b_emit(OP_HALT);
+int bootstrap_compile_ctx(BootstrapCtx *bc, const char *source,
+                          unsigned char *out_bytecode, int max_len) {
+    LOG_INFO_MSG("Bootstrap", "TASK-018", "bootstrap_compile entered");
+    CacheKey key;
+    if (bc->cache != NULL) {
+        key = cache_key(source, cache_kind(bc, CACHE_KIND_BUFFER));
+        ObjectModule hit;
+        int len = cache_get(bc->cache, key, &hit);
+        if (len >= 0 && len <= max_len) {
+            memcpy(out_bytecode, hit.code, (size_t)len);
+            object_free(&hit);
+            return len;
+        }
+        object_free(&hit);
+    }
+    if (bootstrap_front(bc, source) < 0) return -1;
 
-    expr_free(ast);
+    /* Emit bytecode */
+    bc->out = out_bytecode;
+    bc->obj = NULL;
+    bc->max = max_len;
+
+    if (emit_program(bc, 1) < 0) return -1;
+
+    /* A full buffer may have dropped bytes; don't cache truncated output */
+    if (bc->cache != NULL && bc->pos < max_len) {
+        ObjectModule flat;
+        object_init(&flat);
+        flat.code = out_bytecode;
+        flat.code_len = bc->pos;
+        cache_put(bc->cache, key, &flat);
+    }
 
     LOG_INFO_MSG("Bootstrap", "TASK-018", "bootstrap_compile complete");
-    return bc_pos;
+    return bc->pos;
+}
+
+/* Emit bc->ast into obj, then declare functions called but not defined as imports */
+static void emit_object(BootstrapCtx *bc, ObjectModule *obj, int stub) {
+    bc->out = NULL;
+    bc->obj = obj;
+    bc->max = 0;
+
+    emit_program(bc, stub);
+
+    for (int i = 0; i < bc->funcs.count; i++) {
+        if (bc->funcs.entries[i].value == 0) {
+            object_add_symbol_id(obj, bc->funcs.entries[i].key, 0, SYM_IMPORT);
+        }
+    }
+    bc->obj = NULL;
+}
+
+int bootstrap_compile_object(BootstrapCtx *bc, const char *source, ObjectModule *obj) {
+    CacheKey key;
+    if (bc->cache != NULL) {
+        key = cache_key(source, cache_kind(bc, CACHE_KIND_OBJECT));
+        int len = cache_get(bc->cache, key, obj);
+        if (len >= 0) return len;
+    }
+    object_init(obj);
+    if (bootstrap_front(bc, source) < 0) return -1;
+    emit_object(bc, obj, 1);
+    if (bc->cache != NULL) cache_put(bc->cache, key, obj);
+    return obj->code_len;
+}
+
+int bootstrap_compile_unit(BootstrapCtx *bc, const char *source, int slot_base,
+                           ObjectModule *obj, int *slot_end) {
+    object_init(obj);
+    if (bootstrap_front(bc, source) < 0) return -1;
+
+    /* Slots are handed out program-wide: continue where the previous
+     * function stopped, exactly as a whole-program compile would */
+    if (slot_base > MAX_SYMBOLS) slot_base = MAX_SYMBOLS;
+    bc->symtab.count = slot_base;
+    bc->symtab.next_offset = slot_base;
+
+    emit_object(bc, obj, 0);
+    *slot_end = bc->symtab.next_offset;
+    return obj->code_len;
+}
+
+int bootstrap_compile(const char *source, unsigned char *out_bytecode, int max_len) {
+    BootstrapCtx bc;
+    bootstrap_ctx_init(&bc);
+    int len = bootstrap_compile_ctx(&bc, source, out_bytecode, max_len);
+    bootstrap_ctx_free(&bc);
+    return len;
 }
 
 /*
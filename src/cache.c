@@ -0,0 +1,388 @@
+/*
+ * cache.c - Content-addressed on-disk compilation cache
+ *
+ * Entry file:
+ *   CacheHeader
+ *   code[code_len]
+ *   CacheSym[sym_count]      name_off into names
+ *   CacheReloc[reloc_count]  target_off into names, -1 = module-relative
+ *   names[names_len]         NUL-terminated strings
+ *
+ * All integers are in host byte order; a cache directory is not meant to
+ * be shared between machines of different endianness.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "../include/cache.h"
+#include "../include/bootstrap.h"
+#include "../include/intern.h"
+#include "../include/logger.h"
+
+#define CACHE_MAGIC "TCC1"
+
+typedef struct {
+    char magic[4];
+    uint32_t version;         /* CACHE_FORMAT_VERSION << 16 | codegen version */
+    uint64_t key_hi;
+    uint64_t key_lo;
+    int32_t code_len;
+    int32_t sym_count;
+    int32_t reloc_count;
+    int32_t names_len;
+} CacheHeader;
+
+typedef struct {
+    int32_t name_off;
+    int32_t address;
+    int32_t vis;
+} CacheSym;
+
+typedef struct {
+    int32_t offset;
+    int32_t target_off;
+} CacheReloc;
+
+static void *cache_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "cache: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static uint32_t entry_version(void) {
+    return (uint32_t)CACHE_FORMAT_VERSION << 16 | (uint32_t)BOOTSTRAP_CODEGEN_VERSION;
+}
+
+/* ---- Keys ---- */
+
+/* splitmix64 finalizer: spreads every input bit over the word */
+static uint64_t mix64(uint64_t h) {
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+CacheKey cache_key(const char *source, CacheKind kind) {
+    /* Two independent FNV-1a style streams; the second also mixes in
+     * the byte position so transpositions differ in both halves */
+    uint64_t a = 0xcbf29ce484222325ULL ^ entry_version();
+    uint64_t b = 0x84222325cbf29ce4ULL ^ (uint64_t)kind;
+    a = (a ^ (uint64_t)kind) * 0x100000001b3ULL;
+    b = (b ^ entry_version()) * 0x9e3779b97f4a7c15ULL;
+    size_t i = 0;
+    for (const unsigned char *p = (const unsigned char *)source; *p; p++, i++) {
+        a = (a ^ *p) * 0x100000001b3ULL;
+        b = (b ^ (*p + (i << 8))) * 0x9e3779b97f4a7c15ULL;
+    }
+    CacheKey key;
+    key.hi = mix64(a ^ i);
+    key.lo = mix64(b + i);
+    return key;
+}
+
+static void entry_path(const CompileCache *c, CacheKey key, char *buf, size_t size) {
+    snprintf(buf, size, "%s/%02x/%016llx%016llx", c->dir, (unsigned)(key.hi >> 56),
+             (unsigned long long)key.hi, (unsigned long long)key.lo);
+}
+
+/* ---- Open / close ---- */
+
+static long dir_size(const char *dir);
+
+int cache_open(CompileCache *c, const char *dir, long max_bytes) {
+    memset(c, 0, sizeof(*c));
+    if (strlen(dir) + 40 >= sizeof(c->dir)) {
+        fprintf(stderr, "cache: directory path too long: %s\n", dir);
+        return -1;
+    }
+    strcpy(c->dir, dir);
+    if (mkdir(dir, 0777) < 0 && errno != EEXIST) {
+        fprintf(stderr, "cache: cannot create %s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    c->max_bytes = max_bytes > 0 ? max_bytes : CACHE_DEFAULT_MAX;
+    atomic_init(&c->bytes, dir_size(dir));
+    atomic_init(&c->hits, 0);
+    atomic_init(&c->misses, 0);
+    atomic_init(&c->stores, 0);
+    atomic_init(&c->evictions, 0);
+    pthread_mutex_init(&c->evict_lock, NULL);
+    LOG_INFO_MSG("Cache", "TASK-044", "Compile cache opened");
+    return 0;
+}
+
+void cache_close(CompileCache *c) {
+    pthread_mutex_destroy(&c->evict_lock);
+}
+
+/* ---- Lookup ---- */
+
+int cache_get(CompileCache *c, CacheKey key, ObjectModule *obj) {
+    object_init(obj);
+    char path[600];
+    entry_path(c, key, path, sizeof(path));
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        atomic_fetch_add(&c->misses, 1);
+        return -1;
+    }
+    struct stat st;
+    char *buf = NULL;
+    int ok = 0;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(CacheHeader)) {
+        buf = (char *)cache_alloc(NULL, (size_t)st.st_size);
+        ok = read(fd, buf, (size_t)st.st_size) == st.st_size;
+    }
+    if (ok) futimens(fd, NULL);   /* Mark recently used */
+    close(fd);
+
+    CacheHeader h;
+    if (ok) {
+        memcpy(&h, buf, sizeof(h));
+        size_t expect = sizeof(h) + (size_t)h.code_len + (size_t)h.sym_count * sizeof(CacheSym) +
+                        (size_t)h.reloc_count * sizeof(CacheReloc) + (size_t)h.names_len;
+        ok = memcmp(h.magic, CACHE_MAGIC, 4) == 0 && h.version == entry_version() &&
+             h.key_hi == key.hi && h.key_lo == key.lo &&
+             h.code_len >= 0 && h.sym_count >= 0 && h.reloc_count >= 0 && h.names_len >= 0 &&
+             expect == (size_t)st.st_size;
+    }
+    if (!ok) {
+        free(buf);
+        atomic_fetch_add(&c->misses, 1);
+        return -1;
+    }
+
+    const char *p = buf + sizeof(h);
+    const CacheSym *syms = (const CacheSym *)(p + h.code_len);
+    const CacheReloc *relocs = (const CacheReloc *)(syms + h.sym_count);
+    const char *names = (const char *)(relocs + h.reloc_count);
+
+    /* Every name offset must land inside the NUL-terminated names blob,
+     * and every address and patch offset inside the code */
+    ok = h.names_len == 0 || names[h.names_len - 1] == '\0';
+    for (int i = 0; ok && i < h.sym_count; i++) {
+        CacheSym s;
+        memcpy(&s, &syms[i], sizeof(s));
+        ok = s.name_off >= 0 && s.name_off < h.names_len &&
+             s.vis >= SYM_EXPORT && s.vis <= SYM_LOCAL &&
+             (s.vis == SYM_IMPORT ? s.address == 0 : s.address >= 0 && s.address < h.code_len);
+    }
+    for (int i = 0; ok && i < h.reloc_count; i++) {
+        CacheReloc r;
+        memcpy(&r, &relocs[i], sizeof(r));
+        ok = (r.target_off == -1 || (r.target_off >= 0 && r.target_off < h.names_len)) &&
+             r.offset >= 0 && r.offset < h.code_len;
+    }
+    if (!ok) {
+        free(buf);
+        atomic_fetch_add(&c->misses, 1);
+        return -1;
+    }
+
+    obj->code = (unsigned char *)cache_alloc(NULL, (size_t)(h.code_len ? h.code_len : 1));
+    memcpy(obj->code, p, (size_t)h.code_len);
+    obj->code_len = obj->code_capacity = h.code_len;
+    for (int i = 0; i < h.sym_count; i++) {
+        CacheSym s;
+        memcpy(&s, &syms[i], sizeof(s));
+        object_add_symbol_id(obj, intern(names + s.name_off), s.address, (SymVisibility)s.vis);
+    }
+    for (int i = 0; i < h.reloc_count; i++) {
+        CacheReloc r;
+        memcpy(&r, &relocs[i], sizeof(r));
+        object_add_reloc_id(obj, r.offset, r.target_off < 0 ? INTERN_NONE : intern(names + r.target_off));
+    }
+    free(buf);
+    atomic_fetch_add(&c->hits, 1);
+    return obj->code_len;
+}
+
+/* ---- Store ---- */
+
+static int32_t add_name(char **names, int32_t *len, int32_t *cap, int id) {
+    const char *s = intern_str(id);
+    int32_t n = (int32_t)strlen(s) + 1;
+    if (*len + n > *cap) {
+        *cap = (*len + n) * 2;
+        *names = (char *)cache_alloc(*names, (size_t)*cap);
+    }
+    memcpy(*names + *len, s, (size_t)n);
+    *len += n;
+    return *len - n;
+}
+
+int cache_put(CompileCache *c, CacheKey key, const ObjectModule *obj) {
+    char *names = NULL;
+    int32_t names_len = 0, names_cap = 0;
+    CacheSym *syms = (CacheSym *)cache_alloc(NULL, (size_t)(obj->sym_count + 1) * sizeof(CacheSym));
+    CacheReloc *relocs = (CacheReloc *)cache_alloc(NULL, (size_t)(obj->reloc_count + 1) * sizeof(CacheReloc));
+    for (int i = 0; i < obj->sym_count; i++) {
+        syms[i].name_off = add_name(&names, &names_len, &names_cap, obj->symbols[i].name_id);
+        syms[i].address = obj->symbols[i].address;
+        syms[i].vis = (int32_t)obj->symbols[i].vis;
+    }
+    for (int i = 0; i < obj->reloc_count; i++) {
+        relocs[i].offset = obj->relocs[i].offset;
+        relocs[i].target_off = obj->relocs[i].target_id == INTERN_NONE ? -1 :
+            add_name(&names, &names_len, &names_cap, obj->relocs[i].target_id);
+    }
+
+    CacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CACHE_MAGIC, 4);
+    h.version = entry_version();
+    h.key_hi = key.hi;
+    h.key_lo = key.lo;
+    h.code_len = obj->code_len;
+    h.sym_count = obj->sym_count;
+    h.reloc_count = obj->reloc_count;
+    h.names_len = names_len;
+
+    /* Write a private temp file, then publish it with an atomic rename */
+    static atomic_int seq;
+    char path[600], tmp[600];
+    entry_path(c, key, path, sizeof(path));
+    snprintf(tmp, sizeof(tmp), "%s/tmp-%ld-%d", c->dir, (long)getpid(), atomic_fetch_add(&seq, 1));
+    char *slash = strrchr(path, '/');
+    *slash = '\0';
+    mkdir(path, 0777);
+    *slash = '/';
+
+    int rc = -1;
+    FILE *f = fopen(tmp, "wb");
+    if (f != NULL) {
+        int ok = fwrite(&h, sizeof(h), 1, f) == 1 &&
+                 fwrite(obj->code, 1, (size_t)obj->code_len, f) == (size_t)obj->code_len &&
+                 fwrite(syms, sizeof(CacheSym), (size_t)obj->sym_count, f) == (size_t)obj->sym_count &&
+                 fwrite(relocs, sizeof(CacheReloc), (size_t)obj->reloc_count, f) == (size_t)obj->reloc_count &&
+                 fwrite(names, 1, (size_t)names_len, f) == (size_t)names_len;
+        ok = fclose(f) == 0 && ok;
+        if (ok && rename(tmp, path) == 0) {
+            rc = 0;
+        } else {
+            unlink(tmp);
+        }
+    }
+    free(names);
+    free(syms);
+    free(relocs);
+    if (rc < 0) return -1;
+
+    atomic_fetch_add(&c->stores, 1);
+    long size = (long)sizeof(h) + obj->code_len + (long)(obj->sym_count * sizeof(CacheSym)) +
+                (long)(obj->reloc_count * sizeof(CacheReloc)) + names_len;
+    if (atomic_fetch_add(&c->bytes, size) + size > c->max_bytes &&
+        pthread_mutex_trylock(&c->evict_lock) == 0) {
+        cache_evict(c, c->max_bytes / 4 * 3);
+        pthread_mutex_unlock(&c->evict_lock);
+    }
+    return 0;
+}
+
+/* ---- Eviction ---- */
+
+typedef struct {
+    char *path;
+    time_t mtime;
+    long size;
+} CacheFile;
+
+/* Call fn on every file one directory level below dir */
+static void walk_entries(const char *dir, void (*fn)(const char *, const struct stat *, void *),
+                         void *arg) {
+    DIR *d = opendir(dir);
+    if (d == NULL) return;
+    struct dirent *e;
+    char sub[800], file[1100];
+    while ((e = readdir(d)) != NULL) {
+        if (e->d_name[0] == '.') continue;
+        snprintf(sub, sizeof(sub), "%s/%s", dir, e->d_name);
+        struct stat st;
+        if (stat(sub, &st) != 0) continue;
+        if (!S_ISDIR(st.st_mode)) {
+            /* Temp files from writers that died mid-write */
+            if (strncmp(e->d_name, "tmp-", 4) == 0 && st.st_mtime < time(NULL) - 60) unlink(sub);
+            continue;
+        }
+        DIR *sd = opendir(sub);
+        if (sd == NULL) continue;
+        struct dirent *se;
+        while ((se = readdir(sd)) != NULL) {
+            if (se->d_name[0] == '.') continue;
+            snprintf(file, sizeof(file), "%s/%s", sub, se->d_name);
+            if (stat(file, &st) == 0 && S_ISREG(st.st_mode)) fn(file, &st, arg);
+        }
+        closedir(sd);
+    }
+    closedir(d);
+}
+
+static void sum_size(const char *path, const struct stat *st, void *arg) {
+    (void)path;
+    *(long *)arg += (long)st->st_size;
+}
+
+static long dir_size(const char *dir) {
+    long total = 0;
+    walk_entries(dir, sum_size, &total);
+    return total;
+}
+
+typedef struct {
+    CacheFile *files;
+    int count;
+    int cap;
+    long total;
+} CacheFileList;
+
+static void collect_file(const char *path, const struct stat *st, void *arg) {
+    CacheFileList *l = (CacheFileList *)arg;
+    if (l->count >= l->cap) {
+        l->cap = l->cap ? l->cap * 2 : 64;
+        l->files = (CacheFile *)cache_alloc(l->files, (size_t)l->cap * sizeof(CacheFile));
+    }
+    CacheFile *f = &l->files[l->count++];
+    f->path = strdup(path);
+    f->mtime = st->st_mtime;
+    f->size = (long)st->st_size;
+    l->total += f->size;
+}
+
+static int by_mtime(const void *a, const void *b) {
+    time_t ta = ((const CacheFile *)a)->mtime, tb = ((const CacheFile *)b)->mtime;
+    return ta < tb ? -1 : ta > tb;
+}
+
+int cache_evict(CompileCache *c, long target) {
+    CacheFileList l = {NULL, 0, 0, 0};
+    walk_entries(c->dir, collect_file, &l);
+    qsort(l.files, (size_t)l.count, sizeof(CacheFile), by_mtime);
+
+    int removed = 0;
+    for (int i = 0; i < l.count; i++) {
+        /* Another process may have removed it first; either way it's gone */
+        if (l.total > target) {
+            if (unlink(l.files[i].path) == 0) removed++;
+            l.total -= l.files[i].size;
+        }
+        free(l.files[i].path);
+    }
+    free(l.files);
+    atomic_store(&c->bytes, l.total);
+    atomic_fetch_add(&c->evictions, removed);
+    return removed;
+}
@@ -0,0 +1,301 @@
+/*
+ * compact_ast.c - Compact struct-of-arrays AST
+ *
+ * Flattens Expr trees into parallel node arrays with 32-bit child
+ * references, and runs constant folding directly on that layout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/compact_ast.h"
+
+static void *cast_grow(void *p, uint32_t *cap, uint32_t need, size_t elem) {
+    if (need <= *cap) return p;
+    uint32_t n = *cap ? *cap : 64;
+    while (n < need) n *= 2;
+    p = realloc(p, (size_t)n * elem);
+    if (p == NULL) {
+        fprintf(stderr, "compact_ast: realloc failed\n");
+        exit(1);
+    }
+    *cap = n;
+    return p;
+}
+
+void cast_init(CompactAST *ca) {
+    memset(ca, 0, sizeof(*ca));
+    ca->root = CAST_NONE;
+}
+
+void cast_free(CompactAST *ca) {
+    free(ca->kind);
+    free(ca->op);
+    free(ca->nkids);
+    free(ca->val);
+    free(ca->name);
+    free(ca->kids_at);
+    free(ca->kids);
+    cast_init(ca);
+}
+
+void cast_clear(CompactAST *ca) {
+    ca->count = 0;
+    ca->kid_count = 0;
+    ca->root = CAST_NONE;
+}
+
+NodeRef cast_add(CompactAST *ca, NodeType kind, OpType op, int val,
+                 int name_id, const NodeRef *kids, int nkids) {
+    if (ca->count >= ca->capacity) {
+        uint32_t cap = ca->capacity ? ca->capacity * 2 : 64;
+        ca->kind    = (uint8_t *)realloc(ca->kind, cap * sizeof(uint8_t));
+        ca->op      = (uint8_t *)realloc(ca->op, cap * sizeof(uint8_t));
+        ca->nkids   = (uint16_t *)realloc(ca->nkids, cap * sizeof(uint16_t));
+        ca->val     = (int32_t *)realloc(ca->val, cap * sizeof(int32_t));
+        ca->name    = (int32_t *)realloc(ca->name, cap * sizeof(int32_t));
+        ca->kids_at = (uint32_t *)realloc(ca->kids_at, cap * sizeof(uint32_t));
+        if (!ca->kind || !ca->op || !ca->nkids || !ca->val || !ca->name || !ca->kids_at) {
+            fprintf(stderr, "compact_ast: realloc failed\n");
+            exit(1);
+        }
+        ca->capacity = cap;
+    }
+    ca->kids = (NodeRef *)cast_grow(ca->kids, &ca->kid_capacity,
+                                    ca->kid_count + (uint32_t)nkids, sizeof(NodeRef));
+
+    NodeRef n = ca->count++;
+    ca->kind[n] = (uint8_t)kind;
+    ca->op[n] = (uint8_t)op;
+    ca->val[n] = val;
+    ca->name[n] = name_id;
+    ca->nkids[n] = (uint16_t)nkids;
+    ca->kids_at[n] = ca->kid_count;
+    for (int i = 0; i < nkids; i++) {
+        ca->kids[ca->kid_count++] = kids[i];
+    }
+    return n;
+}
+
+/* --- Expr -> compact (post-order) --- */
+
+static NodeRef flatten(CompactAST *ca, const Expr *e);
+
+/* Flatten a child list, then add the node with [first, list...] slots */
+static NodeRef flatten_list(CompactAST *ca, const Expr *e, const Expr *first,
+                            int has_first) {
+    NodeRef local[8];
+    int n = e->param_count + has_first;
+    NodeRef *kids = (n <= 8) ? local : (NodeRef *)malloc((size_t)n * sizeof(NodeRef));
+    if (kids == NULL) {
+        fprintf(stderr, "compact_ast: malloc failed\n");
+        exit(1);
+    }
+    int k = 0;
+    if (has_first) kids[k++] = flatten(ca, first);
+    for (int i = 0; i < e->param_count; i++) {
+        kids[k++] = flatten(ca, e->params[i]);
+    }
+    NodeRef r = cast_add(ca, e->type, e->op, e->array_size, e->name_id, kids, n);
+    if (kids != local) free(kids);
+    return r;
+}
+
+static NodeRef flatten(CompactAST *ca, const Expr *e) {
+    if (e == NULL) return CAST_NONE;
+
+    NodeRef k[4];
+    switch (e->type) {
+        case NODE_CONST:
+            return cast_add(ca, e->type, e->op, e->val, INTERN_NONE, NULL, 0);
+
+        case NODE_VAR:
+            return cast_add(ca, e->type, e->op, 0, e->name_id, NULL, 0);
+
+        case NODE_BINOP:
+        case NODE_ASSIGN:
+        case NODE_ARRAY_ASSIGN:
+            k[0] = flatten(ca, e->left);
+            k[1] = flatten(ca, e->right);
+            return cast_add(ca, e->type, e->op, 0, e->name_id, k, 2);
+
+        case NODE_RETURN:
+        case NODE_DEREF:
+        case NODE_ADDR_OF:
+        case NODE_VAR_DECL:
+        case NODE_TRIT_VAR_DECL:
+        case NODE_ARRAY_ACCESS:
+            k[0] = flatten(ca, e->left);
+            return cast_add(ca, e->type, e->op, 0, e->name_id, k, 1);
+
+        case NODE_IF:
+            k[0] = flatten(ca, e->condition);
+            k[1] = flatten(ca, e->body);
+            k[2] = flatten(ca, e->else_body);
+            return cast_add(ca, e->type, e->op, 0, INTERN_NONE, k, 3);
+
+        case NODE_WHILE:
+            k[0] = flatten(ca, e->condition);
+            k[1] = flatten(ca, e->body);
+            return cast_add(ca, e->type, e->op, 0, INTERN_NONE, k, 2);
+
+        case NODE_FOR:
+            k[0] = flatten(ca, e->left);
+            k[1] = flatten(ca, e->condition);
+            k[2] = flatten(ca, e->increment);
+            k[3] = flatten(ca, e->body);
+            return cast_add(ca, e->type, e->op, 0, INTERN_NONE, k, 4);
+
+        case NODE_FUNC_DEF:
+            return flatten_list(ca, e, e->body, 1);
+
+        case NODE_FUNC_CALL:
+        case NODE_PROGRAM:
+        case NODE_BLOCK:
+        case NODE_ARRAY_DECL:
+        case NODE_TRIT_ARRAY_DECL:
+            return flatten_list(ca, e, NULL, 0);
+    }
+    return CAST_NONE;
+}
+
+NodeRef cast_from_expr(CompactAST *ca, const Expr *e) {
+    ca->root = flatten(ca, e);
+    return ca->root;
+}
+
+/* --- compact -> Expr --- */
+
+static Expr **expand_list(const CompactAST *ca, NodeRef n, int from, int *count) {
+    int c = ca->nkids[n] - from;
+    *count = c;
+    if (c <= 0) {
+        *count = 0;
+        return NULL;
+    }
+    Expr **list = (Expr **)malloc((size_t)c * sizeof(Expr *));
+    if (list == NULL) {
+        fprintf(stderr, "compact_ast: malloc failed\n");
+        exit(1);
+    }
+    for (int i = 0; i < c; i++) {
+        list[i] = cast_to_expr(ca, cast_kid(ca, n, from + i));
+    }
+    return list;
+}
+
+Expr *cast_to_expr(const CompactAST *ca, NodeRef n) {
+    if (n == CAST_NONE) return NULL;
+
+    const char *name = cast_name(ca, n);
+    int count;
+    Expr **list;
+    switch ((NodeType)ca->kind[n]) {
+        case NODE_CONST:
+            return create_const(ca->val[n]);
+        case NODE_VAR:
+            return create_var(name);
+        case NODE_BINOP:
+            return create_binop((OpType)ca->op[n], cast_to_expr(ca, cast_kid(ca, n, 0)),
+                                cast_to_expr(ca, cast_kid(ca, n, 1)));
+        case NODE_ASSIGN:
+            return create_assign(cast_to_expr(ca, cast_kid(ca, n, 0)),
+                                 cast_to_expr(ca, cast_kid(ca, n, 1)));
+        case NODE_ARRAY_ASSIGN:
+            return create_array_assign(name, cast_to_expr(ca, cast_kid(ca, n, 0)),
+                                       cast_to_expr(ca, cast_kid(ca, n, 1)));
+        case NODE_RETURN:
+            return create_return(cast_to_expr(ca, cast_kid(ca, n, 0)));
+        case NODE_DEREF:
+            return create_deref(cast_to_expr(ca, cast_kid(ca, n, 0)));
+        case NODE_ADDR_OF:
+            return create_addr_of(cast_to_expr(ca, cast_kid(ca, n, 0)));
+        case NODE_VAR_DECL:
+            return create_var_decl(name, cast_to_expr(ca, cast_kid(ca, n, 0)));
+        case NODE_TRIT_VAR_DECL:
+            return create_trit_var_decl(name, cast_to_expr(ca, cast_kid(ca, n, 0)));
+        case NODE_ARRAY_ACCESS:
+            return create_array_access(name, cast_to_expr(ca, cast_kid(ca, n, 0)));
+        case NODE_IF:
+            return create_if(cast_to_expr(ca, cast_kid(ca, n, 0)),
+                             cast_to_expr(ca, cast_kid(ca, n, 1)),
+                             cast_to_expr(ca, cast_kid(ca, n, 2)));
+        case NODE_WHILE:
+            return create_while(cast_to_expr(ca, cast_kid(ca, n, 0)),
+                                cast_to_expr(ca, cast_kid(ca, n, 1)));
+        case NODE_FOR:
+            return create_for(cast_to_expr(ca, cast_kid(ca, n, 0)),
+                              cast_to_expr(ca, cast_kid(ca, n, 1)),
+                              cast_to_expr(ca, cast_kid(ca, n, 2)),
+                              cast_to_expr(ca, cast_kid(ca, n, 3)));
+        case NODE_FUNC_DEF: {
+            Expr *body = cast_to_expr(ca, cast_kid(ca, n, 0));
+            list = expand_list(ca, n, 1, &count);
+            return create_func_def(name, list, count, body);
+        }
+        case NODE_FUNC_CALL:
+            list = expand_list(ca, n, 0, &count);
+            return create_func_call(name, list, count);
+        case NODE_ARRAY_DECL:
+            list = expand_list(ca, n, 0, &count);
+            return create_array_decl(name, ca->val[n], list, count);
+        case NODE_TRIT_ARRAY_DECL:
+            list = expand_list(ca, n, 0, &count);
+            return create_trit_array_decl(name, ca->val[n], list, count);
+        case NODE_PROGRAM: {
+            Expr *prog = create_program();
+            for (int i = 0; i < ca->nkids[n]; i++)
+                program_add_func(prog, cast_to_expr(ca, cast_kid(ca, n, i)));
+            return prog;
+        }
+        case NODE_BLOCK: {
+            Expr *block = create_block();
+            for (int i = 0; i < ca->nkids[n]; i++)
+                block_add_stmt(block, cast_to_expr(ca, cast_kid(ca, n, i)));
+            return block;
+        }
+    }
+    return NULL;
+}
+
+/* --- Constant folding --- */
+
+void cast_optimize(CompactAST *ca) {
+    /* Post-order layout: children are folded before their parents */
+    for (NodeRef n = 0; n < ca->count; n++) {
+        if (ca->kind[n] != NODE_BINOP) continue;
+
+        NodeRef l = cast_kid(ca, n, 0);
+        NodeRef r = cast_kid(ca, n, 1);
+        if (l == CAST_NONE || ca->kind[l] != NODE_CONST) continue;
+        if (ca->op[n] != OP_IR_NEG && (r == CAST_NONE || ca->kind[r] != NODE_CONST))
+            continue;
+
+        int a = ca->val[l];
+        int b = (r != CAST_NONE) ? ca->val[r] : 0;
+        int result = 0;
+        switch ((OpType)ca->op[n]) {
+            case OP_IR_ADD:    result = a + b; break;
+            case OP_IR_MUL:    result = a * b; break;
+            case OP_IR_SUB:    result = a - b; break;
+            case OP_IR_DIV:    result = (b != 0) ? a / b : 0; break;
+            case OP_IR_MOD:    result = (b != 0) ? a % b : 0; break;
+            case OP_IR_CMP_EQ: result = (a == b) ? 1 : 0; break;
+            /* CMP_LT/CMP_GT push 1, -1 or 0, as ssa_opt's fold() */
+            case OP_IR_CMP_LT: result = (a < b) ? 1 : (a > b) ? -1 : 0; break;
+            case OP_IR_CMP_GT: result = (a > b) ? 1 : (a < b) ? -1 : 0; break;
+            case OP_IR_NEG:    result = -a; break;
+        }
+
+        /* Children become unreachable; no per-node free needed */
+        ca->kind[n] = NODE_CONST;
+        ca->val[n] = result;
+        ca->nkids[n] = 0;
+    }
+}
+
+size_t cast_memory_bytes(const CompactAST *ca) {
+    size_t per_node = sizeof(uint8_t) * 2 + sizeof(uint16_t) + sizeof(int32_t) * 3;
+    return (size_t)ca->count * per_node +
+           (size_t)ca->kid_count * sizeof(NodeRef);
+}
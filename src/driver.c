@@ -0,0 +1,320 @@
+/*
+ * driver.c - Parallel multi-file compilation driver
+ *
+ * Work distribution: workers pull the next module index from a shared
+ * atomic counter, so long and short modules balance across threads.
+ * Each worker keeps one BootstrapCtx for all modules it compiles.
+ * Objects land in a per-index slot and are handed to the linker in
+ * input order once every worker has joined.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include "../include/driver.h"
+#include "../include/bootstrap.h"
+#include "../include/cache.h"
+#include "../include/intern.h"
+#include "../include/logger.h"
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void *driver_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "driver: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+int driver_default_jobs(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+/* ---- Thread pool ---- */
+
+typedef struct {
+    const char *const *sources;
+    int count;
+    ObjectModule *objs;
+    int *status;            /* Per module: code length or -1 */
+    double *cpu;            /* Per module: compile seconds */
+    atomic_int next;        /* Next module index to claim */
+} CompileQueue;
+
+static void *compile_worker(void *arg) {
+    CompileQueue *q = (CompileQueue *)arg;
+    BootstrapCtx bc;
+    bootstrap_ctx_init(&bc);
+    for (;;) {
+        int i = atomic_fetch_add(&q->next, 1);
+        if (i >= q->count) break;
+        double t0 = now_sec();
+        q->status[i] = bootstrap_compile_object(&bc, q->sources[i], &q->objs[i]);
+        q->cpu[i] = now_sec() - t0;
+    }
+    bootstrap_ctx_free(&bc);
+    return NULL;
+}
+
+int driver_compile(const char *const *sources, const char *const *names, int count,
+                   int jobs, Linker *lnk, DriverTimes *times) {
+    LOG_INFO_MSG("Driver", "TASK-042", "driver_compile entered");
+    DriverTimes t;
+    memset(&t, 0, sizeof(t));
+
+    if (jobs <= 0) jobs = driver_default_jobs();
+    if (jobs > count) jobs = count;
+    if (jobs < 1) jobs = 1;
+    t.jobs = jobs;
+
+    CompileQueue q;
+    q.sources = sources;
+    q.count = count;
+    q.objs = (ObjectModule *)driver_alloc(NULL, (size_t)(count ? count : 1) * sizeof(ObjectModule));
+    q.status = (int *)driver_alloc(NULL, (size_t)(count ? count : 1) * sizeof(int));
+    q.cpu = (double *)driver_alloc(NULL, (size_t)(count ? count : 1) * sizeof(double));
+    atomic_init(&q.next, 0);
+
+    /* Compile: the calling thread is worker 0 */
+    double t0 = now_sec();
+    pthread_t *th = (pthread_t *)driver_alloc(NULL, (size_t)jobs * sizeof(pthread_t));
+    int started = 0;
+    for (int w = 1; w < jobs; w++) {
+        if (pthread_create(&th[w], NULL, compile_worker, &q) != 0) break;
+        started = w;
+    }
+    compile_worker(&q);
+    for (int w = 1; w <= started; w++) pthread_join(th[w], NULL);
+    free(th);
+    t.compile = now_sec() - t0;
+
+    /* Link in input order; the entry stub calls main */
+    t0 = now_sec();
+    int failed = 0;
+    static const unsigned char entry[3] = {OP_CALL, 0, OP_HALT};
+    int entry_mod = linker_add_module(lnk, entry, 3);
+    linker_add_reloc(lnk, entry_mod, 1, "main");
+    for (int i = 0; i < count; i++) {
+        t.compile_cpu += q.cpu[i];
+        if (q.status[i] < 0) {
+            fprintf(stderr, "driver: %s: compilation failed\n",
+                    names != NULL ? names[i] : "<source>");
+            object_free(&q.objs[i]);
+            failed++;
+            continue;
+        }
+        linker_add_object(lnk, &q.objs[i]);
+    }
+    int link_errors = failed == 0 ? linker_link(lnk) : 0;
+    t.link = now_sec() - t0;
+
+    free(q.objs);
+    free(q.status);
+    free(q.cpu);
+    if (times != NULL) *times = t;
+    LOG_INFO_MSG("Driver", "TASK-042", "driver_compile complete");
+    return failed + link_errors;
+}
+
+/* ---- Files ---- */
+
+/* Read a whole file into a NUL-terminated malloc'd buffer, or NULL */
+static char *read_file(const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) return NULL;
+    char *buf = NULL;
+    size_t len = 0, cap = 0;
+    for (;;) {
+        if (cap - len < 4096) {
+            cap = cap ? cap * 2 : 8192;
+            buf = (char *)driver_alloc(buf, cap + 1);
+        }
+        size_t n = fread(buf + len, 1, cap - len, f);
+        len += n;
+        if (n == 0) break;
+    }
+    fclose(f);
+    buf[len] = '\0';
+    return buf;
+}
+
+int driver_read_manifest(const char *path, char ***out_paths) {
+    char *text = read_file(path);
+    if (text == NULL) return -1;
+
+    char **paths = NULL;
+    int count = 0, cap = 0;
+    for (char *line = strtok(text, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        /* Trim surrounding whitespace */
+        while (*line == ' ' || *line == '\t') line++;
+        size_t len = strlen(line);
+        while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\t' ||
+                           line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0 || line[0] == '#') continue;
+        if (count >= cap) {
+            cap = cap ? cap * 2 : 16;
+            paths = (char **)driver_alloc(paths, (size_t)cap * sizeof(char *));
+        }
+        paths[count] = (char *)driver_alloc(NULL, len + 1);
+        memcpy(paths[count], line, len + 1);
+        count++;
+    }
+    free(text);
+    *out_paths = paths;
+    return count;
+}
+
+static int add_path(char ***paths, int *count, int *cap, const char *p) {
+    if (*count >= *cap) {
+        *cap = *cap ? *cap * 2 : 16;
+        *paths = (char **)driver_alloc(*paths, (size_t)*cap * sizeof(char *));
+    }
+    size_t len = strlen(p);
+    (*paths)[*count] = (char *)driver_alloc(NULL, len + 1);
+    memcpy((*paths)[*count], p, len + 1);
+    return (*count)++;
+}
+
+static int add_manifest(char ***paths, int *count, int *cap, const char *manifest) {
+    char **list;
+    int n = driver_read_manifest(manifest, &list);
+    if (n < 0) {
+        fprintf(stderr, "driver: cannot read manifest '%s'\n", manifest);
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        add_path(paths, count, cap, list[i]);
+        free(list[i]);
+    }
+    free(list);
+    return 0;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: ternary_compiler --link [-j N] [-O LEVEL] [-o out.tbc] [--time] "
+                    "[--cache DIR [--cache-max MB]] [--manifest FILE | @FILE] [FILE...]\n");
+}
+
+int driver_main(int argc, char **argv) {
+    int jobs = 0, show_time = 0;
+    const char *out_path = NULL, *cache_dir = NULL;
+    long cache_max = 0;
+    char **paths = NULL;
+    int count = 0, cap = 0, rc = 1;
+
+    for (int i = 0; i < argc; i++) {
+        const char *a = argv[i];
+        if (strcmp(a, "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strncmp(a, "-j", 2) == 0 && a[2] != '\0') {
+            jobs = atoi(a + 2);
+        } else if (strcmp(a, "-O") == 0 && i + 1 < argc) {
+            bootstrap_set_opt_level(atoi(argv[++i]));
+        } else if (strncmp(a, "-O", 2) == 0 && a[2] != '\0') {
+            bootstrap_set_opt_level(atoi(a + 2));
+        } else if (strcmp(a, "-o") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(a, "--time") == 0) {
+            show_time = 1;
+        } else if (strcmp(a, "--cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(a, "--cache-max") == 0 && i + 1 < argc) {
+            cache_max = atol(argv[++i]) * 1024 * 1024;
+        } else if (strcmp(a, "--manifest") == 0 && i + 1 < argc) {
+            if (add_manifest(&paths, &count, &cap, argv[++i]) < 0) goto done;
+        } else if (a[0] == '@') {
+            if (add_manifest(&paths, &count, &cap, a + 1) < 0) goto done;
+        } else if (a[0] == '-') {
+            usage();
+            goto done;
+        } else {
+            add_path(&paths, &count, &cap, a);
+        }
+    }
+    if (count == 0) {
+        usage();
+        goto done;
+    }
+
+    /* Read */
+    double t0 = now_sec();
+    char **sources = (char **)driver_alloc(NULL, (size_t)count * sizeof(char *));
+    int unreadable = 0;
+    for (int i = 0; i < count; i++) {
+        sources[i] = read_file(paths[i]);
+        if (sources[i] == NULL) {
+            fprintf(stderr, "driver: cannot read '%s'\n", paths[i]);
+            unreadable++;
+        }
+    }
+    double t_read = now_sec() - t0;
+
+    CompileCache cache;
+    int use_cache = cache_dir != NULL && cache_open(&cache, cache_dir, cache_max) == 0;
+    if (use_cache) bootstrap_set_cache(&cache);
+
+    Linker lnk;
+    linker_init(&lnk);
+    DriverTimes t;
+    memset(&t, 0, sizeof(t));
+    int errors = unreadable;
+    if (unreadable == 0) {
+        errors = driver_compile((const char *const *)sources, (const char *const *)paths,
+                                count, jobs, &lnk, &t);
+        linker_report_errors(&lnk);
+    }
+    t.read = t_read;
+
+    /* Write */
+    if (errors == 0 && out_path != NULL) {
+        t0 = now_sec();
+        FILE *f = fopen(out_path, "wb");
+        if (f == NULL || fwrite(lnk.output, 1, (size_t)lnk.output_len, f) != (size_t)lnk.output_len) {
+            fprintf(stderr, "driver: cannot write '%s'\n", out_path);
+            errors++;
+        }
+        if (f != NULL) fclose(f);
+        t.write = now_sec() - t0;
+    }
+
+    if (errors == 0) {
+        printf("Linked %d modules into %d bytes of bytecode\n", count, lnk.output_len);
+    }
+    if (show_time) {
+        printf("Timing (-j %d): read %.2f ms, compile %.2f ms (%.2f ms cpu), "
+               "link %.2f ms, write %.2f ms\n",
+               t.jobs, t.read * 1e3, t.compile * 1e3, t.compile_cpu * 1e3,
+               t.link * 1e3, t.write * 1e3);
+        if (use_cache) {
+            printf("Cache: %ld hits, %ld misses, %ld evicted\n", atomic_load(&cache.hits),
+                   atomic_load(&cache.misses), atomic_load(&cache.evictions));
+        }
+    }
+    if (use_cache) {
+        bootstrap_set_cache(NULL);
+        cache_close(&cache);
+    }
+
+    for (int i = 0; i < count; i++) free(sources[i]);
+    free(sources);
+    linker_free(&lnk);
+    rc = errors == 0 ? 0 : 1;
+
+done:
+    for (int i = 0; i < count; i++) free(paths[i]);
+    free(paths);
+    return rc;
+}
@@ -0,0 +1,331 @@
+/*
+ * incremental.c - Function-granularity incremental recompilation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/incremental.h"
+#include "../include/logger.h"
+
+static void *incr_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "incremental: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+void incr_init(IncrBuild *ib) {
+    memset(ib, 0, sizeof(*ib));
+    bootstrap_ctx_init(&ib->bc);
+    ib->bc.cache = NULL;   /* Units are cached here, in memory */
+    linker_init(&ib->lnk);
+}
+
+void incr_free(IncrBuild *ib) {
+    bootstrap_ctx_free(&ib->bc);
+    linker_free(&ib->lnk);
+    free(ib->units);
+    free(ib->spans);
+    free(ib->old_spans);
+    free(ib->prev);
+    free(ib->text);
+    memset(ib, 0, sizeof(*ib));
+}
+
+/* ---- Splitting ---- */
+
+#define FNV_OFFSET 0xcbf29ce484222325ULL
+#define FNV_PRIME  0x100000001b3ULL
+#define CMP_BLOCK  256
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static IncrSpan *push_span(IncrBuild *ib, int count) {
+    if (count >= ib->span_capacity) {
+        ib->span_capacity = ib->span_capacity ? ib->span_capacity * 2 : 64;
+        ib->spans = (IncrSpan *)incr_alloc(ib->spans, (size_t)ib->span_capacity * sizeof(IncrSpan));
+    }
+    return &ib->spans[count];
+}
+
+/* Scan one top-level function starting at a non-space character: it ends
+ * at the brace that brings the nesting depth back to zero, or at the end
+ * of the text (left for the parser to report) */
+static size_t scan_span(const char *source, size_t i, IncrSpan *sp) {
+    size_t start = i;
+    uint64_t h = FNV_OFFSET;
+    int depth = 0, gap = 0;
+    for (; source[i] != '\0'; i++) {
+        char c = source[i];
+        if (is_space(c)) {
+            gap = 1;
+            continue;
+        }
+        if (gap) h = (h ^ (unsigned char)' ') * FNV_PRIME;
+        gap = 0;
+        h = (h ^ (unsigned char)c) * FNV_PRIME;
+        if (c == '{') {
+            depth++;
+        } else if (c == '}' && --depth == 0) {
+            i++;
+            break;
+        }
+    }
+    sp->start = start;
+    sp->len = i - start;
+    sp->hash = h;
+    return i;
+}
+
+static size_t common_prefix(const char *a, const char *b, size_t n) {
+    size_t i = 0;
+    while (i + CMP_BLOCK <= n && memcmp(a + i, b + i, CMP_BLOCK) == 0) i += CMP_BLOCK;
+    while (i < n && a[i] == b[i]) i++;
+    return i;
+}
+
+/* Length of the common tail of a[0..na) and b[0..nb), at most limit */
+static size_t common_suffix(const char *a, size_t na, const char *b, size_t nb, size_t limit) {
+    size_t i = 0;
+    while (i + CMP_BLOCK <= limit &&
+           memcmp(a + na - i - CMP_BLOCK, b + nb - i - CMP_BLOCK, CMP_BLOCK) == 0) i += CMP_BLOCK;
+    while (i < limit && a[na - i - 1] == b[nb - i - 1]) i++;
+    return i;
+}
+
+/*
+ * Split source into top-level functions. Only the region that differs
+ * from the previous source is scanned: spans wholly inside the common
+ * prefix are kept, and once the scan reaches the start of a span inside
+ * the common suffix the rest are kept, shifted. Returns the count.
+ */
+static int split_functions(IncrBuild *ib, const char *source) {
+    size_t n = strlen(source), old_len = ib->prev_len;
+    int old_count = ib->span_count;
+
+    /* The previous split becomes old_spans; spans is rebuilt */
+    IncrSpan *old_spans = ib->spans;
+    int old_capacity = ib->span_capacity;
+    ib->spans = ib->old_spans;
+    ib->span_capacity = ib->old_span_capacity;
+    ib->old_spans = old_spans;
+    ib->old_span_capacity = old_capacity;
+
+    size_t shorter = n < old_len ? n : old_len;
+    size_t prefix = common_prefix(source, ib->prev, shorter);
+    size_t suffix = common_suffix(source, n, ib->prev, old_len, shorter - prefix);
+
+    /* A span ending at old_len may have been cut short by the end of text */
+    int count = 0;
+    while (count < old_count && old_spans[count].start + old_spans[count].len <= prefix &&
+           old_spans[count].start + old_spans[count].len < old_len) {
+        *push_span(ib, count) = old_spans[count];
+        count++;
+    }
+
+    int tail = count;
+    while (tail < old_count && old_spans[tail].start < old_len - suffix) tail++;
+    ptrdiff_t shift = (ptrdiff_t)n - (ptrdiff_t)old_len;
+
+    size_t i = count > 0 ? ib->spans[count - 1].start + ib->spans[count - 1].len : 0;
+    for (;;) {
+        while (source[i] != '\0' && is_space(source[i])) i++;
+        if (source[i] == '\0') break;
+
+        /* Between functions at the start of an unchanged one: the rest of
+         * the split is the previous one, shifted */
+        while (tail < old_count && (size_t)((ptrdiff_t)old_spans[tail].start + shift) < i) tail++;
+        if (tail < old_count && (size_t)((ptrdiff_t)old_spans[tail].start + shift) == i) {
+            for (; tail < old_count; tail++) {
+                IncrSpan *sp = push_span(ib, count++);
+                *sp = old_spans[tail];
+                sp->start = (size_t)((ptrdiff_t)sp->start + shift);
+            }
+            break;
+        }
+        i = scan_span(source, i, push_span(ib, count));
+        count++;
+    }
+
+    if (n + 1 > ib->prev_capacity) {
+        ib->prev_capacity = n + 1;
+        ib->prev = (char *)incr_alloc(ib->prev, ib->prev_capacity);
+    }
+    memcpy(ib->prev, source, n + 1);
+    ib->prev_len = n;
+    ib->span_count = count;
+    return count;
+}
+
+/* ---- Compiling ---- */
+
+static int compile_span(IncrBuild *ib, const char *source, const IncrSpan *sp,
+                        int slot_base, ObjectModule *obj, int *slot_end) {
+    if (sp->len + 1 > ib->text_capacity) {
+        ib->text_capacity = sp->len + 1;
+        ib->text = (char *)incr_alloc(ib->text, ib->text_capacity);
+    }
+    memcpy(ib->text, source + sp->start, sp->len);
+    ib->text[sp->len] = '\0';
+    ib->compiled++;
+    return bootstrap_compile_unit(&ib->bc, ib->text, slot_base, obj, slot_end);
+}
+
+static void set_unit_count(IncrBuild *ib, int count) {
+    if (count > ib->unit_capacity) {
+        ib->unit_capacity = count * 2;
+        ib->units = (IncrUnit *)incr_alloc(ib->units, (size_t)ib->unit_capacity * sizeof(IncrUnit));
+    }
+    ib->unit_count = count;
+}
+
+/* Open-addressed index of the previous build's units by fingerprint hash */
+static int *index_units(const IncrBuild *ib, int *size_out) {
+    int size = 16;
+    while (size < ib->unit_count * 2) size *= 2;
+    int *table = (int *)incr_alloc(NULL, (size_t)size * sizeof(int));
+    for (int i = 0; i < size; i++) table[i] = -1;
+    for (int j = 0; j < ib->unit_count; j++) {
+        int b = (int)(ib->units[j].hash & (uint64_t)(size - 1));
+        while (table[b] >= 0) b = (b + 1) & (size - 1);
+        table[b] = j;
+    }
+    *size_out = size;
+    return table;
+}
+
+/* The function the entry stub calls: main, else the last unit's */
+static int entry_id(const Linker *lnk) {
+    int main_id = intern_find("main");
+    int last = INTERN_NONE;
+    for (int m = 1; m < lnk->module_count; m++) {
+        const ObjectModule *mod = &lnk->modules[m];
+        for (int s = 0; s < mod->sym_count; s++) {
+            if (mod->symbols[s].vis != SYM_EXPORT) continue;
+            if (mod->symbols[s].name_id == main_id) return main_id;
+            last = mod->symbols[s].name_id;
+        }
+    }
+    return last;
+}
+
+/* Entry stub for the units now in lnk: CALL entry; HALT, or just HALT */
+static void build_stub(const Linker *lnk, ObjectModule *stub) {
+    object_init(stub);
+    int id = entry_id(lnk);
+    if (id != INTERN_NONE) {
+        object_emit(stub, OP_CALL);
+        object_emit(stub, 0);
+        object_add_reloc_id(stub, 1, id);
+    }
+    object_emit(stub, OP_HALT);
+}
+
+/* Same functions at the same positions: patch changed modules in place */
+static int apply_in_place(IncrBuild *ib, const int *match, ObjectModule *fresh) {
+    for (int k = 0; k < ib->unit_count; k++) {
+        if (match[k] < 0) linker_replace_object(&ib->lnk, k + 1, &fresh[k]);
+    }
+    /* The entry may have moved; a stub of the same size relinks cheaply */
+    ObjectModule stub;
+    build_stub(&ib->lnk, &stub);
+    linker_replace_object(&ib->lnk, 0, &stub);
+    ib->partial_link = ib->lnk.linked && ib->lnk.error_count == 0;
+    return linker_relink(&ib->lnk) == 0 ? ib->lnk.output_len : -1;
+}
+
+/* Functions added, removed or moved: relink reused modules in new order */
+static int apply_relinked(IncrBuild *ib, int count, const int *match, ObjectModule *fresh) {
+    Linker next;
+    linker_init(&next);
+    linker_add_module(&next, NULL, 0);
+    for (int k = 0; k < count; k++) {
+        /* Moving a module leaves its old slot empty */
+        linker_add_object(&next, match[k] >= 0 ? &ib->lnk.modules[match[k] + 1] : &fresh[k]);
+    }
+    ObjectModule stub;
+    build_stub(&next, &stub);
+    linker_replace_object(&next, 0, &stub);
+    linker_free(&ib->lnk);
+    ib->lnk = next;
+    ib->partial_link = 0;
+    return linker_link(&ib->lnk) == 0 ? ib->lnk.output_len : -1;
+}
+
+int incr_build(IncrBuild *ib, const char *source) {
+    LOG_DEBUG_MSG("Incremental", "TASK-045", "incr_build entered");
+    ib->compiled = 0;
+    ib->reused = 0;
+    int count = split_functions(ib, source);
+    int old_count = ib->unit_count;
+    int size;
+    int *table = index_units(ib, &size);
+    int *match = (int *)incr_alloc(NULL, (size_t)(count + 1) * sizeof(int));
+    char *taken = (char *)calloc((size_t)old_count + 1, 1);
+    ObjectModule *fresh = (ObjectModule *)incr_alloc(NULL, (size_t)(count + 1) * sizeof(ObjectModule));
+    IncrUnit *units = (IncrUnit *)incr_alloc(NULL, (size_t)(count + 1) * sizeof(IncrUnit));
+    if (taken == NULL) {
+        fprintf(stderr, "incremental: calloc failed\n");
+        exit(1);
+    }
+
+    /* Match every function to an old unit with the same fingerprint,
+     * preferring the one at the same position; compile the rest. Nothing
+     * is committed until all of them compile. */
+    int in_place = count == old_count && ib->lnk.module_count == count + 1;
+    int slot = 0, result = 0, k;
+    for (k = 0; k < count; k++) {
+        IncrSpan *sp = &ib->spans[k];
+        int m = -1;
+        if (k < old_count && !taken[k] && ib->units[k].hash == sp->hash &&
+            ib->units[k].slot_base == slot) {
+            m = k;
+        } else {
+            for (int b = (int)(sp->hash & (uint64_t)(size - 1)); table[b] >= 0; b = (b + 1) & (size - 1)) {
+                int j = table[b];
+                if (!taken[j] && ib->units[j].hash == sp->hash && ib->units[j].slot_base == slot) {
+                    m = j;
+                    break;
+                }
+            }
+        }
+
+        units[k].hash = sp->hash;
+        units[k].slot_base = slot;
+        match[k] = m;
+        if (m >= 0) {
+            taken[m] = 1;
+            units[k].slot_end = ib->units[m].slot_end;
+            ib->reused++;
+            if (m != k) in_place = 0;
+        } else if (compile_span(ib, source, sp, slot, &fresh[k], &units[k].slot_end) < 0) {
+            object_free(&fresh[k]);
+            result = -1;
+            break;
+        }
+        slot = units[k].slot_end;
+    }
+
+    if (result == 0) {
+        set_unit_count(ib, count);
+        memcpy(ib->units, units, (size_t)count * sizeof(IncrUnit));
+        result = in_place ? apply_in_place(ib, match, fresh)
+                          : apply_relinked(ib, count, match, fresh);
+    } else {
+        /* The previous build is left as it was */
+        for (int i = 0; i < k; i++) {
+            if (match[i] < 0) object_free(&fresh[i]);
+        }
+    }
+    free(table);
+    free(match);
+    free(taken);
+    free(fresh);
+    free(units);
+    return result;
+}
@@ -0,0 +1,172 @@
+/*
+ * intern.c - Identifier interning
+ *
+ * Open-addressing hash table (FNV-1a, linear probing) from string to
+ * ID, plus an ID-indexed table of string pointers into a chunked pool.
+ *
+ * Thread safety: intern_n/intern_find take intern_lock. intern_str does
+ * not: the ID -> string table is paged and pages never move, and an ID
+ * is published (id_count, release) only after its entry is written.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "../include/intern.h"
+
+#define INTERN_CHUNK_SIZE 4096
+#define INTERN_PAGE_BITS  12                      /* 4096 IDs per page */
+#define INTERN_PAGE_SIZE  (1 << INTERN_PAGE_BITS)
+#define INTERN_MAX_PAGES  4096                    /* up to 16M IDs */
+
+typedef struct InternChunk {
+    struct InternChunk *next;
+    size_t used;
+    char data[INTERN_CHUNK_SIZE];
+} InternChunk;
+
+static const char **id_pages[INTERN_MAX_PAGES];  /* id -> string (id 0 unused) */
+static uint32_t *id_len;        /* id -> length */
+static uint32_t *id_hash;       /* id -> hash (for rehashing) */
+static atomic_int id_count = 1;
+static int id_capacity;
+
+static pthread_mutex_t intern_lock = PTHREAD_MUTEX_INITIALIZER;
+
+#define ID_STR(id) id_pages[(id) >> INTERN_PAGE_BITS][(id) & (INTERN_PAGE_SIZE - 1)]
+
+static int *slots;              /* hash slot -> id, 0 = empty */
+static uint32_t slot_mask;
+
+static InternChunk *chunks;
+
+static void *intern_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "intern: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static uint32_t intern_hash(const char *s, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/* Copy a string into the chunk pool (stable address) */
+static const char *pool_copy(const char *s, size_t len) {
+    char *dst;
+    if (len + 1 > INTERN_CHUNK_SIZE / 4) {
+        /* Long names get their own block */
+        dst = (char *)intern_alloc(NULL, len + 1);
+    } else {
+        if (chunks == NULL || INTERN_CHUNK_SIZE - chunks->used < len + 1) {
+            InternChunk *c = (InternChunk *)intern_alloc(NULL, sizeof(InternChunk));
+            c->used = 0;
+            c->next = chunks;
+            chunks = c;
+        }
+        dst = chunks->data + chunks->used;
+        chunks->used += len + 1;
+    }
+    memcpy(dst, s, len);
+    dst[len] = '\0';
+    return dst;
+}
+
+static void rehash(uint32_t new_size) {
+    free(slots);
+    slots = (int *)intern_alloc(NULL, new_size * sizeof(int));
+    memset(slots, 0, new_size * sizeof(int));
+    slot_mask = new_size - 1;
+    int n = atomic_load_explicit(&id_count, memory_order_relaxed);
+    for (int id = 1; id < n; id++) {
+        uint32_t i = id_hash[id] & slot_mask;
+        while (slots[i] != 0) i = (i + 1) & slot_mask;
+        slots[i] = id;
+    }
+}
+
+/* Returns the slot holding s, or the empty slot where it would go */
+static uint32_t probe(const char *s, size_t len, uint32_t h) {
+    uint32_t i = h & slot_mask;
+    while (slots[i] != 0) {
+        int id = slots[i];
+        if (id_hash[id] == h && id_len[id] == len &&
+            memcmp(ID_STR(id), s, len) == 0) {
+            return i;
+        }
+        i = (i + 1) & slot_mask;
+    }
+    return i;
+}
+
+int intern_n(const char *s, size_t len) {
+    pthread_mutex_lock(&intern_lock);
+    if (slots == NULL) rehash(256);
+
+    uint32_t h = intern_hash(s, len);
+    uint32_t i = probe(s, len, h);
+    if (slots[i] != 0) {
+        int found = slots[i];
+        pthread_mutex_unlock(&intern_lock);
+        return found;
+    }
+
+    int id = atomic_load_explicit(&id_count, memory_order_relaxed);
+    if (id >= INTERN_PAGE_SIZE * INTERN_MAX_PAGES) {
+        fprintf(stderr, "intern: too many identifiers\n");
+        exit(1);
+    }
+    if (id >= id_capacity) {
+        id_capacity = id_capacity ? id_capacity * 2 : 256;
+        id_len = (uint32_t *)intern_alloc(id_len, id_capacity * sizeof(uint32_t));
+        id_hash = (uint32_t *)intern_alloc(id_hash, id_capacity * sizeof(uint32_t));
+    }
+    const char ***page = &id_pages[id >> INTERN_PAGE_BITS];
+    if (*page == NULL) {
+        *page = (const char **)intern_alloc(NULL, INTERN_PAGE_SIZE * sizeof(char *));
+    }
+    ID_STR(id) = pool_copy(s, len);
+    id_len[id] = (uint32_t)len;
+    id_hash[id] = h;
+    slots[i] = id;
+    atomic_store_explicit(&id_count, id + 1, memory_order_release);
+
+    /* Keep load factor under 1/2 */
+    if ((uint32_t)(id + 1) * 2 > slot_mask + 1) rehash((slot_mask + 1) * 2);
+    pthread_mutex_unlock(&intern_lock);
+    return id;
+}
+
+int intern(const char *s) {
+    return intern_n(s, strlen(s));
+}
+
+int intern_find(const char *s) {
+    if (s == NULL) return INTERN_NONE;
+    size_t len = strlen(s);
+    pthread_mutex_lock(&intern_lock);
+    int id = slots == NULL ? INTERN_NONE : slots[probe(s, len, intern_hash(s, len))];
+    pthread_mutex_unlock(&intern_lock);
+    return id;
+}
+
+const char *intern_str(int id) {
+    if (id <= INTERN_NONE || id >= atomic_load_explicit(&id_count, memory_order_acquire)) {
+        return NULL;
+    }
+    return ID_STR(id);
+}
+
+int intern_count(void) {
+    return atomic_load(&id_count) - 1;
+}
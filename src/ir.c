@@ -3,25 +3,137 @@
  *
  * Implements AST construction and constant folding optimization.
  * Phase 1 (MVP): Uses int values for correctness.
+ *
+ * Nodes come from malloc by default, or from an IRArena bump allocator
+ * when one is active, so a whole compilation's AST is freed in one call.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "../include/ir.h"
+#include "../include/intern.h"
+
+/* === Arena allocator === */
+
+struct IRArenaChunk
+{
+    struct IRArenaChunk *next;
+    size_t size; /* Payload capacity */
+    size_t used; /* Payload bytes handed out */
+    /* payload follows (8-byte aligned) */
+};
+
+#define IR_ARENA_ALIGN 8
+#define IR_CHUNK_HDR ((sizeof(IRArenaChunk) + IR_ARENA_ALIGN - 1) & ~(size_t)(IR_ARENA_ALIGN - 1))
+
+static _Thread_local IRArena *active_arena = NULL;  /* Per thread */
+
+void ir_arena_init(IRArena *arena, size_t chunk_size)
+{
+    arena->chunks = NULL;
+    arena->chunk_size = chunk_size ? chunk_size : IR_ARENA_CHUNK_SIZE;
+    arena->bytes_used = 0;
+    arena->chunk_count = 0;
+}
+
+void *ir_arena_alloc(IRArena *arena, size_t size)
+{
+    size = (size + IR_ARENA_ALIGN - 1) & ~(size_t)(IR_ARENA_ALIGN - 1);
+    IRArenaChunk *c = arena->chunks;
+    if (c == NULL || c->size - c->used < size)
+    {
+        /* Oversized requests get a dedicated chunk */
+        size_t payload = size > arena->chunk_size ? size : arena->chunk_size;
+        c = (IRArenaChunk *)malloc(IR_CHUNK_HDR + payload);
+        if (c == NULL)
+        {
+            fprintf(stderr, "ir: arena malloc failed\n");
+            exit(1);
+        }
+        c->size = payload;
+        c->used = 0;
+        c->next = arena->chunks;
+        arena->chunks = c;
+        arena->chunk_count++;
+    }
+    void *p = (char *)c + IR_CHUNK_HDR + c->used;
+    c->used += size;
+    arena->bytes_used += size;
+    return p;
+}
+
+IRArena *ir_arena_activate(IRArena *arena)
+{
+    IRArena *prev = active_arena;
+    active_arena = arena;
+    return prev;
+}
+
+IRArena *ir_arena_current(void)
+{
+    return active_arena;
+}
+
+void ir_arena_release(IRArena *arena)
+{
+    IRArenaChunk *c = arena->chunks;
+    while (c != NULL)
+    {
+        IRArenaChunk *next = c->next;
+        free(c);
+        c = next;
+    }
+    arena->chunks = NULL;
+    arena->bytes_used = 0;
+    arena->chunk_count = 0;
+}
+
+void ir_arena_reset(IRArena *arena)
+{
+    /* Keep the oldest standard-sized chunk, free the rest */
+    IRArenaChunk *keep = NULL;
+    IRArenaChunk *c = arena->chunks;
+    while (c != NULL)
+    {
+        IRArenaChunk *next = c->next;
+        if (next == NULL && c->size == arena->chunk_size)
+            keep = c;
+        else
+            free(c);
+        c = next;
+    }
+    if (keep != NULL)
+    {
+        keep->used = 0;
+        keep->next = NULL;
+    }
+    arena->chunks = keep;
+    arena->bytes_used = 0;
+    arena->chunk_count = keep ? 1 : 0;
+}
 
 /* Helper: allocate and zero-init an Expr node */
 static Expr *alloc_expr(void)
 {
-    Expr *e = (Expr *)malloc(sizeof(Expr));
-    if (e == NULL)
+    Expr *e;
+    if (active_arena != NULL)
     {
-        fprintf(stderr, "ir: malloc failed\n");
-        exit(1);
+        e = (Expr *)ir_arena_alloc(active_arena, sizeof(Expr));
+    }
+    else
+    {
+        e = (Expr *)malloc(sizeof(Expr));
+        if (e == NULL)
+        {
+            fprintf(stderr, "ir: malloc failed\n");
+            exit(1);
+        }
     }
     e->type = NODE_CONST;
     e->val = 0;
     e->name = NULL;
+    e->name_id = INTERN_NONE;
     e->op = OP_IR_ADD;
     e->left = NULL;
     e->right = NULL;
@@ -32,9 +144,61 @@ static Expr *alloc_expr(void)
     e->else_body = NULL;
     e->increment = NULL;
     e->array_size = 0;
+    e->in_arena = (active_arena != NULL);
     return e;
 }
 
+/* Helper: point the node at the interned copy of name (no per-node copy) */
+static void node_set_name(Expr *e, const char *name)
+{
+    e->name_id = name ? intern(name) : INTERN_NONE;
+    e->name = intern_str(e->name_id);
+}
+
+/* Helper: adopt a caller-malloc'd child list. Arena nodes copy it into the
+ * arena (with power-of-two headroom for appends) and free the original. */
+static Expr **node_take_list(const Expr *e, Expr **list, int count)
+{
+    if (!e->in_arena || list == NULL)
+        return list;
+    int cap = 1;
+    while (cap < count)
+        cap *= 2;
+    Expr **copy = (Expr **)ir_arena_alloc(active_arena, (size_t)cap * sizeof(Expr *));
+    memcpy(copy, list, (size_t)count * sizeof(Expr *));
+    free(list);
+    return copy;
+}
+
+/* Helper: append to a node's child list (program funcs / block stmts) */
+static void node_list_append(Expr *e, Expr *child)
+{
+    int n = e->param_count;
+    if (e->in_arena)
+    {
+        /* Capacity is the next power of two >= n; grow when n hits it */
+        if (n == 0 || (n & (n - 1)) == 0)
+        {
+            int cap = n ? n * 2 : 4;
+            Expr **grown = (Expr **)ir_arena_alloc(active_arena, (size_t)cap * sizeof(Expr *));
+            if (n > 0)
+                memcpy(grown, e->params, (size_t)n * sizeof(Expr *));
+            e->params = grown;
+        }
+    }
+    else
+    {
+        e->params = (Expr **)realloc(e->params, (n + 1) * sizeof(Expr *));
+        if (e->params == NULL)
+        {
+            fprintf(stderr, "ir: realloc failed\n");
+            exit(1);
+        }
+    }
+    e->params[n] = child;
+    e->param_count = n + 1;
+}
+
 Expr *create_const(int val)
 {
     Expr *e = alloc_expr();
@@ -47,7 +211,7 @@ Expr *create_var(const char *name)
 {
     Expr *e = alloc_expr();
     e->type = NODE_VAR;
-    e->name = strdup(name);
+    node_set_name(e, name);
     return e;
 }
 
@@ -235,7 +399,8 @@ void optimize(Expr *e)
 
 void expr_free(Expr *e)
 {
-    if (e == NULL)
+    /* Arena nodes are reclaimed in bulk by ir_arena_release() */
+    if (e == NULL || e->in_arena)
         return;
     if (e->left != NULL)
         expr_free(e->left);
@@ -257,8 +422,6 @@ void expr_free(Expr *e)
         }
         free(e->params);
     }
-    if (e->name != NULL)
-        free(e->name);
     free(e);
 }
 
@@ -266,9 +429,9 @@ Expr *create_func_def(const char *name, Expr **params, int param_count, Expr *bo
 {
     Expr *e = alloc_expr();
     e->type = NODE_FUNC_DEF;
-    e->name = strdup(name);
+    node_set_name(e, name);
     e->body = body;
-    e->params = params;
+    e->params = node_take_list(e, params, param_count);
     e->param_count = param_count;
     return e;
 }
@@ -277,8 +440,8 @@ Expr *create_func_call(const char *name, Expr **args, int arg_count)
 {
     Expr *e = alloc_expr();
     e->type = NODE_FUNC_CALL;
-    e->name = strdup(name);
-    e->params = args;
+    node_set_name(e, name);
+    e->params = node_take_list(e, args, arg_count);
     e->param_count = arg_count;
     return e;
 }
@@ -300,14 +463,7 @@ Expr *create_program(void)
 
 void program_add_func(Expr *prog, Expr *func)
 {
-    prog->param_count++;
-    prog->params = (Expr **)realloc(prog->params, prog->param_count * sizeof(Expr *));
-    if (prog->params == NULL)
-    {
-        fprintf(stderr, "ir: realloc failed\n");
-        exit(1);
-    }
-    prog->params[prog->param_count - 1] = func;
+    node_list_append(prog, func);
 }
 
 Expr *create_deref(Expr *expr)
@@ -339,7 +495,7 @@ Expr *create_var_decl(const char *name, Expr *init)
 {
     Expr *e = alloc_expr();
     e->type = NODE_VAR_DECL;
-    e->name = strdup(name);
+    node_set_name(e, name);
     e->left = init;
     return e;
 }
@@ -385,14 +541,7 @@ Expr *create_block(void)
 
 void block_add_stmt(Expr *block, Expr *stmt)
 {
-    block->param_count++;
-    block->params = (Expr **)realloc(block->params, block->param_count * sizeof(Expr *));
-    if (block->params == NULL)
-    {
-        fprintf(stderr, "ir: realloc failed\n");
-        exit(1);
-    }
-    block->params[block->param_count - 1] = stmt;
+    node_list_append(block, stmt);
 }
 
 /* === Phase 3: Array constructors === */
@@ -401,9 +550,9 @@ Expr *create_array_decl(const char *name, int size, Expr **init_values, int init
 {
     Expr *e = alloc_expr();
     e->type = NODE_ARRAY_DECL;
-    e->name = strdup(name);
+    node_set_name(e, name);
     e->array_size = size;
-    e->params = init_values;
+    e->params = node_take_list(e, init_values, init_count);
     e->param_count = init_count;
     return e;
 }
@@ -412,7 +561,7 @@ Expr *create_array_access(const char *name, Expr *index)
 {
     Expr *e = alloc_expr();
     e->type = NODE_ARRAY_ACCESS;
-    e->name = strdup(name);
+    node_set_name(e, name);
     e->left = index;
     return e;
 }
@@ -421,7 +570,7 @@ Expr *create_array_assign(const char *name, Expr *index, Expr *value)
 {
     Expr *e = alloc_expr();
     e->type = NODE_ARRAY_ASSIGN;
-    e->name = strdup(name);
+    node_set_name(e, name);
     e->left = index;
     e->right = value;
     return e;
@@ -432,7 +581,7 @@ Expr *create_trit_var_decl(const char *name, Expr *init)
 {
     Expr *e = alloc_expr();
     e->type = NODE_TRIT_VAR_DECL;
-    e->name = strdup(name);
+    node_set_name(e, name);
     e->left = init;
     return e;
 }
@@ -441,9 +590,1067 @@ Expr *create_trit_array_decl(const char *name, int size, Expr **init_values, int
 {
     Expr *e = alloc_expr();
     e->type = NODE_TRIT_ARRAY_DECL;
-    e->name = strdup(name);
+    node_set_name(e, name);
     e->array_size = size;
-    e->params = init_values;
+    e->params = node_take_list(e, init_values, init_count);
     e->param_count = init_count;
     return e;
 }
+
+/* === Inlining === */
+
+/* Callee-local name -> replacement: a fresh name, or (for a parameter
+ * substituted directly) the argument expression to copy */
+typedef struct
+{
+    int from;
+    const char *to;
+    const Expr *arg;
+} InlineRename;
+
+typedef struct
+{
+    Expr *prog;
+    const InlineOptions *opts;
+    Expr *caller;    /* Function being rewritten */
+    int self_id;     /* Declaration whose initializer is being rewritten */
+    int loop_depth;
+    int slots;       /* Slots the program declares so far */
+    int grown;       /* AST nodes the copies have added so far */
+    int serial;      /* Numbers the inlined copies for fresh names */
+    int count;       /* Calls inlined */
+    Expr **pending;  /* Statements to hoist before the current one */
+    int npending;
+    int pending_cap;
+} Inliner;
+
+static void *inline_alloc(void *p, size_t size)
+{
+    p = realloc(p, size);
+    if (p == NULL)
+    {
+        fprintf(stderr, "ir: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void inline_hoist(Inliner *in, Expr *stmt)
+{
+    if (in->npending == in->pending_cap)
+    {
+        in->pending_cap = in->pending_cap ? in->pending_cap * 2 : 16;
+        in->pending = (Expr **)inline_alloc(in->pending, (size_t)in->pending_cap * sizeof(Expr *));
+    }
+    in->pending[in->npending++] = stmt;
+}
+
+/* Visit every child of e, params included */
+#define FOR_EACH_KID(e, k, stmt)                                                     \
+    do                                                                               \
+    {                                                                                \
+        Expr *kids_[6] = {(e)->left, (e)->right, (e)->body,                          \
+                          (e)->condition, (e)->else_body, (e)->increment};           \
+        for (int i_ = 0; i_ < 6; i_++)                                               \
+        {                                                                            \
+            Expr *k = kids_[i_];                                                     \
+            if (k != NULL)                                                           \
+                stmt;                                                                \
+        }                                                                            \
+        for (int i_ = 0; i_ < (e)->param_count; i_++)                                \
+        {                                                                            \
+            Expr *k = (e)->params[i_];                                               \
+            if (k != NULL)                                                           \
+                stmt;                                                                \
+        }                                                                            \
+    } while (0)
+
+/* Size estimate: one VM instruction or so per node */
+static int inline_size(const Expr *e)
+{
+    if (e == NULL)
+        return 0;
+    int n = 1;
+    FOR_EACH_KID(e, k, n += inline_size(k));
+    return n;
+}
+
+static int inline_has_type(const Expr *e, NodeType type)
+{
+    if (e == NULL)
+        return 0;
+    if (e->type == type)
+        return 1;
+    FOR_EACH_KID(e, k, if (inline_has_type(k, type)) return 1);
+    return 0;
+}
+
+static int inline_mentions(const Expr *e, int name_id)
+{
+    if (e == NULL)
+        return 0;
+    if (e->type != NODE_CONST && e->type != NODE_FUNC_CALL && e->name_id == name_id)
+        return 1;
+    FOR_EACH_KID(e, k, if (inline_mentions(k, name_id)) return 1);
+    return 0;
+}
+
+/* Slots the declarations in e take, as the bootstrap symbol table hands them out */
+static int inline_slots(const Expr *e)
+{
+    if (e == NULL)
+        return 0;
+    int n = 0;
+    if (e->type == NODE_VAR_DECL || e->type == NODE_TRIT_VAR_DECL)
+        n = 1;
+    else if (e->type == NODE_ARRAY_DECL || e->type == NODE_TRIT_ARRAY_DECL)
+        n = e->array_size > 1 ? e->array_size : 1;
+    FOR_EACH_KID(e, k, n += inline_slots(k));
+    return n;
+}
+
+/* Reads of name_id in e, counting those inside loops twice */
+static int inline_uses(const Expr *e, int name_id)
+{
+    if (e == NULL)
+        return 0;
+    int n = (e->type == NODE_VAR && e->name_id == name_id);
+    FOR_EACH_KID(e, k, n += inline_uses(k, name_id));
+    if (e->type == NODE_WHILE || e->type == NODE_FOR)
+        n *= 2;
+    return n;
+}
+
+/* 1 if e assigns to or takes the address of name_id */
+static int inline_writes(const Expr *e, int name_id)
+{
+    if (e == NULL)
+        return 0;
+    if ((e->type == NODE_ASSIGN || e->type == NODE_ADDR_OF) &&
+        e->left != NULL && e->left->type == NODE_VAR && e->left->name_id == name_id)
+        return 1;
+    FOR_EACH_KID(e, k, if (inline_writes(k, name_id)) return 1);
+    return 0;
+}
+
+/* Leading NODE_VAR entries of a function's params are its parameters;
+ * the statements before the last follow them */
+static int func_param_count(const Expr *fn)
+{
+    int n = 0;
+    while (n < fn->param_count && fn->params[n]->type == NODE_VAR)
+        n++;
+    return n;
+}
+
+static void inline_collect_locals(const Expr *e, InlineRename **map, int *n)
+{
+    if (e == NULL)
+        return;
+    if (e->type == NODE_VAR_DECL || e->type == NODE_TRIT_VAR_DECL ||
+        e->type == NODE_ARRAY_DECL || e->type == NODE_TRIT_ARRAY_DECL)
+    {
+        int seen = 0;
+        for (int i = 0; i < *n && !seen; i++)
+            seen = (*map)[i].from == e->name_id;
+        if (!seen)
+        {
+            *map = (InlineRename *)inline_alloc(*map, (size_t)(*n + 1) * sizeof(InlineRename));
+            (*map)[*n].from = e->name_id;
+            (*map)[*n].to = NULL;
+            (*map)[*n].arg = NULL;
+            (*n)++;
+        }
+    }
+    FOR_EACH_KID(e, k, inline_collect_locals(k, map, n));
+}
+
+static const InlineRename *inline_lookup(const InlineRename *map, int n, int name_id)
+{
+    for (int i = 0; i < n; i++)
+        if (map[i].from == name_id)
+            return &map[i];
+    return NULL;
+}
+
+/* 1 if every name e refers to is in map and every assignment is to a variable */
+static int inline_closed(const Expr *e, const InlineRename *map, int n)
+{
+    if (e == NULL)
+        return 1;
+    switch (e->type)
+    {
+    case NODE_VAR:
+        if (inline_lookup(map, n, e->name_id) == NULL)
+            return 0;
+        break;
+    case NODE_VAR_DECL:
+    case NODE_TRIT_VAR_DECL:
+    case NODE_ARRAY_DECL:
+    case NODE_TRIT_ARRAY_DECL:
+    case NODE_ARRAY_ACCESS:
+    case NODE_ARRAY_ASSIGN:
+    {
+        /* Names other than plain reads must stay names */
+        const InlineRename *r = inline_lookup(map, n, e->name_id);
+        if (r == NULL || r->arg != NULL)
+            return 0;
+        break;
+    }
+    case NODE_ASSIGN:
+        if (e->left == NULL || e->left->type != NODE_VAR)
+            return 0;
+        break;
+    default:
+        break;
+    }
+    FOR_EACH_KID(e, k, if (!inline_closed(k, map, n)) return 0);
+    return 1;
+}
+
+/* Deep copy of e with names renamed through map (map may be NULL) */
+static Expr *inline_clone(const Expr *e, const InlineRename *map, int n)
+{
+    if (e == NULL)
+        return NULL;
+    const InlineRename *r = e->type == NODE_FUNC_CALL ? NULL : inline_lookup(map, n, e->name_id);
+    if (r != NULL && r->arg != NULL && e->type == NODE_VAR)
+        return inline_clone(r->arg, NULL, 0);
+
+    Expr *c = alloc_expr();
+    c->type = e->type;
+    c->val = e->val;
+    c->op = e->op;
+    c->array_size = e->array_size;
+    if (r != NULL && r->to != NULL)
+        node_set_name(c, r->to);
+    else
+    {
+        c->name = e->name;
+        c->name_id = e->name_id;
+    }
+    c->left = inline_clone(e->left, map, n);
+    c->right = inline_clone(e->right, map, n);
+    c->body = inline_clone(e->body, map, n);
+    c->condition = inline_clone(e->condition, map, n);
+    c->else_body = inline_clone(e->else_body, map, n);
+    c->increment = inline_clone(e->increment, map, n);
+    if (e->param_count > 0)
+    {
+        Expr **list = (Expr **)inline_alloc(NULL, (size_t)e->param_count * sizeof(Expr *));
+        for (int i = 0; i < e->param_count; i++)
+            list[i] = inline_clone(e->params[i], map, n);
+        c->params = node_take_list(c, list, e->param_count);
+        c->param_count = e->param_count;
+    }
+    return c;
+}
+
+/* The unique definition of name_id in the program, or NULL */
+static Expr *inline_find_func(const Inliner *in, int name_id)
+{
+    Expr *found = NULL;
+    for (int i = 0; i < in->prog->param_count; i++)
+    {
+        Expr *fn = in->prog->params[i];
+        if (fn != NULL && fn->type == NODE_FUNC_DEF && fn->name_id == name_id)
+        {
+            if (found != NULL)
+                return NULL;
+            found = fn;
+        }
+    }
+    return found;
+}
+
+static int inline_is_hot(const Inliner *in, int name_id)
+{
+    if (in->loop_depth > 0)
+        return 1;
+    for (int i = 0; i < in->opts->profile_count; i++)
+        if (in->opts->profile[i].name_id == name_id)
+            return in->opts->profile[i].calls >= in->opts->hot_calls;
+    return 0;
+}
+
+/*
+ * Replace call by an inlined copy of its callee if the cost model allows:
+ * the callee's statements and any parameters that need a variable are
+ * hoisted, and the copy of its return expression is returned. Returns
+ * NULL (call untouched) if the call is not inlined.
+ */
+static Expr *inline_call(Inliner *in, Expr *call, int can_hoist)
+{
+    Expr *g = inline_find_func(in, call->name_id);
+    if (g == NULL || g == in->caller || g->body == NULL ||
+        g->body->type != NODE_RETURN || g->body->left == NULL)
+        return NULL;
+    int np = func_param_count(g);
+    int nstmts = g->param_count - np;
+    if (call->param_count != np)
+        return NULL;
+    for (int i = np; i < g->param_count; i++)
+    {
+        if (inline_has_type(g->params[i], NODE_RETURN) ||
+            inline_has_type(g->params[i], NODE_FUNC_CALL))
+            return NULL;
+    }
+    if (inline_has_type(g->body, NODE_FUNC_CALL))
+        return NULL;
+    if (nstmts > 0 && !can_hoist)
+        return NULL;
+
+    /* Cost: the callee's size less the call it replaces */
+    int size = inline_size(g->body->left);
+    for (int i = np; i < g->param_count; i++)
+        size += inline_size(g->params[i]);
+    int limit = inline_is_hot(in, g->name_id) ? in->opts->hot_cost : in->opts->max_cost;
+    if (size - (1 + np) > limit)
+        return NULL;
+
+    InlineRename *map = (InlineRename *)inline_alloc(NULL, (size_t)(np > 0 ? np : 1) * sizeof(InlineRename));
+    int n = np;
+    int materialized = 0;
+    /* Nodes the program grows by: the copy less the call, with each
+     * substituted parameter use becoming a copy of its argument and each
+     * other argument moving into a declaration */
+    int grown = size - 1;
+    for (int i = 0; i < np; i++)
+    {
+        const Expr *arg = call->params[i];
+        int uses = 0;
+        int written = 0;
+        for (int s = np; s < g->param_count; s++)
+        {
+            uses += inline_uses(g->params[s], g->params[i]->name_id);
+            written |= inline_writes(g->params[s], g->params[i]->name_id);
+        }
+        uses += inline_uses(g->body, g->params[i]->name_id);
+        map[i].from = g->params[i]->name_id;
+        map[i].to = NULL;
+        map[i].arg = NULL;
+        if (!written && !inline_has_type(arg, NODE_FUNC_CALL) &&
+            (arg->type == NODE_CONST || arg->type == NODE_VAR || uses <= 1))
+        {
+            map[i].arg = arg;
+            grown += uses * (inline_size(arg) - 1) - inline_size(arg);
+        }
+        else
+        {
+            materialized++;
+            grown++;
+        }
+    }
+    for (int i = np; i < g->param_count; i++)
+        inline_collect_locals(g->params[i], &map, &n);
+
+    int added = materialized;
+    for (int i = np; i < g->param_count; i++)
+        added += inline_slots(g->params[i]);
+    int ok = inline_closed(g->body, map, n);
+    for (int i = np; i < g->param_count && ok; i++)
+        ok = inline_closed(g->params[i], map, n);
+    if (materialized > 0 && !can_hoist)
+        ok = 0;
+    if (in->opts->slot_budget >= 0 && in->slots + added > in->opts->slot_budget)
+        ok = 0;
+    if (in->opts->size_budget >= 0 && in->grown + grown > in->opts->size_budget)
+        ok = 0;
+    /* int x = f(x): hoisting would move the read of x before x exists */
+    if (ok && (materialized > 0 || nstmts > 0) && in->self_id != INTERN_NONE)
+    {
+        for (int i = 0; i < np && ok; i++)
+            ok = !inline_mentions(call->params[i], in->self_id);
+    }
+    if (!ok)
+    {
+        free(map);
+        return NULL;
+    }
+
+    /* Fresh names (callee$serial$name) cannot clash with source names */
+    int serial = ++in->serial;
+    char fresh[160];
+    for (int i = 0; i < n; i++)
+    {
+        if (map[i].arg != NULL)
+            continue;
+        snprintf(fresh, sizeof(fresh), "%s$%d$%s", g->name, serial, intern_str(map[i].from));
+        map[i].to = intern_str(intern(fresh));
+    }
+    for (int i = 0; i < np; i++)
+    {
+        if (map[i].arg == NULL)
+        {
+            inline_hoist(in, create_var_decl(map[i].to, call->params[i]));
+            call->params[i] = NULL;
+        }
+    }
+    for (int i = np; i < g->param_count; i++)
+        inline_hoist(in, inline_clone(g->params[i], map, n));
+    Expr *result = inline_clone(g->body->left, map, n);
+    free(map);
+    expr_free(call);
+
+    in->slots += added;
+    in->grown += grown;
+    in->count++;
+    return result;
+}
+
+/*
+ * Inline calls in e bottom-up, in evaluation order. can_hoist says
+ * whether code may be placed before the enclosing statement; once a call
+ * stays, nothing after it may move ahead of it.
+ */
+static Expr *inline_expr(Inliner *in, Expr *e, int *can_hoist)
+{
+    if (e == NULL)
+        return NULL;
+    switch (e->type)
+    {
+    case NODE_CONST:
+    case NODE_VAR:
+        return e;
+    case NODE_FUNC_CALL:
+    {
+        for (int i = 0; i < e->param_count; i++)
+            e->params[i] = inline_expr(in, e->params[i], can_hoist);
+        Expr *r = inline_call(in, e, *can_hoist);
+        if (r == NULL)
+        {
+            *can_hoist = 0;
+            return e;
+        }
+        return r;
+    }
+    default:
+        e->left = inline_expr(in, e->left, can_hoist);
+        e->right = inline_expr(in, e->right, can_hoist);
+        return e;
+    }
+}
+
+static void inline_list(Inliner *in, Expr *owner, int first);
+static Expr *inline_stmt(Inliner *in, Expr *s);
+
+/* Inline calls in the body of an if or loop; code hoisted out of a
+ * body that is not a block gets a block made for it */
+static Expr *inline_body(Inliner *in, Expr *body)
+{
+    if (body == NULL || body->type == NODE_BLOCK)
+    {
+        inline_stmt(in, body);
+        return body;
+    }
+    int base = in->npending;
+    Expr *s = inline_stmt(in, body);
+    if (in->npending == base)
+        return s;
+    Expr *block = create_block();
+    for (int i = base; i < in->npending; i++)
+        block_add_stmt(block, in->pending[i]);
+    block_add_stmt(block, s);
+    in->npending = base;
+    return block;
+}
+
+/* Inline calls in one statement, hoisting code to in->pending; returns
+ * the statement, or what replaced it */
+static Expr *inline_stmt(Inliner *in, Expr *s)
+{
+    if (s == NULL)
+        return NULL;
+    int hoist = 1;
+    int never = 0;
+    switch (s->type)
+    {
+    case NODE_VAR_DECL:
+    case NODE_TRIT_VAR_DECL:
+        in->self_id = s->name_id;
+        s->left = inline_expr(in, s->left, &hoist);
+        in->self_id = INTERN_NONE;
+        break;
+    case NODE_ARRAY_DECL:
+    case NODE_TRIT_ARRAY_DECL:
+        in->self_id = s->name_id;
+        for (int i = 0; i < s->param_count; i++)
+            s->params[i] = inline_expr(in, s->params[i], &hoist);
+        in->self_id = INTERN_NONE;
+        break;
+    case NODE_ASSIGN:
+        s->right = inline_expr(in, s->right, &hoist);
+        break;
+    case NODE_ARRAY_ASSIGN:
+    case NODE_RETURN:
+        s->left = inline_expr(in, s->left, &hoist);
+        s->right = inline_expr(in, s->right, &hoist);
+        break;
+    case NODE_IF:
+        s->condition = inline_expr(in, s->condition, &hoist);
+        s->body = inline_body(in, s->body);
+        s->else_body = inline_body(in, s->else_body);
+        break;
+    case NODE_WHILE:
+        in->loop_depth++;
+        s->condition = inline_expr(in, s->condition, &never);
+        s->body = inline_body(in, s->body);
+        in->loop_depth--;
+        break;
+    case NODE_FOR:
+        /* The init runs once before the loop, so it may hoist */
+        s->left = inline_stmt(in, s->left);
+        in->loop_depth++;
+        s->condition = inline_expr(in, s->condition, &never);
+        if (s->increment != NULL && s->increment->type == NODE_ASSIGN)
+            s->increment->right = inline_expr(in, s->increment->right, &never);
+        else
+            s->increment = inline_expr(in, s->increment, &never);
+        s->body = inline_body(in, s->body);
+        in->loop_depth--;
+        break;
+    case NODE_BLOCK:
+        inline_list(in, s, 0);
+        break;
+    default:
+        return inline_expr(in, s, &hoist);
+    }
+    return s;
+}
+
+/* Inline calls in the statements of a block, or of a function (from
+ * params[first] on, then its body), placing hoisted code in order */
+static void inline_list(Inliner *in, Expr *owner, int first)
+{
+    int base = in->npending;
+    int count = owner->param_count;
+    int n = 0;
+    int cap = count + 4;
+    int grew = 0;
+    Expr **list = (Expr **)inline_alloc(NULL, (size_t)cap * sizeof(Expr *));
+    for (int i = 0; i <= count; i++)
+    {
+        Expr *s;
+        if (i < first)
+            s = owner->params[i];
+        else if (i < count)
+            s = inline_stmt(in, owner->params[i]);
+        else if (owner->type == NODE_FUNC_DEF)
+            s = owner->body = inline_stmt(in, owner->body);
+        else
+            s = NULL;
+        int hoisted = in->npending - base;
+        if (n + hoisted + 1 > cap)
+        {
+            cap = 2 * (n + hoisted + 1);
+            list = (Expr **)inline_alloc(list, (size_t)cap * sizeof(Expr *));
+        }
+        for (int k = base; k < in->npending; k++)
+            list[n++] = in->pending[k];
+        in->npending = base;
+        grew |= hoisted > 0;
+        /* A function's body is kept apart as its last statement */
+        if (i < count)
+            list[n++] = s;
+    }
+    if (!grew)
+    {
+        free(list);
+        return;
+    }
+    Expr **old = owner->params;
+    owner->params = node_take_list(owner, list, n);
+    owner->param_count = n;
+    if (!owner->in_arena)
+        free(old);
+}
+
+void inline_options_default(InlineOptions *opts)
+{
+    opts->max_cost = 16;
+    opts->hot_cost = 48;
+    opts->hot_calls = 100;
+    opts->slot_budget = -1;
+    opts->size_budget = -1;
+    opts->profile = NULL;
+    opts->profile_count = 0;
+}
+
+int inline_calls(Expr *prog, const InlineOptions *opts)
+{
+    if (prog == NULL || prog->type != NODE_PROGRAM)
+        return 0;
+    InlineOptions defaults;
+    if (opts == NULL)
+    {
+        inline_options_default(&defaults);
+        opts = &defaults;
+    }
+    Inliner in;
+    memset(&in, 0, sizeof(in));
+    in.prog = prog;
+    in.opts = opts;
+    in.self_id = INTERN_NONE;
+    in.slots = inline_slots(prog);
+
+    /* Only call-free callees are inlined, so each success removes a call;
+     * repeat until callers that became call-free have been used too */
+    int before;
+    do
+    {
+        before = in.count;
+        for (int i = 0; i < prog->param_count; i++)
+        {
+            Expr *fn = prog->params[i];
+            if (fn == NULL || fn->type != NODE_FUNC_DEF)
+                continue;
+            in.caller = fn;
+            inline_list(&in, fn, func_param_count(fn));
+        }
+    } while (in.count != before);
+    free(in.pending);
+    return in.count;
+}
+
+/* === Common subexpression elimination === */
+
+#define CSE_BUCKETS 64
+
+/* A value evaluated in the current run of statements. Its occurrences
+ * are chained through CseOcc.next in evaluation order. */
+typedef struct
+{
+    unsigned hash;
+    int cost;  /* VM instructions one evaluation takes */
+    int count; /* Occurrences */
+    int first;
+    int last;
+    int live;  /* 0 once a write may have changed it */
+    int chain; /* Next entry in the same bucket, or -1 */
+} CseEntry;
+
+typedef struct
+{
+    Expr **ref; /* Where the occurrence hangs */
+    int stmt;   /* Statement it is evaluated in */
+    int next;
+} CseOcc;
+
+typedef struct
+{
+    CseEntry *entries;
+    int nentries;
+    int entry_cap;
+    CseOcc *occs;
+    int nocc;
+    int occ_cap;
+    int heads[CSE_BUCKETS];
+    int self_id;     /* Declaration whose initializer is being scanned */
+    int slots;       /* Slots the program declares so far */
+    int slot_budget;
+    int serial;      /* Numbers the temps for fresh names */
+    int count;       /* Occurrences replaced */
+    int ops;         /* VM instructions saved */
+} Cse;
+
+static int cse_commutes(OpType op)
+{
+    return op == OP_IR_ADD || op == OP_IR_MUL || op == OP_IR_CMP_EQ;
+}
+
+/* Structural equality, up to the order of commutative operands */
+static int cse_equal(const Expr *a, const Expr *b)
+{
+    if (a == NULL || b == NULL)
+        return a == b;
+    if (a->type != b->type)
+        return 0;
+    switch (a->type)
+    {
+    case NODE_CONST:
+        return a->val == b->val;
+    case NODE_VAR:
+        return a->name_id == b->name_id;
+    case NODE_ADDR_OF:
+        return a->left->name_id == b->left->name_id;
+    case NODE_DEREF:
+        return cse_equal(a->left, b->left);
+    case NODE_ARRAY_ACCESS:
+        return a->name_id == b->name_id && cse_equal(a->left, b->left);
+    case NODE_BINOP:
+        if (a->op != b->op)
+            return 0;
+        if (cse_equal(a->left, b->left) && cse_equal(a->right, b->right))
+            return 1;
+        return cse_commutes(a->op) && cse_equal(a->left, b->right) && cse_equal(a->right, b->left);
+    default:
+        return 0;
+    }
+}
+
+static void cse_record(Cse *c, Expr **ref, int stmt, unsigned hash, int cost)
+{
+    int *head = &c->heads[hash % CSE_BUCKETS];
+    int e = *head;
+    while (e >= 0 && !(c->entries[e].live && c->entries[e].hash == hash &&
+                       cse_equal(*c->occs[c->entries[e].first].ref, *ref)))
+        e = c->entries[e].chain;
+    if (e < 0)
+    {
+        if (c->nentries == c->entry_cap)
+        {
+            c->entry_cap = c->entry_cap ? c->entry_cap * 2 : 32;
+            c->entries = (CseEntry *)inline_alloc(c->entries, (size_t)c->entry_cap * sizeof(CseEntry));
+        }
+        e = c->nentries++;
+        c->entries[e].hash = hash;
+        c->entries[e].cost = cost;
+        c->entries[e].count = 0;
+        c->entries[e].first = -1;
+        c->entries[e].live = 1;
+        c->entries[e].chain = *head;
+        *head = e;
+    }
+    if (c->nocc == c->occ_cap)
+    {
+        c->occ_cap = c->occ_cap ? c->occ_cap * 2 : 64;
+        c->occs = (CseOcc *)inline_alloc(c->occs, (size_t)c->occ_cap * sizeof(CseOcc));
+    }
+    int o = c->nocc++;
+    c->occs[o].ref = ref;
+    c->occs[o].stmt = stmt;
+    c->occs[o].next = -1;
+    CseEntry *en = &c->entries[e];
+    if (en->first < 0)
+        en->first = o;
+    else
+        c->occs[en->last].next = o;
+    en->last = o;
+    en->count++;
+}
+
+/*
+ * Hash-cons the pure subexpressions of *ref bottom-up, recording each
+ * operation and load as an occurrence. Returns 0 if *ref is not pure
+ * (calls, assignments, DIV/MOD, which have no opcode); *hash and *cost
+ * are then undefined.
+ */
+static int cse_scan(Cse *c, Expr **ref, int stmt, unsigned *hash, int *cost)
+{
+    Expr *e = *ref;
+    unsigned hl = 0, hr = 0;
+    int cl = 0, cr = 0;
+    int pure = 1;
+    switch (e->type)
+    {
+    case NODE_CONST:
+        *hash = 0x9e3779b9u ^ (unsigned)e->val;
+        *cost = 1;
+        return 1;
+    case NODE_VAR:
+        *hash = 0x85ebca6bu ^ (unsigned)e->name_id * 2654435761u;
+        *cost = 2;
+        return 1;
+    case NODE_ADDR_OF:
+        if (e->left == NULL || e->left->type != NODE_VAR)
+            return 0;
+        *hash = 0xc2b2ae35u ^ (unsigned)e->left->name_id * 2654435761u;
+        *cost = 1;
+        return 1;
+    case NODE_DEREF:
+    case NODE_ARRAY_ACCESS:
+        if (e->left == NULL || !cse_scan(c, &e->left, stmt, &hl, &cl))
+            return 0;
+        *hash = hl * 31u + (e->type == NODE_DEREF ? 0x27d4eb2fu : (unsigned)e->name_id * 2246822519u);
+        *cost = cl + (e->type == NODE_DEREF ? 1 : 3);
+        break;
+    case NODE_BINOP:
+        if (e->op == OP_IR_DIV || e->op == OP_IR_MOD || e->left == NULL)
+            return 0;
+        pure = cse_scan(c, &e->left, stmt, &hl, &cl);
+        if (e->right != NULL)
+            pure &= cse_scan(c, &e->right, stmt, &hr, &cr);
+        if (!pure)
+            return 0;
+        *hash = (cse_commutes(e->op) ? hl + hr : hl * 31u + hr) * 16777619u ^ (unsigned)e->op;
+        *cost = cl + cr + 1;
+        break;
+    default:
+        return 0;
+    }
+    /* int x = ...x...: a temp before the declaration would read another x */
+    if (c->self_id == INTERN_NONE || !inline_mentions(e, c->self_id))
+        cse_record(c, ref, stmt, *hash, *cost);
+    return 1;
+}
+
+/* Retire the values a write to name_id may have changed: those naming
+ * it, and those reading through a pointer, which may point into it */
+static void cse_kill(Cse *c, int name_id)
+{
+    for (int i = 0; i < c->nentries; i++)
+    {
+        CseEntry *en = &c->entries[i];
+        const Expr *e = *c->occs[en->first].ref;
+        if (!en->live)
+            continue;
+        if (inline_mentions(e, name_id) || inline_has_type(e, NODE_DEREF))
+            en->live = 0;
+    }
+}
+
+static void cse_kill_all(Cse *c)
+{
+    for (int i = 0; i < c->nentries; i++)
+        c->entries[i].live = 0;
+}
+
+static int cse_impure(const Expr *e)
+{
+    return inline_has_type(e, NODE_FUNC_CALL) || inline_has_type(e, NODE_ASSIGN) ||
+           inline_has_type(e, NODE_ARRAY_ASSIGN);
+}
+
+static void cse_scan_root(Cse *c, Expr **ref, int stmt)
+{
+    unsigned hash;
+    int cost;
+    if (*ref != NULL)
+        cse_scan(c, ref, stmt, &hash, &cost);
+}
+
+/*
+ * Record the values statement i of a run evaluates, then retire those
+ * its write may change. Nothing is shared across calls or control flow;
+ * an if's condition is evaluated before it, so it still takes part.
+ * Array stores are taken to stay within their array.
+ */
+static void cse_scan_stmt(Cse *c, Expr **stmts, int i)
+{
+    Expr *s = stmts[i];
+    if (s == NULL)
+        return;
+    switch (s->type)
+    {
+    case NODE_VAR_DECL:
+    case NODE_TRIT_VAR_DECL:
+        if (s->left != NULL && cse_impure(s->left))
+            break;
+        c->self_id = s->name_id;
+        cse_scan_root(c, &s->left, i);
+        c->self_id = INTERN_NONE;
+        cse_kill(c, s->name_id);
+        return;
+    case NODE_ASSIGN:
+        if (s->left == NULL || s->left->type != NODE_VAR || cse_impure(s->right))
+            break;
+        cse_scan_root(c, &s->right, i);
+        cse_kill(c, s->left->name_id);
+        return;
+    case NODE_ARRAY_ASSIGN:
+        if (cse_impure(s->left) || cse_impure(s->right))
+            break;
+        cse_scan_root(c, &s->left, i);
+        cse_scan_root(c, &s->right, i);
+        /* Reading the array's name reads its first element */
+        cse_kill(c, s->name_id);
+        return;
+    case NODE_RETURN:
+        if (!cse_impure(s->left))
+            cse_scan_root(c, &s->left, i);
+        break;
+    case NODE_IF:
+        if (!cse_impure(s->condition))
+            cse_scan_root(c, &s->condition, i);
+        break;
+    case NODE_CONST:
+    case NODE_VAR:
+    case NODE_BINOP:
+    case NODE_DEREF:
+    case NODE_ADDR_OF:
+    case NODE_ARRAY_ACCESS:
+        if (!cse_impure(s))
+        {
+            cse_scan_root(c, &stmts[i], i);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+    cse_kill_all(c);
+}
+
+/* Instructions saved by computing entry e once into a temp: one
+ * declaration (PUSH, STORE) and a PUSH, LOAD per occurrence */
+static int cse_saving(const CseEntry *en)
+{
+    return en->count * en->cost - (en->cost + 2 + 2 * en->count);
+}
+
+/*
+ * Eliminate common subexpressions from a run of statements, one value
+ * at a time, most profitable first, rescanning after each since a temp
+ * changes what its operands' other occurrences share. Returns the
+ * number of temps declared; *list may be reallocated.
+ */
+static int cse_run(Cse *c, Expr ***list, int *n, int *cap)
+{
+    int added = 0;
+    for (;;)
+    {
+        if (c->slot_budget >= 0 && c->slots >= c->slot_budget)
+            break;
+        c->nentries = 0;
+        c->nocc = 0;
+        for (int b = 0; b < CSE_BUCKETS; b++)
+            c->heads[b] = -1;
+        for (int i = 0; i < *n; i++)
+            cse_scan_stmt(c, *list, i);
+        int best = -1;
+        for (int e = 0; e < c->nentries; e++)
+        {
+            if (cse_saving(&c->entries[e]) > 0 &&
+                (best < 0 || cse_saving(&c->entries[e]) > cse_saving(&c->entries[best])))
+                best = e;
+        }
+        if (best < 0)
+            break;
+
+        /* Fresh names (cse$serial) cannot clash with source names */
+        CseEntry *en = &c->entries[best];
+        char fresh[32];
+        snprintf(fresh, sizeof(fresh), "cse$%d", ++c->serial);
+        int at = c->occs[en->first].stmt;
+        Expr *decl = create_var_decl(fresh, *c->occs[en->first].ref);
+        for (int o = en->first; o >= 0; o = c->occs[o].next)
+        {
+            Expr *old = *c->occs[o].ref;
+            *c->occs[o].ref = create_var(fresh);
+            if (o != en->first)
+                expr_free(old);
+        }
+        if (*n == *cap)
+        {
+            *cap *= 2;
+            *list = (Expr **)inline_alloc(*list, (size_t)*cap * sizeof(Expr *));
+        }
+        memmove(*list + at + 1, *list + at, (size_t)(*n - at) * sizeof(Expr *));
+        (*list)[at] = decl;
+        (*n)++;
+        c->count += en->count - 1;
+        c->ops += cse_saving(en);
+        c->slots++;
+        added++;
+    }
+    return added;
+}
+
+static void cse_list(Cse *c, Expr *owner, int first);
+static Expr *cse_body(Cse *c, Expr *body);
+
+/* Eliminate common subexpressions in the statements nested in s */
+static void cse_nested(Cse *c, Expr *s)
+{
+    if (s == NULL)
+        return;
+    switch (s->type)
+    {
+    case NODE_IF:
+        s->body = cse_body(c, s->body);
+        s->else_body = cse_body(c, s->else_body);
+        break;
+    case NODE_WHILE:
+    case NODE_FOR:
+        s->body = cse_body(c, s->body);
+        break;
+    case NODE_BLOCK:
+        cse_list(c, s, 0);
+        break;
+    default:
+        break;
+    }
+}
+
+/* The body of an if or loop; one that is not a block gets a block made
+ * for it if temps are declared */
+static Expr *cse_body(Cse *c, Expr *body)
+{
+    if (body == NULL || body->type == NODE_BLOCK)
+    {
+        cse_nested(c, body);
+        return body;
+    }
+    int n = 1, cap = 4;
+    Expr **list = (Expr **)inline_alloc(NULL, (size_t)cap * sizeof(Expr *));
+    list[0] = body;
+    if (cse_run(c, &list, &n, &cap) > 0)
+    {
+        body = create_block();
+        for (int i = 0; i < n; i++)
+            block_add_stmt(body, list[i]);
+    }
+    for (int i = 0; i < n; i++)
+        cse_nested(c, list[i]);
+    free(list);
+    return body;
+}
+
+/* The statements of a block, or of a function (from params[first] on,
+ * then its body) */
+static void cse_list(Cse *c, Expr *owner, int first)
+{
+    int is_func = owner->type == NODE_FUNC_DEF;
+    int n = owner->param_count - first;
+    int cap = n + 4;
+    Expr **list = (Expr **)inline_alloc(NULL, (size_t)cap * sizeof(Expr *));
+    for (int i = 0; i < n; i++)
+        list[i] = owner->params[first + i];
+    if (is_func)
+        list[n++] = owner->body;
+    int added = cse_run(c, &list, &n, &cap);
+    for (int i = 0; i < n; i++)
+        cse_nested(c, list[i]);
+    if (added == 0)
+    {
+        free(list);
+        return;
+    }
+    /* A function's body is kept apart as its last statement */
+    if (is_func)
+        owner->body = list[--n];
+    Expr **merged = (Expr **)inline_alloc(NULL, (size_t)(first + n > 0 ? first + n : 1) * sizeof(Expr *));
+    for (int i = 0; i < first; i++)
+        merged[i] = owner->params[i];
+    memcpy(merged + first, list, (size_t)n * sizeof(Expr *));
+    free(list);
+    Expr **old = owner->params;
+    owner->params = node_take_list(owner, merged, first + n);
+    owner->param_count = first + n;
+    if (!owner->in_arena)
+        free(old);
+}
+
+int cse_exprs(Expr *prog, int slot_budget, int *ops_saved)
+{
+    if (ops_saved != NULL)
+        *ops_saved = 0;
+    if (prog == NULL || prog->type != NODE_PROGRAM)
+        return 0;
+    Cse c;
+    memset(&c, 0, sizeof(c));
+    c.self_id = INTERN_NONE;
+    c.slots = inline_slots(prog);
+    c.slot_budget = slot_budget;
+    for (int i = 0; i < prog->param_count; i++)
+    {
+        Expr *fn = prog->params[i];
+        if (fn != NULL && fn->type == NODE_FUNC_DEF)
+            cse_list(&c, fn, func_param_count(fn));
+    }
+    free(c.entries);
+    free(c.occs);
+    if (ops_saved != NULL)
+        *ops_saved = c.ops;
+    return c.count;
+}
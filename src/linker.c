@@ -11,81 +11,233 @@
 #include <string.h>
 #include "../include/linker.h"
 #include "../include/logger.h"
+#include "../include/intern.h"
+
+/* Grow a table so that one more element fits */
+static void *grow_table(void *p, int count, int *capacity, size_t elem) {
+    if (count < *capacity) return p;
+    *capacity = *capacity ? *capacity * 2 : 16;
+    p = realloc(p, (size_t)*capacity * elem);
+    if (p == NULL) {
+        fprintf(stderr, "linker: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+void object_init(ObjectModule *obj) {
+    memset(obj, 0, sizeof(*obj));
+}
+
+void object_free(ObjectModule *obj) {
+    free(obj->code);
+    free(obj->symbols);
+    free(obj->relocs);
+    object_init(obj);
+}
+
+void object_emit(ObjectModule *obj, unsigned char byte) {
+    obj->code = (unsigned char *)grow_table(obj->code, obj->code_len,
+                                            &obj->code_capacity, 1);
+    obj->code[obj->code_len++] = byte;
+}
+
+void object_add_symbol_id(ObjectModule *obj, int name_id, int address, SymVisibility vis) {
+    obj->symbols = (LinkSymbol *)grow_table(obj->symbols, obj->sym_count,
+                                            &obj->sym_capacity, sizeof(LinkSymbol));
+    LinkSymbol *sym = &obj->symbols[obj->sym_count++];
+    sym->name_id = name_id;
+    sym->address = address;
+    sym->module_id = obj->id;
+    sym->vis = vis;
+}
+
+void object_add_reloc_id(ObjectModule *obj, int offset, int target_id) {
+    obj->relocs = (Relocation *)grow_table(obj->relocs, obj->reloc_count,
+                                           &obj->reloc_capacity, sizeof(Relocation));
+    Relocation *rel = &obj->relocs[obj->reloc_count++];
+    rel->offset = offset;
+    rel->target_id = target_id;
+    rel->module_id = obj->id;
+}
 
 void linker_init(Linker *lnk) {
     memset(lnk, 0, sizeof(Linker));
+    symhash_init(&lnk->global_index);
 }
 
-int linker_add_module(Linker *lnk, const unsigned char *code, int code_len) {
-    if (lnk->module_count >= LINK_MAX_MODULES) {
-        if (lnk->error_count < 16) {
-            snprintf(lnk->errors[lnk->error_count++], 128,
-                     "too many modules (max %d)", LINK_MAX_MODULES);
-        }
-        return -1;
-    }
-    if (code_len > LINK_MAX_CODE) {
-        if (lnk->error_count < 16) {
-            snprintf(lnk->errors[lnk->error_count++], 128,
-                     "module code too large (%d bytes, max %d)", code_len, LINK_MAX_CODE);
-        }
-        return -1;
+void linker_free(Linker *lnk) {
+    for (int m = 0; m < lnk->module_count; m++) {
+        object_free(&lnk->modules[m]);
     }
+    free(lnk->modules);
+    free(lnk->globals);
+    free(lnk->output);
+    symhash_free(&lnk->global_index);
+    linker_init(lnk);
+}
 
+int linker_add_object(Linker *lnk, ObjectModule *obj) {
+    lnk->modules = (ObjectModule *)grow_table(lnk->modules, lnk->module_count,
+                                              &lnk->module_capacity, sizeof(ObjectModule));
     int id = lnk->module_count++;
     ObjectModule *mod = &lnk->modules[id];
+    *mod = *obj;
     mod->id = id;
-    memcpy(mod->code, code, (size_t)code_len);
-    mod->code_len = code_len;
-    mod->sym_count = 0;
-    mod->reloc_count = 0;
     mod->base_addr = 0;
-
+    for (int s = 0; s < mod->sym_count; s++) mod->symbols[s].module_id = id;
+    for (int r = 0; r < mod->reloc_count; r++) mod->relocs[r].module_id = id;
+    object_init(obj);
+    lnk->linked = 0;
     return id;
 }
 
-int linker_add_symbol(Linker *lnk, int module_id, const char *name,
-                      int address, SymVisibility vis) {
+/* Same exported names at the same module-relative addresses */
+static int same_exports(const ObjectModule *a, const ObjectModule *b) {
+    int i = 0, j = 0;
+    for (;;) {
+        while (i < a->sym_count && a->symbols[i].vis != SYM_EXPORT) i++;
+        while (j < b->sym_count && b->symbols[j].vis != SYM_EXPORT) j++;
+        if (i == a->sym_count || j == b->sym_count) return i == a->sym_count && j == b->sym_count;
+        if (a->symbols[i].name_id != b->symbols[j].name_id ||
+            a->symbols[i].address != b->symbols[j].address) return 0;
+        i++;
+        j++;
+    }
+}
+
+int linker_replace_object(Linker *lnk, int module_id, ObjectModule *obj) {
     if (module_id < 0 || module_id >= lnk->module_count) return -1;
     ObjectModule *mod = &lnk->modules[module_id];
-    if (mod->sym_count >= LINK_MAX_SYMBOLS) return -1;
+    if (obj->code_len != mod->code_len || !same_exports(mod, obj)) lnk->linked = 0;
+    int base = mod->base_addr;
+    object_free(mod);
+    *mod = *obj;
+    mod->id = module_id;
+    mod->base_addr = base;
+    mod->dirty = 1;
+    for (int s = 0; s < mod->sym_count; s++) mod->symbols[s].module_id = module_id;
+    for (int r = 0; r < mod->reloc_count; r++) mod->relocs[r].module_id = module_id;
+    object_init(obj);
+    return 0;
+}
 
-    LinkSymbol *sym = &mod->symbols[mod->sym_count++];
-    strncpy(sym->name, name, 63);
-    sym->name[63] = '\0';
-    sym->address = address;
-    sym->module_id = module_id;
-    sym->vis = vis;
+int linker_add_module(Linker *lnk, const unsigned char *code, int code_len) {
+    if (code_len < 0) return -1;
+    ObjectModule obj;
+    object_init(&obj);
+    if (code_len > 0) {
+        obj.code = (unsigned char *)malloc((size_t)code_len);
+        if (obj.code == NULL) {
+            fprintf(stderr, "linker: malloc failed\n");
+            exit(1);
+        }
+        memcpy(obj.code, code, (size_t)code_len);
+    }
+    obj.code_len = code_len;
+    obj.code_capacity = code_len;
+    return linker_add_object(lnk, &obj);
+}
 
+int linker_add_symbol(Linker *lnk, int module_id, const char *name,
+                      int address, SymVisibility vis) {
+    if (module_id < 0 || module_id >= lnk->module_count) return -1;
+    object_add_symbol_id(&lnk->modules[module_id], intern(name), address, vis);
+    lnk->linked = 0;
     return 0;
 }
 
 int linker_add_reloc(Linker *lnk, int module_id, int offset,
                      const char *target_name) {
     if (module_id < 0 || module_id >= lnk->module_count) return -1;
-    ObjectModule *mod = &lnk->modules[module_id];
-    if (mod->reloc_count >= LINK_MAX_RELOCS) return -1;
-
-    Relocation *rel = &mod->relocs[mod->reloc_count++];
-    rel->offset = offset;
-    strncpy(rel->target_name, target_name, 63);
-    rel->target_name[63] = '\0';
-    rel->module_id = module_id;
-
+    object_add_reloc_id(&lnk->modules[module_id], offset, intern(target_name));
+    lnk->modules[module_id].dirty = 1;
     return 0;
 }
 
+int linker_resolve_id(const Linker *lnk, int name_id) {
+    int i = symhash_get(&lnk->global_index, name_id, -1);
+    return i < 0 ? -1 : lnk->globals[i].address;
+}
+
 int linker_resolve(const Linker *lnk, const char *name) {
-    for (int i = 0; i < lnk->global_count; i++) {
-        if (strcmp(lnk->globals[i].name, name) == 0) {
-            return lnk->globals[i].address;
+    int id = intern_find(name);
+    return id == INTERN_NONE ? -1 : linker_resolve_id(lnk, id);
+}
+
+/* Store a resolved address in its one-byte operand, or record an error
+ * when the image has outgrown it */
+static void patch_address(Linker *lnk, int m, int abs_offset, int addr) {
+    if (abs_offset < 0 || abs_offset >= lnk->output_len) return;
+    if (addr > 255) {
+        if (lnk->error_count < 16) {
+            snprintf(lnk->errors[lnk->error_count++], 128,
+                     "address %d at offset %d in module %d exceeds the 1-byte operand",
+                     addr, abs_offset, m);
+        }
+        return;
+    }
+    lnk->output[abs_offset] = (unsigned char)addr;
+}
+
+/* Patch module m's relocations in the output, resolving against the
+ * globals and falling back to the module's own symbols */
+static void relocate_module(Linker *lnk, int m, SymHash *locals) {
+    ObjectModule *mod = &lnk->modules[m];
+    symhash_push_scope(locals);
+    for (int s = mod->sym_count - 1; s >= 0; s--) {
+        /* Inserted last-to-first so the first definition wins */
+        symhash_insert(locals, mod->symbols[s].name_id, s);
+    }
+    for (int r = 0; r < mod->reloc_count; r++) {
+        Relocation *rel = &mod->relocs[r];
+        int abs_offset = rel->offset + mod->base_addr;
+        if (rel->target_id == INTERN_NONE) {
+            if (abs_offset >= 0 && abs_offset < lnk->output_len) {
+                patch_address(lnk, m, abs_offset, lnk->output[abs_offset] + mod->base_addr);
+            }
+            continue;
+        }
+        int resolved_addr = linker_resolve_id(lnk, rel->target_id);
+        if (resolved_addr < 0) {
+            /* Check if it's a local symbol */
+            int s = symhash_get(locals, rel->target_id, -1);
+            if (s < 0) {
+                if (lnk->error_count < 16) {
+                    snprintf(lnk->errors[lnk->error_count++], 128,
+                             "undefined symbol '%s' referenced in module %d",
+                             intern_str(rel->target_id), m);
+                }
+                continue;
+            }
+            resolved_addr = mod->symbols[s].address + mod->base_addr;
+        }
+
+        /* Patch the byte at the relocation offset */
+        patch_address(lnk, m, abs_offset, resolved_addr);
+    }
+    symhash_pop_scope(locals);
+    mod->dirty = 0;
+}
+
+static void check_imports(Linker *lnk, int m) {
+    ObjectModule *mod = &lnk->modules[m];
+    for (int s = 0; s < mod->sym_count; s++) {
+        if (mod->symbols[s].vis == SYM_IMPORT) {
+            if (linker_resolve_id(lnk, mod->symbols[s].name_id) < 0) {
+                if (lnk->error_count < 16) {
+                    snprintf(lnk->errors[lnk->error_count++], 128,
+                             "unresolved import '%s' in module %d",
+                             intern_str(mod->symbols[s].name_id), m);
+                }
+            }
         }
     }
-    return -1;
 }
 
 int linker_link(Linker *lnk) {
     LOG_INFO_MSG("Linker", "TASK-029", "linker_link entered");
+    lnk->error_count = 0;
 
     /* Phase 1: Assign base addresses (concatenate modules) */
     int base = 0;
@@ -94,42 +246,41 @@ int linker_link(Linker *lnk) {
         base += lnk->modules[m].code_len;
     }
 
-    if (base > LINK_MAX_CODE) {
-        if (lnk->error_count < 16) {
-            snprintf(lnk->errors[lnk->error_count++], 128,
-                     "linked output too large (%d bytes, max %d)", base, LINK_MAX_CODE);
+    if (base > lnk->output_capacity) {
+        lnk->output = (unsigned char *)realloc(lnk->output, (size_t)base);
+        if (lnk->output == NULL) {
+            fprintf(stderr, "linker: realloc failed\n");
+            exit(1);
         }
-        return lnk->error_count;
+        lnk->output_capacity = base;
     }
 
     /* Phase 2: Collect global symbols (exports) */
     lnk->global_count = 0;
+    symhash_clear(&lnk->global_index);
     for (int m = 0; m < lnk->module_count; m++) {
         ObjectModule *mod = &lnk->modules[m];
         for (int s = 0; s < mod->sym_count; s++) {
             LinkSymbol *sym = &mod->symbols[s];
             if (sym->vis == SYM_EXPORT) {
                 /* Check for duplicates */
-                int dup = 0;
-                for (int g = 0; g < lnk->global_count; g++) {
-                    if (strcmp(lnk->globals[g].name, sym->name) == 0) {
-                        if (lnk->error_count < 16) {
-                            snprintf(lnk->errors[lnk->error_count++], 128,
-                                     "duplicate symbol '%s' (modules %d and %d)",
-                                     sym->name, lnk->globals[g].module_id, m);
-                        }
-                        dup = 1;
-                        break;
+                int g = symhash_get(&lnk->global_index, sym->name_id, -1);
+                if (g >= 0) {
+                    if (lnk->error_count < 16) {
+                        snprintf(lnk->errors[lnk->error_count++], 128,
+                                 "duplicate symbol '%s' (modules %d and %d)",
+                                 intern_str(sym->name_id), lnk->globals[g].module_id, m);
                     }
+                    continue;
                 }
-                if (!dup && lnk->global_count < LINK_MAX_SYMBOLS) {
-                    LinkSymbol *g = &lnk->globals[lnk->global_count++];
-                    strncpy(g->name, sym->name, 63);
-                    g->name[63] = '\0';
-                    g->address = sym->address + mod->base_addr; /* Relocated */
-                    g->module_id = m;
-                    g->vis = SYM_EXPORT;
-                }
+                lnk->globals = (LinkSymbol *)grow_table(lnk->globals, lnk->global_count,
+                                                        &lnk->global_capacity, sizeof(LinkSymbol));
+                symhash_insert(&lnk->global_index, sym->name_id, lnk->global_count);
+                LinkSymbol *gs = &lnk->globals[lnk->global_count++];
+                gs->name_id = sym->name_id;
+                gs->address = sym->address + mod->base_addr; /* Relocated */
+                gs->module_id = m;
+                gs->vis = SYM_EXPORT;
             }
         }
     }
@@ -138,61 +289,44 @@ int linker_link(Linker *lnk) {
     lnk->output_len = 0;
     for (int m = 0; m < lnk->module_count; m++) {
         ObjectModule *mod = &lnk->modules[m];
-        memcpy(lnk->output + mod->base_addr, mod->code, (size_t)mod->code_len);
+        if (mod->code_len > 0) {
+            memcpy(lnk->output + mod->base_addr, mod->code, (size_t)mod->code_len);
+        }
         lnk->output_len += mod->code_len;
     }
 
     /* Phase 4: Resolve relocations */
-    for (int m = 0; m < lnk->module_count; m++) {
-        ObjectModule *mod = &lnk->modules[m];
-        for (int r = 0; r < mod->reloc_count; r++) {
-            Relocation *rel = &mod->relocs[r];
-            int resolved_addr = linker_resolve(lnk, rel->target_name);
-            if (resolved_addr < 0) {
-                /* Check if it's a local symbol */
-                int found = 0;
-                for (int s = 0; s < mod->sym_count; s++) {
-                    if (strcmp(mod->symbols[s].name, rel->target_name) == 0) {
-                        resolved_addr = mod->symbols[s].address + mod->base_addr;
-                        found = 1;
-                        break;
-                    }
-                }
-                if (!found) {
-                    if (lnk->error_count < 16) {
-                        snprintf(lnk->errors[lnk->error_count++], 128,
-                                 "undefined symbol '%s' referenced in module %d",
-                                 rel->target_name, m);
-                    }
-                    continue;
-                }
-            }
-
-            /* Patch the byte at the relocation offset */
-            int abs_offset = rel->offset + mod->base_addr;
-            if (abs_offset >= 0 && abs_offset < lnk->output_len) {
-                lnk->output[abs_offset] = (unsigned char)(resolved_addr & 0xFF);
-            }
-        }
-    }
+    SymHash locals;
+    symhash_init(&locals);
+    for (int m = 0; m < lnk->module_count; m++) relocate_module(lnk, m, &locals);
+    symhash_free(&locals);
 
     /* Phase 5: Check for unresolved imports */
+    for (int m = 0; m < lnk->module_count; m++) check_imports(lnk, m);
+
+    lnk->linked = 1;
+    LOG_INFO_MSG("Linker", "TASK-029", "linker_link complete");
+    return lnk->error_count;
+}
+
+int linker_relink(Linker *lnk) {
+    if (!lnk->linked || lnk->error_count > 0) return linker_link(lnk);
+
+    /* Layout and exports are unchanged: every other module's bytes,
+     * patches and imports are still correct, so only replaced modules
+     * are copied and patched again */
+    SymHash locals;
+    symhash_init(&locals);
     for (int m = 0; m < lnk->module_count; m++) {
         ObjectModule *mod = &lnk->modules[m];
-        for (int s = 0; s < mod->sym_count; s++) {
-            if (mod->symbols[s].vis == SYM_IMPORT) {
-                if (linker_resolve(lnk, mod->symbols[s].name) < 0) {
-                    if (lnk->error_count < 16) {
-                        snprintf(lnk->errors[lnk->error_count++], 128,
-                                 "unresolved import '%s' in module %d",
-                                 mod->symbols[s].name, m);
-                    }
-                }
-            }
+        if (!mod->dirty) continue;
+        if (mod->code_len > 0) {
+            memcpy(lnk->output + mod->base_addr, mod->code, (size_t)mod->code_len);
         }
+        check_imports(lnk, m);
+        relocate_module(lnk, m, &locals);
     }
-
-    LOG_INFO_MSG("Linker", "TASK-029", "linker_link complete");
+    symhash_free(&locals);
     return lnk->error_count;
 }
 
@@ -67,7 +67,8 @@ void log_entry(LogLevel level, const char *role, const char *task,
     /* Generate ISO 8601 timestamp */
     char timestamp[64];
     time_t now = time(NULL);
-    struct tm *tm_info = localtime(&now);
+    struct tm tm_buf;
+    struct tm *tm_info = localtime_r(&now, &tm_buf);
     if (tm_info == NULL) {
         snprintf(timestamp, sizeof(timestamp), "0000-00-00T00:00:00");
     } else {
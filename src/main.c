@@ -9,16 +9,43 @@
 #include "../include/bootstrap.h"
 #include "../include/selfhost.h"
 #include "../include/verilog_emit.h"
+#include "../include/driver.h"
+#include "../include/server.h"
 
 int main(int argc, char **argv) {
     logger_init("logs/compiler.log");
     LOG_INFO_MSG("Main", "TASK-006", "Compiler started");
 
     if (argc < 2) {
-        printf("Usage: %s [--self-host | --self-host-full | --emit-verilog <source> <out.v> | <c_source>]\n", argv[0]);
+        printf("Usage: %s [--self-host | --self-host-full | --emit-verilog <source> <out.v> | "
+               "--link [-j N] [-O N] [-o out] [--time] [--cache DIR] <files|@manifest>... | "
+               "--server [--socket PATH] [-j N] [--cache DIR] | --client [--socket PATH] [--run] <c_source> | "
+               "<c_source>]\n", argv[0]);
         return 1;
     }
 
+    /* Multi-file mode: compile files in parallel, link one executable */
+    if (strcmp(argv[1], "--link") == 0) {
+        LOG_INFO_MSG("Main", "TASK-042", "Multi-file link mode");
+        int result = driver_main(argc - 2, argv + 2);
+        logger_close();
+        return result;
+    }
+
+    /* Compile server: stay resident, serve requests on a Unix socket */
+    if (strcmp(argv[1], "--server") == 0) {
+        LOG_INFO_MSG("Main", "TASK-043", "Compile server mode");
+        int result = server_main(argc - 2, argv + 2);
+        logger_close();
+        return result;
+    }
+
+    if (strcmp(argv[1], "--client") == 0) {
+        int result = client_main(argc - 2, argv + 2);
+        logger_close();
+        return result;
+    }
+
     /* Self-host mode: compile own source subset and run on VM */
     if (strcmp(argv[1], "--self-host") == 0) {
         LOG_INFO_MSG("Main", "TASK-018", "Self-host mode entered");
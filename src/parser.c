@@ -1,151 +1,311 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <stdint.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 #include "../include/parser.h"
 #include "../include/ir.h"
+#include "../include/intern.h"
 #include "../include/logger.h"
 
 Token tokens[MAX_TOKENS];
 int token_idx = 0;
-char token_names[MAX_TOKENS][MAX_TOKEN_NAME];
+const char *token_names[MAX_TOKENS];
+
+/* ---- Character classes ---- */
+
+#define CC_SPACE  1
+#define CC_DIGIT  2
+#define CC_ALPHA  4   /* letters and '_' */
+#define CC_IDENT  (CC_DIGIT | CC_ALPHA)
+
+/* ASCII class table; replaces locale-dependent isspace/isalpha calls */
+static const unsigned char char_class[256] = {
+    ['\t'] = CC_SPACE, ['\n'] = CC_SPACE, ['\v'] = CC_SPACE,
+    ['\f'] = CC_SPACE, ['\r'] = CC_SPACE, [' '] = CC_SPACE,
+    ['0'] = CC_DIGIT, ['1'] = CC_DIGIT, ['2'] = CC_DIGIT, ['3'] = CC_DIGIT,
+    ['4'] = CC_DIGIT, ['5'] = CC_DIGIT, ['6'] = CC_DIGIT, ['7'] = CC_DIGIT,
+    ['8'] = CC_DIGIT, ['9'] = CC_DIGIT,
+    ['_'] = CC_ALPHA,
+    ['a'] = CC_ALPHA, ['b'] = CC_ALPHA, ['c'] = CC_ALPHA, ['d'] = CC_ALPHA,
+    ['e'] = CC_ALPHA, ['f'] = CC_ALPHA, ['g'] = CC_ALPHA, ['h'] = CC_ALPHA,
+    ['i'] = CC_ALPHA, ['j'] = CC_ALPHA, ['k'] = CC_ALPHA, ['l'] = CC_ALPHA,
+    ['m'] = CC_ALPHA, ['n'] = CC_ALPHA, ['o'] = CC_ALPHA, ['p'] = CC_ALPHA,
+    ['q'] = CC_ALPHA, ['r'] = CC_ALPHA, ['s'] = CC_ALPHA, ['t'] = CC_ALPHA,
+    ['u'] = CC_ALPHA, ['v'] = CC_ALPHA, ['w'] = CC_ALPHA, ['x'] = CC_ALPHA,
+    ['y'] = CC_ALPHA, ['z'] = CC_ALPHA,
+    ['A'] = CC_ALPHA, ['B'] = CC_ALPHA, ['C'] = CC_ALPHA, ['D'] = CC_ALPHA,
+    ['E'] = CC_ALPHA, ['F'] = CC_ALPHA, ['G'] = CC_ALPHA, ['H'] = CC_ALPHA,
+    ['I'] = CC_ALPHA, ['J'] = CC_ALPHA, ['K'] = CC_ALPHA, ['L'] = CC_ALPHA,
+    ['M'] = CC_ALPHA, ['N'] = CC_ALPHA, ['O'] = CC_ALPHA, ['P'] = CC_ALPHA,
+    ['Q'] = CC_ALPHA, ['R'] = CC_ALPHA, ['S'] = CC_ALPHA, ['T'] = CC_ALPHA,
+    ['U'] = CC_ALPHA, ['V'] = CC_ALPHA, ['W'] = CC_ALPHA, ['X'] = CC_ALPHA,
+    ['Y'] = CC_ALPHA, ['Z'] = CC_ALPHA,
+};
+
+#define CLASS(c) char_class[(unsigned char)(c)]
+
+/*
+ * Run scanners: length of the run of whitespace / identifier characters
+ * starting at p, never reading at or past end. The vector paths classify
+ * 32 (AVX2) or 16 (SSE2) bytes per step; the table loop handles the tail.
+ */
+#if defined(__AVX2__)
+static inline __m256i v32_in_range(__m256i v, char lo, char n) {
+    /* (unsigned)(v - lo) <= n - 1 */
+    __m256i d = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8((char)(n - 1))), d);
+}
+#endif
+#if defined(__SSE2__)
+static inline __m128i v16_in_range(__m128i v, char lo, char n) {
+    __m128i d = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8((char)(n - 1))), d);
+}
+#endif
+
+static size_t span_space(const char *p, const char *end) {
+    const char *q = p;
+#if defined(__AVX2__)
+    while (end - q >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)q);
+        __m256i m = _mm256_or_si256(v32_in_range(v, '\t', 5),
+                                    _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(m);
+        if (bits != 0xFFFFFFFFu) return (size_t)(q - p) + (size_t)__builtin_ctz(~bits);
+        q += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    while (end - q >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)q);
+        __m128i m = _mm_or_si128(v16_in_range(v, '\t', 5),
+                                 _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+        unsigned bits = (unsigned)_mm_movemask_epi8(m);
+        if (bits != 0xFFFFu) return (size_t)(q - p) + (size_t)__builtin_ctz(~bits);
+        q += 16;
+    }
+#endif
+    while (q < end && (CLASS(*q) & CC_SPACE)) q++;
+    return (size_t)(q - p);
+}
 
-void tokenize(const char *source) {
-    token_idx = 0;
-    memset(token_names, 0, sizeof(token_names));
-    int i = 0;
+static size_t span_ident(const char *p, const char *end) {
+    const char *q = p;
+#if defined(__AVX2__)
+    while (end - q >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)q);
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(v32_in_range(lower, 'a', 26), v32_in_range(v, '0', 10)),
+            _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_')));
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(m);
+        if (bits != 0xFFFFFFFFu) return (size_t)(q - p) + (size_t)__builtin_ctz(~bits);
+        q += 32;
+    }
+#endif
+#if defined(__SSE2__)
+    while (end - q >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)q);
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(v16_in_range(lower, 'a', 26), v16_in_range(v, '0', 10)),
+            _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+        unsigned bits = (unsigned)_mm_movemask_epi8(m);
+        if (bits != 0xFFFFu) return (size_t)(q - p) + (size_t)__builtin_ctz(~bits);
+        q += 16;
+    }
+#endif
+    while (q < end && (CLASS(*q) & CC_IDENT)) q++;
+    return (size_t)(q - p);
+}
 
-    while (source[i] != '\0') {
-        /* Skip whitespace */
-        if (isspace(source[i])) {
-            i++;
-            continue;
+/* ---- Keywords ---- */
+
+/*
+ * Perfect hash over the seven keywords:
+ *   (first + 5 * last + len) & 7
+ * maps for/while/if/else/int/trit/return to distinct slots, so one
+ * length check and one memcmp decide keyword vs identifier.
+ */
+#define KW_HASH(s, len) \
+    (((unsigned char)(s)[0] + 5u * (unsigned char)(s)[(len) - 1] + (unsigned)(len)) & 7u)
+
+static const struct {
+    const char *text;
+    unsigned char len;
+    TokenType type;
+} keyword_table[8] = {
+    [0] = {"int",    3, TOK_INT_KW},
+    [1] = {"if",     2, TOK_IF},
+    [2] = {"else",   4, TOK_ELSE},
+    [3] = {"for",    3, TOK_FOR},
+    [4] = {"trit",   4, TOK_TRIT_KW},
+    [5] = {"while",  5, TOK_WHILE},
+    [6] = {"return", 6, TOK_RETURN},
+};
+
+static Token lex_word(const char *s, size_t len) {
+    if (len >= 2 && len <= 6) {
+        unsigned h = KW_HASH(s, len);
+        if (keyword_table[h].len == len && memcmp(keyword_table[h].text, s, len) == 0) {
+            return (Token){keyword_table[h].type, 0};
         }
+    }
+    return (Token){TOK_IDENT, intern_n(s, len)};
+}
 
-        /* Keywords and identifiers (start with alpha or underscore) */
-        if (isalpha(source[i]) || source[i] == '_') {
-            int start = i;
-            while (isalnum(source[i]) || source[i] == '_') i++;
-            int len = i - start;
-
-            /* Check keywords first */
-            if (len == 3 && strncmp(&source[start], "for", 3) == 0) {
-                tokens[token_idx++] = (Token){TOK_FOR, 0};
-            } else if (len == 5 && strncmp(&source[start], "while", 5) == 0) {
-                tokens[token_idx++] = (Token){TOK_WHILE, 0};
-            } else if (len == 2 && strncmp(&source[start], "if", 2) == 0) {
-                tokens[token_idx++] = (Token){TOK_IF, 0};
-            } else if (len == 4 && strncmp(&source[start], "else", 4) == 0) {
-                tokens[token_idx++] = (Token){TOK_ELSE, 0};
-            } else if (len == 3 && strncmp(&source[start], "int", 3) == 0) {
-                tokens[token_idx++] = (Token){TOK_INT_KW, 0};
-            } else if (len == 4 && strncmp(&source[start], "trit", 4) == 0) {
-                tokens[token_idx++] = (Token){TOK_TRIT_KW, 0};
-            } else if (len == 6 && strncmp(&source[start], "return", 6) == 0) {
-                tokens[token_idx++] = (Token){TOK_RETURN, 0};
-            } else {
-                int namelen = len < MAX_TOKEN_NAME - 1 ? len : MAX_TOKEN_NAME - 1;
-                strncpy(token_names[token_idx], &source[start], namelen);
-                token_names[token_idx][namelen] = '\0';
-                tokens[token_idx++] = (Token){TOK_IDENT, 0};
-            }
-            continue;
+/* Scan one token from source[*pos .. len), advancing *pos past it */
+static Token lex_one(const char *source, size_t len, size_t *pos) {
+    const char *end = source + len;
+    size_t i = *pos;
+
+    /* Skip whitespace: usually none or one char, so test before scanning */
+    if (i < len && (CLASS(source[i]) & CC_SPACE)) {
+        i++;
+        if (i < len && (CLASS(source[i]) & CC_SPACE)) i += span_space(source + i, end);
+    }
+
+    if (i >= len) {
+        *pos = i;
+        return (Token){TOK_EOF, 0};
+    }
+
+    unsigned char c = (unsigned char)source[i];
+
+    /* Keywords and identifiers (start with alpha or underscore) */
+    if (CLASS(c) & CC_ALPHA) {
+        size_t start = i;
+        i += span_ident(source + i, end);
+        *pos = i;
+        return lex_word(&source[start], i - start);
+    }
+
+    /* Integer literal */
+    if (CLASS(c) & CC_DIGIT) {
+        int value = 0;
+        while (i < len && (CLASS(source[i]) & CC_DIGIT)) {
+            value = value * 10 + (source[i] - '0');
+            i++;
         }
+        *pos = i;
+        return (Token){TOK_INT, value};
+    }
 
-        /* Integer literal */
-        if (isdigit(source[i])) {
-            int value = 0;
-            while (isdigit(source[i])) {
-                value = value * 10 + (source[i] - '0');
-                i++;
+    /* Operators and symbols */
+    char next = i + 1 < len ? source[i + 1] : '\0';
+    TokenType type;
+    switch (c) {
+        case '+':
+            if (next == '+') {
+                *pos = i + 2;
+                return (Token){TOK_PLUS_PLUS, 0};
             }
-            tokens[token_idx++] = (Token){TOK_INT, value};
-            continue;
-        }
+            type = TOK_PLUS;
+            break;
+        case '=':
+            if (next == '=') {
+                *pos = i + 2;
+                return (Token){TOK_EQEQ, 0};
+            }
+            type = TOK_EQ;
+            break;
+        case '-': type = TOK_MINUS; break;
+        case '*': type = TOK_MUL; break;
+        case '&': type = TOK_AMP; break;
+        case '<': type = TOK_LT; break;
+        case '>': type = TOK_GT; break;
+        case '(': type = TOK_LPAREN; break;
+        case ')': type = TOK_RPAREN; break;
+        case '{': type = TOK_LBRACE; break;
+        case '}': type = TOK_RBRACE; break;
+        case ';': type = TOK_SEMI; break;
+        case ',': type = TOK_COMMA; break;
+        case '[': type = TOK_LBRACKET; break;
+        case ']': type = TOK_RBRACKET; break;
+        default:
+            /* No production accepts TOK_ERROR, so the parse fails */
+            fprintf(stderr, "Unexpected character: '%c'\n", source[i]);
+            *pos = i + 1;
+            return (Token){TOK_ERROR, c};
+    }
+    *pos = i + 1;
+    return (Token){type, 0};
+}
 
-        /* Operators and symbols */
-        switch (source[i]) {
-            case '+':
-                if (source[i + 1] == '+') {
-                    tokens[token_idx++] = (Token){TOK_PLUS_PLUS, 0};
-                    i += 2;
-                } else {
-                    tokens[token_idx++] = (Token){TOK_PLUS, 0};
-                    i++;
-                }
-                break;
-            case '-':
-                tokens[token_idx++] = (Token){TOK_MINUS, 0};
-                i++;
-                break;
-            case '*':
-                tokens[token_idx++] = (Token){TOK_MUL, 0};
-                i++;
-                break;
-            case '&':
-                tokens[token_idx++] = (Token){TOK_AMP, 0};
-                i++;
-                break;
-            case '=':
-                if (source[i + 1] == '=') {
-                    tokens[token_idx++] = (Token){TOK_EQEQ, 0};
-                    i += 2;
-                } else {
-                    tokens[token_idx++] = (Token){TOK_EQ, 0};
-                    i++;
-                }
-                break;
-            case '<':
-                tokens[token_idx++] = (Token){TOK_LT, 0};
-                i++;
-                break;
-            case '>':
-                tokens[token_idx++] = (Token){TOK_GT, 0};
-                i++;
-                break;
-            case '(':
-                tokens[token_idx++] = (Token){TOK_LPAREN, 0};
-                i++;
-                break;
-            case ')':
-                tokens[token_idx++] = (Token){TOK_RPAREN, 0};
-                i++;
-                break;
-            case '{':
-                tokens[token_idx++] = (Token){TOK_LBRACE, 0};
-                i++;
-                break;
-            case '}':
-                tokens[token_idx++] = (Token){TOK_RBRACE, 0};
-                i++;
-                break;
-            case ';':
-                tokens[token_idx++] = (Token){TOK_SEMI, 0};
-                i++;
-                break;
-            case ',':
-                tokens[token_idx++] = (Token){TOK_COMMA, 0};
-                i++;
-                break;
-            case '[':
-                tokens[token_idx++] = (Token){TOK_LBRACKET, 0};
-                i++;
-                break;
-            case ']':
-                tokens[token_idx++] = (Token){TOK_RBRACKET, 0};
-                i++;
-                break;
-            default:
-                fprintf(stderr, "Unexpected character: '%c'\n", source[i]);
-                exit(1);
+void tokenize(const char *source) {
+    size_t pos = 0, len = strlen(source);
+    token_idx = 0;
+
+    for (;;) {
+        if (token_idx == MAX_TOKENS - 1) {
+            /* Batch buffer full: truncate. parse_program() streams instead. */
+            fprintf(stderr, "tokenize: more than %d tokens, input truncated\n",
+                    MAX_TOKENS - 1);
+            tokens[token_idx++] = (Token){TOK_EOF, 0};
+            break;
         }
+        Token t = lex_one(source, len, &pos);
+        if (t.type == TOK_IDENT) token_names[token_idx] = intern_str(t.value);
+        tokens[token_idx++] = t;
+        if (t.type == TOK_EOF) break;
     }
 
-    tokens[token_idx++] = (Token){TOK_EOF, 0};
-
     LOG_DEBUG_MSG("Lexer", "TASK-006", "tokenize complete");
 }
 
+/* ==== Streaming lexer ==== */
+
+void lexer_init(Lexer *lx, const char *source) {
+    lexer_init_at(lx, source, 0);
+}
+
+void lexer_init_at(Lexer *lx, const char *source, size_t offset) {
+    lx->source = source;
+    lx->len = strlen(source);
+    lx->pos = offset < lx->len ? offset : lx->len;
+    lx->head = 0;
+    lx->count = 0;
+    lx->consumed = 0;
+    lx->end = lx->pos;
+}
+
+Token lexer_peek(Lexer *lx, int k) {
+    /* Fill the ring up to k; EOF repeats once reached */
+    while (lx->count <= k) {
+        Token t;
+        if (lx->count > 0 &&
+            lx->ring[(lx->head + lx->count - 1) & (LEXER_LOOKAHEAD - 1)].type == TOK_EOF) {
+            t = (Token){TOK_EOF, 0};
+        } else {
+            t = lex_one(lx->source, lx->len, &lx->pos);
+        }
+        lx->ring[(lx->head + lx->count) & (LEXER_LOOKAHEAD - 1)] = t;
+        lx->ends[(lx->head + lx->count) & (LEXER_LOOKAHEAD - 1)] = lx->pos;
+        lx->count++;
+    }
+    return lx->ring[(lx->head + k) & (LEXER_LOOKAHEAD - 1)];
+}
+
+Token lexer_next(Lexer *lx) {
+    lx->consumed++;
+    if (lx->count == 0) {
+        /* Nothing buffered: scan straight through the ring */
+        Token t = lex_one(lx->source, lx->len, &lx->pos);
+        lx->end = lx->pos;
+        return t;
+    }
+    Token t = lx->ring[lx->head];
+    lx->end = lx->ends[lx->head];
+    lx->head = (lx->head + 1) & (LEXER_LOOKAHEAD - 1);
+    lx->count--;
+    return t;
+}
+
 // Parse to AST (postfix for now)
 void parse(void) {
     // TODO: Shunting-yard algorithm for proper precedence
@@ -154,504 +314,481 @@ void parse(void) {
 
 /* ==== Recursive descent parser for functions (TASK-004) ==== */
 
-static int pidx;          /* Parser index into tokens[] */
-static int perror_flag;   /* Parser error flag */
+/* All parser state lives in the Parser passed as ps */
+#define PEEK(k)     lexer_peek(&ps->lex, (k))
+#define PEEK_NAME() intern_str(PEEK(0).value)
+#define ADVANCE()   ((void)lexer_next(&ps->lex))
 
-static void parser_error(const char *msg) {
-    fprintf(stderr, "parser error: %s (at token %d)\n", msg, pidx);
+static void parser_error(Parser *ps, const char *msg) {
+    fprintf(stderr, "parser error: %s (at token %d)\n", msg, ps->lex.consumed);
     log_entry(LOG_ERROR, "Parser", "TASK-004", msg, NULL);
-    perror_flag = 1;
+    ps->error = 1;
 }
 
-static int expect(TokenType t) {
-    if (tokens[pidx].type != t) {
-        parser_error("unexpected token");
+static int expect(Parser *ps, TokenType t) {
+    if (PEEK(0).type != t) {
+        parser_error(ps, "unexpected token");
         return 0;
     }
-    pidx++;
+    ADVANCE();
     return 1;
 }
 
 /* Forward declarations */
-static Expr *parse_expr_r(void);
+static Expr *parse_expr_r(Parser *ps);
 
-static Expr *parse_primary(void) {
-    if (perror_flag) return NULL;
+static Expr *parse_primary(Parser *ps) {
+    if (ps->error) return NULL;
 
     /* Dereference: *expr */
-    if (tokens[pidx].type == TOK_MUL) {
-        pidx++;
-        Expr *inner = parse_primary();
-        if (perror_flag) return NULL;
+    if (PEEK(0).type == TOK_MUL) {
+        ADVANCE();
+        Expr *inner = parse_primary(ps);
+        if (ps->error) return NULL;
         return create_deref(inner);
     }
 
     /* Address-of: &ident */
-    if (tokens[pidx].type == TOK_AMP) {
-        pidx++;
-        if (tokens[pidx].type != TOK_IDENT) {
-            parser_error("expected identifier after &");
+    if (PEEK(0).type == TOK_AMP) {
+        ADVANCE();
+        if (PEEK(0).type != TOK_IDENT) {
+            parser_error(ps, "expected identifier after &");
             return NULL;
         }
-        Expr *var = create_var(token_names[pidx]);
-        pidx++;
+        Expr *var = create_var(PEEK_NAME());
+        ADVANCE();
         return create_addr_of(var);
     }
 
-    if (tokens[pidx].type == TOK_INT) {
-        Expr *e = create_const(tokens[pidx].value);
-        pidx++;
+    if (PEEK(0).type == TOK_INT) {
+        Expr *e = create_const(PEEK(0).value);
+        ADVANCE();
         return e;
     }
 
-    if (tokens[pidx].type == TOK_IDENT) {
-        char *name = strdup(token_names[pidx]);
-        pidx++;
+    if (PEEK(0).type == TOK_IDENT) {
+        const char *name = PEEK_NAME();
+        ADVANCE();
 
         /* Array access: ident '[' expr ']' */
-        if (tokens[pidx].type == TOK_LBRACKET) {
-            pidx++; /* skip [ */
-            Expr *index = parse_expr_r();
-            if (perror_flag) { free(name); return NULL; }
-            if (!expect(TOK_RBRACKET)) { free(name); expr_free(index); return NULL; }
+        if (PEEK(0).type == TOK_LBRACKET) {
+            ADVANCE(); /* skip [ */
+            Expr *index = parse_expr_r(ps);
+            if (ps->error) return NULL;
+            if (!expect(ps, TOK_RBRACKET)) { expr_free(index); return NULL; }
             Expr *access = create_array_access(name, index);
-            free(name);
             return access;
         }
 
         /* Function call: ident '(' args ')' */
-        if (tokens[pidx].type == TOK_LPAREN) {
-            pidx++; /* skip ( */
+        if (PEEK(0).type == TOK_LPAREN) {
+            ADVANCE(); /* skip ( */
 
             Expr **args = NULL;
             int argc = 0;
 
-            if (tokens[pidx].type != TOK_RPAREN) {
+            if (PEEK(0).type != TOK_RPAREN) {
                 /* Parse first argument */
                 argc = 1;
                 args = (Expr **)malloc(sizeof(Expr *));
-                args[0] = parse_expr_r();
-                if (perror_flag) { free(name); free(args); return NULL; }
+                args[0] = parse_expr_r(ps);
+                if (ps->error) { free(args); return NULL; }
 
                 /* Parse remaining arguments */
-                while (tokens[pidx].type == TOK_COMMA && !perror_flag) {
-                    pidx++; /* skip , */
+                while (PEEK(0).type == TOK_COMMA && !ps->error) {
+                    ADVANCE(); /* skip , */
                     argc++;
                     args = (Expr **)realloc(args, argc * sizeof(Expr *));
-                    args[argc - 1] = parse_expr_r();
+                    args[argc - 1] = parse_expr_r(ps);
                 }
             }
 
-            if (!expect(TOK_RPAREN)) {
-                free(name);
+            if (!expect(ps, TOK_RPAREN)) {
                 for (int k = 0; k < argc; k++) expr_free(args[k]);
                 free(args);
                 return NULL;
             }
 
             Expr *call = create_func_call(name, args, argc);
-            free(name);
             return call;
         }
 
         /* Variable reference */
         Expr *var = create_var(name);
-        free(name);
         return var;
     }
 
-    parser_error("expected expression");
+    parser_error(ps, "expected expression");
     return NULL;
 }
 
-static Expr *parse_term(void) {
-    Expr *left = parse_primary();
-    if (perror_flag) return NULL;
+static Expr *parse_term(Parser *ps) {
+    Expr *left = parse_primary(ps);
+    if (ps->error) return NULL;
 
-    while (tokens[pidx].type == TOK_MUL && !perror_flag) {
-        pidx++;
-        Expr *right = parse_primary();
-        if (perror_flag) { expr_free(left); return NULL; }
+    while (PEEK(0).type == TOK_MUL && !ps->error) {
+        ADVANCE();
+        Expr *right = parse_primary(ps);
+        if (ps->error) { expr_free(left); return NULL; }
         left = create_binop(OP_IR_MUL, left, right);
     }
     return left;
 }
 
 /* Parse additive expression: term ((+|-) term)* */
-static Expr *parse_additive(void) {
-    Expr *left = parse_term();
-    if (perror_flag) return NULL;
-
-    while ((tokens[pidx].type == TOK_PLUS || tokens[pidx].type == TOK_MINUS) && !perror_flag) {
-        OpType op = (tokens[pidx].type == TOK_PLUS) ? OP_IR_ADD : OP_IR_SUB;
-        pidx++;
-        Expr *right = parse_term();
-        if (perror_flag) { expr_free(left); return NULL; }
+static Expr *parse_additive(Parser *ps) {
+    Expr *left = parse_term(ps);
+    if (ps->error) return NULL;
+
+    while ((PEEK(0).type == TOK_PLUS || PEEK(0).type == TOK_MINUS) && !ps->error) {
+        OpType op = (PEEK(0).type == TOK_PLUS) ? OP_IR_ADD : OP_IR_SUB;
+        ADVANCE();
+        Expr *right = parse_term(ps);
+        if (ps->error) { expr_free(left); return NULL; }
         left = create_binop(op, left, right);
     }
     return left;
 }
 
 /* Parse comparison expression: additive ((==|<|>) additive)* */
-static Expr *parse_expr_r(void) {
-    Expr *left = parse_additive();
-    if (perror_flag) return NULL;
+static Expr *parse_expr_r(Parser *ps) {
+    Expr *left = parse_additive(ps);
+    if (ps->error) return NULL;
 
-    while ((tokens[pidx].type == TOK_EQEQ || tokens[pidx].type == TOK_LT ||
-            tokens[pidx].type == TOK_GT) && !perror_flag) {
+    while ((PEEK(0).type == TOK_EQEQ || PEEK(0).type == TOK_LT ||
+            PEEK(0).type == TOK_GT) && !ps->error) {
         OpType op;
-        switch (tokens[pidx].type) {
+        switch (PEEK(0).type) {
             case TOK_EQEQ: op = OP_IR_CMP_EQ; break;
             case TOK_LT:   op = OP_IR_CMP_LT; break;
             case TOK_GT:   op = OP_IR_CMP_GT; break;
             default:       op = OP_IR_CMP_EQ; break;
         }
-        pidx++;
-        Expr *right = parse_additive();
-        if (perror_flag) { expr_free(left); return NULL; }
+        ADVANCE();
+        Expr *right = parse_additive(ps);
+        if (ps->error) { expr_free(left); return NULL; }
         left = create_binop(op, left, right);
     }
     return left;
 }
 
 /* Forward declare parse_stmt for mutual recursion */
-static Expr *parse_stmt(void);
+static Expr *parse_stmt(Parser *ps);
 
 /* Parse a brace-enclosed block: { stmt1; stmt2; ... }
  * Returns a NODE_BLOCK with statements in params array. */
-static Expr *parse_block(void) {
-    if (!expect(TOK_LBRACE)) return NULL;
+static Expr *parse_block(Parser *ps) {
+    if (!expect(ps, TOK_LBRACE)) return NULL;
     Expr *block = create_block();
 
-    while (tokens[pidx].type != TOK_RBRACE && tokens[pidx].type != TOK_EOF && !perror_flag) {
-        Expr *s = parse_stmt();
-        if (perror_flag) { expr_free(block); return NULL; }
+    while (PEEK(0).type != TOK_RBRACE && PEEK(0).type != TOK_EOF && !ps->error) {
+        Expr *s = parse_stmt(ps);
+        if (ps->error) { expr_free(block); return NULL; }
         block_add_stmt(block, s);
     }
 
-    if (!expect(TOK_RBRACE)) { expr_free(block); return NULL; }
+    if (!expect(ps, TOK_RBRACE)) { expr_free(block); return NULL; }
     return block;
 }
 
-static Expr *parse_stmt(void) {
-    if (perror_flag) return NULL;
+static Expr *parse_stmt(Parser *ps) {
+    if (ps->error) return NULL;
 
     /* if statement: if (expr) { ... } [else { ... }] */
-    if (tokens[pidx].type == TOK_IF) {
-        pidx++; /* skip 'if' */
-        if (!expect(TOK_LPAREN)) return NULL;
-        Expr *cond = parse_expr_r();
-        if (perror_flag) return NULL;
-        if (!expect(TOK_RPAREN)) { expr_free(cond); return NULL; }
+    if (PEEK(0).type == TOK_IF) {
+        ADVANCE(); /* skip 'if' */
+        if (!expect(ps, TOK_LPAREN)) return NULL;
+        Expr *cond = parse_expr_r(ps);
+        if (ps->error) return NULL;
+        if (!expect(ps, TOK_RPAREN)) { expr_free(cond); return NULL; }
 
-        Expr *body = parse_block();
-        if (perror_flag) { expr_free(cond); return NULL; }
+        Expr *body = parse_block(ps);
+        if (ps->error) { expr_free(cond); return NULL; }
 
         Expr *else_body = NULL;
-        if (tokens[pidx].type == TOK_ELSE) {
-            pidx++; /* skip 'else' */
-            else_body = parse_block();
-            if (perror_flag) { expr_free(cond); expr_free(body); return NULL; }
+        if (PEEK(0).type == TOK_ELSE) {
+            ADVANCE(); /* skip 'else' */
+            else_body = parse_block(ps);
+            if (ps->error) { expr_free(cond); expr_free(body); return NULL; }
         }
 
         return create_if(cond, body, else_body);
     }
 
     /* while statement: while (expr) { ... } */
-    if (tokens[pidx].type == TOK_WHILE) {
-        pidx++; /* skip 'while' */
-        if (!expect(TOK_LPAREN)) return NULL;
-        Expr *cond = parse_expr_r();
-        if (perror_flag) return NULL;
-        if (!expect(TOK_RPAREN)) { expr_free(cond); return NULL; }
+    if (PEEK(0).type == TOK_WHILE) {
+        ADVANCE(); /* skip 'while' */
+        if (!expect(ps, TOK_LPAREN)) return NULL;
+        Expr *cond = parse_expr_r(ps);
+        if (ps->error) return NULL;
+        if (!expect(ps, TOK_RPAREN)) { expr_free(cond); return NULL; }
 
-        Expr *body = parse_block();
-        if (perror_flag) { expr_free(cond); return NULL; }
+        Expr *body = parse_block(ps);
+        if (ps->error) { expr_free(cond); return NULL; }
 
         return create_while(cond, body);
     }
 
     /* for statement: for (init; cond; inc) { ... } */
-    if (tokens[pidx].type == TOK_FOR) {
-        pidx++; /* skip 'for' */
-        if (!expect(TOK_LPAREN)) return NULL;
+    if (PEEK(0).type == TOK_FOR) {
+        ADVANCE(); /* skip 'for' */
+        if (!expect(ps, TOK_LPAREN)) return NULL;
 
         /* init: either a var decl or an expression statement */
         Expr *init = NULL;
-        if (tokens[pidx].type == TOK_INT_KW) {
+        if (PEEK(0).type == TOK_INT_KW) {
             /* int x = expr; */
-            pidx++;
-            if (tokens[pidx].type != TOK_IDENT) {
-                parser_error("expected variable name in for-init");
+            ADVANCE();
+            if (PEEK(0).type != TOK_IDENT) {
+                parser_error(ps, "expected variable name in for-init");
                 return NULL;
             }
-            char *vname = strdup(token_names[pidx]);
-            pidx++;
-            if (!expect(TOK_EQ)) { free(vname); return NULL; }
-            Expr *init_expr = parse_expr_r();
-            if (perror_flag) { free(vname); return NULL; }
-            if (!expect(TOK_SEMI)) { free(vname); expr_free(init_expr); return NULL; }
+            const char *vname = PEEK_NAME();
+            ADVANCE();
+            if (!expect(ps, TOK_EQ)) return NULL;
+            Expr *init_expr = parse_expr_r(ps);
+            if (ps->error) return NULL;
+            if (!expect(ps, TOK_SEMI)) { expr_free(init_expr); return NULL; }
             init = create_var_decl(vname, init_expr);
-            free(vname);
         } else {
-            init = parse_expr_r();
-            if (perror_flag) return NULL;
-            if (!expect(TOK_SEMI)) { expr_free(init); return NULL; }
+            init = parse_expr_r(ps);
+            if (ps->error) return NULL;
+            if (!expect(ps, TOK_SEMI)) { expr_free(init); return NULL; }
         }
 
         /* cond */
-        Expr *cond = parse_expr_r();
-        if (perror_flag) { expr_free(init); return NULL; }
-        if (!expect(TOK_SEMI)) { expr_free(init); expr_free(cond); return NULL; }
+        Expr *cond = parse_expr_r(ps);
+        if (ps->error) { expr_free(init); return NULL; }
+        if (!expect(ps, TOK_SEMI)) { expr_free(init); expr_free(cond); return NULL; }
 
         /* increment: expression (may include ident = expr or ident++) */
         Expr *inc = NULL;
-        if (tokens[pidx].type == TOK_IDENT) {
-            char *iname = strdup(token_names[pidx]);
-            pidx++;
-            if (tokens[pidx].type == TOK_EQ) {
-                pidx++;
-                Expr *rhs = parse_expr_r();
-                if (perror_flag) { free(iname); expr_free(init); expr_free(cond); return NULL; }
+        if (PEEK(0).type == TOK_IDENT &&
+            (PEEK(1).type == TOK_EQ || PEEK(1).type == TOK_PLUS_PLUS)) {
+            const char *iname = PEEK_NAME();
+            ADVANCE();
+            if (PEEK(0).type == TOK_EQ) {
+                ADVANCE();
+                Expr *rhs = parse_expr_r(ps);
+                if (ps->error) { expr_free(init); expr_free(cond); return NULL; }
                 inc = create_assign(create_var(iname), rhs);
-            } else if (tokens[pidx].type == TOK_PLUS_PLUS) {
-                pidx++;
+            } else {
+                ADVANCE();
                 /* i++ -> i = i + 1 */
                 inc = create_assign(create_var(iname),
                     create_binop(OP_IR_ADD, create_var(iname), create_const(1)));
-            } else {
-                /* just a variable expression */
-                pidx--;  /* put back; let parse_expr_r handle it */
-                pidx--;
-                inc = parse_expr_r();
-                if (perror_flag) { free(iname); expr_free(init); expr_free(cond); return NULL; }
             }
-            free(iname);
         } else {
-            inc = parse_expr_r();
-            if (perror_flag) { expr_free(init); expr_free(cond); return NULL; }
+            inc = parse_expr_r(ps);
+            if (ps->error) { expr_free(init); expr_free(cond); return NULL; }
         }
 
-        if (!expect(TOK_RPAREN)) { expr_free(init); expr_free(cond); expr_free(inc); return NULL; }
+        if (!expect(ps, TOK_RPAREN)) { expr_free(init); expr_free(cond); expr_free(inc); return NULL; }
 
-        Expr *body = parse_block();
-        if (perror_flag) { expr_free(init); expr_free(cond); expr_free(inc); return NULL; }
+        Expr *body = parse_block(ps);
+        if (ps->error) { expr_free(init); expr_free(cond); expr_free(inc); return NULL; }
 
         return create_for(init, cond, inc, body);
     }
 
-    if (tokens[pidx].type == TOK_RETURN) {
-        pidx++; /* skip 'return' */
-        Expr *expr = parse_expr_r();
-        if (perror_flag) return NULL;
-        if (!expect(TOK_SEMI)) { expr_free(expr); return NULL; }
+    if (PEEK(0).type == TOK_RETURN) {
+        ADVANCE(); /* skip 'return' */
+        Expr *expr = parse_expr_r(ps);
+        if (ps->error) return NULL;
+        if (!expect(ps, TOK_SEMI)) { expr_free(expr); return NULL; }
         return create_return(expr);
     }
 
     /* Variable declaration: int x = expr; or int *x = expr; or int x[N]; */
-    if (tokens[pidx].type == TOK_INT_KW) {
-        pidx++; /* skip 'int' */
+    if (PEEK(0).type == TOK_INT_KW) {
+        ADVANCE(); /* skip 'int' */
         int is_ptr = 0;
-        if (tokens[pidx].type == TOK_MUL) {
+        if (PEEK(0).type == TOK_MUL) {
             is_ptr = 1;
-            pidx++; /* skip '*' */
+            ADVANCE(); /* skip '*' */
         }
         (void)is_ptr; /* type tracking deferred to Phase 3 */
-        if (tokens[pidx].type != TOK_IDENT) {
-            parser_error("expected variable name in declaration");
+        if (PEEK(0).type != TOK_IDENT) {
+            parser_error(ps, "expected variable name in declaration");
             return NULL;
         }
-        char *vname = strdup(token_names[pidx]);
-        pidx++;
+        const char *vname = PEEK_NAME();
+        ADVANCE();
 
         /* Array declaration: int x[N]; or int x[N] = {v1, v2, ...}; */
-        if (tokens[pidx].type == TOK_LBRACKET) {
-            pidx++; /* skip [ */
-            if (tokens[pidx].type != TOK_INT) {
-                parser_error("expected array size");
-                free(vname);
+        if (PEEK(0).type == TOK_LBRACKET) {
+            ADVANCE(); /* skip [ */
+            if (PEEK(0).type != TOK_INT) {
+                parser_error(ps, "expected array size");
                 return NULL;
             }
-            int arr_size = tokens[pidx].value;
-            pidx++;
-            if (!expect(TOK_RBRACKET)) { free(vname); return NULL; }
+            int arr_size = PEEK(0).value;
+            ADVANCE();
+            if (!expect(ps, TOK_RBRACKET)) return NULL;
 
             Expr **init_vals = NULL;
             int init_count = 0;
 
             /* Optional initializer: = { expr, expr, ... } */
-            if (tokens[pidx].type == TOK_EQ) {
-                pidx++; /* skip = */
-                if (!expect(TOK_LBRACE)) { free(vname); return NULL; }
-                while (tokens[pidx].type != TOK_RBRACE && tokens[pidx].type != TOK_EOF && !perror_flag) {
+            if (PEEK(0).type == TOK_EQ) {
+                ADVANCE(); /* skip = */
+                if (!expect(ps, TOK_LBRACE)) return NULL;
+                while (PEEK(0).type != TOK_RBRACE && PEEK(0).type != TOK_EOF && !ps->error) {
                     init_count++;
                     init_vals = (Expr **)realloc(init_vals, init_count * sizeof(Expr *));
-                    init_vals[init_count - 1] = parse_expr_r();
-                    if (perror_flag) { free(vname); return NULL; }
-                    if (tokens[pidx].type == TOK_COMMA) pidx++;
+                    init_vals[init_count - 1] = parse_expr_r(ps);
+                    if (ps->error) return NULL;
+                    if (PEEK(0).type == TOK_COMMA) ADVANCE();
                 }
-                if (!expect(TOK_RBRACE)) { free(vname); return NULL; }
+                if (!expect(ps, TOK_RBRACE)) return NULL;
             }
 
-            if (!expect(TOK_SEMI)) { free(vname); return NULL; }
+            if (!expect(ps, TOK_SEMI)) return NULL;
             Expr *decl = create_array_decl(vname, arr_size, init_vals, init_count);
-            free(vname);
             return decl;
         }
 
-        if (!expect(TOK_EQ)) { free(vname); return NULL; }
-        Expr *init = parse_expr_r();
-        if (perror_flag) { free(vname); return NULL; }
-        if (!expect(TOK_SEMI)) { free(vname); expr_free(init); return NULL; }
+        if (!expect(ps, TOK_EQ)) return NULL;
+        Expr *init = parse_expr_r(ps);
+        if (ps->error) return NULL;
+        if (!expect(ps, TOK_SEMI)) { expr_free(init); return NULL; }
         Expr *decl = create_var_decl(vname, init);
-        free(vname);
         return decl;
     }
 
     /* Variable declaration: trit x = expr; or trit *x = expr; or trit x[N]; */
-    if (tokens[pidx].type == TOK_TRIT_KW) {
-        pidx++; /* skip 'trit' */
+    if (PEEK(0).type == TOK_TRIT_KW) {
+        ADVANCE(); /* skip 'trit' */
         int is_ptr = 0;
-        if (tokens[pidx].type == TOK_MUL) {
+        if (PEEK(0).type == TOK_MUL) {
             is_ptr = 1;
-            pidx++; /* skip '*' */
+            ADVANCE(); /* skip '*' */
         }
         (void)is_ptr; /* type tracking deferred to Phase 3 */
-        if (tokens[pidx].type != TOK_IDENT) {
-            parser_error("expected variable name in declaration");
+        if (PEEK(0).type != TOK_IDENT) {
+            parser_error(ps, "expected variable name in declaration");
             return NULL;
         }
-        char *vname = strdup(token_names[pidx]);
-        pidx++;
+        const char *vname = PEEK_NAME();
+        ADVANCE();
 
         /* Array declaration: trit x[N]; or trit x[N] = {v1, v2, ...}; */
-        if (tokens[pidx].type == TOK_LBRACKET) {
-            pidx++; /* skip [ */
-            if (tokens[pidx].type != TOK_INT) {
-                parser_error("expected array size");
-                free(vname);
+        if (PEEK(0).type == TOK_LBRACKET) {
+            ADVANCE(); /* skip [ */
+            if (PEEK(0).type != TOK_INT) {
+                parser_error(ps, "expected array size");
                 return NULL;
             }
-            int arr_size = tokens[pidx].value;
-            pidx++;
-            if (!expect(TOK_RBRACKET)) { free(vname); return NULL; }
+            int arr_size = PEEK(0).value;
+            ADVANCE();
+            if (!expect(ps, TOK_RBRACKET)) return NULL;
 
             Expr **init_vals = NULL;
             int init_count = 0;
 
             /* Optional initializer: = { expr, expr, ... } */
-            if (tokens[pidx].type == TOK_EQ) {
-                pidx++; /* skip = */
-                if (!expect(TOK_LBRACE)) { free(vname); return NULL; }
-                while (tokens[pidx].type != TOK_RBRACE && tokens[pidx].type != TOK_EOF && !perror_flag) {
+            if (PEEK(0).type == TOK_EQ) {
+                ADVANCE(); /* skip = */
+                if (!expect(ps, TOK_LBRACE)) return NULL;
+                while (PEEK(0).type != TOK_RBRACE && PEEK(0).type != TOK_EOF && !ps->error) {
                     init_count++;
                     init_vals = (Expr **)realloc(init_vals, init_count * sizeof(Expr *));
-                    init_vals[init_count - 1] = parse_expr_r();
-                    if (perror_flag) { free(vname); return NULL; }
-                    if (tokens[pidx].type == TOK_COMMA) pidx++;
+                    init_vals[init_count - 1] = parse_expr_r(ps);
+                    if (ps->error) return NULL;
+                    if (PEEK(0).type == TOK_COMMA) ADVANCE();
                 }
-                if (!expect(TOK_RBRACE)) { free(vname); return NULL; }
+                if (!expect(ps, TOK_RBRACE)) return NULL;
             }
 
-            if (!expect(TOK_SEMI)) { free(vname); return NULL; }
+            if (!expect(ps, TOK_SEMI)) return NULL;
             Expr *decl = create_trit_array_decl(vname, arr_size, init_vals, init_count);
-            free(vname);
             return decl;
         }
 
-        if (!expect(TOK_EQ)) { free(vname); return NULL; }
-        Expr *init = parse_expr_r();
-        if (perror_flag) { free(vname); return NULL; }
-        if (!expect(TOK_SEMI)) { free(vname); expr_free(init); return NULL; }
+        if (!expect(ps, TOK_EQ)) return NULL;
+        Expr *init = parse_expr_r(ps);
+        if (ps->error) return NULL;
+        if (!expect(ps, TOK_SEMI)) { expr_free(init); return NULL; }
         Expr *decl = create_trit_var_decl(vname, init);
-        free(vname);
         return decl;
     }
 
     /* Assignment or expression statement: ident = expr; or ident[expr] = expr; or *expr = expr; */
-    if (tokens[pidx].type == TOK_IDENT) {
-        int saved = pidx;
-        char *vname = strdup(token_names[pidx]);
-        pidx++;
+    if (PEEK(0).type == TOK_IDENT &&
+        (PEEK(1).type == TOK_LBRACKET || PEEK(1).type == TOK_EQ)) {
+        const char *vname = PEEK_NAME();
+        ADVANCE();
 
         /* Array assignment: ident[expr] = expr; */
-        if (tokens[pidx].type == TOK_LBRACKET) {
-            pidx++; /* skip [ */
-            Expr *index = parse_expr_r();
-            if (perror_flag) { free(vname); return NULL; }
-            if (!expect(TOK_RBRACKET)) { free(vname); expr_free(index); return NULL; }
-            if (!expect(TOK_EQ)) { free(vname); expr_free(index); return NULL; }
-            Expr *rhs = parse_expr_r();
-            if (perror_flag) { free(vname); expr_free(index); return NULL; }
-            if (!expect(TOK_SEMI)) { free(vname); expr_free(index); expr_free(rhs); return NULL; }
+        if (PEEK(0).type == TOK_LBRACKET) {
+            ADVANCE(); /* skip [ */
+            Expr *index = parse_expr_r(ps);
+            if (ps->error) return NULL;
+            if (!expect(ps, TOK_RBRACKET)) { expr_free(index); return NULL; }
+            if (!expect(ps, TOK_EQ)) { expr_free(index); return NULL; }
+            Expr *rhs = parse_expr_r(ps);
+            if (ps->error) { expr_free(index); return NULL; }
+            if (!expect(ps, TOK_SEMI)) { expr_free(index); expr_free(rhs); return NULL; }
             Expr *arr_assign = create_array_assign(vname, index, rhs);
-            free(vname);
             return arr_assign;
         }
 
-        if (tokens[pidx].type == TOK_EQ) {
-            pidx++; /* skip '=' */
-            Expr *rhs = parse_expr_r();
-            if (perror_flag) { free(vname); return NULL; }
-            if (!expect(TOK_SEMI)) { free(vname); expr_free(rhs); return NULL; }
+        if (PEEK(0).type == TOK_EQ) {
+            ADVANCE(); /* skip '=' */
+            Expr *rhs = parse_expr_r(ps);
+            if (ps->error) return NULL;
+            if (!expect(ps, TOK_SEMI)) { expr_free(rhs); return NULL; }
             Expr *lhs = create_var(vname);
-            free(vname);
             return create_assign(lhs, rhs);
         }
-        /* Not an assignment — backtrack */
-        free(vname);
-        pidx = saved;
     }
 
-    parser_error("expected statement (return, decl, assign, if, while, or for)");
+    parser_error(ps, "expected statement (return, decl, assign, if, while, or for)");
     return NULL;
 }
 
-static Expr *parse_func_def_r(void) {
-    if (perror_flag) return NULL;
+static Expr *parse_func_def_r(Parser *ps) {
+    if (ps->error) return NULL;
 
     /* 'int' ident '(' params? ')' '{' body '}' */
-    if (!expect(TOK_INT_KW)) return NULL;
+    if (!expect(ps, TOK_INT_KW)) return NULL;
 
-    if (tokens[pidx].type != TOK_IDENT) {
-        parser_error("expected function name");
+    if (PEEK(0).type != TOK_IDENT) {
+        parser_error(ps, "expected function name");
         return NULL;
     }
-    char *fname = strdup(token_names[pidx]);
-    pidx++;
+    const char *fname = PEEK_NAME();
+    ADVANCE();
 
-    if (!expect(TOK_LPAREN)) { free(fname); return NULL; }
+    if (!expect(ps, TOK_LPAREN)) return NULL;
 
     /* Parse parameter list: (int x, int y, ...) */
     Expr **params = NULL;
     int pcount = 0;
 
-    while (tokens[pidx].type == TOK_INT_KW && !perror_flag) {
-        pidx++; /* skip 'int' */
-        if (tokens[pidx].type != TOK_IDENT) {
-            parser_error("expected parameter name");
-            free(fname);
+    while (PEEK(0).type == TOK_INT_KW && !ps->error) {
+        ADVANCE(); /* skip 'int' */
+        if (PEEK(0).type != TOK_IDENT) {
+            parser_error(ps, "expected parameter name");
             for (int k = 0; k < pcount; k++) expr_free(params[k]);
             free(params);
             return NULL;
         }
         pcount++;
         params = (Expr **)realloc(params, pcount * sizeof(Expr *));
-        params[pcount - 1] = create_var(token_names[pidx]);
-        pidx++;
+        params[pcount - 1] = create_var(PEEK_NAME());
+        ADVANCE();
 
-        if (tokens[pidx].type == TOK_COMMA) pidx++; /* skip , */
+        if (PEEK(0).type == TOK_COMMA) ADVANCE(); /* skip , */
     }
 
-    if (!expect(TOK_RPAREN)) {
-        free(fname);
+    if (!expect(ps, TOK_RPAREN)) {
         for (int k = 0; k < pcount; k++) expr_free(params[k]);
         free(params);
         return NULL;
     }
 
-    if (!expect(TOK_LBRACE)) {
-        free(fname);
+    if (!expect(ps, TOK_LBRACE)) {
         for (int k = 0; k < pcount; k++) expr_free(params[k]);
         free(params);
         return NULL;
@@ -664,10 +801,9 @@ static Expr *parse_func_def_r(void) {
     int stmt_count = 0;
     Expr *body = NULL;
 
-    while (tokens[pidx].type != TOK_RBRACE && !perror_flag) {
-        Expr *s = parse_stmt();
-        if (perror_flag) {
-            free(fname);
+    while (PEEK(0).type != TOK_RBRACE && !ps->error) {
+        Expr *s = parse_stmt(ps);
+        if (ps->error) {
             for (int k = 0; k < pcount; k++) expr_free(params[k]);
             free(params);
             for (int k = 0; k < stmt_count; k++) expr_free(stmts[k]);
@@ -683,8 +819,7 @@ static Expr *parse_func_def_r(void) {
         body = s;
     }
 
-    if (!expect(TOK_RBRACE)) {
-        free(fname);
+    if (!expect(ps, TOK_RBRACE)) {
         expr_free(body);
         for (int k = 0; k < pcount; k++) expr_free(params[k]);
         free(params);
@@ -705,21 +840,33 @@ static Expr *parse_func_def_r(void) {
     free(stmts);
 
     Expr *fn = create_func_def(fname, all_params, total, body);
-    free(fname);
     return fn;
 }
 
-Expr *parse_program(const char *source) {
-    LOG_DEBUG_MSG("Parser", "TASK-004", "parse_program entered");
-    tokenize(source);
-    pidx = 0;
-    perror_flag = 0;
+void parser_init(Parser *ps, const char *source) {
+    parser_init_at(ps, source, 0);
+}
+
+void parser_init_at(Parser *ps, const char *source, size_t offset) {
+    lexer_init_at(&ps->lex, source, offset);
+    ps->error = 0;
+}
+
+Expr *parser_parse_function(Parser *ps) {
+    Expr *fn = parse_func_def_r(ps);
+    if (fn != NULL && ps->error) {
+        expr_free(fn);
+        return NULL;
+    }
+    return fn;
+}
 
+Expr *parser_parse_program(Parser *ps) {
     Expr *prog = create_program();
 
-    while (tokens[pidx].type != TOK_EOF && !perror_flag) {
-        Expr *fn = parse_func_def_r();
-        if (fn == NULL || perror_flag) {
+    while (PEEK(0).type != TOK_EOF && !ps->error) {
+        Expr *fn = parse_func_def_r(ps);
+        if (fn == NULL || ps->error) {
             expr_free(prog);
             return NULL;
         }
@@ -728,3 +875,10 @@ Expr *parse_program(const char *source) {
 
     return prog;
 }
+
+Expr *parse_program(const char *source) {
+    LOG_DEBUG_MSG("Parser", "TASK-004", "parse_program entered");
+    Parser ps;
+    parser_init(&ps, source);
+    return parser_parse_program(&ps);
+}
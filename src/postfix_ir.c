@@ -14,12 +14,19 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
+#include <pthread.h>
 #include "../include/postfix_ir.h"
+#include "../include/intern.h"
+#include "../include/vm.h"
+#include "../include/ternary.h"
 
 void pf_init(PostfixSeq *seq) {
     seq->capacity = 64;
     seq->count = 0;
     seq->next_label = 0;
+    seq->label_at = NULL;
+    seq->label_capacity = 0;
     seq->instrs = (PostfixInstr *)malloc(seq->capacity * sizeof(PostfixInstr));
     if (!seq->instrs) {
         fprintf(stderr, "postfix_ir: malloc failed\n");
@@ -28,15 +35,30 @@ void pf_init(PostfixSeq *seq) {
 }
 
 void pf_free(PostfixSeq *seq) {
-    if (seq->instrs) {
-        for (int i = 0; i < seq->count; i++) {
-            if (seq->instrs[i].name) free(seq->instrs[i].name);
-        }
-        free(seq->instrs);
-    }
+    free(seq->instrs);
+    free(seq->label_at);
     seq->instrs = NULL;
+    seq->label_at = NULL;
     seq->count = 0;
     seq->capacity = 0;
+    seq->label_capacity = 0;
+}
+
+/* Record that label id sits at instruction index at */
+static void pf_place_label(PostfixSeq *seq, int id, int at) {
+    if (id < 0) return;
+    if (id >= seq->label_capacity) {
+        int cap = seq->label_capacity ? seq->label_capacity : 16;
+        while (cap <= id) cap *= 2;
+        seq->label_at = (int *)realloc(seq->label_at, (size_t)cap * sizeof(int));
+        if (!seq->label_at) {
+            fprintf(stderr, "postfix_ir: realloc failed\n");
+            exit(1);
+        }
+        for (int i = seq->label_capacity; i < cap; i++) seq->label_at[i] = -1;
+        seq->label_capacity = cap;
+    }
+    seq->label_at[id] = at;
 }
 
 void pf_emit(PostfixSeq *seq, PostfixOp op, int operand, const char *name) {
@@ -52,14 +74,22 @@ void pf_emit(PostfixSeq *seq, PostfixOp op, int operand, const char *name) {
     PostfixInstr *instr = &seq->instrs[seq->count++];
     instr->op = op;
     instr->operand = operand;
-    instr->name = name ? strdup(name) : NULL;
+    instr->name = name ? intern_str(intern(name)) : NULL;
+    if (op == PF_LABEL) pf_place_label(seq, operand, seq->count - 1);
 }
 
 int pf_alloc_label(PostfixSeq *seq) {
     return seq->next_label++;
 }
 
-int pf_find_label(PostfixSeq *seq, int label_id) {
+int pf_find_label(const PostfixSeq *seq, int label_id) {
+    if (label_id >= 0 && label_id < seq->label_capacity) {
+        int at = seq->label_at[label_id];
+        if (at >= 0 && at < seq->count && seq->instrs[at].op == PF_LABEL &&
+            seq->instrs[at].operand == label_id) {
+            return at;
+        }
+    }
     for (int i = 0; i < seq->count; i++) {
         if (seq->instrs[i].op == PF_LABEL && seq->instrs[i].operand == label_id) {
             return i;
@@ -70,22 +100,35 @@ int pf_find_label(PostfixSeq *seq, int label_id) {
 
 /* --- AST to postfix conversion --- */
 
-static void emit_ast(PostfixSeq *seq, Expr *e) {
-    if (e == NULL) return;
+#define KIND(n)   ((NodeType)ca->kind[n])
+#define KID(n, i) cast_kid(ca, (n), (i))
+#define NAME(n)   cast_name(ca, (n))
+
+static void emit_ast(PostfixSeq *seq, const CompactAST *ca, NodeRef n) {
+    if (n == CAST_NONE) return;
 
-    switch (e->type) {
+    switch (KIND(n)) {
         case NODE_CONST:
-            pf_emit(seq, PF_PUSH_CONST, e->val, NULL);
+            pf_emit(seq, PF_PUSH_CONST, ca->val[n], NULL);
             break;
 
         case NODE_VAR:
-            pf_emit(seq, PF_PUSH_VAR, 0, e->name);
+            pf_emit(seq, PF_PUSH_VAR, 0, NAME(n));
             break;
 
-        case NODE_BINOP:
-            emit_ast(seq, e->left);
-            emit_ast(seq, e->right);
-            switch (e->op) {
+        case NODE_BINOP: {
+            /* Dividing by +-3^k drops k trits (and negates) */
+            NodeRef rhs = KID(n, 1);
+            int k = (OpType)ca->op[n] == OP_IR_DIV && rhs != CAST_NONE &&
+                    KIND(rhs) == NODE_CONST ? trit_pow3_log(ca->val[rhs]) : 0;
+            emit_ast(seq, ca, KID(n, 0));
+            if (k > 0) {
+                pf_emit(seq, PF_TSHR, k, NULL);
+                if (ca->val[rhs] < 0) pf_emit(seq, PF_NEG, 0, NULL);
+                break;
+            }
+            emit_ast(seq, ca, rhs);
+            switch ((OpType)ca->op[n]) {
                 case OP_IR_ADD:    pf_emit(seq, PF_ADD, 0, NULL); break;
                 case OP_IR_SUB:    pf_emit(seq, PF_SUB, 0, NULL); break;
                 case OP_IR_MUL:    pf_emit(seq, PF_MUL, 0, NULL); break;
@@ -93,57 +136,64 @@ static void emit_ast(PostfixSeq *seq, Expr *e) {
                 case OP_IR_CMP_LT: pf_emit(seq, PF_CMP_LT, 0, NULL); break;
                 case OP_IR_CMP_GT: pf_emit(seq, PF_CMP_GT, 0, NULL); break;
                 case OP_IR_NEG:    pf_emit(seq, PF_NEG, 0, NULL); break;
+                default: break; /* DIV/MOD: no postfix op yet */
             }
             break;
+        }
 
         case NODE_RETURN:
-            emit_ast(seq, e->left);
+            emit_ast(seq, ca, KID(n, 0));
             pf_emit(seq, PF_RET, 0, NULL);
             break;
 
         case NODE_VAR_DECL:
-            if (e->left) emit_ast(seq, e->left);
-            pf_emit(seq, PF_STORE_VAR, 0, e->name);
+        case NODE_TRIT_VAR_DECL:
+            emit_ast(seq, ca, KID(n, 0));
+            pf_emit(seq, PF_STORE_VAR, 0, NAME(n));
             break;
 
-        case NODE_ASSIGN:
-            emit_ast(seq, e->right);
-            if (e->left && e->left->type == NODE_VAR) {
-                pf_emit(seq, PF_STORE_VAR, 0, e->left->name);
+        case NODE_ASSIGN: {
+            NodeRef lhs = KID(n, 0);
+            emit_ast(seq, ca, KID(n, 1));
+            if (lhs != CAST_NONE && KIND(lhs) == NODE_VAR) {
+                pf_emit(seq, PF_STORE_VAR, 0, NAME(lhs));
             }
             break;
+        }
 
         case NODE_DEREF:
-            emit_ast(seq, e->left);
+            emit_ast(seq, ca, KID(n, 0));
             pf_emit(seq, PF_DEREF, 0, NULL);
             break;
 
-        case NODE_ADDR_OF:
-            if (e->left && e->left->type == NODE_VAR)
-                pf_emit(seq, PF_ADDR_OF, 0, e->left->name);
+        case NODE_ADDR_OF: {
+            NodeRef var = KID(n, 0);
+            if (var != CAST_NONE && KIND(var) == NODE_VAR)
+                pf_emit(seq, PF_ADDR_OF, 0, NAME(var));
             break;
+        }
 
         case NODE_FUNC_CALL:
             /* Push args in order, then call */
-            for (int i = 0; i < e->param_count; i++) {
-                emit_ast(seq, e->params[i]);
+            for (int i = 0; i < ca->nkids[n]; i++) {
+                emit_ast(seq, ca, KID(n, i));
             }
-            pf_emit(seq, PF_CALL, e->param_count, e->name);
+            pf_emit(seq, PF_CALL, ca->nkids[n], NAME(n));
             break;
 
         case NODE_FUNC_DEF:
-            pf_emit(seq, PF_ENTER, 0, e->name);
+            pf_emit(seq, PF_ENTER, 0, NAME(n));
             /* Emit preceding statements (stored in params after the formal params) */
-            for (int i = 0; i < e->param_count; i++) {
-                emit_ast(seq, e->params[i]);
+            for (int i = 1; i < ca->nkids[n]; i++) {
+                emit_ast(seq, ca, KID(n, i));
             }
-            emit_ast(seq, e->body);
-            pf_emit(seq, PF_LEAVE, 0, e->name);
+            emit_ast(seq, ca, KID(n, 0));
+            pf_emit(seq, PF_LEAVE, 0, NAME(n));
             break;
 
         case NODE_PROGRAM:
-            for (int i = 0; i < e->param_count; i++) {
-                emit_ast(seq, e->params[i]);
+            for (int i = 0; i < ca->nkids[n]; i++) {
+                emit_ast(seq, ca, KID(n, i));
             }
             pf_emit(seq, PF_HALT, 0, NULL);
             break;
@@ -152,20 +202,21 @@ static void emit_ast(PostfixSeq *seq, Expr *e) {
             /* Setun-70 style: eval cond, branch if zero (skip body) */
             int lbl_else = pf_alloc_label(seq);
             int lbl_end = pf_alloc_label(seq);
+            NodeRef else_body = KID(n, 2);
 
-            emit_ast(seq, e->condition);
+            emit_ast(seq, ca, KID(n, 0));
             pf_emit(seq, PF_BRZ, lbl_else, NULL);
 
             /* then branch */
-            emit_ast(seq, e->body);
-            if (e->else_body) {
+            emit_ast(seq, ca, KID(n, 1));
+            if (else_body != CAST_NONE) {
                 pf_emit(seq, PF_JMP, lbl_end, NULL);
             }
 
             pf_emit(seq, PF_LABEL, lbl_else, NULL);
 
-            if (e->else_body) {
-                emit_ast(seq, e->else_body);
+            if (else_body != CAST_NONE) {
+                emit_ast(seq, ca, else_body);
                 pf_emit(seq, PF_LABEL, lbl_end, NULL);
             }
             break;
@@ -179,10 +230,10 @@ static void emit_ast(PostfixSeq *seq, Expr *e) {
             pf_emit(seq, PF_LABEL, lbl_start, NULL);
             pf_emit(seq, PF_LOOP_BEGIN, 0, NULL);
 
-            emit_ast(seq, e->condition);
+            emit_ast(seq, ca, KID(n, 0));
             pf_emit(seq, PF_BRZ, lbl_end, NULL);
 
-            emit_ast(seq, e->body);
+            emit_ast(seq, ca, KID(n, 1));
 
             /* Loop continuation: push nonzero for LOOP_END */
             pf_emit(seq, PF_PUSH_CONST, 1, NULL);
@@ -198,16 +249,16 @@ static void emit_ast(PostfixSeq *seq, Expr *e) {
             int lbl_start = pf_alloc_label(seq);
             int lbl_end = pf_alloc_label(seq);
 
-            emit_ast(seq, e->left);  /* init */
+            emit_ast(seq, ca, KID(n, 0));  /* init */
 
             pf_emit(seq, PF_LABEL, lbl_start, NULL);
             pf_emit(seq, PF_LOOP_BEGIN, 0, NULL);
 
-            emit_ast(seq, e->condition);  /* cond */
+            emit_ast(seq, ca, KID(n, 1));  /* cond */
             pf_emit(seq, PF_BRZ, lbl_end, NULL);
 
-            emit_ast(seq, e->body);       /* body */
-            emit_ast(seq, e->increment);  /* inc */
+            emit_ast(seq, ca, KID(n, 3));  /* body */
+            emit_ast(seq, ca, KID(n, 2));  /* inc */
 
             pf_emit(seq, PF_PUSH_CONST, 1, NULL);
             pf_emit(seq, PF_LOOP_END, 0, NULL);
@@ -217,148 +268,1062 @@ static void emit_ast(PostfixSeq *seq, Expr *e) {
         }
 
         case NODE_BLOCK:
-            for (int i = 0; i < e->param_count; i++) {
-                emit_ast(seq, e->params[i]);
+            for (int i = 0; i < ca->nkids[n]; i++) {
+                emit_ast(seq, ca, KID(n, i));
             }
             break;
 
         /* Phase 3: Arrays */
         case NODE_ARRAY_DECL:
+        case NODE_TRIT_ARRAY_DECL:
             /* Emit initializers as STORE_VAR with computed names */
-            for (int i = 0; i < e->param_count; i++) {
-                emit_ast(seq, e->params[i]);
+            for (int i = 0; i < ca->nkids[n]; i++) {
+                emit_ast(seq, ca, KID(n, i));
                 char slotname[72];
-                snprintf(slotname, sizeof(slotname), "%s[%d]", e->name, i);
+                snprintf(slotname, sizeof(slotname), "%s[%d]", NAME(n), i);
                 pf_emit(seq, PF_STORE_VAR, i, slotname);
             }
             break;
 
         case NODE_ARRAY_ACCESS:
             /* Push base + index, deref */
-            pf_emit(seq, PF_PUSH_VAR, 0, e->name);
-            emit_ast(seq, e->left);
+            pf_emit(seq, PF_PUSH_VAR, 0, NAME(n));
+            emit_ast(seq, ca, KID(n, 0));
             pf_emit(seq, PF_ADD, 0, NULL);
             pf_emit(seq, PF_DEREF, 0, NULL);
             break;
 
         case NODE_ARRAY_ASSIGN:
             /* Compute address, compute value, store */
-            pf_emit(seq, PF_PUSH_VAR, 0, e->name);
-            emit_ast(seq, e->left);
+            pf_emit(seq, PF_PUSH_VAR, 0, NAME(n));
+            emit_ast(seq, ca, KID(n, 0));
             pf_emit(seq, PF_ADD, 0, NULL);
-            emit_ast(seq, e->right);
-            pf_emit(seq, PF_STORE_VAR, 0, e->name);
+            emit_ast(seq, ca, KID(n, 1));
+            pf_emit(seq, PF_STORE_VAR, 0, NAME(n));
             break;
+    }
+}
 
-        case NODE_TRIT_VAR_DECL:
-            if (e->left) emit_ast(seq, e->left);
-            pf_emit(seq, PF_STORE_VAR, 0, e->name);
-            break;
+void pf_from_compact(PostfixSeq *seq, const CompactAST *ca, NodeRef root) {
+    emit_ast(seq, ca, root);
+}
 
-        case NODE_TRIT_ARRAY_DECL:
-            /* Emit initializers as STORE_VAR with computed names */
-            for (int i = 0; i < e->param_count; i++) {
-                emit_ast(seq, e->params[i]);
-                char slotname[72];
-                snprintf(slotname, sizeof(slotname), "%s[%d]", e->name, i);
-                pf_emit(seq, PF_STORE_VAR, i, slotname);
+void pf_from_ast(PostfixSeq *seq, Expr *ast) {
+    CompactAST ca;
+    cast_init(&ca);
+    NodeRef root = cast_from_expr(&ca, ast);
+    emit_ast(seq, &ca, root);
+    cast_free(&ca);
+}
+
+/* --- Peephole optimization --- */
+
+/* Shorthand for the rule table */
+#define ANY(op)       {op, PF_ARG_ANY, 0}
+#define EQ(op, v)     {op, PF_ARG_EQ, v}
+#define SAME(op, i)   {op, PF_ARG_SAME, i}
+#define POW3(op, s)   {op, PF_ARG_POW3, s}
+#define LIT(op, v)    {op, PF_OUT_LIT, v}
+#define COPY(op, i)   {op, PF_OUT_COPY, i}
+#define FOLD(i)       {PF_PUSH_CONST, PF_OUT_FOLD, i}
+#define LOG3(op, i)   {op, PF_OUT_LOG3, i}
+#define RULE(name, m, r) {name, m, sizeof((PfPattern[])m) / sizeof(PfPattern), \
+                          r, sizeof((PfReplace[])r) / sizeof(PfReplace)}
+#define RULE0(name, m)   {name, m, sizeof((PfPattern[])m) / sizeof(PfPattern), {{0}}, 0}
+#define P(...) {__VA_ARGS__}
+
+/*
+ * Rules are written in program order; the pattern's stack input is
+ * whatever the code before it left. Setun-70's POLIZ peepholes (a + 0,
+ * a * 1, a * 0, constant folding) plus strength reductions and stack
+ * traffic the lowering tends to produce.
+ */
+const PfRule pf_default_rules[] = {
+    /* Constant folding */
+    RULE("fold-add", P(ANY(PF_PUSH_CONST), ANY(PF_PUSH_CONST), ANY(PF_ADD)), P(FOLD(0))),
+    RULE("fold-sub", P(ANY(PF_PUSH_CONST), ANY(PF_PUSH_CONST), ANY(PF_SUB)), P(FOLD(0))),
+    RULE("fold-mul", P(ANY(PF_PUSH_CONST), ANY(PF_PUSH_CONST), ANY(PF_MUL)), P(FOLD(0))),
+    RULE("fold-eq", P(ANY(PF_PUSH_CONST), ANY(PF_PUSH_CONST), ANY(PF_CMP_EQ)), P(FOLD(0))),
+    RULE("fold-lt", P(ANY(PF_PUSH_CONST), ANY(PF_PUSH_CONST), ANY(PF_CMP_LT)), P(FOLD(0))),
+    RULE("fold-gt", P(ANY(PF_PUSH_CONST), ANY(PF_PUSH_CONST), ANY(PF_CMP_GT)), P(FOLD(0))),
+    RULE("fold-neg", P(ANY(PF_PUSH_CONST), ANY(PF_NEG)), P(FOLD(0))),
+    RULE("fold-tshl", P(ANY(PF_PUSH_CONST), ANY(PF_TSHL)), P(FOLD(0))),
+    RULE("fold-tshr", P(ANY(PF_PUSH_CONST), ANY(PF_TSHR)), P(FOLD(0))),
+
+    /* Identities */
+    RULE0("add-0", P(EQ(PF_PUSH_CONST, 0), ANY(PF_ADD))),
+    RULE0("sub-0", P(EQ(PF_PUSH_CONST, 0), ANY(PF_SUB))),
+    RULE0("mul-1", P(EQ(PF_PUSH_CONST, 1), ANY(PF_MUL))),
+    RULE0("neg-neg", P(ANY(PF_NEG), ANY(PF_NEG))),
+    RULE("mul-0", P(EQ(PF_PUSH_CONST, 0), ANY(PF_MUL)), P(LIT(PF_DROP, 0), LIT(PF_PUSH_CONST, 0))),
+    RULE("dup-sub", P(ANY(PF_DUP), ANY(PF_SUB)), P(LIT(PF_DROP, 0), LIT(PF_PUSH_CONST, 0))),
+    RULE("dup-eq", P(ANY(PF_DUP), ANY(PF_CMP_EQ)), P(LIT(PF_DROP, 0), LIT(PF_PUSH_CONST, 1))),
+    RULE("dup-lt", P(ANY(PF_DUP), ANY(PF_CMP_LT)), P(LIT(PF_DROP, 0), LIT(PF_PUSH_CONST, 0))),
+    RULE("dup-gt", P(ANY(PF_DUP), ANY(PF_CMP_GT)), P(LIT(PF_DROP, 0), LIT(PF_PUSH_CONST, 0))),
+    /* A comparison already yields 0 or 1 */
+    RULE("eq-is-1", P(ANY(PF_CMP_EQ), EQ(PF_PUSH_CONST, 1), ANY(PF_CMP_EQ)), P(LIT(PF_CMP_EQ, 0))),
+
+    /* Strength reduction */
+    RULE("mul-2", P(EQ(PF_PUSH_CONST, 2), ANY(PF_MUL)), P(LIT(PF_DUP, 0), LIT(PF_ADD, 0))),
+    RULE("mul-neg1", P(EQ(PF_PUSH_CONST, -1), ANY(PF_MUL)), P(LIT(PF_NEG, 0))),
+    /* Balanced ternary: multiplying by 3^k shifts in k zero trits */
+    RULE("mul-pow3", P(POW3(PF_PUSH_CONST, 1), ANY(PF_MUL)), P(LOG3(PF_TSHL, 0))),
+    RULE("mul-neg-pow3", P(POW3(PF_PUSH_CONST, -1), ANY(PF_MUL)),
+         P(LOG3(PF_TSHL, 0), LIT(PF_NEG, 0))),
+    RULE("pow3-mul-load", P(POW3(PF_PUSH_CONST, 1), ANY(PF_PUSH_VAR), ANY(PF_MUL)),
+         P(COPY(PF_PUSH_VAR, 1), LOG3(PF_TSHL, 0))),
+    RULE("neg-pow3-mul-load", P(POW3(PF_PUSH_CONST, -1), ANY(PF_PUSH_VAR), ANY(PF_MUL)),
+         P(COPY(PF_PUSH_VAR, 1), LOG3(PF_TSHL, 0), LIT(PF_NEG, 0))),
+    RULE("zero-minus", P(EQ(PF_PUSH_CONST, 0), ANY(PF_SWAP), ANY(PF_SUB)), P(LIT(PF_NEG, 0))),
+    RULE("neg-add", P(ANY(PF_NEG), ANY(PF_ADD)), P(LIT(PF_SUB, 0))),
+    RULE("neg-sub", P(ANY(PF_NEG), ANY(PF_SUB)), P(LIT(PF_ADD, 0))),
+
+    /* Commuted operands */
+    RULE("swap-add", P(ANY(PF_SWAP), ANY(PF_ADD)), P(LIT(PF_ADD, 0))),
+    RULE("swap-mul", P(ANY(PF_SWAP), ANY(PF_MUL)), P(LIT(PF_MUL, 0))),
+    RULE("swap-eq", P(ANY(PF_SWAP), ANY(PF_CMP_EQ)), P(LIT(PF_CMP_EQ, 0))),
+    RULE("swap-lt", P(ANY(PF_SWAP), ANY(PF_CMP_LT)), P(LIT(PF_CMP_GT, 0))),
+    RULE("swap-gt", P(ANY(PF_SWAP), ANY(PF_CMP_GT)), P(LIT(PF_CMP_LT, 0))),
+    RULE("swap-consts", P(ANY(PF_PUSH_CONST), ANY(PF_PUSH_CONST), ANY(PF_SWAP)),
+         P(COPY(PF_PUSH_CONST, 1), COPY(PF_PUSH_CONST, 0))),
+    RULE("swap-loads", P(ANY(PF_PUSH_VAR), ANY(PF_PUSH_VAR), ANY(PF_SWAP)),
+         P(COPY(PF_PUSH_VAR, 1), COPY(PF_PUSH_VAR, 0))),
+    RULE("swap-const-load", P(ANY(PF_PUSH_CONST), ANY(PF_PUSH_VAR), ANY(PF_SWAP)),
+         P(COPY(PF_PUSH_VAR, 1), COPY(PF_PUSH_CONST, 0))),
+    RULE("swap-load-const", P(ANY(PF_PUSH_VAR), ANY(PF_PUSH_CONST), ANY(PF_SWAP)),
+         P(COPY(PF_PUSH_CONST, 1), COPY(PF_PUSH_VAR, 0))),
+
+    /* Redundant stack traffic */
+    RULE0("dup-drop", P(ANY(PF_DUP), ANY(PF_DROP))),
+    RULE0("swap-swap", P(ANY(PF_SWAP), ANY(PF_SWAP))),
+    RULE("dup-swap", P(ANY(PF_DUP), ANY(PF_SWAP)), P(LIT(PF_DUP, 0))),
+    RULE0("const-drop", P(ANY(PF_PUSH_CONST), ANY(PF_DROP))),
+    RULE0("load-drop", P(ANY(PF_PUSH_VAR), ANY(PF_DROP))),
+    RULE0("addr-drop", P(ANY(PF_ADDR_OF), ANY(PF_DROP))),
+
+    /* Memory */
+    RULE("load-load", P(ANY(PF_PUSH_VAR), SAME(PF_PUSH_VAR, 0)), P(COPY(PF_PUSH_VAR, 0), LIT(PF_DUP, 0))),
+    RULE("store-load", P(ANY(PF_STORE_VAR), SAME(PF_PUSH_VAR, 0)), P(LIT(PF_DUP, 0), COPY(PF_STORE_VAR, 0))),
+    RULE("addr-deref", P(ANY(PF_ADDR_OF), ANY(PF_DEREF)), P(COPY(PF_PUSH_VAR, 0))),
+    RULE0("self-store", P(ANY(PF_ADDR_OF), SAME(PF_PUSH_VAR, 0), ANY(PF_STORE))),
+
+    /* Branches */
+    RULE("brz-taken", P(EQ(PF_PUSH_CONST, 0), ANY(PF_BRZ)), P(COPY(PF_JMP, 1))),
+    RULE0("brz-not-taken", P({PF_PUSH_CONST, PF_ARG_NONZERO, 0}, ANY(PF_BRZ))),
+    RULE("jmp-next", P(ANY(PF_JMP), SAME(PF_LABEL, 0)), P(COPY(PF_LABEL, 1))),
+};
+const int pf_default_rule_count = (int)(sizeof(pf_default_rules) / sizeof(pf_default_rules[0]));
+
+#undef ANY
+#undef EQ
+#undef SAME
+#undef POW3
+#undef LIT
+#undef COPY
+#undef FOLD
+#undef LOG3
+#undef RULE
+#undef RULE0
+#undef P
+
+/* Trie node: the rules whose pattern, read backwards, ends here */
+typedef struct {
+    int child[PF_OP_COUNT];
+    int first_rule;         /* Index into rules, chained through next_rule */
+} PfNode;
+
+struct PfMatcher {
+    PfRule *rules;
+    int *next_rule;
+    int rule_count;
+    PfNode *nodes;
+    int node_count;
+    int node_capacity;
+};
+
+/* Evaluate constant ops in[0..n) as the VM would; 0 and *out set if
+ * they leave exactly one value */
+static int pf_fold(const PostfixInstr *in, int n, int *out) {
+    unsigned int st[PF_RULE_MAX];
+    int sp = 0;
+    for (int i = 0; i < n; i++) {
+        PostfixOp op = in[i].op;
+        if (op == PF_PUSH_CONST) {
+            if (sp >= PF_RULE_MAX) return -1;
+            st[sp++] = (unsigned int)in[i].operand;
+            continue;
+        }
+        if (op == PF_NEG) {
+            if (sp < 1) return -1;
+            st[sp - 1] = 0u - st[sp - 1];
+            continue;
+        }
+        if (op == PF_TSHL || op == PF_TSHR) {
+            if (sp < 1) return -1;
+            for (int k = in[i].operand; k > 0 && st[sp - 1] != 0; k--) {
+                st[sp - 1] = op == PF_TSHL ? st[sp - 1] * 3u : (unsigned int)((int)st[sp - 1] / 3);
             }
-            break;
+            continue;
+        }
+        if (sp < 2) return -1;
+        unsigned int b = st[--sp], a = st[sp - 1];
+        int sa = (int)a, sb = (int)b;
+        switch (op) {
+            case PF_ADD:    st[sp - 1] = a + b; break;
+            case PF_SUB:    st[sp - 1] = a - b; break;
+            case PF_MUL:    st[sp - 1] = a * b; break;
+            case PF_CMP_EQ: st[sp - 1] = sa == sb ? 1 : 0; break;
+            case PF_CMP_LT: st[sp - 1] = (unsigned int)(sa < sb ? 1 : sa > sb ? -1 : 0); break;
+            case PF_CMP_GT: st[sp - 1] = (unsigned int)(sa > sb ? 1 : sa < sb ? -1 : 0); break;
+            default: return -1;
+        }
     }
+    if (sp != 1) return -1;
+    *out = (int)st[0];
+    return 0;
 }
 
-void pf_from_ast(PostfixSeq *seq, Expr *ast) {
-    emit_ast(seq, ast);
+static int pf_rule_valid(const PfRule *r) {
+    if (r->match_len < 1 || r->match_len > PF_RULE_MAX) return 0;
+    if (r->repl_len < 0 || r->repl_len > r->match_len) return 0;
+    for (int i = 0; i < r->match_len; i++) {
+        const PfPattern *p = &r->match[i];
+        if ((int)p->op < 0 || p->op >= PF_OP_COUNT) return 0;
+        if (p->arg == PF_ARG_SAME && (p->value < 0 || p->value >= i)) return 0;
+        if (p->arg == PF_ARG_POW3 && p->value != 1 && p->value != -1) return 0;
+    }
+    for (int i = 0; i < r->repl_len; i++) {
+        const PfReplace *q = &r->repl[i];
+        if ((int)q->op < 0 || q->op >= PF_OP_COUNT) return 0;
+        if (q->out == PF_OUT_LIT) continue;
+        if (q->value < 0 || q->value >= r->match_len) return 0;
+        if (q->out == PF_OUT_LOG3 && r->match[q->value].arg != PF_ARG_POW3) return 0;
+        if (q->out == PF_OUT_FOLD) {
+            /* Must fold for any constants: try with placeholders */
+            PostfixInstr probe[PF_RULE_MAX];
+            int v;
+            for (int k = q->value; k < r->match_len; k++) {
+                probe[k - q->value].op = r->match[k].op;
+                probe[k - q->value].operand = 1;
+            }
+            if (pf_fold(probe, r->match_len - q->value, &v) < 0) return 0;
+        }
+    }
+    return 1;
 }
 
-/* --- Peephole optimization --- */
+/* Append an empty trie node; tail tracks each node's last rule */
+static int pf_new_node(PfMatcher *m, int **tail) {
+    if (m->node_count >= m->node_capacity) {
+        m->node_capacity = m->node_capacity ? m->node_capacity * 2 : 32;
+        m->nodes = (PfNode *)realloc(m->nodes, (size_t)m->node_capacity * sizeof(PfNode));
+        *tail = (int *)realloc(*tail, (size_t)m->node_capacity * sizeof(int));
+        if (m->nodes == NULL || *tail == NULL) {
+            fprintf(stderr, "postfix_ir: realloc failed\n");
+            exit(1);
+        }
+    }
+    PfNode *node = &m->nodes[m->node_count];
+    for (int c = 0; c < PF_OP_COUNT; c++) node->child[c] = -1;
+    node->first_rule = -1;
+    (*tail)[m->node_count] = -1;
+    return m->node_count++;
+}
 
-void pf_optimize(PostfixSeq *seq) {
+PfMatcher *pf_compile_rules(const PfRule *rules, int count) {
+    for (int i = 0; i < count; i++) {
+        if (!pf_rule_valid(&rules[i])) return NULL;
+    }
+    PfMatcher *m = (PfMatcher *)calloc(1, sizeof(PfMatcher));
+    if (m != NULL) {
+        m->rules = (PfRule *)malloc((size_t)(count > 0 ? count : 1) * sizeof(PfRule));
+        m->next_rule = (int *)malloc((size_t)(count > 0 ? count : 1) * sizeof(int));
+    }
+    if (m == NULL || m->rules == NULL || m->next_rule == NULL) {
+        fprintf(stderr, "postfix_ir: malloc failed\n");
+        exit(1);
+    }
+    if (count > 0) memcpy(m->rules, rules, (size_t)count * sizeof(PfRule));
+    m->rule_count = count;
+
+    /* Each rule's ops go in last first, the order they are read off the
+     * tail of the output */
+    int *tail = NULL;
+    pf_new_node(m, &tail);
+    for (int i = 0; i < count; i++) {
+        int node = 0;
+        for (int k = rules[i].match_len - 1; k >= 0; k--) {
+            int op = rules[i].match[k].op;
+            if (m->nodes[node].child[op] < 0) {
+                int child = pf_new_node(m, &tail);
+                m->nodes[node].child[op] = child;
+            }
+            node = m->nodes[node].child[op];
+        }
+        /* Rules at one node keep table order */
+        m->next_rule[i] = -1;
+        if (tail[node] < 0) m->nodes[node].first_rule = i;
+        else m->next_rule[tail[node]] = i;
+        tail[node] = i;
+    }
+    free(tail);
+    return m;
+}
+
+void pf_free_rules(PfMatcher *m) {
+    if (m == NULL) return;
+    free(m->rules);
+    free(m->next_rule);
+    free(m->nodes);
+    free(m);
+}
+
+/* 1 if the last match_len instructions of out satisfy r's operand
+ * constraints (their ops are already known to match) */
+static int pf_args_match(const PfRule *r, const PostfixInstr *at) {
+    for (int k = 0; k < r->match_len; k++) {
+        const PfPattern *p = &r->match[k];
+        switch (p->arg) {
+            case PF_ARG_ANY:
+                break;
+            case PF_ARG_EQ:
+                if (at[k].operand != p->value) return 0;
+                break;
+            case PF_ARG_NONZERO:
+                if (at[k].operand == 0) return 0;
+                break;
+            case PF_ARG_SAME:
+                if (at[k].operand != at[p->value].operand || at[k].name != at[p->value].name) return 0;
+                break;
+            case PF_ARG_POW3:
+                if (trit_pow3_log(at[k].operand) == 0 || (at[k].operand < 0) != (p->value < 0)) return 0;
+                break;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Find the rule to apply to the tail of out[0..n): walk the trie from
+ * the last instruction backwards, then take the deepest node with a
+ * rule whose constraints hold. Writes the replacement to rep and
+ * returns its length, with *pop set to the pattern length; -1 if none.
+ */
+static int pf_match_tail(const PfMatcher *m, const PostfixInstr *out, int n,
+                         int *pop, PostfixInstr *rep) {
+    int path[PF_RULE_MAX + 1];
+    int depth = 0, node = 0;
+    while (depth < PF_RULE_MAX && depth < n) {
+        node = m->nodes[node].child[out[n - 1 - depth].op];
+        if (node < 0) break;
+        path[++depth] = node;
+    }
+    for (; depth > 0; depth--) {
+        const PostfixInstr *at = &out[n - depth];
+        for (int i = m->nodes[path[depth]].first_rule; i >= 0; i = m->next_rule[i]) {
+            const PfRule *r = &m->rules[i];
+            if (!pf_args_match(r, at)) continue;
+            for (int k = 0; k < r->repl_len; k++) {
+                const PfReplace *q = &r->repl[k];
+                rep[k].name = NULL;
+                rep[k].operand = q->value;
+                if (q->out == PF_OUT_COPY) {
+                    rep[k] = at[q->value];
+                } else if (q->out == PF_OUT_FOLD) {
+                    pf_fold(at + q->value, r->match_len - q->value, &rep[k].operand);
+                } else if (q->out == PF_OUT_LOG3) {
+                    rep[k].operand = trit_pow3_log(at[q->value].operand);
+                }
+                rep[k].op = q->op;
+            }
+            *pop = r->match_len;
+            return r->repl_len;
+        }
+    }
+    return -1;
+}
+
+int pf_optimize_with(PostfixSeq *seq, const PfMatcher *m) {
     /*
-     * Peephole patterns inspired by Setun-70's compact instruction design:
-     *
-     * 1. PUSH 0, ADD -> NOP (identity: a + 0 = a)
-     * 2. PUSH 1, MUL -> NOP (identity: a * 1 = a)
-     * 3. PUSH 0, MUL -> DROP, PUSH 0 (zero: a * 0 = 0)
-     * 4. DUP, DROP -> NOP (redundant stack ops)
-     * 5. Two consecutive PUSH_CONST + arithmetic -> fold to one PUSH_CONST
+     * One pass: instructions are appended to the output (in place, over
+     * the part of the array already read) and the rules are tried on
+     * the output's tail after each append. A rewrite pops the matched
+     * instructions and queues its replacement on a worklist, which is
+     * fed back before reading on, so only the neighborhood of a change
+     * is looked at again. Rewrites never grow the code, so the output
+     * never overtakes the input.
      */
+    PostfixInstr *work = NULL;
+    int wcount = 0, wcap = 0;
+    int n = 0, r = 0, rewrites = 0;
+    while (r < seq->count || wcount > 0) {
+        PostfixInstr in = wcount > 0 ? work[--wcount] : seq->instrs[r++];
+        if (in.op == PF_NOP) continue;
+        /* A label a rule pops comes back through the worklist and is
+         * placed again */
+        if (in.op == PF_LABEL) pf_place_label(seq, in.operand, n);
+        seq->instrs[n++] = in;
+
+        PostfixInstr rep[PF_RULE_MAX];
+        int pop;
+        int k = pf_match_tail(m, seq->instrs, n, &pop, rep);
+        if (k < 0) continue;
+        rewrites++;
+        n -= pop;
+        if (wcount + k > wcap) {
+            wcap = wcap ? wcap * 2 : 16;
+            work = (PostfixInstr *)realloc(work, (size_t)wcap * sizeof(PostfixInstr));
+            if (!work) {
+                fprintf(stderr, "postfix_ir: realloc failed\n");
+                exit(1);
+            }
+        }
+        /* Last on the worklist is fed first */
+        while (k > 0) work[wcount++] = rep[--k];
+    }
+    seq->count = n;
+    free(work);
+    return rewrites;
+}
+
+static PfMatcher *pf_default_matcher;
+static pthread_once_t pf_default_once = PTHREAD_ONCE_INIT;
+
+static void pf_compile_default(void) {
+    pf_default_matcher = pf_compile_rules(pf_default_rules, pf_default_rule_count);
+    if (pf_default_matcher == NULL) {
+        fprintf(stderr, "postfix_ir: malformed default peephole rule\n");
+        exit(1);
+    }
+}
+
+void pf_optimize(PostfixSeq *seq) {
+    pthread_once(&pf_default_once, pf_compile_default);
+    pf_optimize_with(seq, pf_default_matcher);
+}
+
+/* --- Stack scheduling --- */
+
+#define PF_SCHED_WINDOW 32  /* Farthest reference considered */
+#define PF_SCHED_LOADS  8   /* Most loads of one store scheduled together */
+#define PF_SCHED_EXTRA  5   /* Most instructions an edit appends */
+#define PF_LOAD_OPS     2   /* PUSH s; LOAD */
+#define PF_BITS         ((int)(8 * sizeof(unsigned long)))
+
+/* Operand stack effect of op; -1 for ops that end a stretch of code
+ * with a known stack shape */
+static int pf_effect(PostfixOp op, int *pops, int *pushes) {
+    switch (op) {
+        case PF_PUSH_CONST: case PF_PUSH_VAR: case PF_ADDR_OF:
+            *pops = 0; *pushes = 1; break;
+        case PF_STORE_VAR: case PF_DROP:
+            *pops = 1; *pushes = 0; break;
+        case PF_STORE:
+            *pops = 2; *pushes = 0; break;
+        case PF_ADD: case PF_SUB: case PF_MUL:
+        case PF_CMP_EQ: case PF_CMP_LT: case PF_CMP_GT:
+        case PF_CONSENSUS: case PF_ACCEPT_ANY:
+            *pops = 2; *pushes = 1; break;
+        case PF_NEG: case PF_DEREF: case PF_TSHL: case PF_TSHR:
+            *pops = 1; *pushes = 1; break;
+        case PF_DUP:  *pops = 1; *pushes = 2; break;
+        case PF_SWAP: *pops = 2; *pushes = 2; break;
+        case PF_OVER: *pops = 2; *pushes = 3; break;
+        case PF_ROT:  *pops = 3; *pushes = 3; break;
+        case PF_NOP:  *pops = 0; *pushes = 0; break;
+        default: return -1;
+    }
+    return 0;
+}
+
+static int pf_is_boundary(PostfixOp op) {
+    int pops, pushes;
+    return pf_effect(op, &pops, &pushes) < 0;
+}
+
+typedef struct {
+    const PostfixSeq *seq;
+    int n;
+    int *height;            /* Stack height before each instruction, relative
+                               to the start of its stretch */
+    int *addr_at;           /* STORE/DEREF: the ADDR_OF in its stretch that
+                               pushed its address, else -1 */
+    int *block;             /* Liveness block of each instruction */
+    unsigned long *live_in; /* Slots live into each block, words per block */
+    int words;
+    int nslots;
+    int dead_at_exit;
+} PfSched;
+
+static unsigned long *pf_alloc_bits(size_t count) {
+    unsigned long *bits = (unsigned long *)calloc(count ? count : 1, sizeof(unsigned long));
+    if (!bits) {
+        fprintf(stderr, "postfix_ir: calloc failed\n");
+        exit(1);
+    }
+    return bits;
+}
+
+/* Slot instruction k reads: the slot, -1 for none, -2 for any */
+static int pf_reads(const PfSched *S, int k) {
+    const PostfixInstr *in = &S->seq->instrs[k];
+    switch (in->op) {
+        case PF_PUSH_VAR:
+            return in->name == NULL ? in->operand : -2;
+        case PF_DEREF:
+            return S->addr_at[k] >= 0 ? S->seq->instrs[S->addr_at[k]].operand : -2;
+        case PF_CALL:
+        case PF_LOOP_END:       /* Goes to an address only known at run time */
+            return -2;
+        default:
+            return -1;
+    }
+}
+
+/* Slot instruction k certainly overwrites, or -1 */
+static int pf_kills(const PfSched *S, int k) {
+    const PostfixInstr *in = &S->seq->instrs[k];
+    if (in->op == PF_STORE_VAR && in->name == NULL) return in->operand;
+    if (in->op == PF_STORE && S->addr_at[k] >= 0) return S->seq->instrs[S->addr_at[k]].operand;
+    return -1;
+}
+
+/* 1 if instruction k may overwrite slot s */
+static int pf_may_write(const PfSched *S, int k, int s) {
+    const PostfixInstr *in = &S->seq->instrs[k];
+    if (in->op == PF_STORE_VAR) return in->name != NULL || in->operand == s;
+    if (in->op == PF_STORE) return S->addr_at[k] < 0 || S->seq->instrs[S->addr_at[k]].operand == s;
+    return 0;
+}
+
+/* Heights and the addresses STOREs and DEREFs use, by following
+ * ADDR_OF results through the stack */
+static void pf_stack_heights(PfSched *S) {
+    const PostfixSeq *seq = S->seq;
+    int *tag = (int *)malloc((size_t)(S->n + 1) * sizeof(int));
+    if (!tag) {
+        fprintf(stderr, "postfix_ir: malloc failed\n");
+        exit(1);
+    }
+    int h = 0, sp = 0;
+    for (int k = 0; k < S->n; k++) {
+        const PostfixInstr *in = &seq->instrs[k];
+        int pops, pushes, t[3] = {-1, -1, -1};
+        S->height[k] = h;
+        S->addr_at[k] = -1;
+        if (pf_effect(in->op, &pops, &pushes) < 0) {
+            h = sp = 0;
+            continue;
+        }
+        /* Values from before the stretch are untagged */
+        for (int i = 0; i < pops; i++) t[i] = sp > 0 ? tag[--sp] : -1;
+        h += pushes - pops;
+        switch (in->op) {
+            case PF_STORE: S->addr_at[k] = t[1]; break;
+            case PF_DEREF: S->addr_at[k] = t[0]; tag[sp++] = -1; break;
+            case PF_ADDR_OF: tag[sp++] = in->name == NULL ? k : -1; break;
+            case PF_DUP:  tag[sp++] = t[0]; tag[sp++] = t[0]; break;
+            case PF_SWAP: tag[sp++] = t[0]; tag[sp++] = t[1]; break;
+            case PF_OVER: tag[sp++] = t[1]; tag[sp++] = t[0]; tag[sp++] = t[1]; break;
+            case PF_ROT:  tag[sp++] = t[1]; tag[sp++] = t[0]; tag[sp++] = t[2]; break;
+            default:
+                for (int i = 0; i < pushes; i++) tag[sp++] = -1;
+                break;
+        }
+    }
+    S->height[S->n] = h;
+    free(tag);
+}
+
+/*
+ * Live slots on entry to each block: stretches of code between
+ * boundary instructions, and each boundary instruction on its own.
+ * Backward dataflow to a fixpoint; anything unknown (a call, a load
+ * through an unknown address, an unplaced label) makes every slot live.
+ */
+static void pf_liveness(PfSched *S) {
+    const PostfixSeq *seq = S->seq;
+    int n = S->n, nb = 0;
+    S->nslots = 1;
+    for (int k = 0; k < n; k++) {
+        const PostfixInstr *in = &seq->instrs[k];
+        if ((in->op == PF_PUSH_VAR || in->op == PF_STORE_VAR || in->op == PF_ADDR_OF) &&
+            in->name == NULL && in->operand >= S->nslots) {
+            S->nslots = in->operand + 1;
+        }
+        int boundary = pf_is_boundary(in->op);
+        if (k == 0 || boundary || pf_is_boundary(seq->instrs[k - 1].op)) nb++;
+        S->block[k] = nb - 1;
+    }
+    int w = S->words = (S->nslots + PF_BITS - 1) / PF_BITS;
+    unsigned long *gen = pf_alloc_bits((size_t)nb * w);
+    unsigned long *kill = pf_alloc_bits((size_t)nb * w);
+    int *last = (int *)malloc((size_t)(nb + 1) * sizeof(int));
+    S->live_in = pf_alloc_bits((size_t)nb * w);
+    if (!last) {
+        fprintf(stderr, "postfix_ir: malloc failed\n");
+        exit(1);
+    }
+
+    for (int k = n - 1; k >= 0; k--) {
+        int b = S->block[k];
+        unsigned long *g = gen + (size_t)b * w, *kl = kill + (size_t)b * w;
+        if (k == n - 1 || S->block[k + 1] != b) last[b] = k;
+        int s = pf_kills(S, k);
+        if (s >= 0) {
+            g[s / PF_BITS] &= ~(1UL << (s % PF_BITS));
+            kl[s / PF_BITS] |= 1UL << (s % PF_BITS);
+        }
+        s = pf_reads(S, k);
+        if (s == -2) {
+            for (int i = 0; i < w; i++) g[i] = ~0UL;
+        } else if (s >= 0) {
+            g[s / PF_BITS] |= 1UL << (s % PF_BITS);
+        }
+    }
+
+    unsigned long *out = pf_alloc_bits((size_t)w);
     int changed = 1;
     while (changed) {
         changed = 0;
-        for (int i = 0; i < seq->count - 1; i++) {
-            PostfixInstr *a = &seq->instrs[i];
-            PostfixInstr *b = &seq->instrs[i + 1];
-
-            /* Pattern: PUSH_CONST 0, ADD -> NOP both */
-            if (a->op == PF_PUSH_CONST && a->operand == 0 && b->op == PF_ADD) {
-                a->op = PF_NOP;
-                b->op = PF_NOP;
-                changed = 1;
-            }
-            /* Pattern: PUSH_CONST 1, MUL -> NOP both */
-            else if (a->op == PF_PUSH_CONST && a->operand == 1 && b->op == PF_MUL) {
-                a->op = PF_NOP;
-                b->op = PF_NOP;
-                changed = 1;
+        for (int b = nb - 1; b >= 0; b--) {
+            const PostfixInstr *in = &seq->instrs[last[b]];
+            int next = last[b] + 1 < n ? S->block[last[b] + 1] : -1;
+            int target = -1, falls = 1, unknown = 0;
+            if (in->op == PF_JMP || in->op == PF_BRZ || in->op == PF_BRN || in->op == PF_BRP) {
+                int at = pf_find_label(seq, in->operand);
+                if (at < 0) unknown = 1; else target = S->block[at];
+                falls = in->op != PF_JMP;
+            } else if (in->op == PF_RET || in->op == PF_HALT) {
+                falls = 0;
             }
-            /* Pattern: PUSH_CONST 0, MUL -> DROP prev, PUSH 0 */
-            else if (a->op == PF_PUSH_CONST && a->operand == 0 && b->op == PF_MUL) {
-                a->op = PF_DROP;
-                b->op = PF_PUSH_CONST;
-                b->operand = 0;
-                changed = 1;
+            for (int i = 0; i < w; i++) {
+                unsigned long o = unknown ? ~0UL : 0;
+                if (falls) o |= next >= 0 ? S->live_in[(size_t)next * w + i] : S->dead_at_exit ? 0 : ~0UL;
+                if (!falls && target < 0 && !S->dead_at_exit) o = ~0UL;
+                if (target >= 0) o |= S->live_in[(size_t)target * w + i];
+                out[i] = o;
             }
-            /* Pattern: Two PUSH_CONST + ADD -> fold */
-            if (i >= 1) {
-                PostfixInstr *prev = &seq->instrs[i - 1];
-                if (prev->op == PF_PUSH_CONST && a->op == PF_PUSH_CONST &&
-                    b->op == PF_ADD) {
-                    prev->operand = prev->operand + a->operand;
-                    a->op = PF_NOP;
-                    b->op = PF_NOP;
-                    changed = 1;
-                }
-                else if (prev->op == PF_PUSH_CONST && a->op == PF_PUSH_CONST &&
-                         b->op == PF_MUL) {
-                    prev->operand = prev->operand * a->operand;
-                    a->op = PF_NOP;
-                    b->op = PF_NOP;
-                    changed = 1;
-                }
-                else if (prev->op == PF_PUSH_CONST && a->op == PF_PUSH_CONST &&
-                         b->op == PF_SUB) {
-                    prev->operand = prev->operand - a->operand;
-                    a->op = PF_NOP;
-                    b->op = PF_NOP;
+            for (int i = 0; i < w; i++) {
+                size_t at = (size_t)b * w + i;
+                unsigned long in_bits = gen[at] | (out[i] & ~kill[at]);
+                if (in_bits != S->live_in[at]) {
+                    S->live_in[at] = in_bits;
                     changed = 1;
                 }
             }
         }
+    }
+    free(out);
+    free(gen);
+    free(kill);
+    free(last);
+}
+
+/* 1 if slot s is overwritten or dead before anything reads it again
+ * after instruction k */
+static int pf_dead_after(const PfSched *S, int k, int s) {
+    for (int x = k + 1; x <= k + PF_SCHED_WINDOW; x++) {
+        if (x == S->n) return S->dead_at_exit;
+        if (pf_is_boundary(S->seq->instrs[x].op)) {
+            return !(S->live_in[(size_t)S->block[x] * S->words + s / PF_BITS] >> (s % PF_BITS) & 1);
+        }
+        int r = pf_reads(S, x);
+        if (r == s || r == -2) return 0;
+        if (pf_kills(S, x) == s) return 1;
+    }
+    return 0;
+}
+
+typedef struct {
+    int drop;                           /* Remove the instruction itself */
+    int n;
+    PostfixInstr add[PF_SCHED_EXTRA];   /* Appended after it */
+} PfEdit;
+
+static void pf_edit_add(PfEdit *e, PostfixOp op, int operand) {
+    e->add[e->n].op = op;
+    e->add[e->n].operand = operand;
+    e->add[e->n].name = NULL;
+    e->n++;
+}
+
+/* How the first reference of a pair provides the value */
+enum {
+    PF_SCHED_MOVE,      /* The value itself (its store is removed) */
+    PF_SCHED_DUP,       /* A DUP of it (made before its store) */
+    PF_SCHED_TUCK       /* A copy of a load, which lies just under it */
+};
+
+/*
+ * Getting a value from one reference of a slot to the next. The value
+ * is on top at height b + 1 after the first, the code in between takes
+ * the stack down to low, and the second finds the stack at height h.
+ * Either a loaded value is still where the load left it and is picked
+ * (DUP, OVER), or the value is sunk under what the code in between
+ * touches (SWAP, ROT ROT; a load's copy is tucked under with DUP or
+ * SWAP OVER) and raised at the second (SWAP, ROT).
+ */
+typedef struct {
+    int mode;
+    PostfixOp pick;     /* PF_DUP or PF_OVER, or PF_NOP */
+    int sink, raise;
+    int cost;           /* Instructions added */
+} PfPlan;
+
+static int pf_plan(int b, int low, int h, int mode, PfPlan *p) {
+    p->mode = mode;
+    p->pick = PF_NOP;
+    p->sink = p->raise = p->cost = 0;
+    if (mode == PF_SCHED_TUCK && low >= b && h - b <= 1) {
+        p->pick = h == b ? PF_DUP : PF_OVER;
+        p->cost = 1;
+        return 0;
+    }
+    if (low > b) low = b;
+    p->sink = b - low;
+    p->raise = h - low;
+    if (p->sink > 2 || p->raise > 2) return -1;
+    p->cost = (mode == PF_SCHED_TUCK ? (p->sink > 1 ? p->sink : 1) : p->sink) +
+              (mode == PF_SCHED_DUP) + (p->raise > 0);
+    return 0;
+}
+
+static void pf_apply_plan(PfEdit *first, PfEdit *second, const PfPlan *p) {
+    second->drop = 1;
+    if (p->pick != PF_NOP) {
+        pf_edit_add(second, p->pick, 0);
+        return;
+    }
+    if (p->mode == PF_SCHED_TUCK) {
+        if (p->sink == 2) pf_edit_add(first, PF_SWAP, 0);
+        pf_edit_add(first, p->sink == 2 ? PF_OVER : PF_DUP, 0);
+    } else {
+        for (int i = 0; i < p->sink; i++) pf_edit_add(first, p->sink == 1 ? PF_SWAP : PF_ROT, 0);
+    }
+    if (p->raise > 0) pf_edit_add(second, p->raise == 1 ? PF_SWAP : PF_ROT, 0);
+}
+
+int pf_schedule_stack(PostfixSeq *seq, int dead_at_exit) {
+    PfSched S;
+    int n = S.n = seq->count;
+    S.seq = seq;
+    S.dead_at_exit = dead_at_exit;
+    S.height = (int *)malloc((size_t)(n + 1) * sizeof(int));
+    S.addr_at = (int *)malloc((size_t)(n + 1) * sizeof(int));
+    S.block = (int *)malloc((size_t)(n + 1) * sizeof(int));
+    PfEdit *edit = (PfEdit *)calloc((size_t)(n + 1), sizeof(PfEdit));
+    if (!S.height || !S.addr_at || !S.block || !edit) {
+        fprintf(stderr, "postfix_ir: malloc failed\n");
+        exit(1);
+    }
+    pf_stack_heights(&S);
+    pf_liveness(&S);
+
+    /*
+     * References to one slot within a stretch, left to right. A store
+     * followed by loads that read all it leaves behind is removed
+     * together with them, its value kept on the stack; otherwise the
+     * first reference of a pair leaves a copy for the second. A pair
+     * of loads may chain on to the next. Edits never overlap, so the
+     * heights of the original code stay valid for each.
+     */
+    int removed = 0, busy = 0;
+    for (int i = 0; i < n; i++) {
+        const PostfixInstr *in = &seq->instrs[i];
+        int slot, addr = -1, is_store = in->op != PF_PUSH_VAR;
+        if ((in->op == PF_PUSH_VAR || in->op == PF_STORE_VAR) && in->name == NULL) {
+            slot = in->operand;
+        } else if (in->op == PF_STORE && S.addr_at[i] >= busy) {
+            addr = S.addr_at[i];
+            slot = seq->instrs[addr].operand;
+        } else {
+            continue;
+        }
+
+        /* The loads that follow, up to anything that may overwrite slot */
+        int js[PF_SCHED_LOADS], lows[PF_SCHED_LOADS], r = 0;
+        int low = INT_MAX, clean = 1;
+        for (int k = i + 1; k < n && k <= i + PF_SCHED_WINDOW && r < PF_SCHED_LOADS; k++) {
+            const PostfixInstr *x = &seq->instrs[k];
+            int pops, pushes;
+            if (pf_effect(x->op, &pops, &pushes) < 0 || pf_may_write(&S, k, slot)) break;
+            if (x->op == PF_PUSH_VAR && x->name == NULL && x->operand == slot) {
+                js[r] = k;
+                lows[r++] = low;
+                low = INT_MAX;
+                continue;
+            }
+            int rd = pf_reads(&S, k);
+            if (rd == slot || rd == -2) clean = 0;
+            if (S.height[k] - pops < low) low = S.height[k] - pops;
+        }
+        if (r == 0) continue;
+        int remove = is_store && clean && pf_dead_after(&S, js[r - 1], slot);
+        int kept = is_store && !remove;
+        if (!remove) r = 1;
+
+        /* Plan each pair; together they may add no more instructions
+         * than the loads (and a removed store) take */
+        PfPlan plan[PF_SCHED_LOADS];
+        int budget = PF_LOAD_OPS * r + (!remove ? 0 : addr >= 0 ? 2 : 3);
+        int added = kept && addr >= 0;   /* STORE_VAR's lowering has a SWAP more */
+        int ok = 1;
+        for (int t = 0; t < r && ok; t++) {
+            int from = t == 0 ? i : js[t - 1];
+            int mode = t > 0 || !is_store ? PF_SCHED_TUCK : remove ? PF_SCHED_MOVE : PF_SCHED_DUP;
+            ok = pf_plan(S.height[from + 1], lows[t], S.height[js[t]], mode, &plan[t]) == 0;
+            added += plan[t].cost;
+        }
+        if (!ok || added > budget) continue;
 
-        /* Compact: remove NOPs */
-        if (changed) {
-            int write = 0;
-            for (int read = 0; read < seq->count; read++) {
-                if (seq->instrs[read].op != PF_NOP) {
-                    if (write != read) {
-                        seq->instrs[write] = seq->instrs[read];
-                    }
-                    write++;
-                } else {
-                    if (seq->instrs[read].name) free(seq->instrs[read].name);
+        for (int t = 0; t < r; t++) {
+            int from = t == 0 ? i : js[t - 1];
+            if (t == 0 && is_store) {
+                edit[i].drop = 1;
+                if (addr >= 0) edit[addr].drop = 1;
+                if (kept) {
+                    pf_edit_add(&edit[i], PF_DUP, 0);
+                    pf_edit_add(&edit[i], PF_STORE_VAR, slot);
                 }
             }
-            seq->count = write;
+            pf_apply_plan(&edit[from], &edit[js[t]], &plan[t]);
         }
+        removed += r + remove;
+        busy = js[r - 1];
+        i = busy - 1;
     }
+
+    if (removed > 0) {
+        int extra = 0;
+        for (int k = 0; k < n; k++) extra += edit[k].n;
+        PostfixInstr *out = (PostfixInstr *)malloc((size_t)(n + extra + 1) * sizeof(PostfixInstr));
+        if (!out) {
+            fprintf(stderr, "postfix_ir: malloc failed\n");
+            exit(1);
+        }
+        int w = 0;
+        for (int k = 0; k < n; k++) {
+            if (!edit[k].drop) {
+                if (seq->instrs[k].op == PF_LABEL) pf_place_label(seq, seq->instrs[k].operand, w);
+                out[w++] = seq->instrs[k];
+            }
+            for (int a = 0; a < edit[k].n; a++) out[w++] = edit[k].add[a];
+        }
+        free(seq->instrs);
+        seq->instrs = out;
+        seq->count = w;
+        seq->capacity = n + extra + 1;
+    }
+    free(S.height);
+    free(S.addr_at);
+    free(S.block);
+    free(S.live_in);
+    free(edit);
+    return removed;
+}
+
+/* --- Lowering to bytecode --- */
+
+/* Append one byte (or only count it when obj is NULL) */
+static void put(ObjectModule *obj, int *len, int byte) {
+    if (obj != NULL) object_emit(obj, (unsigned char)byte);
+    (*len)++;
+}
+
+/* Push value: one PUSH when it fits the signed operand byte */
+static void put_const(ObjectModule *obj, int *len, int value) {
+    if (value >= -128 && value <= 127) {
+        put(obj, len, OP_PUSH);
+        put(obj, len, value & 0xFF);
+        return;
+    }
+    put_const(obj, len, value / 64);
+    put(obj, len, OP_PUSH);
+    put(obj, len, 64);
+    put(obj, len, OP_MUL);
+    if (value % 64 != 0) {
+        put_const(obj, len, value % 64);
+        put(obj, len, OP_ADD);
+    }
+}
+
+/* Branch with a module-relative target patched by the linker */
+static void put_branch(ObjectModule *obj, int *len, int op, int target) {
+    put(obj, len, op);
+    if (obj != NULL) object_add_reloc_id(obj, obj->code_len, INTERN_NONE);
+    put(obj, len, target);
+}
+
+static int lower_instr(ObjectModule *obj, int *len, const PostfixInstr *in, int target) {
+    static const unsigned char simple[] = {
+        [PF_ADD] = OP_ADD, [PF_SUB] = OP_SUB, [PF_MUL] = OP_MUL,
+        [PF_CMP_EQ] = OP_CMP_EQ, [PF_CMP_LT] = OP_CMP_LT, [PF_CMP_GT] = OP_CMP_GT,
+        [PF_NEG] = OP_NEG, [PF_CONSENSUS] = OP_CONSENSUS, [PF_ACCEPT_ANY] = OP_ACCEPT_ANY,
+        [PF_LOOP_BEGIN] = OP_LOOP_BEGIN, [PF_LOOP_END] = OP_LOOP_END, [PF_RET] = OP_RET,
+        [PF_ENTER] = OP_ENTER, [PF_LEAVE] = OP_LEAVE, [PF_DEREF] = OP_LOAD,
+        [PF_STORE] = OP_STORE, [PF_DUP] = OP_DUP, [PF_DROP] = OP_DROP,
+        [PF_SWAP] = OP_SWAP, [PF_OVER] = OP_OVER, [PF_ROT] = OP_ROT,
+        [PF_HALT] = OP_HALT,
+    };
+    switch (in->op) {
+        case PF_PUSH_CONST:
+            put_const(obj, len, in->operand);
+            break;
+        case PF_PUSH_VAR:
+        case PF_STORE_VAR:
+        case PF_ADDR_OF:
+            if (in->name != NULL) return -1;
+            put_const(obj, len, in->operand);
+            if (in->op == PF_PUSH_VAR) {
+                put(obj, len, OP_LOAD);
+            } else if (in->op == PF_STORE_VAR) {
+                put(obj, len, OP_SWAP);
+                put(obj, len, OP_STORE);
+            }
+            break;
+        case PF_BRZ:
+        case PF_BRN:
+        case PF_BRP:
+        case PF_JMP:
+            put_branch(obj, len, in->op == PF_BRZ ? OP_BRZ : in->op == PF_BRN ? OP_BRN :
+                                 in->op == PF_BRP ? OP_BRP : OP_JMP, target);
+            break;
+        case PF_TSHL:
+        case PF_TSHR:
+            put(obj, len, in->op == PF_TSHL ? OP_TSHL : OP_TSHR);
+            put(obj, len, in->operand);
+            break;
+        case PF_CALL:
+            return -1;
+        case PF_NOP:
+        case PF_LABEL:
+            break;
+        default:
+            put(obj, len, simple[in->op]);
+            break;
+    }
+    return 0;
+}
+
+static int is_branch(PostfixOp op) {
+    return op == PF_BRZ || op == PF_BRN || op == PF_BRP || op == PF_JMP;
+}
+
+/*
+ * Where branch i really goes: its label, or past any chain of JMPs that
+ * follows the label (with nothing in between that emits code). Returns
+ * the instruction index, or -1 if a label is not placed.
+ */
+static int branch_dest(const PostfixSeq *seq, int i) {
+    int d = pf_find_label(seq, seq->instrs[i].operand);
+    /* A chain longer than the sequence is a cycle: stop threading */
+    for (int hops = 0; d >= 0 && hops < seq->count; hops++) {
+        int j = d;
+        while (j < seq->count && (seq->instrs[j].op == PF_LABEL || seq->instrs[j].op == PF_NOP)) j++;
+        if (j == seq->count || seq->instrs[j].op != PF_JMP || j == i) break;
+        int next = pf_find_label(seq, seq->instrs[j].operand);
+        if (next < 0) break;
+        d = next;
+    }
+    return d;
+}
+
+void pf_pc_map_free(PfPcMap *map) {
+    free(map->pc);
+    map->pc = NULL;
+    map->count = 0;
+}
+
+int pf_pc_map_find(const PfPcMap *map, int pc) {
+    if (map->pc == NULL || pc < 0 || pc >= map->pc[map->count]) return -1;
+    /* Last instruction starting at or before pc; those sharing its
+     * offset emit nothing, so the last of them is the one that owns it */
+    int lo = 0, hi = map->count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (map->pc[mid] <= pc) lo = mid; else hi = mid - 1;
+    }
+    return lo;
+}
+
+int pf_lower_map(const PostfixSeq *seq, ObjectModule *obj, PfPcMap *map) {
+    /* at[i]: offset of instruction i (at[count]: the length); size[i]:
+     * its bytes; dest[i]: the instruction branch i ends up at */
+    int n = seq->count;
+    int *at = (int *)malloc((size_t)(n + 1) * sizeof(int));
+    int *size = (int *)malloc((size_t)(n + 1) * sizeof(int));
+    int *dest = (int *)malloc((size_t)(n + 1) * sizeof(int));
+    if (at == NULL || size == NULL || dest == NULL) {
+        fprintf(stderr, "postfix_ir: malloc failed\n");
+        exit(1);
+    }
+
+    /* Pass 1: sizes, with every branch in its long form */
+    for (int i = 0; i < n; i++) {
+        const PostfixInstr *in = &seq->instrs[i];
+        size[i] = 0;
+        dest[i] = is_branch(in->op) ? branch_dest(seq, i) : 0;
+        if (dest[i] < 0 || lower_instr(NULL, &size[i], in, 0) < 0) {
+            free(at);
+            free(size);
+            free(dest);
+            return -1;
+        }
+    }
+
+    /*
+     * Relaxation: a branch to the code right after it is a JMP of no
+     * bytes or a conditional branch reduced to dropping its condition.
+     * Shrinking only pulls targets closer, so sizes fall monotonically
+     * and the loop ends once a pass changes nothing.
+     */
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        at[0] = 0;
+        for (int i = 0; i < n; i++) at[i + 1] = at[i] + size[i];
+        for (int i = 0; i < n; i++) {
+            if (!is_branch(seq->instrs[i].op) || at[dest[i]] != at[i + 1]) continue;
+            int shortest = seq->instrs[i].op == PF_JMP ? 0 : 1;
+            if (size[i] > shortest) {
+                size[i] = shortest;
+                changed = 1;
+            }
+        }
+    }
+
+    /* Pass 2: emit with targets known */
+    int start = obj->code_len;
+    int len = 0;
+    for (int i = 0; i < n; i++) {
+        const PostfixInstr *in = &seq->instrs[i];
+        if (is_branch(in->op) && size[i] < 2) {
+            if (size[i] == 1) put(obj, &len, OP_DROP);
+        } else {
+            lower_instr(obj, &len, in, is_branch(in->op) ? at[dest[i]] : 0);
+        }
+    }
+    if (map != NULL) {
+        map->pc = at;
+        map->count = n;
+    } else {
+        free(at);
+    }
+    free(size);
+    free(dest);
+    return obj->code_len - start;
+}
+
+int pf_lower(const PostfixSeq *seq, ObjectModule *obj) {
+    return pf_lower_map(seq, obj, NULL);
 }
 
 /* --- Dump --- */
 
 static const char *pf_op_names[] = {
-    "PUSH_CONST", "PUSH_VAR", "STORE_VAR",
-    "ADD", "SUB", "MUL",
+    "PUSH_CONST", "PUSH_VAR", "STORE_VAR", "STORE",
+    "ADD", "SUB", "MUL", "TSHL", "TSHR",
     "CMP_EQ", "CMP_LT", "CMP_GT",
     "NEG", "CONSENSUS", "ACCEPT_ANY",
     "BRZ", "BRN", "BRP", "JMP",
@@ -366,7 +1331,7 @@ static const char *pf_op_names[] = {
     "CALL", "RET",
     "ENTER", "LEAVE",
     "DEREF", "ADDR_OF",
-    "DUP", "DROP",
+    "DUP", "DROP", "SWAP", "OVER", "ROT",
     "HALT", "NOP", "LABEL"
 };
 
@@ -375,7 +1340,7 @@ void pf_dump(const PostfixSeq *seq) {
     for (int i = 0; i < seq->count; i++) {
         const PostfixInstr *instr = &seq->instrs[i];
         printf("  %3d: %-12s", i, pf_op_names[instr->op]);
-        if (instr->op == PF_PUSH_CONST) {
+        if (instr->op == PF_PUSH_CONST || instr->op == PF_TSHL || instr->op == PF_TSHR) {
             printf(" %d", instr->operand);
         } else if (instr->op == PF_LABEL) {
             printf(" L%d", instr->operand);
@@ -384,6 +1349,9 @@ void pf_dump(const PostfixSeq *seq) {
             printf(" -> L%d", instr->operand);
         } else if (instr->name) {
             printf(" %s", instr->name);
+        } else if (instr->op == PF_PUSH_VAR || instr->op == PF_STORE_VAR ||
+                   instr->op == PF_ADDR_OF) {
+            printf(" [%d]", instr->operand);
         }
         printf("\n");
     }
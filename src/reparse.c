@@ -0,0 +1,189 @@
+/*
+ * reparse.c - Incremental reparsing for editor integration
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/reparse.h"
+#include "../include/parser.h"
+#include "../include/logger.h"
+
+static void *reparse_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "reparse: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void reserve_extents(ParseDoc *doc, int n) {
+    if (n > doc->extent_capacity) {
+        doc->extent_capacity = n > 2 * doc->extent_capacity ? n : 2 * doc->extent_capacity;
+        doc->extents = (FuncExtent *)reparse_alloc(doc->extents,
+                                                   (size_t)doc->extent_capacity * sizeof(FuncExtent));
+    }
+}
+
+/* Parse functions from the start of the text; on a syntax error the
+ * previous AST and extents stay */
+static int parse_all(ParseDoc *doc) {
+    Parser ps;
+    parser_init(&ps, doc->text);
+    Expr *prog = create_program();
+    FuncExtent *ext = NULL;
+    int cap = 0;
+    size_t pos = 0;
+    doc->reparsed = 0;
+    while (lexer_peek(&ps.lex, 0).type != TOK_EOF) {
+        Expr *fn = parser_parse_function(&ps);
+        if (fn == NULL) {
+            expr_free(prog);
+            free(ext);
+            doc->error = 1;
+            return -1;
+        }
+        program_add_func(prog, fn);
+        if (prog->param_count > cap) {
+            cap = cap ? cap * 2 : 4;
+            ext = (FuncExtent *)reparse_alloc(ext, (size_t)cap * sizeof(FuncExtent));
+        }
+        ext[prog->param_count - 1] = (FuncExtent){pos, ps.lex.end};
+        pos = ps.lex.end;
+        doc->reparsed++;
+    }
+    expr_free(doc->program);
+    free(doc->extents);
+    doc->program = prog;
+    doc->extents = ext;
+    doc->extent_capacity = cap;
+    doc->error = 0;
+    return 0;
+}
+
+int parse_doc_open(ParseDoc *doc, const char *source) {
+    memset(doc, 0, sizeof(*doc));
+    doc->len = strlen(source);
+    doc->capacity = doc->len + 1;
+    doc->text = (char *)reparse_alloc(NULL, doc->capacity);
+    memcpy(doc->text, source, doc->len + 1);
+    return parse_all(doc);
+}
+
+void parse_doc_free(ParseDoc *doc) {
+    expr_free(doc->program);
+    free(doc->text);
+    free(doc->extents);
+    memset(doc, 0, sizeof(*doc));
+}
+
+/* First function whose extent ends after offset */
+static int first_touched(const ParseDoc *doc, size_t offset) {
+    int lo = 0, hi = doc->program->param_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (doc->extents[mid].end <= offset) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+int parse_doc_edit(ParseDoc *doc, size_t offset, size_t removed, const char *inserted) {
+    LOG_DEBUG_MSG("Reparse", "TASK-046", "parse_doc_edit entered");
+    if (offset > doc->len || removed > doc->len - offset) return -2;
+
+    /* Splice the text */
+    size_t ins = strlen(inserted);
+    size_t new_len = doc->len - removed + ins;
+    if (new_len + 1 > doc->capacity) {
+        doc->capacity = new_len + 1 > 2 * doc->capacity ? new_len + 1 : 2 * doc->capacity;
+        doc->text = (char *)reparse_alloc(doc->text, doc->capacity);
+    }
+    memmove(doc->text + offset + ins, doc->text + offset + removed, doc->len - offset - removed + 1);
+    memcpy(doc->text + offset, inserted, ins);
+    doc->len = new_len;
+    doc->reused = 0;
+
+    /* The previous text did not parse, so its extents are not this
+     * text's: start over */
+    if (doc->error) return parse_all(doc);
+
+    Expr *prog = doc->program;
+    int old_count = prog->param_count;
+    ptrdiff_t delta = (ptrdiff_t)ins - (ptrdiff_t)removed;
+    size_t edit_end = offset + removed;     /* In old coordinates */
+
+    /* Functions ending at or before the edit are untouched; lexing
+     * restarts just past the last of them */
+    int keep = first_touched(doc, offset);
+    size_t pos = keep > 0 ? doc->extents[keep - 1].end : 0;
+
+    /* The new parse may fall back into step with the old one at the
+     * start of any old function at or after edit_end */
+    int sync = keep;
+    while (sync < old_count && doc->extents[sync].start < edit_end) sync++;
+
+    Expr **parsed = NULL;
+    FuncExtent *parsed_ext = NULL;
+    int n = 0, cap = 0, resumed = -1;
+    Parser ps;
+    parser_init_at(&ps, doc->text, pos);
+    doc->reparsed = 0;
+    while (lexer_peek(&ps.lex, 0).type != TOK_EOF) {
+        Expr *fn = parser_parse_function(&ps);
+        if (fn == NULL) {
+            /* Nothing is spliced yet, so the old AST stays whole */
+            for (int i = 0; i < n; i++) expr_free(parsed[i]);
+            free(parsed);
+            free(parsed_ext);
+            doc->error = 1;
+            return -1;
+        }
+        if (n == cap) {
+            cap = cap ? cap * 2 : 4;
+            parsed = (Expr **)reparse_alloc(parsed, (size_t)cap * sizeof(Expr *));
+            parsed_ext = (FuncExtent *)reparse_alloc(parsed_ext, (size_t)cap * sizeof(FuncExtent));
+        }
+        parsed[n] = fn;
+        parsed_ext[n] = (FuncExtent){pos, ps.lex.end};
+        n++;
+        doc->reparsed++;
+        pos = ps.lex.end;
+
+        /* Ended where an untouched old function starts: the rest of the
+         * text, and so the rest of the AST, is unchanged */
+        while (sync < old_count && (ptrdiff_t)doc->extents[sync].start + delta < (ptrdiff_t)pos) sync++;
+        if (sync < old_count && (ptrdiff_t)doc->extents[sync].start + delta == (ptrdiff_t)pos) {
+            resumed = sync;
+            break;
+        }
+    }
+
+    /* Splice the function list: [0, keep) + parsed + [resumed, old_count) */
+    int tail = resumed >= 0 ? old_count - resumed : 0;
+    int dropped_end = resumed >= 0 ? resumed : old_count;
+    for (int i = keep; i < dropped_end; i++) expr_free(prog->params[i]);
+    int count = keep + n + tail;
+    if (count > old_count) {
+        prog->params = (Expr **)reparse_alloc(prog->params, (size_t)count * sizeof(Expr *));
+    }
+    reserve_extents(doc, count);
+    if (tail > 0) {
+        memmove(&prog->params[keep + n], &prog->params[resumed], (size_t)tail * sizeof(Expr *));
+        memmove(&doc->extents[keep + n], &doc->extents[resumed], (size_t)tail * sizeof(FuncExtent));
+        for (int i = keep + n; i < count; i++) {
+            doc->extents[i].start = (size_t)((ptrdiff_t)doc->extents[i].start + delta);
+            doc->extents[i].end = (size_t)((ptrdiff_t)doc->extents[i].end + delta);
+        }
+    }
+    if (n > 0) {
+        memcpy(&prog->params[keep], parsed, (size_t)n * sizeof(Expr *));
+        memcpy(&doc->extents[keep], parsed_ext, (size_t)n * sizeof(FuncExtent));
+    }
+    prog->param_count = count;
+    doc->reused = keep + tail;
+    free(parsed);
+    free(parsed_ext);
+    return 0;
+}
@@ -0,0 +1,404 @@
+/*
+ * server.c - Persistent compile server over a Unix domain socket
+ *
+ * Workers all block in accept() on the shared listening socket, so the
+ * kernel hands each new connection to an idle worker. Shutdown closes
+ * the listening side with shutdown(), which wakes every blocked accept,
+ * and shuts down the read side of each open connection so workers idle
+ * on a persistent client see EOF.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "../include/server.h"
+#include "../include/bootstrap.h"
+#include "../include/cache.h"
+#include "../include/driver.h"
+#include "../include/vm.h"
+#include "../include/logger.h"
+
+/* The VM keeps its stacks and memory in globals */
+static pthread_mutex_t vm_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *server_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "server: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+/* ---- Framing ---- */
+
+static int read_full(int fd, void *buf, size_t len) {
+    unsigned char *p = (unsigned char *)buf;
+    while (len > 0) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_full(int fd, const void *buf, size_t len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int send_response(int fd, int status, int result, const unsigned char *code, int len) {
+    ServerResponse resp;
+    resp.status = status;
+    resp.result = result;
+    resp.len = (uint32_t)len;
+    if (write_full(fd, &resp, sizeof(resp)) < 0) return -1;
+    return len > 0 ? write_full(fd, code, (size_t)len) : 0;
+}
+
+/* ---- Workers ---- */
+
+typedef struct {
+    Server *server;
+    int index;                /* Slot in server->active */
+    BootstrapCtx bc;
+    char *source;             /* Request buffer, grown on demand */
+    size_t source_cap;
+    unsigned char code[SERVER_MAX_CODE];
+} ServerWorker;
+
+/* Serve requests on one connection until EOF. Returns 1 after SHUTDOWN */
+static int serve_connection(ServerWorker *w, int fd) {
+    for (;;) {
+        ServerRequest req;
+        if (read_full(fd, &req, sizeof(req)) < 0) return 0;
+        atomic_fetch_add(&w->server->requests, 1);
+
+        if (req.op == SERVER_OP_SHUTDOWN) {
+            send_response(fd, SERVER_OK, 0, NULL, 0);
+            server_stop(w->server);
+            return 1;
+        }
+        if (req.len > SERVER_MAX_SOURCE) {
+            /* Payload is unread, so the stream cannot be resynchronized */
+            send_response(fd, SERVER_ERR_REQUEST, 0, NULL, 0);
+            return 0;
+        }
+
+        if (req.len + 1 > w->source_cap) {
+            w->source_cap = req.len + 1;
+            w->source = (char *)server_alloc(w->source, w->source_cap);
+        }
+        if (read_full(fd, w->source, req.len) < 0) return 0;
+        w->source[req.len] = '\0';
+
+        if (req.op != SERVER_OP_COMPILE && req.op != SERVER_OP_RUN) {
+            if (send_response(fd, SERVER_ERR_REQUEST, 0, NULL, 0) < 0) return 0;
+            continue;
+        }
+
+        int len = bootstrap_compile_ctx(&w->bc, w->source, w->code, SERVER_MAX_CODE);
+        if (len < 0) {
+            if (send_response(fd, SERVER_ERR_COMPILE, 0, NULL, 0) < 0) return 0;
+            continue;
+        }
+
+        int status = SERVER_OK, result = 0;
+        if (req.op == SERVER_OP_RUN) {
+            pthread_mutex_lock(&vm_lock);
+            vm_memory_reset();
+            /* A run cut off mid-way has no result, only whatever is on the stack */
+            if (vm_run_limit(w->code, (size_t)len, SERVER_MAX_STEPS) < 0) status = SERVER_ERR_RUN;
+            else result = vm_get_result();
+            pthread_mutex_unlock(&vm_lock);
+        }
+        if (send_response(fd, status, result, w->code, len) < 0) return 0;
+    }
+}
+
+static void *server_worker(void *arg) {
+    ServerWorker *w = (ServerWorker *)arg;
+    Server *s = w->server;
+
+    while (!atomic_load(&s->stopping)) {
+        int fd = accept(s->listen_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            /* Shut down, or failing for good (EMFILE, ...): either way
+             * take the other workers down too, so server_serve() returns */
+            if (!atomic_load(&s->stopping)) perror("server: accept");
+            server_stop(s);
+            break;
+        }
+        pthread_mutex_lock(&s->lock);
+        int stopping = atomic_load(&s->stopping);
+        if (!stopping) s->active[w->index] = fd;
+        pthread_mutex_unlock(&s->lock);
+        if (stopping) {
+            close(fd);
+            break;
+        }
+
+        serve_connection(w, fd);
+
+        pthread_mutex_lock(&s->lock);
+        s->active[w->index] = -1;
+        pthread_mutex_unlock(&s->lock);
+        close(fd);
+    }
+    return NULL;
+}
+
+/* ---- Server lifecycle ---- */
+
+int server_open(Server *s, const char *path, int workers) {
+    memset(s, 0, sizeof(*s));
+    s->listen_fd = -1;
+    if (strlen(path) >= sizeof(s->path)) {
+        fprintf(stderr, "server: socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(s->path, path);
+    s->workers = workers > 0 ? workers : driver_default_jobs();
+    atomic_init(&s->stopping, 0);
+    atomic_init(&s->requests, 0);
+
+    /* Replace a stale socket, but never anything else at that path */
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "server: %s exists and is not a socket\n", path);
+            return -1;
+        }
+        unlink(path);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        perror("server: socket");
+        return -1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        perror("server: bind");
+        close(fd);
+        return -1;
+    }
+    s->listen_fd = fd;
+    pthread_mutex_init(&s->lock, NULL);
+    s->active = (int *)server_alloc(NULL, (size_t)s->workers * sizeof(int));
+    for (int i = 0; i < s->workers; i++) s->active[i] = -1;
+    LOG_INFO_MSG("Server", "TASK-043", "Listening");
+    return 0;
+}
+
+int server_serve(Server *s) {
+    ServerWorker **ws = (ServerWorker **)server_alloc(NULL, (size_t)s->workers * sizeof(ServerWorker *));
+    pthread_t *th = (pthread_t *)server_alloc(NULL, (size_t)s->workers * sizeof(pthread_t));
+    for (int w = 0; w < s->workers; w++) {
+        ws[w] = (ServerWorker *)server_alloc(NULL, sizeof(ServerWorker));
+        ws[w]->server = s;
+        ws[w]->index = w;
+        ws[w]->source = NULL;
+        ws[w]->source_cap = 0;
+        bootstrap_ctx_init(&ws[w]->bc);
+    }
+
+    /* The calling thread is worker 0 */
+    int started = 0;
+    for (int w = 1; w < s->workers; w++) {
+        if (pthread_create(&th[w], NULL, server_worker, ws[w]) != 0) break;
+        started = w;
+    }
+    server_worker(ws[0]);
+    for (int w = 1; w <= started; w++) pthread_join(th[w], NULL);
+
+    for (int w = 0; w < s->workers; w++) {
+        bootstrap_ctx_free(&ws[w]->bc);
+        free(ws[w]->source);
+        free(ws[w]);
+    }
+    free(ws);
+    free(th);
+    LOG_INFO_MSG("Server", "TASK-043", "Stopped");
+    return 0;
+}
+
+void server_stop(Server *s) {
+    pthread_mutex_lock(&s->lock);
+    atomic_store(&s->stopping, 1);
+    shutdown(s->listen_fd, SHUT_RDWR);
+    for (int i = 0; i < s->workers; i++) {
+        if (s->active[i] >= 0) shutdown(s->active[i], SHUT_RD);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+void server_close(Server *s) {
+    if (s->listen_fd >= 0) {
+        close(s->listen_fd);
+        unlink(s->path);
+        s->listen_fd = -1;
+        free(s->active);
+        s->active = NULL;
+        pthread_mutex_destroy(&s->lock);
+    }
+}
+
+/* ---- Client ---- */
+
+int client_connect(const char *path) {
+    struct sockaddr_un addr;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int client_request(int fd, int op, const char *source, ServerReply *reply) {
+    memset(reply, 0, sizeof(*reply));
+    size_t len = source != NULL ? strlen(source) : 0;
+    ServerRequest req;
+    req.op = (uint32_t)op;
+    req.len = (uint32_t)len;
+    if (write_full(fd, &req, sizeof(req)) < 0) return -1;
+    if (len > 0 && write_full(fd, source, len) < 0) return -1;
+
+    ServerResponse resp;
+    if (read_full(fd, &resp, sizeof(resp)) < 0) return -1;
+    reply->status = resp.status;
+    reply->result = resp.result;
+    if (resp.len > 0) {
+        if (resp.len > SERVER_MAX_CODE) return -1;
+        reply->code = (unsigned char *)server_alloc(NULL, resp.len);
+        reply->code_len = (int)resp.len;
+        if (read_full(fd, reply->code, resp.len) < 0) {
+            client_reply_free(reply);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void client_reply_free(ServerReply *reply) {
+    free(reply->code);
+    reply->code = NULL;
+    reply->code_len = 0;
+}
+
+/* ---- Command line ---- */
+
+int server_main(int argc, char **argv) {
+    const char *path = SERVER_DEFAULT_SOCKET, *cache_dir = NULL;
+    int jobs = 0;
+    long cache_max = 0;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jobs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--cache-max") == 0 && i + 1 < argc) {
+            cache_max = atol(argv[++i]) * 1024 * 1024;
+        } else {
+            fprintf(stderr, "Usage: ternary_compiler --server [--socket PATH] [-j N] "
+                            "[--cache DIR [--cache-max MB]]\n");
+            return 1;
+        }
+    }
+
+    /* Workers pick the cache up when server_serve creates their contexts */
+    CompileCache cache;
+    int use_cache = cache_dir != NULL && cache_open(&cache, cache_dir, cache_max) == 0;
+    if (use_cache) bootstrap_set_cache(&cache);
+
+    Server s;
+    if (server_open(&s, path, jobs) < 0) return 1;
+    printf("Serving on %s with %d workers\n", s.path, s.workers);
+    fflush(stdout);
+    server_serve(&s);
+    printf("Served %ld requests\n", atomic_load(&s.requests));
+    server_close(&s);
+    if (use_cache) {
+        printf("Cache: %ld hits, %ld misses\n", atomic_load(&cache.hits), atomic_load(&cache.misses));
+        bootstrap_set_cache(NULL);
+        cache_close(&cache);
+    }
+    return 0;
+}
+
+int client_main(int argc, char **argv) {
+    const char *path = SERVER_DEFAULT_SOCKET;
+    const char *source = NULL;
+    int op = SERVER_OP_COMPILE;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--socket") == 0 && i + 1 < argc) {
+            path = argv[++i];
+        } else if (strcmp(argv[i], "--run") == 0) {
+            op = SERVER_OP_RUN;
+        } else if (strcmp(argv[i], "--shutdown") == 0) {
+            op = SERVER_OP_SHUTDOWN;
+        } else if (source == NULL && argv[i][0] != '-') {
+            source = argv[i];
+        } else {
+            source = NULL;
+            op = 0;
+            break;
+        }
+    }
+    if (op == 0 || (source == NULL && op != SERVER_OP_SHUTDOWN)) {
+        fprintf(stderr, "Usage: ternary_compiler --client [--socket PATH] "
+                        "[--run] <c_source> | --shutdown\n");
+        return 1;
+    }
+
+    int fd = client_connect(path);
+    if (fd < 0) {
+        fprintf(stderr, "client: cannot connect to %s\n", path);
+        return 1;
+    }
+    ServerReply reply;
+    int rc = client_request(fd, op, source, &reply);
+    close(fd);
+    if (rc < 0) {
+        fprintf(stderr, "client: request failed\n");
+        return 1;
+    }
+    if (reply.status == SERVER_ERR_COMPILE) {
+        fprintf(stderr, "client: compilation failed\n");
+    } else if (reply.status == SERVER_ERR_RUN) {
+        fprintf(stderr, "client: run exceeded %ld steps\n", SERVER_MAX_STEPS);
+    } else if (reply.status != SERVER_OK) {
+        fprintf(stderr, "client: request rejected\n");
+    } else if (op != SERVER_OP_SHUTDOWN) {
+        printf("Generated %d bytes of bytecode\n", reply.code_len);
+        if (op == SERVER_OP_RUN) printf("Result: %d\n", reply.result);
+    }
+    client_reply_free(&reply);
+    return reply.status == SERVER_OK ? 0 : 1;
+}
@@ -0,0 +1,1052 @@
+/*
+ * ssa.c - SSA-form mid-level IR: construction and analyses
+ *
+ * Construction follows Braun et al., "Simple and Efficient Construction
+ * of Static Single Assignment Form" (CC 2013): the AST is walked once,
+ * each block records the current value of every promoted variable, and
+ * reads that miss look through the predecessors, placing phis where
+ * paths meet. Loop headers stay unsealed until their back edge is
+ * known; phis placed there meanwhile get their operands on sealing.
+ * Phis that turn out to merge a single value are removed afterwards.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/ssa.h"
+#include "../include/intern.h"
+#include "../include/logger.h"
+
+static void *ssa_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "ssa: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+void ssa_init(SsaFunc *f) {
+    memset(f, 0, sizeof(*f));
+    f->name_id = INTERN_NONE;
+}
+
+void ssa_free(SsaFunc *f) {
+    for (int i = 0; i < f->count; i++) free(f->instrs[i].args);
+    for (int b = 0; b < f->block_count; b++) {
+        free(f->blocks[b].code);
+        free(f->blocks[b].preds);
+    }
+    free(f->instrs);
+    free(f->blocks);
+    free(f->vars);
+    free(f->rpo);
+    free(f->use_start);
+    free(f->uses);
+    memset(f, 0, sizeof(*f));
+}
+
+int ssa_new_instr(SsaFunc *f, SsaOp op, int a, int b) {
+    if (f->count >= f->capacity) {
+        f->capacity = f->capacity ? f->capacity * 2 : 64;
+        f->instrs = (SsaInstr *)ssa_alloc(f->instrs, (size_t)f->capacity * sizeof(SsaInstr));
+    }
+    SsaInstr *in = &f->instrs[f->count];
+    in->op = op;
+    in->block = -1;
+    in->imm = 0;
+    in->a = a;
+    in->b = b;
+    in->args = NULL;
+    in->nargs = 0;
+    in->var = -1;
+    return f->count++;
+}
+
+int ssa_const(SsaFunc *f, int imm) {
+    int v = ssa_new_instr(f, SSA_CONST, -1, -1);
+    f->instrs[v].imm = imm;
+    return v;
+}
+
+static int add_block(SsaFunc *f) {
+    if (f->block_count >= f->block_capacity) {
+        f->block_capacity = f->block_capacity ? f->block_capacity * 2 : 16;
+        f->blocks = (SsaBlock *)ssa_alloc(f->blocks, (size_t)f->block_capacity * sizeof(SsaBlock));
+    }
+    SsaBlock *bb = &f->blocks[f->block_count];
+    memset(bb, 0, sizeof(*bb));
+    bb->idom = -1;
+    bb->rpo = -1;
+    return f->block_count++;
+}
+
+void ssa_insert(SsaFunc *f, int b, int at, int v) {
+    SsaBlock *bb = &f->blocks[b];
+    if (bb->count >= bb->capacity) {
+        bb->capacity = bb->capacity ? bb->capacity * 2 : 8;
+        bb->code = (int *)ssa_alloc(bb->code, (size_t)bb->capacity * sizeof(int));
+    }
+    memmove(&bb->code[at + 1], &bb->code[at], (size_t)(bb->count - at) * sizeof(int));
+    bb->code[at] = v;
+    bb->count++;
+    f->instrs[v].block = b;
+}
+
+static void add_pred(SsaFunc *f, int b, int pred) {
+    SsaBlock *bb = &f->blocks[b];
+    if (bb->npreds >= bb->pred_capacity) {
+        bb->pred_capacity = bb->pred_capacity ? bb->pred_capacity * 2 : 4;
+        bb->preds = (int *)ssa_alloc(bb->preds, (size_t)bb->pred_capacity * sizeof(int));
+    }
+    bb->preds[bb->npreds++] = pred;
+}
+
+static void add_edge(SsaFunc *f, int from, int to) {
+    f->blocks[from].succs[f->blocks[from].nsuccs++] = to;
+    add_pred(f, to, from);
+}
+
+/* ---- Construction ---- */
+
+typedef struct {
+    int block;
+    int var;
+    int phi;
+} PendingPhi;
+
+typedef struct {
+    SsaFunc *f;
+    const CompactAST *ca;
+    int cur;                /* Block receiving instructions */
+    int next_slot;
+    int slot_limit;
+    int stride;             /* Variables per block row of defs */
+    int *defs;              /* defs[block * stride + var]: current value or -1 */
+    char *sealed;
+    int block_capacity;
+    PendingPhi *pending;    /* Phis in unsealed blocks awaiting operands */
+    int npending;
+    int pending_capacity;
+    int *mem_names;         /* Names whose address is taken or that are indexed */
+    int nmem;
+    int mem_capacity;
+    int failed;
+} SsaBuilder;
+
+#define KIND(n)    ((NodeType)B->ca->kind[n])
+#define OPOF(n)    ((OpType)B->ca->op[n])
+#define KID(n, i)  cast_kid(B->ca, (n), (i))
+#define NKIDS(n)   ((int)B->ca->nkids[n])
+#define NAME_ID(n) (B->ca->name[n])
+
+static int new_block(SsaBuilder *B) {
+    int b = add_block(B->f);
+    if (b >= B->block_capacity) {
+        int old = B->block_capacity;
+        B->block_capacity = B->block_capacity ? B->block_capacity * 2 : 16;
+        B->defs = (int *)ssa_alloc(B->defs, (size_t)B->block_capacity * (size_t)B->stride * sizeof(int));
+        B->sealed = (char *)ssa_alloc(B->sealed, (size_t)B->block_capacity);
+        for (int i = old * B->stride; i < B->block_capacity * B->stride; i++) B->defs[i] = -1;
+        memset(B->sealed + old, 0, (size_t)(B->block_capacity - old));
+    }
+    return b;
+}
+
+/* Append an instruction to the current block */
+static int emit(SsaBuilder *B, SsaOp op, int a, int b) {
+    int v = ssa_new_instr(B->f, op, a, b);
+    ssa_insert(B->f, B->cur, B->f->blocks[B->cur].count, v);
+    return v;
+}
+
+static void terminate(SsaBuilder *B, SsaOp op, int a, int t0, int t1) {
+    emit(B, op, a, -1);
+    if (t0 >= 0) add_edge(B->f, B->cur, t0);
+    if (t1 >= 0) add_edge(B->f, B->cur, t1);
+}
+
+static void write_var(SsaBuilder *B, int var, int block, int v) {
+    B->defs[block * B->stride + var] = v;
+    if (B->f->instrs[v].var < 0 && B->f->instrs[v].op != SSA_CONST) B->f->instrs[v].var = var;
+}
+
+static int new_phi(SsaBuilder *B, int block, int var) {
+    SsaFunc *f = B->f;
+    int phi = ssa_new_instr(f, SSA_PHI, -1, -1);
+    f->instrs[phi].var = var;
+    int at = 0;
+    while (at < f->blocks[block].count && f->instrs[f->blocks[block].code[at]].op == SSA_PHI) at++;
+    ssa_insert(f, block, at, phi);
+    return phi;
+}
+
+static int read_var(SsaBuilder *B, int var, int block);
+
+static void add_phi_args(SsaBuilder *B, int phi) {
+    SsaFunc *f = B->f;
+    int block = f->instrs[phi].block, var = f->instrs[phi].var;
+    int n = f->blocks[block].npreds;
+    f->instrs[phi].args = (int *)ssa_alloc(NULL, (size_t)(n > 0 ? n : 1) * sizeof(int));
+    f->instrs[phi].nargs = n;
+    for (int i = 0; i < n; i++) f->instrs[phi].args[i] = -1;
+    for (int i = 0; i < n; i++) {
+        int v = read_var(B, var, f->blocks[block].preds[i]);
+        f->instrs[phi].args[i] = v;
+    }
+}
+
+static int read_var(SsaBuilder *B, int var, int block) {
+    int v = B->defs[block * B->stride + var];
+    if (v >= 0) return v;
+    SsaBlock *bb = &B->f->blocks[block];
+    if (!B->sealed[block]) {
+        v = new_phi(B, block, var);
+        if (B->npending >= B->pending_capacity) {
+            B->pending_capacity = B->pending_capacity ? B->pending_capacity * 2 : 16;
+            B->pending = (PendingPhi *)ssa_alloc(B->pending, (size_t)B->pending_capacity * sizeof(PendingPhi));
+        }
+        B->pending[B->npending++] = (PendingPhi){block, var, v};
+    } else if (bb->npreds == 0) {
+        /* No assignment on some path: reads as fresh memory would */
+        v = ssa_const(B->f, 0);
+    } else if (bb->npreds == 1) {
+        v = read_var(B, var, bb->preds[0]);
+    } else {
+        /* Record the phi first so cycles through loops end at it */
+        v = new_phi(B, block, var);
+        write_var(B, var, block, v);
+        add_phi_args(B, v);
+    }
+    write_var(B, var, block, v);
+    return v;
+}
+
+/* All predecessors of block are known: complete its pending phis */
+static void seal_block(SsaBuilder *B, int block) {
+    for (int i = 0; i < B->npending; i++) {
+        if (B->pending[i].block == block) {
+            int phi = B->pending[i].phi;
+            B->pending[i] = B->pending[--B->npending];
+            i--;
+            add_phi_args(B, phi);
+        }
+    }
+    B->sealed[block] = 1;
+}
+
+static int is_mem_name(const SsaBuilder *B, int name_id) {
+    for (int i = 0; i < B->nmem; i++) {
+        if (B->mem_names[i] == name_id) return 1;
+    }
+    return 0;
+}
+
+/* Collect names that must stay in memory: &x, x[i] */
+static void scan_mem_names(SsaBuilder *B, NodeRef n) {
+    if (n == CAST_NONE) return;
+    int name_id = INTERN_NONE;
+    if (KIND(n) == NODE_ADDR_OF && KID(n, 0) != CAST_NONE && KIND(KID(n, 0)) == NODE_VAR) {
+        name_id = NAME_ID(KID(n, 0));
+    } else if (KIND(n) == NODE_ARRAY_ACCESS || KIND(n) == NODE_ARRAY_ASSIGN) {
+        name_id = NAME_ID(n);
+    }
+    if (name_id != INTERN_NONE && !is_mem_name(B, name_id)) {
+        if (B->nmem >= B->mem_capacity) {
+            B->mem_capacity = B->mem_capacity ? B->mem_capacity * 2 : 8;
+            B->mem_names = (int *)ssa_alloc(B->mem_names, (size_t)B->mem_capacity * sizeof(int));
+        }
+        B->mem_names[B->nmem++] = name_id;
+    }
+    for (int i = 0; i < NKIDS(n); i++) scan_mem_names(B, KID(n, i));
+}
+
+/* Most recent declaration of name_id, or -1 */
+static int lookup_var(const SsaBuilder *B, int name_id) {
+    for (int i = B->f->var_count - 1; i >= 0; i--) {
+        if (B->f->vars[i].name_id == name_id) return i;
+    }
+    return -1;
+}
+
+/* Declare a variable of size slots, or return -1 if out of slots */
+static int declare_var(SsaBuilder *B, int name_id, int size, int in_memory) {
+    if (B->next_slot >= B->slot_limit) return -1;
+    SsaFunc *f = B->f;
+    int slot = B->next_slot++;
+    for (int i = 1; i < size; i++) {
+        if (B->next_slot < B->slot_limit) B->next_slot++;
+    }
+    /* A truncated array would reach into the lowering's temporaries */
+    if (slot + size > B->slot_limit) B->failed = 1;
+
+    if (f->var_count >= f->var_capacity) {
+        f->var_capacity = f->var_capacity ? f->var_capacity * 2 : 16;
+        f->vars = (SsaVar *)ssa_alloc(f->vars, (size_t)f->var_capacity * sizeof(SsaVar));
+    }
+    SsaVar *sv = &f->vars[f->var_count];
+    sv->name_id = name_id;
+    sv->slot = slot;
+    sv->size = size > 1 ? size : 1;
+    sv->in_memory = in_memory || is_mem_name(B, name_id);
+    return f->var_count++;
+}
+
+static int build_expr(SsaBuilder *B, NodeRef n);
+
+static int cond_value(SsaBuilder *B, NodeRef cond) {
+    int v = build_expr(B, cond);
+    /* CMP_LT/CMP_GT are ternary; the branch takes only 1 as true */
+    if (cond != CAST_NONE && KIND(cond) == NODE_BINOP &&
+        (OPOF(cond) == OP_IR_CMP_LT || OPOF(cond) == OP_IR_CMP_GT)) {
+        v = emit(B, SSA_CMP_EQ, v, ssa_const(B->f, 1));
+    }
+    return v;
+}
+
+static int build_expr(SsaBuilder *B, NodeRef n) {
+    SsaFunc *f = B->f;
+    if (n == CAST_NONE) {
+        B->failed = 1;
+        return ssa_const(f, 0);
+    }
+    switch (KIND(n)) {
+        case NODE_CONST:
+            return ssa_const(f, B->ca->val[n]);
+
+        case NODE_VAR: {
+            int var = lookup_var(B, NAME_ID(n));
+            if (var < 0) return ssa_const(f, 0);
+            if (f->vars[var].in_memory) return emit(B, SSA_LOAD, ssa_const(f, f->vars[var].slot), -1);
+            return read_var(B, var, B->cur);
+        }
+
+        case NODE_BINOP: {
+            int l = build_expr(B, KID(n, 0));
+            int r = build_expr(B, KID(n, 1));
+            switch (OPOF(n)) {
+                case OP_IR_ADD:    return emit(B, SSA_ADD, l, r);
+                case OP_IR_SUB:    return emit(B, SSA_SUB, l, r);
+                case OP_IR_MUL:    return emit(B, SSA_MUL, l, r);
+                case OP_IR_CMP_EQ: return emit(B, SSA_CMP_EQ, l, r);
+                case OP_IR_CMP_LT: return emit(B, SSA_CMP_LT, l, r);
+                case OP_IR_CMP_GT: return emit(B, SSA_CMP_GT, l, r);
+                default:
+                    B->failed = 1;
+                    return l;
+            }
+        }
+
+        case NODE_DEREF:
+            return emit(B, SSA_LOAD, build_expr(B, KID(n, 0)), -1);
+
+        case NODE_ADDR_OF: {
+            NodeRef var = KID(n, 0);
+            if (var == CAST_NONE || KIND(var) != NODE_VAR) {
+                B->failed = 1;
+                return ssa_const(f, 0);
+            }
+            int v = lookup_var(B, NAME_ID(var));
+            return ssa_const(f, v >= 0 ? f->vars[v].slot : 0);
+        }
+
+        case NODE_ARRAY_ACCESS: {
+            int var = lookup_var(B, NAME_ID(n));
+            if (var < 0) return ssa_const(f, 0);
+            int base = ssa_const(f, f->vars[var].slot);
+            int addr = emit(B, SSA_ADD, base, build_expr(B, KID(n, 0)));
+            return emit(B, SSA_LOAD, addr, -1);
+        }
+
+        default:
+            /* Calls need a call convention; statements are not values */
+            B->failed = 1;
+            return ssa_const(f, 0);
+    }
+}
+
+static void assign_var(SsaBuilder *B, int var, NodeRef rhs) {
+    int v = build_expr(B, rhs);
+    SsaVar *sv = &B->f->vars[var];
+    if (sv->in_memory) {
+        emit(B, SSA_STORE, ssa_const(B->f, sv->slot), v);
+    } else {
+        write_var(B, var, B->cur, v);
+    }
+}
+
+static void build_stmt(SsaBuilder *B, NodeRef n);
+
+static void build_list(SsaBuilder *B, NodeRef n, int from) {
+    for (int i = from; i < NKIDS(n) && !B->failed; i++) build_stmt(B, KID(n, i));
+}
+
+/* cond ? body : else_body */
+static void build_if(SsaBuilder *B, NodeRef n) {
+    int c = cond_value(B, KID(n, 0));
+    int then_b = new_block(B);
+    int join = new_block(B);
+    int else_b = KID(n, 2) != CAST_NONE ? new_block(B) : join;
+    terminate(B, SSA_BR, c, then_b, else_b);
+    seal_block(B, then_b);
+
+    B->cur = then_b;
+    build_stmt(B, KID(n, 1));
+    terminate(B, SSA_JMP, -1, join, -1);
+    if (else_b != join) {
+        seal_block(B, else_b);
+        B->cur = else_b;
+        build_stmt(B, KID(n, 2));
+        terminate(B, SSA_JMP, -1, join, -1);
+    }
+    seal_block(B, join);
+    B->cur = join;
+}
+
+/* header: cond -> body | exit; body: body, inc -> header */
+static void build_loop(SsaBuilder *B, NodeRef cond, NodeRef body, NodeRef inc) {
+    if (cond == CAST_NONE) {
+        B->failed = 1;
+        return;
+    }
+    int header = new_block(B);
+    terminate(B, SSA_JMP, -1, header, -1);
+    B->cur = header;
+    int c = cond_value(B, cond);
+    int body_b = new_block(B);
+    int exit_b = new_block(B);
+    terminate(B, SSA_BR, c, body_b, exit_b);
+    seal_block(B, body_b);
+    seal_block(B, exit_b);
+
+    B->cur = body_b;
+    build_stmt(B, body);
+    build_stmt(B, inc);
+    terminate(B, SSA_JMP, -1, header, -1);
+    seal_block(B, header);
+    B->cur = exit_b;
+}
+
+static void build_stmt(SsaBuilder *B, NodeRef n) {
+    if (n == CAST_NONE || B->failed) return;
+    SsaFunc *f = B->f;
+    switch (KIND(n)) {
+        case NODE_VAR_DECL:
+        case NODE_TRIT_VAR_DECL: {
+            /* Declared before its initializer is evaluated, as the
+             * bootstrap symbol table does */
+            int var = declare_var(B, NAME_ID(n), 1, 0);
+            if (var >= 0 && KID(n, 0) != CAST_NONE) assign_var(B, var, KID(n, 0));
+            break;
+        }
+
+        case NODE_ASSIGN: {
+            NodeRef lhs = KID(n, 0);
+            if (lhs != CAST_NONE && KIND(lhs) == NODE_VAR) {
+                int var = lookup_var(B, NAME_ID(lhs));
+                if (var >= 0) assign_var(B, var, KID(n, 1));
+            }
+            break;
+        }
+
+        case NODE_ARRAY_DECL:
+        case NODE_TRIT_ARRAY_DECL: {
+            int size = B->ca->val[n];
+            int var = declare_var(B, NAME_ID(n), size, 1);
+            if (var < 0) break;
+            for (int i = 0; i < NKIDS(n) && i < size; i++) {
+                int v = build_expr(B, KID(n, i));
+                emit(B, SSA_STORE, ssa_const(f, f->vars[var].slot + i), v);
+            }
+            break;
+        }
+
+        case NODE_ARRAY_ASSIGN: {
+            int var = lookup_var(B, NAME_ID(n));
+            if (var < 0) break;
+            int base = ssa_const(f, f->vars[var].slot);
+            int addr = emit(B, SSA_ADD, base, build_expr(B, KID(n, 0)));
+            int v = build_expr(B, KID(n, 1));
+            emit(B, SSA_STORE, addr, v);
+            break;
+        }
+
+        case NODE_RETURN: {
+            int v = KID(n, 0) != CAST_NONE ? build_expr(B, KID(n, 0)) : ssa_const(f, 0);
+            emit(B, SSA_OUT, v, -1);
+            terminate(B, SSA_EXIT, -1, -1, -1);
+            /* Code after a return is unreachable; ssa_build drops it */
+            B->cur = new_block(B);
+            seal_block(B, B->cur);
+            break;
+        }
+
+        case NODE_BLOCK:
+            build_list(B, n, 0);
+            break;
+
+        case NODE_IF:
+            build_if(B, n);
+            break;
+
+        case NODE_WHILE:
+            build_loop(B, KID(n, 0), KID(n, 1), CAST_NONE);
+            break;
+
+        case NODE_FOR:
+            build_stmt(B, KID(n, 0));
+            build_loop(B, KID(n, 1), KID(n, 3), KID(n, 2));
+            break;
+
+        case NODE_FUNC_CALL:
+        case NODE_FUNC_DEF:
+        case NODE_PROGRAM:
+            B->failed = 1;
+            break;
+
+        default:
+            /* Bare expression (for-increments): its value is dropped;
+             * built only so unsupported constructs still fail */
+            build_expr(B, n);
+            break;
+    }
+}
+
+static int resolve(const int *forward, int v) {
+    while (v >= 0 && forward[v] >= 0) v = forward[v];
+    return v;
+}
+
+void ssa_remove_trivial_phis(SsaFunc *f) {
+    int *forward = (int *)ssa_alloc(NULL, (size_t)(f->count > 0 ? f->count : 1) * sizeof(int));
+    for (int i = 0; i < f->count; i++) forward[i] = -1;
+    int undef = -1;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int p = 0; p < f->count; p++) {
+            SsaInstr *in = &f->instrs[p];
+            if (in->op != SSA_PHI) continue;
+            int same = -1, trivial = 1;
+            for (int i = 0; i < in->nargs; i++) {
+                int a = resolve(forward, in->args[i]);
+                in->args[i] = a;
+                if (a == p || a == same) continue;
+                if (same >= 0) {
+                    trivial = 0;
+                    break;
+                }
+                same = a;
+            }
+            if (!trivial) continue;
+            if (same < 0) {
+                if (undef < 0) undef = ssa_const(f, 0);
+                same = undef;
+                in = &f->instrs[p];
+            }
+            forward[p] = same;
+            in->op = SSA_NOP;
+            in->block = -1;
+            changed = 1;
+        }
+    }
+
+    for (int i = 0; i < f->count; i++) {
+        SsaInstr *in = &f->instrs[i];
+        if (in->op == SSA_NOP) continue;
+        in->a = resolve(forward, in->a);
+        in->b = resolve(forward, in->b);
+        for (int k = 0; k < in->nargs; k++) in->args[k] = resolve(forward, in->args[k]);
+    }
+    for (int b = 0; b < f->block_count; b++) {
+        SsaBlock *bb = &f->blocks[b];
+        int w = 0;
+        for (int i = 0; i < bb->count; i++) {
+            if (f->instrs[bb->code[i]].op != SSA_NOP) bb->code[w++] = bb->code[i];
+        }
+        bb->count = w;
+    }
+    free(forward);
+}
+
+int ssa_build(SsaFunc *f, const CompactAST *ca, NodeRef func, int slot_base, int slot_limit) {
+    LOG_DEBUG_MSG("SSA", "TASK-047", "ssa_build entered");
+    ssa_init(f);
+    f->name_id = ca->name[func];
+    f->slot_base = slot_base;
+
+    SsaBuilder b;
+    SsaBuilder *B = &b;
+    memset(B, 0, sizeof(*B));
+    B->f = f;
+    B->ca = ca;
+    B->next_slot = slot_base;
+    B->slot_limit = slot_limit;
+    B->stride = slot_limit - slot_base > 0 ? slot_limit - slot_base : 1;
+
+    if (KIND(func) != NODE_FUNC_DEF) {
+        B->failed = 1;
+    } else {
+        scan_mem_names(B, func);
+        B->cur = new_block(B);
+        seal_block(B, B->cur);
+        /* Parameters arrive in their slots (bootstrap.h call
+         * convention); promoted ones are loaded from there once */
+        int k = 1;
+        for (; k < NKIDS(func) && KIND(KID(func, k)) == NODE_VAR; k++) {
+            int var = declare_var(B, NAME_ID(KID(func, k)), 1, 0);
+            if (var >= 0 && !f->vars[var].in_memory) {
+                write_var(B, var, B->cur, emit(B, SSA_LOAD, ssa_const(f, f->vars[var].slot), -1));
+            }
+        }
+        /* Leading statements, then the body; falling off the end
+         * returns 0 */
+        build_list(B, func, k);
+        build_stmt(B, KID(func, 0));
+        if (!B->failed) {
+            emit(B, SSA_OUT, ssa_const(f, 0), -1);
+            terminate(B, SSA_EXIT, -1, -1, -1);
+        }
+    }
+
+    f->slot_end = B->next_slot;
+    free(B->defs);
+    free(B->sealed);
+    free(B->pending);
+    free(B->mem_names);
+    if (B->failed) return -1;
+    ssa_remove_unreachable(f);
+    ssa_remove_trivial_phis(f);
+    return 0;
+}
+
+int ssa_build_expr(SsaFunc *f, const Expr *func, int slot_base, int slot_limit) {
+    CompactAST ca;
+    cast_init(&ca);
+    NodeRef root = cast_from_expr(&ca, func);
+    int rc = ssa_build(f, &ca, root, slot_base, slot_limit);
+    cast_free(&ca);
+    return rc;
+}
+
+#undef KIND
+#undef OPOF
+#undef KID
+#undef NKIDS
+#undef NAME_ID
+
+/* ---- Def-use ---- */
+
+/* Operand k of in: a, b, then the phi arguments */
+static int *operand_at(SsaInstr *in, int k) {
+    return k == 0 ? &in->a : k == 1 ? &in->b : &in->args[k - 2];
+}
+
+void ssa_build_uses(SsaFunc *f) {
+    f->use_start = (int *)ssa_alloc(f->use_start, (size_t)(f->count + 1) * sizeof(int));
+    memset(f->use_start, 0, (size_t)(f->count + 1) * sizeof(int));
+    int total = 0;
+    for (int u = 0; u < f->count; u++) {
+        SsaInstr *in = &f->instrs[u];
+        if (in->op == SSA_NOP) continue;
+        for (int k = 0; k < 2 + in->nargs; k++) {
+            int v = *operand_at(in, k);
+            if (v >= 0) {
+                f->use_start[v + 1]++;
+                total++;
+            }
+        }
+    }
+    for (int v = 0; v < f->count; v++) f->use_start[v + 1] += f->use_start[v];
+    f->uses = (int *)ssa_alloc(f->uses, (size_t)(total > 0 ? total : 1) * sizeof(int));
+    int *fill = (int *)ssa_alloc(NULL, (size_t)(f->count > 0 ? f->count : 1) * sizeof(int));
+    memcpy(fill, f->use_start, (size_t)f->count * sizeof(int));
+    for (int u = 0; u < f->count; u++) {
+        SsaInstr *in = &f->instrs[u];
+        if (in->op == SSA_NOP) continue;
+        for (int k = 0; k < 2 + in->nargs; k++) {
+            int v = *operand_at(in, k);
+            if (v >= 0) f->uses[fill[v]++] = u;
+        }
+    }
+    free(fill);
+}
+
+void ssa_replace_uses(SsaFunc *f, int from, int to) {
+    for (int u = 0; u < f->count; u++) {
+        SsaInstr *in = &f->instrs[u];
+        if (in->op == SSA_NOP) continue;
+        for (int k = 0; k < 2 + in->nargs; k++) {
+            int *op = operand_at(in, k);
+            if (*op == from) *op = to;
+        }
+    }
+}
+
+/* ---- Dominators (Cooper, Harvey & Kennedy) ---- */
+
+void ssa_dominators(SsaFunc *f) {
+    int n = f->block_count;
+    f->rpo = (int *)ssa_alloc(f->rpo, (size_t)(n > 0 ? n : 1) * sizeof(int));
+    f->rpo_count = 0;
+    for (int b = 0; b < n; b++) {
+        f->blocks[b].rpo = -1;
+        f->blocks[b].idom = -1;
+    }
+    if (n == 0) return;
+
+    /* Iterative DFS for postorder */
+    int *stack = (int *)ssa_alloc(NULL, (size_t)n * sizeof(int));
+    int *next = (int *)ssa_alloc(NULL, (size_t)n * sizeof(int));
+    char *seen = (char *)ssa_alloc(NULL, (size_t)n);
+    memset(seen, 0, (size_t)n);
+    int *post = (int *)ssa_alloc(NULL, (size_t)n * sizeof(int));
+    int npost = 0, sp = 0;
+    stack[sp++] = 0;
+    next[0] = 0;
+    seen[0] = 1;
+    while (sp > 0) {
+        int b = stack[sp - 1];
+        if (next[b] < f->blocks[b].nsuccs) {
+            int s = f->blocks[b].succs[next[b]++];
+            if (!seen[s]) {
+                seen[s] = 1;
+                next[s] = 0;
+                stack[sp++] = s;
+            }
+        } else {
+            post[npost++] = b;
+            sp--;
+        }
+    }
+    for (int i = 0; i < npost; i++) {
+        int b = post[npost - 1 - i];
+        f->rpo[i] = b;
+        f->blocks[b].rpo = i;
+    }
+    f->rpo_count = npost;
+
+    f->blocks[0].idom = 0;
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 1; i < npost; i++) {
+            int b = f->rpo[i];
+            int idom = -1;
+            for (int p = 0; p < f->blocks[b].npreds; p++) {
+                int q = f->blocks[b].preds[p];
+                if (f->blocks[q].rpo < 0 || f->blocks[q].idom < 0) continue;
+                if (idom < 0) {
+                    idom = q;
+                    continue;
+                }
+                /* Intersect */
+                int x = q, y = idom;
+                while (x != y) {
+                    while (f->blocks[x].rpo > f->blocks[y].rpo) x = f->blocks[x].idom;
+                    while (f->blocks[y].rpo > f->blocks[x].rpo) y = f->blocks[y].idom;
+                }
+                idom = x;
+            }
+            if (idom != f->blocks[b].idom) {
+                f->blocks[b].idom = idom;
+                changed = 1;
+            }
+        }
+    }
+    f->blocks[0].idom = -1;
+    free(stack);
+    free(next);
+    free(seen);
+    free(post);
+}
+
+int ssa_dominates(const SsaFunc *f, int a, int b) {
+    while (b >= 0) {
+        if (b == a) return 1;
+        b = f->blocks[b].idom;
+    }
+    return 0;
+}
+
+int ssa_split_edge(SsaFunc *f, int from, int k) {
+    int s = f->blocks[from].succs[k];
+    int mid = add_block(f);
+    int jmp = ssa_new_instr(f, SSA_JMP, -1, -1);
+    ssa_insert(f, mid, 0, jmp);
+    f->blocks[mid].succs[0] = s;
+    f->blocks[mid].nsuccs = 1;
+    add_pred(f, mid, from);
+    /* Same predecessor index: phi operands stay in place */
+    for (int i = 0; i < f->blocks[s].npreds; i++) {
+        if (f->blocks[s].preds[i] == from) {
+            f->blocks[s].preds[i] = mid;
+            break;
+        }
+    }
+    f->blocks[from].succs[k] = mid;
+    return mid;
+}
+
+int ssa_split_critical_edges(SsaFunc *f) {
+    int added = 0;
+    int n = f->block_count;
+    for (int p = 0; p < n; p++) {
+        if (f->blocks[p].nsuccs < 2) continue;
+        for (int k = 0; k < f->blocks[p].nsuccs; k++) {
+            if (f->blocks[f->blocks[p].succs[k]].npreds < 2) continue;
+            ssa_split_edge(f, p, k);
+            added++;
+        }
+    }
+    return added;
+}
+
+/* Drop the preds of b (and their phi operands) for which keep[] is 0 */
+static void filter_preds(SsaFunc *f, int b, const char *keep) {
+    SsaBlock *bb = &f->blocks[b];
+    int w = 0;
+    for (int p = 0; p < bb->npreds; p++) {
+        if (!keep[bb->preds[p]]) continue;
+        for (int i = 0; i < bb->count; i++) {
+            SsaInstr *in = &f->instrs[bb->code[i]];
+            if (in->op == SSA_PHI) in->args[w] = in->args[p];
+        }
+        bb->preds[w++] = bb->preds[p];
+    }
+    for (int i = 0; i < bb->count; i++) {
+        SsaInstr *in = &f->instrs[bb->code[i]];
+        if (in->op == SSA_PHI) in->nargs = w;
+    }
+    bb->npreds = w;
+}
+
+int ssa_remove_unreachable(SsaFunc *f) {
+    int n = f->block_count;
+    if (n == 0) return 0;
+    char *reach = (char *)ssa_alloc(NULL, (size_t)n);
+    int *stack = (int *)ssa_alloc(NULL, (size_t)n * sizeof(int));
+    memset(reach, 0, (size_t)n);
+    int sp = 0;
+    reach[0] = 1;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        int b = stack[--sp];
+        for (int k = 0; k < f->blocks[b].nsuccs; k++) {
+            int s = f->blocks[b].succs[k];
+            if (!reach[s]) {
+                reach[s] = 1;
+                stack[sp++] = s;
+            }
+        }
+    }
+
+    /* Renumber the survivors in order */
+    int *newid = stack;
+    int kept = 0;
+    for (int b = 0; b < n; b++) newid[b] = reach[b] ? kept++ : -1;
+    if (kept == n) {
+        free(reach);
+        free(stack);
+        return 0;
+    }
+    for (int b = 0; b < n; b++) {
+        SsaBlock *bb = &f->blocks[b];
+        if (!reach[b]) {
+            for (int i = 0; i < bb->count; i++) {
+                SsaInstr *in = &f->instrs[bb->code[i]];
+                in->op = SSA_NOP;
+                in->block = -1;
+            }
+            free(bb->code);
+            free(bb->preds);
+            continue;
+        }
+        filter_preds(f, b, reach);
+        for (int p = 0; p < bb->npreds; p++) bb->preds[p] = newid[bb->preds[p]];
+        for (int k = 0; k < bb->nsuccs; k++) bb->succs[k] = newid[bb->succs[k]];
+        for (int i = 0; i < bb->count; i++) f->instrs[bb->code[i]].block = newid[b];
+        f->blocks[newid[b]] = *bb;
+    }
+    f->block_count = kept;
+    free(reach);
+    free(stack);
+    return n - kept;
+}
+
+int ssa_merge_blocks(SsaFunc *f) {
+    int merged = 0;
+    for (int b = 0; b < f->block_count; b++) {
+        for (;;) {
+            SsaBlock *bb = &f->blocks[b];
+            if (bb->count == 0 || bb->nsuccs != 1) break;
+            int jmp = bb->code[bb->count - 1];
+            int s = bb->succs[0];
+            if (f->instrs[jmp].op != SSA_JMP || s == 0 || s == b || f->blocks[s].npreds != 1) break;
+
+            /* Single-operand phis are copies */
+            SsaBlock *sb = &f->blocks[s];
+            int first = 0;
+            while (first < sb->count && f->instrs[sb->code[first]].op == SSA_PHI) {
+                SsaInstr *phi = &f->instrs[sb->code[first]];
+                phi->op = SSA_NOP;
+                phi->block = -1;
+                ssa_replace_uses(f, sb->code[first], phi->args[0]);
+                first++;
+            }
+
+            /* Replace b's JMP with s's code; s inherits nothing */
+            f->instrs[jmp].op = SSA_NOP;
+            f->instrs[jmp].block = -1;
+            bb->count--;
+            for (int i = first; i < sb->count; i++) ssa_insert(f, b, bb->count, sb->code[i]);
+            bb = &f->blocks[b];
+            sb = &f->blocks[s];
+            bb->nsuccs = sb->nsuccs;
+            for (int k = 0; k < sb->nsuccs; k++) {
+                int t = sb->succs[k];
+                bb->succs[k] = t;
+                for (int p = 0; p < f->blocks[t].npreds; p++) {
+                    if (f->blocks[t].preds[p] == s) {
+                        f->blocks[t].preds[p] = b;
+                        break;
+                    }
+                }
+            }
+            sb->count = 0;
+            sb->npreds = 0;
+            sb->nsuccs = 0;
+            merged++;
+        }
+    }
+    if (merged > 0) ssa_remove_unreachable(f);
+    return merged;
+}
+
+/* ---- Verification ---- */
+
+static int is_terminator(SsaOp op) {
+    return op == SSA_JMP || op == SSA_BR || op == SSA_EXIT;
+}
+
+static int verify_fail(const SsaFunc *f, const char *what, int block, int v) {
+    fprintf(stderr, "ssa: %s: %s in B%d (v%d)\n", intern_str(f->name_id) ? intern_str(f->name_id) : "?",
+            what, block, v);
+    return -1;
+}
+
+int ssa_verify(SsaFunc *f) {
+    ssa_dominators(f);
+    int *pos = (int *)ssa_alloc(NULL, (size_t)(f->count > 0 ? f->count : 1) * sizeof(int));
+    int rc = 0;
+    for (int b = 0; b < f->block_count && rc == 0; b++) {
+        SsaBlock *bb = &f->blocks[b];
+        if (bb->count == 0) {
+            rc = verify_fail(f, "empty block", b, -1);
+            break;
+        }
+        int phis = 1;
+        for (int i = 0; i < bb->count && rc == 0; i++) {
+            int v = bb->code[i];
+            SsaInstr *in = &f->instrs[v];
+            pos[v] = i;
+            if (in->block != b) rc = verify_fail(f, "instruction in wrong block", b, v);
+            else if (in->op == SSA_CONST || in->op == SSA_NOP) rc = verify_fail(f, "constant or deleted instruction placed", b, v);
+            else if (in->op == SSA_PHI && !phis) rc = verify_fail(f, "phi after body", b, v);
+            else if (in->op == SSA_PHI && in->nargs != bb->npreds) rc = verify_fail(f, "phi arity", b, v);
+            else if (is_terminator(in->op) != (i == bb->count - 1)) rc = verify_fail(f, "misplaced terminator", b, v);
+            if (in->op != SSA_PHI) phis = 0;
+        }
+        if (rc != 0) break;
+        SsaOp term = f->instrs[bb->code[bb->count - 1]].op;
+        int want = term == SSA_JMP ? 1 : term == SSA_BR ? 2 : 0;
+        if (bb->nsuccs != want) {
+            rc = verify_fail(f, "successor count", b, bb->code[bb->count - 1]);
+            break;
+        }
+        for (int k = 0; k < bb->nsuccs; k++) {
+            int s = bb->succs[k], in_succs = 0, in_preds = 0;
+            for (int j = 0; j < bb->nsuccs; j++) in_succs += bb->succs[j] == s;
+            for (int j = 0; j < f->blocks[s].npreds; j++) in_preds += f->blocks[s].preds[j] == b;
+            if (in_succs != in_preds) rc = verify_fail(f, "pred/succ mismatch", b, -1);
+        }
+    }
+
+    /* Every use is dominated by its definition */
+    for (int b = 0; b < f->block_count && rc == 0; b++) {
+        SsaBlock *bb = &f->blocks[b];
+        if (bb->rpo < 0) continue;
+        for (int i = 0; i < bb->count && rc == 0; i++) {
+            int u = bb->code[i];
+            SsaInstr *in = &f->instrs[u];
+            for (int k = 0; k < 2 + in->nargs && rc == 0; k++) {
+                int v = *operand_at(in, k);
+                if (v < 0) {
+                    if (k >= 2) rc = verify_fail(f, "missing phi operand", b, u);
+                    continue;
+                }
+                if (v >= f->count || f->instrs[v].op == SSA_NOP) {
+                    rc = verify_fail(f, "use of undefined value", b, u);
+                    continue;
+                }
+                const SsaInstr *def = &f->instrs[v];
+                if (def->op == SSA_CONST) continue;
+                if (def->op == SSA_STORE || def->op == SSA_OUT || is_terminator(def->op)) {
+                    rc = verify_fail(f, "use of instruction without a value", b, u);
+                } else if (in->op == SSA_PHI) {
+                    if (!ssa_dominates(f, def->block, bb->preds[k - 2])) {
+                        rc = verify_fail(f, "phi operand not dominating its edge", b, u);
+                    }
+                } else if (def->block == b ? pos[v] >= i : !ssa_dominates(f, def->block, b)) {
+                    rc = verify_fail(f, "use not dominated by definition", b, u);
+                }
+            }
+        }
+    }
+    free(pos);
+    return rc;
+}
+
+/* ---- Dump ---- */
+
+static const char *ssa_op_names[] = {
+    "const", "add", "sub", "mul", "cmp_eq", "cmp_lt", "cmp_gt",
+    "phi", "load", "store", "out", "jmp", "br", "exit", "nop"
+};
+
+static void dump_operand(const SsaFunc *f, int v) {
+    if (v >= 0 && f->instrs[v].op == SSA_CONST) printf(" %d", f->instrs[v].imm);
+    else printf(" v%d", v);
+}
+
+void ssa_dump(const SsaFunc *f) {
+    printf("--- SSA %s (%d blocks, %d values) ---\n",
+           intern_str(f->name_id) ? intern_str(f->name_id) : "?", f->block_count, f->count);
+    for (int b = 0; b < f->block_count; b++) {
+        const SsaBlock *bb = &f->blocks[b];
+        printf("B%d:", b);
+        if (bb->npreds > 0) {
+            printf("  ; preds");
+            for (int p = 0; p < bb->npreds; p++) printf(" B%d", bb->preds[p]);
+        }
+        printf("\n");
+        for (int i = 0; i < bb->count; i++) {
+            int v = bb->code[i];
+            const SsaInstr *in = &f->instrs[v];
+            SsaOp op = in->op;
+            if (op == SSA_STORE || op == SSA_OUT || is_terminator(op)) printf("  %-8s", ssa_op_names[op]);
+            else printf("  v%-3d = %-6s", v, ssa_op_names[op]);
+            if (op == SSA_PHI) {
+                for (int k = 0; k < in->nargs; k++) dump_operand(f, in->args[k]);
+            } else {
+                if (in->a >= 0) dump_operand(f, in->a);
+                if (in->b >= 0) dump_operand(f, in->b);
+            }
+            if (op == SSA_JMP) printf(" -> B%d", bb->succs[0]);
+            else if (op == SSA_BR) printf(" -> B%d, B%d", bb->succs[0], bb->succs[1]);
+            if (in->var >= 0) printf("  ; %s", intern_str(f->vars[in->var].name_id));
+            printf("\n");
+        }
+    }
+    printf("---\n");
+}
@@ -0,0 +1,507 @@
+/*
+ * ssa_lower.c - SSA to postfix IR lowering
+ *
+ * The stack machine has no registers, so SSA values are either
+ * evaluated in place, as part of the one expression that uses them, or
+ * stored to a memory slot and reloaded at each use:
+ *
+ *   - Unused pure values and phis are dropped.
+ *   - A pure value used exactly once, later in its own block, by a
+ *     non-phi instruction is inlined into its user's expression tree
+ *     (LOADs only when no STORE lies between their definition and the
+ *     point the tree is evaluated).
+ *   - Constants are pushed at every use.
+ *   - Everything else gets a slot: live ranges are computed on the
+ *     SSA form, values that are live at the same time interfere, and
+ *     slots are assigned greedily in dominance order, preferring the
+ *     slot of a phi partner and then the home slot of the variable the
+ *     value was assigned to, so most phi copies disappear.
+ *
+ * Phi copies go at the end of each predecessor (critical edges are
+ * split first), as a parallel copy when a source slot is also a
+ * destination.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../include/ssa.h"
+#include "../include/intern.h"
+#include "../include/logger.h"
+
+static void *lower_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "ssa_lower: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void *lower_calloc(size_t n, size_t size) {
+    void *p = calloc(n > 0 ? n : 1, size);
+    if (p == NULL) {
+        fprintf(stderr, "ssa_lower: calloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+typedef struct {
+    SsaFunc *f;
+    PostfixSeq *seq;
+    char *inlined;      /* Evaluated inside its user's tree */
+    char *dead;         /* Unused pure value or phi: not emitted */
+    int *reg;           /* Index among slot-needing values, or -1 */
+    int *value_of;      /* reg index -> value id */
+    int nregs;
+    int words;          /* uint64_t words per live set */
+    uint64_t *live_in;  /* Per block, phi definitions excluded */
+    uint64_t *interf;   /* nregs x nregs bit matrix */
+    int *slot;          /* Per value */
+    int *label;         /* Per block */
+} Lowering;
+
+static int is_pure(SsaOp op) {
+    return op == SSA_ADD || op == SSA_SUB || op == SSA_MUL || op == SSA_CMP_EQ ||
+           op == SSA_CMP_LT || op == SSA_CMP_GT || op == SSA_LOAD;
+}
+
+#define SET_HAS(set, i) (((set)[(i) >> 6] >> ((i) & 63)) & 1)
+#define SET_ADD(set, i) ((set)[(i) >> 6] |= (uint64_t)1 << ((i) & 63))
+#define SET_DEL(set, i) ((set)[(i) >> 6] &= ~((uint64_t)1 << ((i) & 63)))
+
+/* ---- Inlining decisions ---- */
+
+static void choose_inlined(Lowering *L) {
+    SsaFunc *f = L->f;
+    int *pos = (int *)lower_calloc((size_t)f->count, sizeof(int));
+    int *eval_at = (int *)lower_calloc((size_t)f->count, sizeof(int));
+    int *stores = NULL;
+    int stores_capacity = 0;
+
+    for (int r = 0; r < f->rpo_count; r++) {
+        SsaBlock *bb = &f->blocks[f->rpo[r]];
+        if (bb->count + 1 > stores_capacity) {
+            stores_capacity = bb->count + 1;
+            stores = (int *)lower_alloc(stores, (size_t)stores_capacity * sizeof(int));
+        }
+        /* stores[i]: STOREs among the first i instructions */
+        stores[0] = 0;
+        for (int i = 0; i < bb->count; i++) {
+            int v = bb->code[i];
+            pos[v] = i;
+            stores[i + 1] = stores[i] + (f->instrs[v].op == SSA_STORE);
+            SsaOp op = f->instrs[v].op;
+            if ((is_pure(op) || op == SSA_PHI) && ssa_use_count(f, v) == 0) L->dead[v] = 1;
+        }
+
+        /* Walk backwards so every tree knows where its root is evaluated */
+        for (int i = bb->count - 1; i >= 0; i--) {
+            int v = bb->code[i];
+            SsaInstr *in = &f->instrs[v];
+            if (in->op == SSA_PHI || L->dead[v]) continue;
+            int at = L->inlined[v] ? eval_at[v] : i;
+            int ops[2] = {in->a, in->b};
+            for (int k = 0; k < 2; k++) {
+                int o = ops[k];
+                if (o < 0) continue;
+                SsaInstr *d = &f->instrs[o];
+                if (!is_pure(d->op) || d->block != f->rpo[r] || ssa_use_count(f, o) != 1) continue;
+                if (d->op == SSA_LOAD && stores[at] != stores[pos[o] + 1]) continue;
+                L->inlined[o] = 1;
+                eval_at[o] = at;
+            }
+        }
+    }
+    free(pos);
+    free(eval_at);
+    free(stores);
+}
+
+/* ---- Liveness and interference ---- */
+
+/* Add the slot values read by the tree rooted at v to live */
+static void add_reads(const Lowering *L, int v, uint64_t *live) {
+    const SsaInstr *in = &L->f->instrs[v];
+    int ops[2] = {in->a, in->b};
+    for (int k = 0; k < 2; k++) {
+        int o = ops[k];
+        if (o < 0) continue;
+        if (L->inlined[o]) add_reads(L, o, live);
+        else if (L->reg[o] >= 0) SET_ADD(live, L->reg[o]);
+    }
+}
+
+static void interfere(Lowering *L, int x, const uint64_t *live) {
+    for (int w = 0; w < L->words; w++) {
+        uint64_t bits = live[w];
+        while (bits != 0) {
+            int y = w * 64 + __builtin_ctzll(bits);
+            bits &= bits - 1;
+            if (y == x) continue;
+            SET_ADD(&L->interf[(size_t)x * (size_t)L->words], y);
+            SET_ADD(&L->interf[(size_t)y * (size_t)L->words], x);
+        }
+    }
+}
+
+/* Live set at the end of block b */
+static void live_out(const Lowering *L, int b, uint64_t *live) {
+    const SsaFunc *f = L->f;
+    const SsaBlock *bb = &f->blocks[b];
+    memset(live, 0, (size_t)L->words * sizeof(uint64_t));
+    for (int k = 0; k < bb->nsuccs; k++) {
+        const SsaBlock *sb = &f->blocks[bb->succs[k]];
+        const uint64_t *in = &L->live_in[(size_t)bb->succs[k] * (size_t)L->words];
+        for (int w = 0; w < L->words; w++) live[w] |= in[w];
+        for (int p = 0; p < sb->npreds; p++) {
+            if (sb->preds[p] != b) continue;
+            for (int i = 0; i < sb->count; i++) {
+                const SsaInstr *phi = &f->instrs[sb->code[i]];
+                if (phi->op != SSA_PHI) break;
+                if (L->reg[phi->args[p]] >= 0) SET_ADD(live, L->reg[phi->args[p]]);
+            }
+        }
+    }
+}
+
+/* Scan block b backwards from live-out; with build set, record
+ * interferences. Leaves the live-in set (phis removed) in live. */
+static void scan_block(Lowering *L, int b, uint64_t *live, int build) {
+    const SsaFunc *f = L->f;
+    const SsaBlock *bb = &f->blocks[b];
+    int first = 0;
+    while (first < bb->count && f->instrs[bb->code[first]].op == SSA_PHI) first++;
+    for (int i = bb->count - 1; i >= first; i--) {
+        int v = bb->code[i];
+        if (L->inlined[v] || L->dead[v]) continue;
+        if (L->reg[v] >= 0) {
+            if (build) interfere(L, L->reg[v], live);
+            SET_DEL(live, L->reg[v]);
+        }
+        add_reads(L, v, live);
+    }
+    /* Phis are all defined on entry */
+    for (int i = 0; i < first; i++) {
+        int r = L->reg[bb->code[i]];
+        if (r >= 0) SET_DEL(live, r);
+    }
+    if (build) {
+        for (int i = 0; i < first; i++) {
+            int r = L->reg[bb->code[i]];
+            if (r < 0) continue;
+            interfere(L, r, live);
+            for (int j = 0; j < first; j++) {
+                int r2 = L->reg[bb->code[j]];
+                if (r2 >= 0 && r2 != r) {
+                    SET_ADD(&L->interf[(size_t)r * (size_t)L->words], r2);
+                }
+            }
+        }
+    }
+}
+
+static void build_interference(Lowering *L) {
+    SsaFunc *f = L->f;
+    L->live_in = (uint64_t *)lower_calloc((size_t)f->block_count * (size_t)L->words, sizeof(uint64_t));
+    L->interf = (uint64_t *)lower_calloc((size_t)L->nregs * (size_t)L->words, sizeof(uint64_t));
+    uint64_t *live = (uint64_t *)lower_calloc((size_t)L->words, sizeof(uint64_t));
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int r = f->rpo_count - 1; r >= 0; r--) {
+            int b = f->rpo[r];
+            live_out(L, b, live);
+            scan_block(L, b, live, 0);
+            uint64_t *in = &L->live_in[(size_t)b * (size_t)L->words];
+            if (memcmp(in, live, (size_t)L->words * sizeof(uint64_t)) != 0) {
+                memcpy(in, live, (size_t)L->words * sizeof(uint64_t));
+                changed = 1;
+            }
+        }
+    }
+    for (int r = 0; r < f->rpo_count; r++) {
+        live_out(L, f->rpo[r], live);
+        scan_block(L, f->rpo[r], live, 1);
+    }
+    free(live);
+}
+
+/* ---- Slot assignment ---- */
+
+static int try_slot(const char *taken, int slot, int limit) {
+    return slot >= 0 && slot < limit && !taken[slot];
+}
+
+static int assign_slots(Lowering *L, int temp_base, int temp_limit) {
+    SsaFunc *f = L->f;
+    int limit = temp_limit;
+    for (int i = 0; i < f->var_count; i++) {
+        if (f->vars[i].slot + 1 > limit) limit = f->vars[i].slot + 1;
+    }
+    char *taken = (char *)lower_calloc((size_t)limit, 1);
+    int rc = 0;
+
+    for (int r = 0; r < f->rpo_count && rc == 0; r++) {
+        SsaBlock *bb = &f->blocks[f->rpo[r]];
+        for (int i = 0; i < bb->count; i++) {
+            int v = bb->code[i];
+            int x = L->reg[v];
+            if (x < 0) continue;
+            memset(taken, 0, (size_t)limit);
+            const uint64_t *row = &L->interf[(size_t)x * (size_t)L->words];
+            for (int y = 0; y < L->nregs; y++) {
+                if (SET_HAS(row, y) && L->slot[L->value_of[y]] >= 0) taken[L->slot[L->value_of[y]]] = 1;
+            }
+
+            /* Phi partners: operands of a phi, and phis using v */
+            SsaInstr *in = &f->instrs[v];
+            int s = -1;
+            for (int k = 0; k < in->nargs && s < 0; k++) {
+                int a = in->args[k];
+                if (L->reg[a] >= 0 && try_slot(taken, L->slot[a], limit)) s = L->slot[a];
+            }
+            for (int u = f->use_start[v]; u < f->use_start[v + 1] && s < 0; u++) {
+                int user = f->uses[u];
+                if (f->instrs[user].op == SSA_PHI && try_slot(taken, L->slot[user], limit)) s = L->slot[user];
+            }
+            if (s < 0 && in->var >= 0 && !f->vars[in->var].in_memory &&
+                try_slot(taken, f->vars[in->var].slot, limit)) {
+                s = f->vars[in->var].slot;
+            }
+            /* Free promoted variable slots, then temporaries */
+            for (int k = 0; k < f->var_count && s < 0; k++) {
+                if (!f->vars[k].in_memory && try_slot(taken, f->vars[k].slot, limit)) s = f->vars[k].slot;
+            }
+            for (int t = temp_base; t < temp_limit && s < 0; t++) {
+                if (try_slot(taken, t, limit)) s = t;
+            }
+            if (s < 0) {
+                rc = -1;
+                break;
+            }
+            L->slot[v] = s;
+        }
+    }
+    free(taken);
+    return rc;
+}
+
+/* ---- Emission ---- */
+
+static void emit_value(Lowering *L, int v);
+
+/* Compute v's own operation from its operands */
+static void emit_tree(Lowering *L, int v) {
+    const SsaInstr *in = &L->f->instrs[v];
+    if (in->op == SSA_LOAD) {
+        if (L->f->instrs[in->a].op == SSA_CONST) {
+            pf_emit(L->seq, PF_PUSH_VAR, L->f->instrs[in->a].imm, NULL);
+        } else {
+            emit_value(L, in->a);
+            pf_emit(L->seq, PF_DEREF, 0, NULL);
+        }
+        return;
+    }
+    emit_value(L, in->a);
+    emit_value(L, in->b);
+    switch (in->op) {
+        case SSA_ADD:    pf_emit(L->seq, PF_ADD, 0, NULL); break;
+        case SSA_SUB:    pf_emit(L->seq, PF_SUB, 0, NULL); break;
+        case SSA_MUL:    pf_emit(L->seq, PF_MUL, 0, NULL); break;
+        case SSA_CMP_EQ: pf_emit(L->seq, PF_CMP_EQ, 0, NULL); break;
+        case SSA_CMP_LT: pf_emit(L->seq, PF_CMP_LT, 0, NULL); break;
+        case SSA_CMP_GT: pf_emit(L->seq, PF_CMP_GT, 0, NULL); break;
+        default: break;
+    }
+}
+
+/* Push v's value */
+static void emit_value(Lowering *L, int v) {
+    const SsaInstr *in = &L->f->instrs[v];
+    if (in->op == SSA_CONST) pf_emit(L->seq, PF_PUSH_CONST, in->imm, NULL);
+    else if (L->inlined[v]) emit_tree(L, v);
+    else pf_emit(L->seq, PF_PUSH_VAR, L->slot[v], NULL);
+}
+
+/* Copies into the phis of succ for the edge from b */
+static void emit_phi_copies(Lowering *L, int b, int succ) {
+    SsaFunc *f = L->f;
+    SsaBlock *sb = &f->blocks[succ];
+    int p = 0;
+    while (p < sb->npreds && sb->preds[p] != b) p++;
+    if (p == sb->npreds) return;
+
+    int n = 0, parallel = 0;
+    int *dst = (int *)lower_calloc((size_t)sb->count, sizeof(int));
+    int *src = (int *)lower_calloc((size_t)sb->count, sizeof(int));
+    for (int i = 0; i < sb->count && f->instrs[sb->code[i]].op == SSA_PHI; i++) {
+        int phi = sb->code[i];
+        int a = f->instrs[phi].args[p];
+        if (L->reg[phi] < 0) continue;
+        if (f->instrs[a].op != SSA_CONST && L->slot[a] == L->slot[phi]) continue;
+        dst[n] = phi;
+        src[n] = a;
+        n++;
+    }
+    for (int i = 0; i < n && !parallel; i++) {
+        for (int j = 0; j < n; j++) {
+            if (j != i && f->instrs[src[i]].op != SSA_CONST && L->slot[src[i]] == L->slot[dst[j]]) parallel = 1;
+        }
+    }
+    if (!parallel) {
+        for (int i = 0; i < n; i++) {
+            pf_emit(L->seq, PF_ADDR_OF, L->slot[dst[i]], NULL);
+            emit_value(L, src[i]);
+            pf_emit(L->seq, PF_STORE, 0, NULL);
+        }
+    } else {
+        /* Read every source before writing any destination */
+        for (int i = 0; i < n; i++) emit_value(L, src[i]);
+        for (int i = n - 1; i >= 0; i--) {
+            pf_emit(L->seq, PF_ADDR_OF, L->slot[dst[i]], NULL);
+            pf_emit(L->seq, PF_SWAP, 0, NULL);
+            pf_emit(L->seq, PF_STORE, 0, NULL);
+        }
+    }
+    free(dst);
+    free(src);
+}
+
+static void emit_blocks(Lowering *L) {
+    SsaFunc *f = L->f;
+    PostfixSeq *seq = L->seq;
+    const char *name = intern_str(f->name_id);
+    int end_label = -1;
+    pf_emit(seq, PF_ENTER, 0, name);
+    for (int r = 0; r < f->rpo_count; r++) {
+        int b = f->rpo[r];
+        int next = r + 1 < f->rpo_count ? f->rpo[r + 1] : -1;
+        SsaBlock *bb = &f->blocks[b];
+        pf_emit(seq, PF_LABEL, L->label[b], NULL);
+        for (int i = 0; i < bb->count; i++) {
+            int v = bb->code[i];
+            SsaInstr *in = &f->instrs[v];
+            if (in->op == SSA_PHI || L->inlined[v] || L->dead[v]) continue;
+            switch (in->op) {
+                case SSA_STORE:
+                    emit_value(L, in->a);
+                    emit_value(L, in->b);
+                    pf_emit(seq, PF_STORE, 0, NULL);
+                    break;
+                case SSA_OUT:
+                    emit_value(L, in->a);
+                    break;
+                case SSA_JMP:
+                    emit_phi_copies(L, b, bb->succs[0]);
+                    if (bb->succs[0] != next) pf_emit(seq, PF_JMP, L->label[bb->succs[0]], NULL);
+                    break;
+                case SSA_BR:
+                    emit_value(L, in->a);
+                    pf_emit(seq, PF_BRZ, L->label[bb->succs[1]], NULL);
+                    if (bb->succs[0] != next) pf_emit(seq, PF_JMP, L->label[bb->succs[0]], NULL);
+                    break;
+                case SSA_EXIT:
+                    if (next < 0 && end_label < 0) {
+                        pf_emit(seq, PF_LEAVE, 0, name);
+                    } else if (next >= 0) {
+                        if (end_label < 0) end_label = pf_alloc_label(seq);
+                        pf_emit(seq, PF_JMP, end_label, NULL);
+                    }
+                    /* else fall through to the shared LEAVE below */
+                    break;
+                default:
+                    /* Value kept in a slot */
+                    pf_emit(seq, PF_ADDR_OF, L->slot[v], NULL);
+                    emit_tree(L, v);
+                    pf_emit(seq, PF_STORE, 0, NULL);
+                    break;
+            }
+        }
+    }
+    if (end_label >= 0) {
+        pf_emit(seq, PF_LABEL, end_label, NULL);
+        pf_emit(seq, PF_LEAVE, 0, name);
+    }
+}
+
+/* Reverse postorder visiting the zero/exit successor first, so each
+ * block's fall-through successor (then branch, loop body) follows it
+ * and the exit block comes last */
+static void layout_blocks(SsaFunc *f) {
+    for (int b = 0; b < f->block_count; b++) {
+        SsaBlock *bb = &f->blocks[b];
+        if (bb->nsuccs == 2) {
+            int t = bb->succs[0];
+            bb->succs[0] = bb->succs[1];
+            bb->succs[1] = t;
+        }
+    }
+    ssa_dominators(f);
+    for (int b = 0; b < f->block_count; b++) {
+        SsaBlock *bb = &f->blocks[b];
+        if (bb->nsuccs == 2) {
+            int t = bb->succs[0];
+            bb->succs[0] = bb->succs[1];
+            bb->succs[1] = t;
+        }
+    }
+}
+
+int ssa_lower(SsaFunc *f, PostfixSeq *seq, int temp_base, int temp_limit) {
+    LOG_DEBUG_MSG("SSA", "TASK-047", "ssa_lower entered");
+    ssa_split_critical_edges(f);
+    layout_blocks(f);
+    ssa_build_uses(f);
+
+    Lowering lw;
+    Lowering *L = &lw;
+    memset(L, 0, sizeof(*L));
+    L->f = f;
+    L->seq = seq;
+    L->inlined = (char *)lower_calloc((size_t)f->count, 1);
+    L->dead = (char *)lower_calloc((size_t)f->count, 1);
+    L->reg = (int *)lower_calloc((size_t)f->count, sizeof(int));
+    L->value_of = (int *)lower_calloc((size_t)f->count, sizeof(int));
+    L->slot = (int *)lower_calloc((size_t)f->count, sizeof(int));
+    L->label = (int *)lower_calloc((size_t)f->block_count, sizeof(int));
+
+    choose_inlined(L);
+    for (int v = 0; v < f->count; v++) {
+        L->reg[v] = -1;
+        L->slot[v] = -1;
+    }
+    for (int r = 0; r < f->rpo_count; r++) {
+        SsaBlock *bb = &f->blocks[f->rpo[r]];
+        for (int i = 0; i < bb->count; i++) {
+            int v = bb->code[i];
+            SsaOp op = f->instrs[v].op;
+            if ((op == SSA_PHI || is_pure(op)) && !L->inlined[v] && !L->dead[v]) {
+                L->value_of[L->nregs] = v;
+                L->reg[v] = L->nregs++;
+            }
+        }
+    }
+    L->words = (L->nregs + 63) / 64;
+    if (L->words == 0) L->words = 1;
+    build_interference(L);
+
+    int rc = assign_slots(L, temp_base, temp_limit);
+    if (rc == 0) {
+        for (int r = 0; r < f->rpo_count; r++) L->label[f->rpo[r]] = pf_alloc_label(seq);
+        emit_blocks(L);
+    }
+
+    free(L->inlined);
+    free(L->dead);
+    free(L->reg);
+    free(L->value_of);
+    free(L->slot);
+    free(L->label);
+    free(L->live_in);
+    free(L->interf);
+    return rc;
+}
@@ -0,0 +1,625 @@
+/*
+ * ssa_opt.c - Optimization passes on the SSA IR
+ *
+ * SCCP follows Wegman & Zadeck, "Constant Propagation with Conditional
+ * Branches" (TOPLAS 1991): every value starts unknown (TOP) and only
+ * moves down the lattice TOP -> constant -> varying (BOT), blocks are
+ * evaluated only once an edge into them is found executable, and phis
+ * merge only the operands of executable edges. Two worklists drive it:
+ * newly executable edges, and values whose lattice cell dropped.
+ *
+ * The loop passes work on natural loops (a header plus every block
+ * that reaches one of its back edges without passing it), innermost
+ * first, each given a preheader: the one block outside the loop that
+ * jumps to the header. LICM moves invariant computations there; strength
+ * reduction replaces iv * k by a new variable stepped by addition.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/ssa.h"
+#include "../include/vm.h"
+#include "../include/logger.h"
+
+static void *opt_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "ssa_opt: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void *opt_calloc(size_t n, size_t size) {
+    void *p = calloc(n > 0 ? n : 1, size);
+    if (p == NULL) {
+        fprintf(stderr, "ssa_opt: calloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+/* Operand k of in: a, b, then the phi arguments */
+static int *operand_at(SsaInstr *in, int k) {
+    return k == 0 ? &in->a : k == 1 ? &in->b : &in->args[k - 2];
+}
+
+/* Drop entry p of b's predecessor list and the phi operands for it */
+static void remove_pred(SsaFunc *f, int b, int p) {
+    SsaBlock *bb = &f->blocks[b];
+    for (int i = 0; i < bb->count; i++) {
+        SsaInstr *in = &f->instrs[bb->code[i]];
+        if (in->op != SSA_PHI) continue;
+        memmove(&in->args[p], &in->args[p + 1], (size_t)(in->nargs - p - 1) * sizeof(int));
+        in->nargs--;
+    }
+    memmove(&bb->preds[p], &bb->preds[p + 1], (size_t)(bb->npreds - p - 1) * sizeof(int));
+    bb->npreds--;
+}
+
+/* Drop deleted instructions from every block */
+static void compact_blocks(SsaFunc *f) {
+    for (int b = 0; b < f->block_count; b++) {
+        SsaBlock *bb = &f->blocks[b];
+        int w = 0;
+        for (int i = 0; i < bb->count; i++) {
+            if (f->instrs[bb->code[i]].op != SSA_NOP) bb->code[w++] = bb->code[i];
+        }
+        bb->count = w;
+    }
+}
+
+/* ---- Sparse conditional constant propagation ---- */
+
+enum { LAT_TOP, LAT_CONST, LAT_BOT };
+
+typedef struct {
+    SsaFunc *f;
+    char *lat;          /* Per value */
+    int *val;           /* Per value, when lat is LAT_CONST */
+    char *block_exec;
+    int *edge_base;     /* Edge (b, pred index p) is edge_exec[edge_base[b] + p] */
+    char *edge_exec;
+    int *block_work;
+    int nblock_work;
+    int *value_work;
+    int nvalue_work;
+} Sccp;
+
+/* The VM's arithmetic, in unsigned to keep overflow defined */
+static int fold(SsaOp op, int a, int b) {
+    switch (op) {
+        case SSA_ADD:    return (int)((unsigned)a + (unsigned)b);
+        case SSA_SUB:    return (int)((unsigned)a - (unsigned)b);
+        case SSA_MUL:    return (int)((unsigned)a * (unsigned)b);
+        case SSA_CMP_EQ: return a == b ? 1 : 0;
+        case SSA_CMP_LT: return a < b ? 1 : (a > b ? -1 : 0);
+        case SSA_CMP_GT: return a > b ? 1 : (a < b ? -1 : 0);
+        default:         return 0;
+    }
+}
+
+static void mark_edge(Sccp *S, int from, int to) {
+    SsaBlock *tb = &S->f->blocks[to];
+    int added = 0;
+    for (int p = 0; p < tb->npreds; p++) {
+        if (tb->preds[p] == from && !S->edge_exec[S->edge_base[to] + p]) {
+            S->edge_exec[S->edge_base[to] + p] = 1;
+            added = 1;
+        }
+    }
+    if (added) S->block_work[S->nblock_work++] = to;
+}
+
+static void lower_to(Sccp *S, int v, int lat, int val) {
+    if (lat == S->lat[v] && (lat != LAT_CONST || val == S->val[v])) return;
+    /* Never climb back up: a second constant means varying */
+    if (lat < S->lat[v] || (lat == LAT_CONST && S->lat[v] == LAT_CONST)) lat = LAT_BOT;
+    if (lat == S->lat[v]) return;
+    S->lat[v] = (char)lat;
+    S->val[v] = val;
+    S->value_work[S->nvalue_work++] = v;
+}
+
+static void evaluate(Sccp *S, int v) {
+    SsaFunc *f = S->f;
+    SsaInstr *in = &f->instrs[v];
+    int b = in->block;
+    switch (in->op) {
+        case SSA_PHI: {
+            int lat = LAT_TOP, val = 0;
+            for (int p = 0; p < in->nargs && lat != LAT_BOT; p++) {
+                if (!S->edge_exec[S->edge_base[b] + p]) continue;
+                int o = in->args[p];
+                if (S->lat[o] == LAT_TOP) continue;
+                if (S->lat[o] == LAT_BOT || (lat == LAT_CONST && S->val[o] != val)) {
+                    lat = LAT_BOT;
+                } else {
+                    lat = LAT_CONST;
+                    val = S->val[o];
+                }
+            }
+            lower_to(S, v, lat, val);
+            break;
+        }
+        case SSA_ADD: case SSA_SUB: case SSA_MUL:
+        case SSA_CMP_EQ: case SSA_CMP_LT: case SSA_CMP_GT: {
+            int la = S->lat[in->a], lb = S->lat[in->b];
+            int va = S->val[in->a], vb = S->val[in->b];
+            if (la == LAT_CONST && lb == LAT_CONST) {
+                lower_to(S, v, LAT_CONST, fold(in->op, va, vb));
+            } else if (in->op == SSA_MUL && ((la == LAT_CONST && va == 0) || (lb == LAT_CONST && vb == 0))) {
+                lower_to(S, v, LAT_CONST, 0);
+            } else if (in->a == in->b && in->op != SSA_ADD && in->op != SSA_MUL && la != LAT_TOP) {
+                /* x - x, x == x, x < x, x > x */
+                lower_to(S, v, LAT_CONST, fold(in->op, 0, 0));
+            } else if (la == LAT_BOT || lb == LAT_BOT) {
+                lower_to(S, v, LAT_BOT, 0);
+            }
+            break;
+        }
+        case SSA_LOAD:
+            lower_to(S, v, LAT_BOT, 0);
+            break;
+        case SSA_JMP:
+            mark_edge(S, b, f->blocks[b].succs[0]);
+            break;
+        case SSA_BR: {
+            int lat = S->lat[in->a];
+            if (lat == LAT_BOT || (lat == LAT_CONST && S->val[in->a] != 0)) mark_edge(S, b, f->blocks[b].succs[0]);
+            if (lat == LAT_BOT || (lat == LAT_CONST && S->val[in->a] == 0)) mark_edge(S, b, f->blocks[b].succs[1]);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+int ssa_sccp(SsaFunc *f) {
+    LOG_DEBUG_MSG("SSA", "TASK-048", "ssa_sccp entered");
+    if (f->block_count == 0) return 0;
+    ssa_build_uses(f);
+
+    Sccp sccp;
+    Sccp *S = &sccp;
+    memset(S, 0, sizeof(*S));
+    S->f = f;
+    S->lat = (char *)opt_calloc((size_t)f->count, 1);
+    S->val = (int *)opt_calloc((size_t)f->count, sizeof(int));
+    S->block_exec = (char *)opt_calloc((size_t)f->block_count, 1);
+    S->edge_base = (int *)opt_calloc((size_t)f->block_count + 1, sizeof(int));
+    for (int b = 0; b < f->block_count; b++) S->edge_base[b + 1] = S->edge_base[b] + f->blocks[b].npreds;
+    S->edge_exec = (char *)opt_calloc((size_t)S->edge_base[f->block_count], 1);
+    /* Each edge and each lattice drop (at most two per value) is queued once */
+    S->block_work = (int *)opt_calloc((size_t)S->edge_base[f->block_count] + 1, sizeof(int));
+    S->value_work = (int *)opt_calloc((size_t)f->count * 2, sizeof(int));
+
+    for (int v = 0; v < f->count; v++) {
+        if (f->instrs[v].op == SSA_CONST) {
+            S->lat[v] = LAT_CONST;
+            S->val[v] = f->instrs[v].imm;
+        }
+    }
+
+    S->block_work[S->nblock_work++] = 0;
+    while (S->nblock_work > 0 || S->nvalue_work > 0) {
+        if (S->nblock_work > 0) {
+            int b = S->block_work[--S->nblock_work];
+            SsaBlock *bb = &f->blocks[b];
+            int first = !S->block_exec[b];
+            S->block_exec[b] = 1;
+            /* A new edge only changes the phis; the first one runs everything */
+            for (int i = 0; i < bb->count; i++) {
+                int v = bb->code[i];
+                if (first || f->instrs[v].op == SSA_PHI) evaluate(S, v);
+            }
+            continue;
+        }
+        int v = S->value_work[--S->nvalue_work];
+        for (int u = f->use_start[v]; u < f->use_start[v + 1]; u++) {
+            int user = f->uses[u];
+            if (f->instrs[user].block >= 0 && S->block_exec[f->instrs[user].block]) evaluate(S, user);
+        }
+    }
+
+    /* Rewrite: constants for constant values, jumps for decided branches */
+    int changed = 0;
+    int n = f->count;
+    int *repl = (int *)opt_calloc((size_t)n, sizeof(int));
+    for (int v = 0; v < n; v++) {
+        repl[v] = -1;
+        SsaInstr *in = &f->instrs[v];
+        if (in->op == SSA_CONST || in->block < 0 || S->lat[v] != LAT_CONST) continue;
+        if (in->op == SSA_STORE || in->op == SSA_OUT || in->op == SSA_JMP ||
+            in->op == SSA_BR || in->op == SSA_EXIT) continue;
+        repl[v] = ssa_const(f, S->val[v]);
+        in = &f->instrs[v];
+        in->op = SSA_NOP;
+        in->block = -1;
+        changed++;
+    }
+    for (int u = 0; u < f->count; u++) {
+        SsaInstr *in = &f->instrs[u];
+        if (in->op == SSA_NOP) continue;
+        for (int k = 0; k < 2 + in->nargs; k++) {
+            int *o = operand_at(in, k);
+            if (*o >= 0 && *o < n && repl[*o] >= 0) *o = repl[*o];
+        }
+    }
+    for (int b = 0; b < f->block_count; b++) {
+        SsaBlock *bb = &f->blocks[b];
+        if (!S->block_exec[b] || bb->count == 0) continue;
+        SsaInstr *term = &f->instrs[bb->code[bb->count - 1]];
+        if (term->op != SSA_BR || f->instrs[term->a].op != SSA_CONST) continue;
+        int taken = f->instrs[term->a].imm != 0 ? 0 : 1;
+        int kept = bb->succs[taken], dropped = bb->succs[1 - taken];
+        SsaBlock *db = &f->blocks[dropped];
+        for (int p = 0; p < db->npreds; p++) {
+            if (db->preds[p] == b) {
+                remove_pred(f, dropped, p);
+                break;
+            }
+        }
+        term->op = SSA_JMP;
+        term->a = -1;
+        bb->succs[0] = kept;
+        bb->nsuccs = 1;
+        changed++;
+    }
+    free(repl);
+
+    compact_blocks(f);
+    changed += ssa_remove_unreachable(f);
+    ssa_remove_trivial_phis(f);
+
+    free(S->lat);
+    free(S->val);
+    free(S->block_exec);
+    free(S->edge_base);
+    free(S->edge_exec);
+    free(S->block_work);
+    free(S->value_work);
+    return changed;
+}
+
+/* ---- Dead code elimination ---- */
+
+int ssa_dce(SsaFunc *f) {
+    LOG_DEBUG_MSG("SSA", "TASK-048", "ssa_dce entered");
+    int removed = 0;
+
+    /* Stores overwritten before any load, block by block, scanning
+     * backwards with the constant addresses stored since the last load */
+    int *stored = NULL;
+    int nstored = 0, stored_capacity = 0;
+    for (int b = 0; b < f->block_count; b++) {
+        SsaBlock *bb = &f->blocks[b];
+        nstored = 0;
+        for (int i = bb->count - 1; i >= 0; i--) {
+            SsaInstr *in = &f->instrs[bb->code[i]];
+            if (in->op == SSA_LOAD) {
+                nstored = 0;
+                continue;
+            }
+            if (in->op != SSA_STORE || f->instrs[in->a].op != SSA_CONST) continue;
+            int addr = f->instrs[in->a].imm, seen = 0;
+            for (int k = 0; k < nstored && !seen; k++) seen = stored[k] == addr;
+            if (seen) {
+                in->op = SSA_NOP;
+                in->block = -1;
+                removed++;
+                continue;
+            }
+            if (nstored >= stored_capacity) {
+                stored_capacity = stored_capacity ? stored_capacity * 2 : 16;
+                stored = (int *)opt_alloc(stored, (size_t)stored_capacity * sizeof(int));
+            }
+            stored[nstored++] = addr;
+        }
+    }
+    free(stored);
+
+    /* Mark from the instructions with effects, sweep the rest */
+    char *live = (char *)opt_calloc((size_t)f->count, 1);
+    int *work = (int *)opt_calloc((size_t)f->count, sizeof(int));
+    int nwork = 0;
+    for (int v = 0; v < f->count; v++) {
+        SsaOp op = f->instrs[v].op;
+        if (f->instrs[v].block < 0) continue;
+        if (op == SSA_STORE || op == SSA_OUT || op == SSA_JMP || op == SSA_BR || op == SSA_EXIT) {
+            live[v] = 1;
+            work[nwork++] = v;
+        }
+    }
+    while (nwork > 0) {
+        SsaInstr *in = &f->instrs[work[--nwork]];
+        for (int k = 0; k < 2 + in->nargs; k++) {
+            int o = *operand_at(in, k);
+            if (o >= 0 && !live[o] && f->instrs[o].block >= 0) {
+                live[o] = 1;
+                work[nwork++] = o;
+            }
+        }
+    }
+    for (int v = 0; v < f->count; v++) {
+        SsaInstr *in = &f->instrs[v];
+        if (in->block < 0 || live[v]) continue;
+        in->op = SSA_NOP;
+        in->block = -1;
+        removed++;
+    }
+    free(live);
+    free(work);
+    compact_blocks(f);
+    return removed;
+}
+
+/* ---- Loops ---- */
+
+typedef struct {
+    int header;
+    int preheader;      /* Sole predecessor from outside, or -1 */
+    int pre_index;      /* Its index in the header's preds */
+    char *body;         /* Per block */
+    int size;
+} SsaLoop;
+
+static int loop_order(const void *x, const void *y) {
+    return ((const SsaLoop *)x)->size - ((const SsaLoop *)y)->size;
+}
+
+static void free_loops(SsaLoop *loops, int n) {
+    for (int i = 0; i < n; i++) free(loops[i].body);
+    free(loops);
+}
+
+/* Natural loops, innermost (smallest) first; dominators must be current */
+static int find_loops(SsaFunc *f, SsaLoop **out) {
+    SsaLoop *loops = NULL;
+    int n = 0;
+    int *stack = (int *)opt_calloc((size_t)f->block_count, sizeof(int));
+    for (int h = 0; h < f->block_count; h++) {
+        SsaBlock *hb = &f->blocks[h];
+        if (hb->rpo < 0) continue;
+        char *body = NULL;
+        int size = 0, sp = 0;
+        for (int p = 0; p < hb->npreds; p++) {
+            int latch = hb->preds[p];
+            if (f->blocks[latch].rpo < 0 || !ssa_dominates(f, h, latch)) continue;
+            if (body == NULL) {
+                body = (char *)opt_calloc((size_t)f->block_count, 1);
+                body[h] = 1;
+                size = 1;
+            }
+            if (!body[latch]) {
+                body[latch] = 1;
+                size++;
+                stack[sp++] = latch;
+            }
+        }
+        if (body == NULL) continue;
+        /* Everything that reaches a latch without passing the header */
+        while (sp > 0) {
+            SsaBlock *bb = &f->blocks[stack[--sp]];
+            for (int p = 0; p < bb->npreds; p++) {
+                int q = bb->preds[p];
+                if (body[q] || f->blocks[q].rpo < 0) continue;
+                body[q] = 1;
+                size++;
+                stack[sp++] = q;
+            }
+        }
+        int outside = 0, pre = -1, pre_index = -1;
+        for (int p = 0; p < hb->npreds; p++) {
+            if (body[hb->preds[p]]) continue;
+            outside++;
+            pre = hb->preds[p];
+            pre_index = p;
+        }
+        loops = (SsaLoop *)opt_alloc(loops, (size_t)(n + 1) * sizeof(SsaLoop));
+        loops[n].header = h;
+        loops[n].preheader = outside == 1 ? pre : -1;
+        loops[n].pre_index = outside == 1 ? pre_index : -1;
+        loops[n].body = body;
+        loops[n].size = size;
+        n++;
+    }
+    free(stack);
+    if (n > 1) qsort(loops, (size_t)n, sizeof(SsaLoop), loop_order);
+    *out = loops;
+    return n;
+}
+
+/* Find the loops, first giving each one entered by a branch a block of
+ * its own to hoist into */
+static int find_loops_with_preheaders(SsaFunc *f, SsaLoop **out) {
+    ssa_dominators(f);
+    SsaLoop *loops;
+    int n = find_loops(f, &loops), split = 0;
+    for (int i = 0; i < n; i++) {
+        int pre = loops[i].preheader;
+        if (pre < 0 || f->blocks[pre].nsuccs == 1) continue;
+        int k = f->blocks[pre].succs[0] == loops[i].header ? 0 : 1;
+        ssa_split_edge(f, pre, k);
+        split++;
+    }
+    if (split > 0) {
+        free_loops(loops, n);
+        ssa_dominators(f);
+        n = find_loops(f, &loops);
+    }
+    *out = loops;
+    return n;
+}
+
+/* Add v to block b just before its terminator */
+static void insert_before_terminator(SsaFunc *f, int b, int v) {
+    ssa_insert(f, b, f->blocks[b].count - 1, v);
+}
+
+/* Remove v from its block */
+static void unlink_instr(SsaFunc *f, int v) {
+    SsaBlock *bb = &f->blocks[f->instrs[v].block];
+    for (int i = 0; i < bb->count; i++) {
+        if (bb->code[i] == v) {
+            memmove(&bb->code[i], &bb->code[i + 1], (size_t)(bb->count - i - 1) * sizeof(int));
+            bb->count--;
+            break;
+        }
+    }
+    f->instrs[v].block = -1;
+}
+
+static int is_arith(SsaOp op) {
+    return op == SSA_ADD || op == SSA_SUB || op == SSA_MUL ||
+           op == SSA_CMP_EQ || op == SSA_CMP_LT || op == SSA_CMP_GT;
+}
+
+/* Defined outside the loop (constants included) */
+static int outside(const SsaFunc *f, const SsaLoop *lp, int v) {
+    return v < 0 || f->instrs[v].block < 0 || !lp->body[f->instrs[v].block];
+}
+
+/* ---- Loop-invariant code motion ---- */
+
+int ssa_licm(SsaFunc *f) {
+    LOG_DEBUG_MSG("SSA", "TASK-049", "ssa_licm entered");
+    if (f->block_count == 0) return 0;
+    SsaLoop *loops;
+    int n = find_loops_with_preheaders(f, &loops);
+    int hoisted = 0;
+    for (int l = 0; l < n; l++) {
+        SsaLoop *lp = &loops[l];
+        if (lp->preheader < 0) continue;
+        int stores = 0;
+        for (int b = 0; b < f->block_count; b++) {
+            if (!lp->body[b]) continue;
+            for (int i = 0; i < f->blocks[b].count; i++) stores += f->instrs[f->blocks[b].code[i]].op == SSA_STORE;
+        }
+        /* Dominance order, so operands hoist before their users */
+        for (int r = 0; r < f->rpo_count; r++) {
+            int b = f->rpo[r];
+            if (!lp->body[b]) continue;
+            for (int i = 0; i < f->blocks[b].count; i++) {
+                int v = f->blocks[b].code[i];
+                SsaInstr *in = &f->instrs[v];
+                int movable = is_arith(in->op) ||
+                              /* Loads only from fixed addresses of memory the loop never writes */
+                              (in->op == SSA_LOAD && stores == 0 && f->instrs[in->a].op == SSA_CONST &&
+                               f->instrs[in->a].imm >= 0 && f->instrs[in->a].imm < MEMORY_SIZE);
+                if (!movable || !outside(f, lp, in->a) || !outside(f, lp, in->b)) continue;
+                unlink_instr(f, v);
+                insert_before_terminator(f, lp->preheader, v);
+                hoisted++;
+                i--;
+            }
+        }
+    }
+    free_loops(loops, n);
+    return hoisted;
+}
+
+/* ---- Induction-variable strength reduction ---- */
+
+/* New phi at the top of block b with one (unset) operand per pred */
+static int new_phi(SsaFunc *f, int b) {
+    int phi = ssa_new_instr(f, SSA_PHI, -1, -1);
+    SsaInstr *in = &f->instrs[phi];
+    in->nargs = f->blocks[b].npreds;
+    in->args = (int *)opt_calloc((size_t)in->nargs, sizeof(int));
+    ssa_insert(f, b, 0, phi);
+    return phi;
+}
+
+/* Value computing op(a, b) at the end of block b: folded if both are constants */
+static int emit_at_end(SsaFunc *f, int b, SsaOp op, int x, int y) {
+    if (f->instrs[x].op == SSA_CONST && f->instrs[y].op == SSA_CONST) {
+        return ssa_const(f, fold(op, f->instrs[x].imm, f->instrs[y].imm));
+    }
+    int v = ssa_new_instr(f, op, x, y);
+    insert_before_terminator(f, b, v);
+    return v;
+}
+
+/*
+ * Basic induction variable: a header phi whose operands are init from
+ * the preheader and, from every latch, one value inc = phi + c or
+ * phi - c with c constant. Returns inc and sets *step, or -1.
+ */
+static int basic_iv(const SsaFunc *f, const SsaLoop *lp, int phi, int *step) {
+    const SsaInstr *in = &f->instrs[phi];
+    int inc = -1;
+    for (int p = 0; p < in->nargs; p++) {
+        if (p == lp->pre_index) continue;
+        if (inc >= 0 && in->args[p] != inc) return -1;
+        inc = in->args[p];
+    }
+    if (inc < 0 || outside(f, lp, inc)) return -1;
+    const SsaInstr *d = &f->instrs[inc];
+    if (d->op == SSA_ADD && d->a == phi && f->instrs[d->b].op == SSA_CONST) *step = f->instrs[d->b].imm;
+    else if (d->op == SSA_ADD && d->b == phi && f->instrs[d->a].op == SSA_CONST) *step = f->instrs[d->a].imm;
+    else if (d->op == SSA_SUB && d->a == phi && f->instrs[d->b].op == SSA_CONST) *step = (int)(0u - (unsigned)f->instrs[d->b].imm);
+    else return -1;
+    return inc;
+}
+
+int ssa_strength_reduce(SsaFunc *f) {
+    LOG_DEBUG_MSG("SSA", "TASK-049", "ssa_strength_reduce entered");
+    if (f->block_count == 0) return 0;
+    SsaLoop *loops;
+    int n = find_loops_with_preheaders(f, &loops);
+    int reduced = 0;
+    for (int l = 0; l < n; l++) {
+        SsaLoop *lp = &loops[l];
+        if (lp->preheader < 0) continue;
+        int h = lp->header;
+        for (int i = 0; i < f->blocks[h].count; i++) {
+            int phi = f->blocks[h].code[i];
+            if (f->instrs[phi].op != SSA_PHI) break;
+            int step;
+            int inc = basic_iv(f, lp, phi, &step);
+            if (inc < 0) continue;
+            /* Each phi * k in the loop, k invariant, becomes its own
+             * variable starting at init * k and stepping by step * k */
+            for (int m = 0; m < f->count; m++) {
+                SsaInstr *mul = &f->instrs[m];
+                if (mul->op != SSA_MUL || mul->block < 0 || !lp->body[mul->block]) continue;
+                int k = mul->a == phi ? mul->b : mul->b == phi ? mul->a : -1;
+                if (k < 0 || k == phi || !outside(f, lp, k)) continue;
+
+                int init = f->instrs[phi].args[lp->pre_index];
+                int start = emit_at_end(f, lp->preheader, SSA_MUL, init, k);
+                int delta = emit_at_end(f, lp->preheader, SSA_MUL, ssa_const(f, step), k);
+                int j = new_phi(f, h);
+                i++;    /* The phi being reduced moved down one */
+                int next = ssa_new_instr(f, SSA_ADD, j, delta);
+                SsaBlock *ib = &f->blocks[f->instrs[inc].block];
+                int at = 0;
+                while (ib->code[at] != inc) at++;
+                ssa_insert(f, f->instrs[inc].block, at + 1, next);
+                SsaInstr *jp = &f->instrs[j];
+                for (int p = 0; p < jp->nargs; p++) jp->args[p] = p == lp->pre_index ? start : next;
+                ssa_replace_uses(f, m, j);
+                unlink_instr(f, m);
+                f->instrs[m].op = SSA_NOP;
+                reduced++;
+            }
+        }
+    }
+    free_loops(loops, n);
+    return reduced;
+}
+
+int ssa_optimize(SsaFunc *f, int level) {
+    if (level < 1) return 0;
+    int changed = ssa_sccp(f);
+    changed += ssa_dce(f);
+    changed += ssa_merge_blocks(f);
+    changed += ssa_licm(f);
+    if (level >= 2) {
+        int reduced = ssa_strength_reduce(f);
+        if (reduced > 0) changed += reduced + ssa_dce(f);
+    }
+    return changed;
+}
@@ -0,0 +1,130 @@
+/*
+ * symhash.c - Scoped open-addressing symbol table
+ *
+ * Linear probing over a power-of-two slot array. Each slot holds the
+ * innermost binding of one key; shadowed bindings are chained through
+ * SymHashEntry.shadowed.
+ *
+ * Deletion needs no tombstones: bindings are only removed in LIFO order,
+ * and a key's slot is cleared only when its outermost binding goes. At
+ * that point every key that was first bound later is already gone, so
+ * no remaining probe chain runs through the cleared slot. Rehashing
+ * re-inserts keys in order of their outermost binding to keep that true.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/symhash.h"
+
+static void *symhash_alloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "symhash: realloc failed\n");
+        exit(1);
+    }
+    return p;
+}
+
+static uint32_t key_hash(int key) {
+    uint32_t h = (uint32_t)key * 2654435761u;
+    return h ^ (h >> 16);
+}
+
+/* Slot holding key, or the empty slot where it would go */
+static uint32_t probe(const int *slots, uint32_t mask, const SymHashEntry *entries, int key) {
+    uint32_t i = key_hash(key) & mask;
+    while (slots[i] != 0 && entries[slots[i] - 1].key != key) {
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+static void rehash(SymHash *h, uint32_t size) {
+    int *old = h->slots;
+    uint32_t old_mask = h->slot_mask;
+
+    h->slots = (int *)symhash_alloc(NULL, size * sizeof(int));
+    memset(h->slots, 0, size * sizeof(int));
+    h->slot_mask = size - 1;
+
+    if (old == NULL) return;
+    for (int i = 0; i < h->count; i++) {
+        if (h->entries[i].shadowed != -1) continue;
+        int key = h->entries[i].key;
+        int inner = old[probe(old, old_mask, h->entries, key)];
+        h->slots[probe(h->slots, h->slot_mask, h->entries, key)] = inner;
+    }
+    free(old);
+}
+
+void symhash_init(SymHash *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void symhash_free(SymHash *h) {
+    free(h->entries);
+    free(h->slots);
+    free(h->scopes);
+    symhash_init(h);
+}
+
+void symhash_clear(SymHash *h) {
+    if (h->slots) memset(h->slots, 0, (h->slot_mask + 1) * sizeof(int));
+    h->count = 0;
+    h->key_count = 0;
+    h->depth = 0;
+}
+
+int symhash_insert(SymHash *h, int key, int value) {
+    if (h->slots == NULL) {
+        rehash(h, 16);
+    } else if ((uint32_t)(h->key_count + 1) * 2 > h->slot_mask + 1) {
+        /* Keep load factor under 1/2 */
+        rehash(h, (h->slot_mask + 1) * 2);
+    }
+    if (h->count >= h->capacity) {
+        h->capacity = h->capacity ? h->capacity * 2 : 16;
+        h->entries = (SymHashEntry *)symhash_alloc(h->entries,
+            (size_t)h->capacity * sizeof(SymHashEntry));
+    }
+
+    uint32_t s = probe(h->slots, h->slot_mask, h->entries, key);
+    int idx = h->count++;
+    h->entries[idx].key = key;
+    h->entries[idx].value = value;
+    h->entries[idx].shadowed = h->slots[s] - 1;
+    if (h->slots[s] == 0) h->key_count++;
+    h->slots[s] = idx + 1;
+    return idx;
+}
+
+int symhash_find(const SymHash *h, int key) {
+    if (h->slots == NULL) return -1;
+    return h->slots[probe(h->slots, h->slot_mask, h->entries, key)] - 1;
+}
+
+int symhash_in_scope(const SymHash *h, int key) {
+    int e = symhash_find(h, key);
+    int base = h->depth > 0 ? h->scopes[h->depth - 1] : 0;
+    return e >= base;
+}
+
+void symhash_push_scope(SymHash *h) {
+    if (h->depth >= h->scope_capacity) {
+        h->scope_capacity = h->scope_capacity ? h->scope_capacity * 2 : 8;
+        h->scopes = (int *)symhash_alloc(h->scopes, (size_t)h->scope_capacity * sizeof(int));
+    }
+    h->scopes[h->depth++] = h->count;
+}
+
+void symhash_pop_scope(SymHash *h) {
+    if (h->depth == 0) return;
+    int base = h->scopes[--h->depth];
+    while (h->count > base) {
+        const SymHashEntry *e = &h->entries[--h->count];
+        uint32_t s = probe(h->slots, h->slot_mask, h->entries, e->key);
+        h->slots[s] = e->shadowed + 1;
+        if (e->shadowed < 0) h->key_count--;
+    }
+}
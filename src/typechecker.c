@@ -1,7 +1,7 @@
 /*
  * typechecker.c - Type Checking Implementation (Phase 3)
  *
- * Walks the AST and performs type inference/checking.
+ * Walks the compact AST and performs type inference/checking.
  * Reports type errors without stopping compilation.
  */
 
@@ -11,12 +11,22 @@
 #include <stdarg.h>
 #include "../include/typechecker.h"
 #include "../include/logger.h"
+#include "../include/intern.h"
 
 void typechecker_init(TypeChecker *tc) {
+    tc->env.symbols = NULL;
     tc->env.count = 0;
+    tc->env.capacity = 0;
+    symhash_init(&tc->env.index);
     tc->error_count = 0;
 }
 
+void typechecker_free(TypeChecker *tc) {
+    free(tc->env.symbols);
+    symhash_free(&tc->env.index);
+    typechecker_init(tc);
+}
+
 static void tc_error(TypeChecker *tc, int node_type, const char *fmt, ...) {
     if (tc->error_count >= TYPE_MAX_ERRORS) return;
     TypeError *err = &tc->errors[tc->error_count++];
@@ -28,59 +38,92 @@ static void tc_error(TypeChecker *tc, int node_type, const char *fmt, ...) {
     va_end(args);
 }
 
-void typechecker_add_symbol(TypeChecker *tc, const char *name, TypeDesc type) {
-    if (tc->env.count >= TYPE_MAX_SYMBOLS) return;
-    TypeSymbol *sym = &tc->env.symbols[tc->env.count++];
-    strncpy(sym->name, name, 63);
-    sym->name[63] = '\0';
+static void add_symbol_id(TypeChecker *tc, int name_id, TypeDesc type) {
+    TypeEnv *env = &tc->env;
+    if (env->count >= env->capacity) {
+        env->capacity = env->capacity ? env->capacity * 2 : 32;
+        env->symbols = (TypeSymbol *)realloc(env->symbols,
+            (size_t)env->capacity * sizeof(TypeSymbol));
+        if (env->symbols == NULL) {
+            fprintf(stderr, "typechecker: realloc failed\n");
+            exit(1);
+        }
+    }
+    symhash_insert(&env->index, name_id, env->count);
+    TypeSymbol *sym = &env->symbols[env->count++];
+    sym->name_id = name_id;
     sym->type = type;
     sym->is_param = 0;
 }
 
+void typechecker_add_symbol(TypeChecker *tc, const char *name, TypeDesc type) {
+    add_symbol_id(tc, intern(name), type);
+}
+
+const TypeSymbol *typechecker_lookup_id(const TypeChecker *tc, int name_id) {
+    /* Innermost binding (most recent scope first) */
+    int i = symhash_get(&tc->env.index, name_id, -1);
+    return i < 0 ? NULL : &tc->env.symbols[i];
+}
+
 const TypeSymbol *typechecker_lookup(const TypeChecker *tc, const char *name) {
-    /* Search from end (most recent scope first) */
-    for (int i = tc->env.count - 1; i >= 0; i--) {
-        if (strcmp(tc->env.symbols[i].name, name) == 0) {
-            return &tc->env.symbols[i];
+    int id = intern_find(name);
+    return id == INTERN_NONE ? NULL : typechecker_lookup_id(tc, id);
+}
+
+#define KIND(n)   ((NodeType)ca->kind[n])
+#define KID(n, i) cast_kid(ca, (n), (i))
+#define NAME(n)   cast_name(ca, (n))
+#define NAME_ID(n) (ca->name[n])
+
+/* Static bounds check when an array index is a constant */
+static void check_const_index(TypeChecker *tc, const CompactAST *ca, NodeRef n,
+                              const TypeSymbol *sym) {
+    NodeRef idx = KID(n, 0);
+    if (idx != CAST_NONE && KIND(idx) == NODE_CONST && sym->type.kind == TYPE_ARRAY) {
+        if (ca->val[idx] < 0 || ca->val[idx] >= sym->type.array_size) {
+            tc_error(tc, KIND(n),
+                "array index %d out of bounds for '%s' (size %d)",
+                ca->val[idx], NAME(n), sym->type.array_size);
         }
     }
-    return NULL;
 }
 
-TypeDesc typechecker_infer(TypeChecker *tc, Expr *e) {
+static TypeDesc infer_node(TypeChecker *tc, const CompactAST *ca, NodeRef n) {
     TypeDesc unknown = {TYPE_UNKNOWN, 0};
     TypeDesc int_type = {TYPE_INT, 0};
     TypeDesc trit_type = {TYPE_TRIT, 0};
 
-    if (e == NULL) return unknown;
+    if (n == CAST_NONE) return unknown;
 
-    switch (e->type) {
+    switch (KIND(n)) {
         case NODE_CONST:
             return int_type;
 
         case NODE_VAR: {
-            const TypeSymbol *sym = typechecker_lookup(tc, e->name);
+            const TypeSymbol *sym = typechecker_lookup_id(tc, NAME_ID(n));
             if (sym == NULL) {
-                tc_error(tc, e->type, "undeclared variable '%s'", e->name);
+                tc_error(tc, KIND(n), "undeclared variable '%s'", NAME(n));
                 return unknown;
             }
             return sym->type;
         }
 
         case NODE_BINOP: {
-            TypeDesc lt = typechecker_infer(tc, e->left);
-            TypeDesc rt = typechecker_infer(tc, e->right);
+            TypeDesc lt = infer_node(tc, ca, KID(n, 0));
+            TypeDesc rt = infer_node(tc, ca, KID(n, 1));
 
             /* Arithmetic and comparison require int or trit operands */
             if (lt.kind != TYPE_INT && lt.kind != TYPE_TRIT && lt.kind != TYPE_UNKNOWN) {
-                tc_error(tc, e->type, "left operand of binary op is not int or trit");
+                tc_error(tc, KIND(n), "left operand of binary op is not int or trit");
             }
             if (rt.kind != TYPE_INT && rt.kind != TYPE_TRIT && rt.kind != TYPE_UNKNOWN) {
-                tc_error(tc, e->type, "right operand of binary op is not int or trit");
+                tc_error(tc, KIND(n), "right operand of binary op is not int or trit");
             }
 
             /* Comparison ops return int (0 or 1) */
-            if (e->op == OP_IR_CMP_EQ || e->op == OP_IR_CMP_LT || e->op == OP_IR_CMP_GT) {
+            OpType op = (OpType)ca->op[n];
+            if (op == OP_IR_CMP_EQ || op == OP_IR_CMP_LT || op == OP_IR_CMP_GT) {
                 return int_type;
             }
             /* For now, operations on trits return trit */
@@ -91,18 +134,19 @@ TypeDesc typechecker_infer(TypeChecker *tc, Expr *e) {
         }
 
         case NODE_DEREF: {
-            TypeDesc inner = typechecker_infer(tc, e->left);
+            TypeDesc inner = infer_node(tc, ca, KID(n, 0));
             if (inner.kind != TYPE_PTR && inner.kind != TYPE_UNKNOWN) {
-                tc_error(tc, e->type, "dereference of non-pointer type");
+                tc_error(tc, KIND(n), "dereference of non-pointer type");
             }
             return int_type;
         }
 
         case NODE_ADDR_OF: {
-            if (e->left && e->left->type == NODE_VAR) {
-                const TypeSymbol *sym = typechecker_lookup(tc, e->left->name);
+            NodeRef var = KID(n, 0);
+            if (var != CAST_NONE && KIND(var) == NODE_VAR) {
+                const TypeSymbol *sym = typechecker_lookup_id(tc, NAME_ID(var));
                 if (sym == NULL) {
-                    tc_error(tc, e->type, "address-of undeclared variable '%s'", e->left->name);
+                    tc_error(tc, KIND(n), "address-of undeclared variable '%s'", NAME(var));
                 }
             }
             TypeDesc ptr = {TYPE_PTR, 0};
@@ -110,61 +154,47 @@ TypeDesc typechecker_infer(TypeChecker *tc, Expr *e) {
         }
 
         case NODE_ARRAY_ACCESS: {
-            const TypeSymbol *sym = typechecker_lookup(tc, e->name);
+            const TypeSymbol *sym = typechecker_lookup_id(tc, NAME_ID(n));
             if (sym == NULL) {
-                tc_error(tc, e->type, "undeclared array '%s'", e->name);
+                tc_error(tc, KIND(n), "undeclared array '%s'", NAME(n));
                 return unknown;
             }
             if (sym->type.kind != TYPE_ARRAY) {
-                tc_error(tc, e->type, "'%s' is not an array", e->name);
+                tc_error(tc, KIND(n), "'%s' is not an array", NAME(n));
             }
             /* Check index type */
-            TypeDesc idx_type = typechecker_infer(tc, e->left);
+            TypeDesc idx_type = infer_node(tc, ca, KID(n, 0));
             if (idx_type.kind != TYPE_INT && idx_type.kind != TYPE_UNKNOWN) {
-                tc_error(tc, e->type, "array index is not an integer");
-            }
-            /* Static bounds check if index is constant */
-            if (e->left && e->left->type == NODE_CONST && sym->type.kind == TYPE_ARRAY) {
-                if (e->left->val < 0 || e->left->val >= sym->type.array_size) {
-                    tc_error(tc, e->type,
-                        "array index %d out of bounds for '%s' (size %d)",
-                        e->left->val, e->name, sym->type.array_size);
-                }
+                tc_error(tc, KIND(n), "array index is not an integer");
             }
+            check_const_index(tc, ca, n, sym);
             return int_type;
         }
 
         case NODE_ARRAY_ASSIGN: {
-            const TypeSymbol *sym = typechecker_lookup(tc, e->name);
+            const TypeSymbol *sym = typechecker_lookup_id(tc, NAME_ID(n));
             if (sym == NULL) {
-                tc_error(tc, e->type, "undeclared array '%s'", e->name);
+                tc_error(tc, KIND(n), "undeclared array '%s'", NAME(n));
                 return unknown;
             }
             if (sym->type.kind != TYPE_ARRAY) {
-                tc_error(tc, e->type, "'%s' is not an array", e->name);
+                tc_error(tc, KIND(n), "'%s' is not an array", NAME(n));
             }
             /* Check index */
-            TypeDesc idx_type = typechecker_infer(tc, e->left);
+            TypeDesc idx_type = infer_node(tc, ca, KID(n, 0));
             if (idx_type.kind != TYPE_INT && idx_type.kind != TYPE_UNKNOWN) {
-                tc_error(tc, e->type, "array index is not an integer");
-            }
-            /* Static bounds check */
-            if (e->left && e->left->type == NODE_CONST && sym->type.kind == TYPE_ARRAY) {
-                if (e->left->val < 0 || e->left->val >= sym->type.array_size) {
-                    tc_error(tc, e->type,
-                        "array index %d out of bounds for '%s' (size %d)",
-                        e->left->val, e->name, sym->type.array_size);
-                }
+                tc_error(tc, KIND(n), "array index is not an integer");
             }
+            check_const_index(tc, ca, n, sym);
             /* Check value type */
-            typechecker_infer(tc, e->right);
+            infer_node(tc, ca, KID(n, 1));
             return int_type;
         }
 
         case NODE_FUNC_CALL:
             /* Type check arguments */
-            for (int i = 0; i < e->param_count; i++) {
-                typechecker_infer(tc, e->params[i]);
+            for (int i = 0; i < ca->nkids[n]; i++) {
+                infer_node(tc, ca, KID(n, i));
             }
             return int_type; /* All functions return int in our subset */
 
@@ -173,142 +203,159 @@ TypeDesc typechecker_infer(TypeChecker *tc, Expr *e) {
     }
 }
 
+TypeDesc typechecker_infer(TypeChecker *tc, Expr *e) {
+    CompactAST ca;
+    cast_init(&ca);
+    NodeRef root = cast_from_expr(&ca, e);
+    TypeDesc t = infer_node(tc, &ca, root);
+    cast_free(&ca);
+    return t;
+}
+
 /* Recursively check an AST node */
-static void check_node(TypeChecker *tc, Expr *e) {
-    if (e == NULL) return;
+static void check_node(TypeChecker *tc, const CompactAST *ca, NodeRef n) {
+    if (n == CAST_NONE) return;
 
-    switch (e->type) {
+    switch (KIND(n)) {
         case NODE_PROGRAM:
-            for (int i = 0; i < e->param_count; i++) {
-                check_node(tc, e->params[i]);
+            for (int i = 0; i < ca->nkids[n]; i++) {
+                check_node(tc, ca, KID(n, i));
             }
             break;
 
         case NODE_FUNC_DEF: {
             /* Add function params to env */
             int saved_count = tc->env.count;
-            for (int i = 0; i < e->param_count; i++) {
-                if (e->params[i] && e->params[i]->type == NODE_VAR) {
-                    TypeDesc p = {TYPE_INT, 0};
-                    typechecker_add_symbol(tc, e->params[i]->name, p);
+            symhash_push_scope(&tc->env.index);
+            for (int i = 1; i < ca->nkids[n]; i++) {
+                NodeRef p = KID(n, i);
+                if (p != CAST_NONE && KIND(p) == NODE_VAR) {
+                    TypeDesc pt = {TYPE_INT, 0};
+                    add_symbol_id(tc, NAME_ID(p), pt);
                 }
                 /* Also process non-param statements (they come after params) */
-                check_node(tc, e->params[i]);
+                check_node(tc, ca, p);
             }
-            check_node(tc, e->body);
+            check_node(tc, ca, KID(n, 0));
             /* Restore scope */
+            symhash_pop_scope(&tc->env.index);
             tc->env.count = saved_count;
             break;
         }
 
         case NODE_VAR_DECL: {
             /* Check initial value type */
-            if (e->left) {
-                typechecker_infer(tc, e->left);
-            }
+            infer_node(tc, ca, KID(n, 0));
             /* Add to env */
             TypeDesc t = {TYPE_INT, 0};
-            typechecker_add_symbol(tc, e->name, t);
+            add_symbol_id(tc, NAME_ID(n), t);
             break;
         }
 
         case NODE_ARRAY_DECL: {
             /* Check initializer types */
-            for (int i = 0; i < e->param_count; i++) {
-                TypeDesc vt = typechecker_infer(tc, e->params[i]);
+            for (int i = 0; i < ca->nkids[n]; i++) {
+                TypeDesc vt = infer_node(tc, ca, KID(n, i));
                 if (vt.kind != TYPE_INT && vt.kind != TYPE_UNKNOWN) {
-                    tc_error(tc, e->type, "array initializer %d is not int", i);
+                    tc_error(tc, KIND(n), "array initializer %d is not int", i);
                 }
             }
             /* Check init count vs array size */
-            if (e->param_count > e->array_size) {
-                tc_error(tc, e->type,
+            if (ca->nkids[n] > ca->val[n]) {
+                tc_error(tc, KIND(n),
                     "too many initializers for array '%s' (size %d, got %d)",
-                    e->name, e->array_size, e->param_count);
+                    NAME(n), ca->val[n], ca->nkids[n]);
             }
             /* Add to env */
-            TypeDesc t = {TYPE_ARRAY, e->array_size};
-            typechecker_add_symbol(tc, e->name, t);
+            TypeDesc t = {TYPE_ARRAY, ca->val[n]};
+            add_symbol_id(tc, NAME_ID(n), t);
             break;
         }
 
         case NODE_TRIT_VAR_DECL: {
             /* Check initial value type */
-            if (e->left) {
-                typechecker_infer(tc, e->left);
-            }
+            infer_node(tc, ca, KID(n, 0));
             /* Add to env */
             TypeDesc t = {TYPE_TRIT, 0};
-            typechecker_add_symbol(tc, e->name, t);
+            add_symbol_id(tc, NAME_ID(n), t);
             break;
         }
 
         case NODE_TRIT_ARRAY_DECL: {
             /* Check initializer types */
-            for (int i = 0; i < e->param_count; i++) {
-                TypeDesc vt = typechecker_infer(tc, e->params[i]);
+            for (int i = 0; i < ca->nkids[n]; i++) {
+                TypeDesc vt = infer_node(tc, ca, KID(n, i));
                 if (vt.kind != TYPE_TRIT && vt.kind != TYPE_INT && vt.kind != TYPE_UNKNOWN) {
-                    tc_error(tc, e->type, "trit array initializer %d is not trit or int", i);
+                    tc_error(tc, KIND(n), "trit array initializer %d is not trit or int", i);
                 }
             }
             /* Check init count vs array size */
-            if (e->param_count > e->array_size) {
-                tc_error(tc, e->type,
+            if (ca->nkids[n] > ca->val[n]) {
+                tc_error(tc, KIND(n),
                     "too many initializers for trit array '%s' (size %d, got %d)",
-                    e->name, e->array_size, e->param_count);
+                    NAME(n), ca->val[n], ca->nkids[n]);
             }
             /* Add to env */
-            TypeDesc t = {TYPE_TRIT_ARRAY, e->array_size};
-            typechecker_add_symbol(tc, e->name, t);
+            TypeDesc t = {TYPE_TRIT_ARRAY, ca->val[n]};
+            add_symbol_id(tc, NAME_ID(n), t);
             break;
         }
 
         case NODE_ASSIGN:
-            typechecker_infer(tc, e->left);
-            typechecker_infer(tc, e->right);
+            infer_node(tc, ca, KID(n, 0));
+            infer_node(tc, ca, KID(n, 1));
             break;
 
         case NODE_ARRAY_ACCESS:
         case NODE_ARRAY_ASSIGN:
-            typechecker_infer(tc, e);
+            infer_node(tc, ca, n);
             break;
 
         case NODE_RETURN:
-            if (e->left) typechecker_infer(tc, e->left);
+            infer_node(tc, ca, KID(n, 0));
             break;
 
         case NODE_IF:
-            typechecker_infer(tc, e->condition);
-            check_node(tc, e->body);
-            if (e->else_body) check_node(tc, e->else_body);
+            infer_node(tc, ca, KID(n, 0));
+            check_node(tc, ca, KID(n, 1));
+            check_node(tc, ca, KID(n, 2));
             break;
 
         case NODE_WHILE:
-            typechecker_infer(tc, e->condition);
-            check_node(tc, e->body);
+            infer_node(tc, ca, KID(n, 0));
+            check_node(tc, ca, KID(n, 1));
             break;
 
         case NODE_FOR:
-            check_node(tc, e->left);     /* init */
-            typechecker_infer(tc, e->condition);
-            check_node(tc, e->increment);
-            check_node(tc, e->body);
+            check_node(tc, ca, KID(n, 0));     /* init */
+            infer_node(tc, ca, KID(n, 1));
+            check_node(tc, ca, KID(n, 2));
+            check_node(tc, ca, KID(n, 3));
             break;
 
         case NODE_BLOCK:
-            for (int i = 0; i < e->param_count; i++) {
-                check_node(tc, e->params[i]);
+            for (int i = 0; i < ca->nkids[n]; i++) {
+                check_node(tc, ca, KID(n, i));
             }
             break;
 
         default:
-            typechecker_infer(tc, e);
+            infer_node(tc, ca, n);
             break;
     }
 }
 
+int typechecker_check_compact(TypeChecker *tc, const CompactAST *ca, NodeRef root) {
+    check_node(tc, ca, root);
+    return tc->error_count;
+}
+
 int typechecker_check(TypeChecker *tc, Expr *ast) {
-    check_node(tc, ast);
+    CompactAST ca;
+    cast_init(&ca);
+    NodeRef root = cast_from_expr(&ca, ast);
+    check_node(tc, &ca, root);
+    cast_free(&ca);
     return tc->error_count;
 }
 
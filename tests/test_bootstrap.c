@@ -5,6 +5,8 @@
  * self-test (compile & run mini-program), variable support.
  */
 
+#include <string.h>
+#include <pthread.h>
 #include "../include/test_harness.h"
 #include "../include/bootstrap.h"
 #include "../include/vm.h"
@@ -38,6 +40,19 @@ TEST(test_symtab_lookup) {
     ASSERT_EQ(symtab_lookup(&tab, "alpha"), 0);
     ASSERT_EQ(symtab_lookup(&tab, "beta"), 1);
     ASSERT_EQ(symtab_lookup(&tab, "gamma"), -1);
+    symtab_free(&tab);
+}
+
+TEST(test_symtab_scope) {
+    BootstrapSymTab tab;
+    symtab_init(&tab);
+    symtab_add(&tab, "x", 0);
+    symhash_push_scope(&tab.index);
+    int inner = symtab_add(&tab, "x", 0);
+    ASSERT_EQ(symtab_lookup(&tab, "x"), inner);
+    symhash_pop_scope(&tab.index);
+    ASSERT_EQ(symtab_lookup(&tab, "x"), 0);
+    symtab_free(&tab);
 }
 
 TEST(test_symtab_full) {
@@ -205,6 +220,111 @@ TEST(test_bootstrap_nested_if) {
     ASSERT_TRUE(len > 0);
 }
 
+/* ---- Calls ---- */
+
+/* Compile and run source; its result, or -99 on a compile error */
+static int run_source(const char *source) {
+    unsigned char code[512];
+    int len = bootstrap_compile(source, code, 512);
+    if (len < 0) return -99;
+    vm_memory_reset();
+    vm_run(code, (size_t)len);
+    return vm_get_result();
+}
+
+TEST(test_bootstrap_call_args) {
+    /* Arguments bind left to right; the stub calls main wherever it is */
+    ASSERT_EQ(run_source("int main() { return sub(9, 4); } "
+                         "int sub(int a, int b) { return a - b; }"), 5);
+    /* Without main, the last function is the entry */
+    ASSERT_EQ(run_source("int two() { return 2; } int four() { return two() * 2; }"), 4);
+    /* A return leaves at once; falling off the end returns 0 */
+    ASSERT_EQ(run_source("int f(int x) { if (x > 3) { return 1; } return 2; } "
+                         "int g() { int y = 1; } int main() { return f(5) * 10 + f(1) + g(); }"), 12);
+    ASSERT_EQ(run_source("int main() { return nowhere(1); }"), -99);
+}
+
+TEST(test_bootstrap_recursion) {
+    /* Each activation gets its own n */
+    ASSERT_EQ(run_source("int fib(int n) { if (n < 2) { return n; } "
+                         "return fib(n - 1) + fib(n - 2); } "
+                         "int main() { return fib(10); }"), 55);
+    ASSERT_EQ(run_source("int fact(int n) { int r = 1; if (n > 1) { r = n * fact(n - 1); } return r; } "
+                         "int main() { return fact(5); }"), 120);
+    /* Mutual recursion */
+    ASSERT_EQ(run_source("int even(int n) { if (n == 0) { return 1; } return odd(n - 1); } "
+                         "int odd(int n) { if (n == 0) { return 0; } return even(n - 1); } "
+                         "int main() { return even(10) * 10 + odd(7); }"), 11);
+}
+
+TEST(test_bootstrap_tail_calls) {
+    /* 300 levels would need some 900 return-stack entries as calls */
+    ASSERT_EQ(run_source("int count(int n, int acc) { if (n == 0) { return acc; } "
+                         "return count(n - 1, acc + 2); } "
+                         "int main() { int n = 100; n = n * 3; return count(n, 0); }"), 600);
+    ASSERT_EQ(run_source("int even(int n) { if (n == 0) { return 1; } return odd(n - 1); } "
+                         "int odd(int n) { if (n == 0) { return 0; } return even(n - 1); } "
+                         "int main() { int n = 100; n = n * 3; return even(n) * 10 + odd(n + 1); }"), 11);
+    /* Loops inside a tail-recursive function leave nothing behind */
+    ASSERT_EQ(run_source("int f(int n, int acc) { int i = 0; while (i < 2) { i = i + 1; } "
+                         "if (n == 0) { return acc; } return f(n - 1, acc + i); } "
+                         "int main() { int n = 100; n = n * 2; return f(n, 0); }"), 400);
+    ASSERT_EQ(vm_rstack_depth(), 0);
+    /* Not a tail call: the caller still adds after the call returns */
+    ASSERT_EQ(run_source("int f(int n) { if (n == 0) { return 0; } return 1 + f(n - 1); } "
+                         "int main() { return f(20); }"), 20);
+}
+
+/* ---- Reentrancy ---- */
+
+static const char *mt_sources[] = {
+    "int main() { int a = 1 + 2; int b = a * 3; return b; }",
+    "int main() { int s = 0; for (int i = 0; i < 5; i++) { s = s + i; } return s; }",
+    "int main() { int arr[4] = {1, 2, 3, 4}; arr[2] = 9; return arr[2]; }",
+    "int f(int x) { int y = x; return y; } int main() { int y = 4; while (y > 1) { y = y - 1; } return y; }",
+};
+#define MT_SOURCES 4
+#define MT_ROUNDS  200
+
+typedef struct {
+    int src;
+    unsigned char expect[256];
+    int expect_len;
+    int mismatches;
+} CompileJob;
+
+static void *compile_worker(void *arg) {
+    CompileJob *job = (CompileJob *)arg;
+    BootstrapCtx bc;
+    bootstrap_ctx_init(&bc);
+    unsigned char code[256];
+    for (int r = 0; r < MT_ROUNDS; r++) {
+        int len = bootstrap_compile_ctx(&bc, mt_sources[job->src], code, 256);
+        if (len != job->expect_len || memcmp(code, job->expect, (size_t)len) != 0) {
+            job->mismatches++;
+        }
+    }
+    bootstrap_ctx_free(&bc);
+    return NULL;
+}
+
+TEST(test_bootstrap_parallel_compile) {
+    /* Concurrent compiles on separate contexts match serial output */
+    CompileJob jobs[MT_SOURCES];
+    pthread_t th[MT_SOURCES];
+    for (int i = 0; i < MT_SOURCES; i++) {
+        jobs[i].src = i;
+        jobs[i].mismatches = 0;
+        jobs[i].expect_len = bootstrap_compile(mt_sources[i], jobs[i].expect, 256);
+        ASSERT_TRUE(jobs[i].expect_len > 0);
+    }
+    for (int i = 0; i < MT_SOURCES; i++) {
+        pthread_create(&th[i], NULL, compile_worker, &jobs[i]);
+    }
+    for (int i = 0; i < MT_SOURCES; i++) pthread_join(th[i], NULL);
+    for (int i = 0; i < MT_SOURCES; i++) ASSERT_EQ(jobs[i].mismatches, 0);
+}
+
 int main(void) {
     TEST_SUITE_BEGIN("Bootstrap Self-Host (TASK-018)");
     /* Symbol table */
@@ -212,6 +332,7 @@ int main(void) {
     RUN_TEST(test_symtab_add);
     RUN_TEST(test_symtab_lookup);
     RUN_TEST(test_symtab_full);
+    RUN_TEST(test_symtab_scope);
     /* Compilation */
     RUN_TEST(test_bootstrap_simple_const);
     RUN_TEST(test_bootstrap_addition);
@@ -230,6 +351,10 @@ int main(void) {
     RUN_TEST(test_bootstrap_comparison_eq);
     RUN_TEST(test_bootstrap_comparison_ops);
     RUN_TEST(test_bootstrap_nested_if);
+    RUN_TEST(test_bootstrap_call_args);
+    RUN_TEST(test_bootstrap_recursion);
+    RUN_TEST(test_bootstrap_tail_calls);
+    RUN_TEST(test_bootstrap_parallel_compile);
     /* Self-test */
     RUN_TEST(test_bootstrap_self_test);
     TEST_SUITE_END();
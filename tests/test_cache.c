@@ -0,0 +1,346 @@
+/*
+ * test_cache.c - Content-addressed compile cache tests
+ *
+ * Tests: keys, entry round trip, bootstrap hits, corrupt entries and fields,
+ *        LRU eviction, concurrent writer processes
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "../include/test_harness.h"
+#include "../include/cache.h"
+#include "../include/bootstrap.h"
+#include "../include/linker.h"
+
+static char cache_dir[64];
+
+static void fresh_dir(void) {
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", cache_dir);
+    if (system(cmd) != 0) printf("cannot clear %s\n", cache_dir);
+}
+
+static void entry_file(CacheKey key, char *buf, size_t size) {
+    snprintf(buf, size, "%s/%02x/%016llx%016llx", cache_dir, (unsigned)(key.hi >> 56),
+             (unsigned long long)key.hi, (unsigned long long)key.lo);
+}
+
+/* ---- Keys ---- */
+
+TEST(test_cache_keys) {
+    CacheKey a = cache_key("int main() { return 1; }", CACHE_KIND_BUFFER);
+    CacheKey b = cache_key("int main() { return 1; }", CACHE_KIND_BUFFER);
+    CacheKey c = cache_key("int main() { return 2; }", CACHE_KIND_BUFFER);
+    CacheKey d = cache_key("int main() { return 1; }", CACHE_KIND_OBJECT);
+    CacheKey e = cache_key("ab", CACHE_KIND_BUFFER);
+    CacheKey f = cache_key("ba", CACHE_KIND_BUFFER);
+    ASSERT_TRUE(a.hi == b.hi && a.lo == b.lo);
+    ASSERT_TRUE(a.hi != c.hi && a.lo != c.lo);
+    ASSERT_TRUE(a.hi != d.hi && a.lo != d.lo);
+    ASSERT_TRUE(e.hi != f.hi && e.lo != f.lo);
+}
+
+/* ---- Entries ---- */
+
+TEST(test_cache_round_trip) {
+    fresh_dir();
+    CompileCache cache;
+    ASSERT_EQ(cache_open(&cache, cache_dir, 0), 0);
+
+    ObjectModule obj;
+    object_init(&obj);
+    for (int i = 0; i < 10; i++) object_emit(&obj, (unsigned char)(i * 7));
+    object_add_symbol_id(&obj, intern("cached_fn"), 2, SYM_EXPORT);
+    object_add_symbol_id(&obj, intern("cached_import"), 0, SYM_IMPORT);
+    object_add_reloc_id(&obj, 5, INTERN_NONE);
+    object_add_reloc_id(&obj, 8, intern("cached_import"));
+
+    CacheKey key = cache_key("round trip", CACHE_KIND_OBJECT);
+    ObjectModule got;
+    ASSERT_EQ(cache_get(&cache, key, &got), -1);
+    ASSERT_EQ(cache_put(&cache, key, &obj), 0);
+    ASSERT_EQ(cache_get(&cache, key, &got), 10);
+
+    ASSERT_TRUE(memcmp(got.code, obj.code, 10) == 0);
+    ASSERT_EQ(got.sym_count, 2);
+    ASSERT_STR_EQ(intern_str(got.symbols[0].name_id), "cached_fn");
+    ASSERT_EQ(got.symbols[0].address, 2);
+    ASSERT_EQ(got.symbols[1].vis, SYM_IMPORT);
+    ASSERT_EQ(got.reloc_count, 2);
+    ASSERT_EQ(got.relocs[0].target_id, INTERN_NONE);
+    ASSERT_EQ(got.relocs[1].offset, 8);
+    ASSERT_STR_EQ(intern_str(got.relocs[1].target_id), "cached_import");
+    ASSERT_EQ(atomic_load(&cache.hits), 1);
+    ASSERT_EQ(atomic_load(&cache.misses), 1);
+
+    object_free(&got);
+    object_free(&obj);
+    cache_close(&cache);
+}
+
+TEST(test_cache_bootstrap_hits) {
+    fresh_dir();
+    CompileCache cache;
+    ASSERT_EQ(cache_open(&cache, cache_dir, 0), 0);
+    bootstrap_set_cache(&cache);
+
+    const char *src = "int main() { int x = 0; while (x < 5) { x = x + 1; } return x; }";
+    unsigned char first[256], second[256];
+    int len1 = bootstrap_compile(src, first, 256);
+    int len2 = bootstrap_compile(src, second, 256);
+    ASSERT_GT(len1, 0);
+    ASSERT_EQ(len2, len1);
+    ASSERT_TRUE(memcmp(first, second, (size_t)len1) == 0);
+    ASSERT_EQ(atomic_load(&cache.hits), 1);
+    ASSERT_EQ(atomic_load(&cache.stores), 1);
+
+    /* Object mode is cached separately and keeps its metadata */
+    const char *mod = "int f(int x) { return g(x); }";
+    BootstrapCtx bc;
+    bootstrap_ctx_init(&bc);
+    ObjectModule a, b;
+    ASSERT_GT(bootstrap_compile_object(&bc, mod, &a), 0);
+    ASSERT_EQ(bootstrap_compile_object(&bc, mod, &b), a.code_len);
+    ASSERT_EQ(atomic_load(&cache.hits), 2);
+    ASSERT_EQ(b.sym_count, a.sym_count);
+    for (int i = 0; i < a.sym_count; i++) {
+        ASSERT_EQ(b.symbols[i].name_id, a.symbols[i].name_id);
+        ASSERT_EQ(b.symbols[i].vis, a.symbols[i].vis);
+    }
+
+    /* Parse failures are not cached */
+    ASSERT_EQ(bootstrap_compile_object(&bc, "int f( {", &b), -1);
+    ASSERT_EQ(atomic_load(&cache.stores), 2);
+
+    object_free(&a);
+    object_free(&b);
+    bootstrap_ctx_free(&bc);
+    bootstrap_set_cache(NULL);
+    cache_close(&cache);
+}
+
+TEST(test_cache_corrupt_entry) {
+    fresh_dir();
+    CompileCache cache;
+    ASSERT_EQ(cache_open(&cache, cache_dir, 0), 0);
+    bootstrap_set_cache(&cache);
+
+    const char *src = "int main() { return 4 * 4; }";
+    unsigned char code[256];
+    int len = bootstrap_compile(src, code, 256);
+
+    char path[256];
+    entry_file(cache_key(src, CACHE_KIND_BUFFER), path, sizeof(path));
+    ASSERT_EQ(truncate(path, 20), 0);
+
+    unsigned char again[256];
+    ASSERT_EQ(bootstrap_compile(src, again, 256), len);
+    ASSERT_TRUE(memcmp(code, again, (size_t)len) == 0);
+    ASSERT_EQ(atomic_load(&cache.hits), 0);
+    ASSERT_EQ(atomic_load(&cache.stores), 2);   /* Rewritten */
+
+    bootstrap_set_cache(NULL);
+    cache_close(&cache);
+}
+
+/* Overwrite the int32 at off in the entry file */
+static void poke_entry(const char *path, long off, int32_t value) {
+    int fd = open(path, O_WRONLY);
+    if (fd < 0 || pwrite(fd, &value, sizeof(value), off) != (ssize_t)sizeof(value))
+        printf("cannot patch %s\n", path);
+    if (fd >= 0) close(fd);
+}
+
+TEST(test_cache_corrupt_fields) {
+    /* Well-sized entries whose offsets point outside the code or names
+     * blob are misses, not out-of-bounds reads in the linker */
+    fresh_dir();
+    CompileCache cache;
+    ASSERT_EQ(cache_open(&cache, cache_dir, 0), 0);
+
+    ObjectModule obj;
+    object_init(&obj);
+    for (int i = 0; i < 10; i++) object_emit(&obj, (unsigned char)i);
+    object_add_symbol_id(&obj, intern("bounded_fn"), 2, SYM_EXPORT);
+    object_add_symbol_id(&obj, intern("bounded_import"), 0, SYM_IMPORT);
+    object_add_reloc_id(&obj, 5, INTERN_NONE);
+    object_add_reloc_id(&obj, 8, intern("bounded_import"));
+
+    /* Field (int32 index into a CacheSym {name_off, address, vis} or a
+     * CacheReloc {offset, target_off}) and the bad value written there */
+    static const struct { int reloc; int index; int field; int32_t value; } cases[] = {
+        { 0, 0, 1, 10 },    /* Symbol address past the code */
+        { 0, 0, 1, -1 },
+        { 0, 0, 2, 7 },     /* Unknown visibility */
+        { 0, 1, 1, 3 },     /* Import with an address */
+        { 1, 0, 0, 10 },    /* Patch offset past the code */
+        { 1, 1, 0, -4 },
+        { 1, 0, 1, -2 },    /* Neither -1 nor a name */
+        { 1, 1, 1, 1000 },
+    };
+    char path[256];
+    for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+        char src[32];
+        snprintf(src, sizeof(src), "fields %d", i);
+        CacheKey key = cache_key(src, CACHE_KIND_OBJECT);
+        ASSERT_EQ(cache_put(&cache, key, &obj), 0);
+        entry_file(key, path, sizeof(path));
+
+        /* The names blob starts with the first symbol's name and ends the
+         * file; relocations and symbols sit right before it */
+        struct stat st;
+        ASSERT_EQ(stat(path, &st), 0);
+        char buf[512];
+        FILE *f = fopen(path, "rb");
+        ASSERT_NOT_NULL(f);
+        size_t n = fread(buf, 1, sizeof(buf), f);
+        fclose(f);
+        ASSERT_EQ((long)n, (long)st.st_size);
+        long names = -1;
+        for (long at = 0; at + 10 <= (long)n && names < 0; at++)
+            if (memcmp(buf + at, "bounded_fn", 10) == 0) names = at;
+        ASSERT_GT((int)names, 0);
+        long relocs = names - 2 * 2 * (long)sizeof(int32_t);
+        long syms = relocs - 2 * 3 * (long)sizeof(int32_t);
+        long off = cases[i].reloc ? relocs + (cases[i].index * 2 + cases[i].field) * (long)sizeof(int32_t)
+                                  : syms + (cases[i].index * 3 + cases[i].field) * (long)sizeof(int32_t);
+
+        ObjectModule got;
+        ASSERT_EQ(cache_get(&cache, key, &got), 10);
+        object_free(&got);
+        poke_entry(path, off, cases[i].value);
+        ASSERT_EQ(cache_get(&cache, key, &got), -1);
+        object_free(&got);
+    }
+
+    object_free(&obj);
+    cache_close(&cache);
+}
+
+/* ---- Eviction ---- */
+
+static void set_age(CacheKey key, int seconds_ago) {
+    char path[256];
+    entry_file(key, path, sizeof(path));
+    struct timespec ts[2];
+    clock_gettime(CLOCK_REALTIME, &ts[0]);
+    ts[0].tv_sec -= seconds_ago;
+    ts[1] = ts[0];
+    utimensat(AT_FDCWD, path, ts, 0);
+}
+
+TEST(test_cache_lru_eviction) {
+    fresh_dir();
+    CompileCache cache;
+    ASSERT_EQ(cache_open(&cache, cache_dir, 1L << 20), 0);
+
+    ObjectModule obj;
+    object_init(&obj);
+    for (int i = 0; i < 100; i++) object_emit(&obj, (unsigned char)i);
+    CacheKey k[3];
+    k[0] = cache_key("a", CACHE_KIND_BUFFER);
+    k[1] = cache_key("b", CACHE_KIND_BUFFER);
+    k[2] = cache_key("c", CACHE_KIND_BUFFER);
+    for (int i = 0; i < 3; i++) ASSERT_EQ(cache_put(&cache, k[i], &obj), 0);
+    set_age(k[0], 300);
+    set_age(k[1], 200);
+    set_age(k[2], 100);
+
+    /* A hit makes "a" the most recently used, so "b" goes first */
+    ObjectModule got;
+    ASSERT_EQ(cache_get(&cache, k[0], &got), 100);
+    object_free(&got);
+    long entry = atomic_load(&cache.bytes) / 3;
+    ASSERT_EQ(cache_evict(&cache, entry * 2), 1);
+    ASSERT_EQ(cache_get(&cache, k[1], &got), -1);
+    ASSERT_EQ(cache_get(&cache, k[0], &got), 100);
+    object_free(&got);
+    ASSERT_EQ(cache_get(&cache, k[2], &got), 100);
+    object_free(&got);
+    cache_close(&cache);
+
+    /* Stores past the cap trim the directory automatically */
+    fresh_dir();
+    ASSERT_EQ(cache_open(&cache, cache_dir, entry * 10), 0);
+    for (int i = 0; i < 50; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "entry%d", i);
+        ASSERT_EQ(cache_put(&cache, cache_key(name, CACHE_KIND_BUFFER), &obj), 0);
+    }
+    ASSERT_TRUE(atomic_load(&cache.bytes) <= entry * 10);
+    ASSERT_GT((int)atomic_load(&cache.evictions), 0);
+    cache_close(&cache);
+    object_free(&obj);
+}
+
+/* ---- Concurrent processes ---- */
+
+#define WRITERS 4
+#define WRITER_SOURCES 40
+
+static void writer_source(int i, char *buf, size_t size) {
+    snprintf(buf, size, "int main() { int a = %d; return a * 2 + %d; }", i, i % 7);
+}
+
+TEST(test_cache_concurrent_processes) {
+    fresh_dir();
+    pid_t pids[WRITERS];
+    for (int w = 0; w < WRITERS; w++) {
+        pids[w] = fork();
+        if (pids[w] == 0) {
+            /* Every writer compiles the same sources, racing on each entry */
+            CompileCache cache;
+            if (cache_open(&cache, cache_dir, 0) != 0) _exit(1);
+            bootstrap_set_cache(&cache);
+            for (int i = 0; i < WRITER_SOURCES; i++) {
+                char src[128];
+                unsigned char code[256];
+                writer_source((i + w * 11) % WRITER_SOURCES, src, sizeof(src));
+                if (bootstrap_compile(src, code, 256) <= 0) _exit(1);
+            }
+            _exit(0);
+        }
+    }
+    for (int w = 0; w < WRITERS; w++) {
+        int status;
+        waitpid(pids[w], &status, 0);
+        ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+
+    /* Every entry is complete and matches a fresh compile */
+    CompileCache cache;
+    ASSERT_EQ(cache_open(&cache, cache_dir, 0), 0);
+    for (int i = 0; i < WRITER_SOURCES; i++) {
+        char src[128];
+        unsigned char code[256];
+        writer_source(i, src, sizeof(src));
+        int len = bootstrap_compile(src, code, 256);
+        ObjectModule got;
+        ASSERT_EQ(cache_get(&cache, cache_key(src, CACHE_KIND_BUFFER), &got), len);
+        ASSERT_TRUE(memcmp(got.code, code, (size_t)len) == 0);
+        object_free(&got);
+    }
+    cache_close(&cache);
+}
+
+int main(void) {
+    TEST_SUITE_BEGIN("Compile Cache");
+
+    snprintf(cache_dir, sizeof(cache_dir), "/tmp/test_cache_%d", (int)getpid());
+
+    RUN_TEST(test_cache_keys);
+    RUN_TEST(test_cache_round_trip);
+    RUN_TEST(test_cache_bootstrap_hits);
+    RUN_TEST(test_cache_corrupt_entry);
+    RUN_TEST(test_cache_corrupt_fields);
+    RUN_TEST(test_cache_lru_eviction);
+    RUN_TEST(test_cache_concurrent_processes);
+
+    fresh_dir();
+    TEST_SUITE_END();
+}
@@ -0,0 +1,244 @@
+/*
+ * test_driver.c - Parallel multi-file driver tests
+ *
+ * Tests: object module emission, parallel compile + link determinism,
+ *        cross-module imports, entry stub, manifests, driver_main
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/test_harness.h"
+#include "../include/driver.h"
+#include "../include/bootstrap.h"
+#include "../include/linker.h"
+#include "../include/vm.h"
+
+/* ---- Object modules ---- */
+
+TEST(test_object_exports_imports) {
+    BootstrapCtx bc;
+    bootstrap_ctx_init(&bc);
+    ObjectModule obj;
+    int len = bootstrap_compile_object(&bc,
+        "int f(int x) { return helper(x); } int g() { return f(1); }", &obj);
+    ASSERT_GT(len, 0);
+    ASSERT_EQ(obj.code_len, len);
+
+    int exports = 0, imports = 0, helper_imported = 0;
+    for (int i = 0; i < obj.sym_count; i++) {
+        if (obj.symbols[i].vis == SYM_EXPORT) exports++;
+        if (obj.symbols[i].vis == SYM_IMPORT) {
+            imports++;
+            if (strcmp(intern_str(obj.symbols[i].name_id), "helper") == 0) helper_imported = 1;
+        }
+    }
+    ASSERT_EQ(exports, 2);
+    ASSERT_EQ(imports, 1);     /* f is called but defined locally */
+    ASSERT_TRUE(helper_imported);
+    object_free(&obj);
+    bootstrap_ctx_free(&bc);
+}
+
+TEST(test_object_matches_buffer_compile) {
+    /* Same bytes as bootstrap_compile; branch targets become relocs */
+    const char *src = "int main() { int x = 0; while (x < 3) { x = x + 1; } return x; }";
+    unsigned char code[256];
+    int len = bootstrap_compile(src, code, 256);
+
+    BootstrapCtx bc;
+    bootstrap_ctx_init(&bc);
+    ObjectModule obj;
+    ASSERT_EQ(bootstrap_compile_object(&bc, src, &obj), len);
+    ASSERT_TRUE(memcmp(obj.code, code, (size_t)len) == 0);
+    ASSERT_EQ(obj.reloc_count, 2);    /* entry stub, loop exit */
+    ASSERT_EQ(obj.relocs[0].target_id, INTERN_NONE);
+    ASSERT_EQ(obj.relocs[1].target_id, INTERN_NONE);
+    object_free(&obj);
+    bootstrap_ctx_free(&bc);
+}
+
+/* ---- Parallel compile + link ---- */
+
+/* As many as fit the 1-byte call targets of a linked image */
+#define N_MODULES 8
+
+static char *module_src[N_MODULES];
+
+static void make_sources(void) {
+    for (int i = 0; i < N_MODULES; i++) {
+        char buf[256];
+        if (i == N_MODULES - 1) {
+            snprintf(buf, sizeof(buf),
+                     "int main() { int s = 0; for (int i = 0; i < 4; i++) { s = s + i; } "
+                     "return s + f%d(1); }", i - 1);
+        } else if (i > 0) {
+            snprintf(buf, sizeof(buf), "int f%d(int x) { return f%d(x) + %d; }", i, i - 1, i);
+        } else {
+            snprintf(buf, sizeof(buf), "int f0(int x) { return x; }");
+        }
+        module_src[i] = strdup(buf);
+    }
+}
+
+TEST(test_driver_deterministic_across_jobs) {
+    Linker serial, parallel;
+    linker_init(&serial);
+    linker_init(&parallel);
+    DriverTimes t;
+
+    ASSERT_EQ(driver_compile((const char *const *)module_src, NULL, N_MODULES, 1, &serial, &t), 0);
+    ASSERT_EQ(t.jobs, 1);
+    ASSERT_EQ(driver_compile((const char *const *)module_src, NULL, N_MODULES, 4, &parallel, &t), 0);
+    ASSERT_EQ(t.jobs, 4);
+
+    ASSERT_EQ(serial.module_count, N_MODULES + 1);   /* + entry stub */
+    ASSERT_EQ(parallel.output_len, serial.output_len);
+    ASSERT_TRUE(memcmp(parallel.output, serial.output, (size_t)serial.output_len) == 0);
+    /* Each module starts with its own entry stub, CALL; HALT */
+    ASSERT_EQ(linker_resolve(&serial, "f5"), serial.modules[6].base_addr + 3);
+    ASSERT_TRUE(serial.output_len <= 256);
+    vm_memory_reset();
+    vm_run(serial.output, (size_t)serial.output_len);
+    ASSERT_EQ(vm_get_result(), 28);     /* 6 + f6(1) */
+    linker_free(&serial);
+    linker_free(&parallel);
+}
+
+TEST(test_driver_entry_runs_main) {
+    /* Entry stub jumps into main in a later module; its loop branches
+     * are relocated by the module base */
+    const char *srcs[] = {
+        "int f(int x) { return x; }",
+        "int main() { int x = 0; while (x < 3) { x = x + 1; } return x; }",
+    };
+    Linker lnk;
+    linker_init(&lnk);
+    ASSERT_EQ(driver_compile(srcs, NULL, 2, 2, &lnk, NULL), 0);
+    ASSERT_EQ(lnk.output[1], (unsigned char)linker_resolve(&lnk, "main"));
+
+    vm_memory_reset();
+    vm_run(lnk.output, (size_t)lnk.output_len);
+    ASSERT_EQ(vm_get_result(), 3);
+    linker_free(&lnk);
+}
+
+TEST(test_driver_errors) {
+    const char *missing[] = {"int main() { return nothere(1); }"};
+    Linker lnk;
+    linker_init(&lnk);
+    ASSERT_GT(driver_compile(missing, NULL, 1, 1, &lnk, NULL), 0);
+    linker_free(&lnk);
+
+    const char *bad[] = {"int main() { return 1; }", "int f( {"};
+    const char *names[] = {"ok.c", "bad.c"};
+    linker_init(&lnk);
+    ASSERT_EQ(driver_compile(bad, names, 2, 2, &lnk, NULL), 1);
+    linker_free(&lnk);
+
+    /* An image past the 1-byte call and jump targets fails to link */
+    char *big[14];
+    for (int i = 0; i < 13; i++) {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "int g%d(int x) { while (x < %d) { x = x + 1; } return x; }", i, i);
+        big[i] = strdup(buf);
+    }
+    big[13] = strdup("int main() { return g12(1); }");
+    linker_init(&lnk);
+    ASSERT_GT(driver_compile((const char *const *)big, NULL, 14, 2, &lnk, NULL), 0);
+    ASSERT_GT(lnk.output_len, 255);
+    ASSERT_GT(lnk.error_count, 0);
+    linker_free(&lnk);
+    for (int i = 0; i < 14; i++) free(big[i]);
+}
+
+/* ---- Files and manifests ---- */
+
+static void write_text(const char *path, const char *text) {
+    FILE *f = fopen(path, "w");
+    fputs(text, f);
+    fclose(f);
+}
+
+TEST(test_driver_manifest_and_main) {
+    char dir[] = "/tmp/test_driver_XXXXXX";
+    ASSERT_NOT_NULL(mkdtemp(dir));
+    char a[128], b[128], man[128], out[128];
+    snprintf(a, sizeof(a), "%s/a.c", dir);
+    snprintf(b, sizeof(b), "%s/b.c", dir);
+    snprintf(man, sizeof(man), "%s/build.list", dir);
+    snprintf(out, sizeof(out), "%s/out.tbc", dir);
+    write_text(a, "int f(int x) { return x; }\n");
+    write_text(b, "int main() { return 2 * 3; }\n");
+    char list[300];
+    snprintf(list, sizeof(list), "# modules\n%s\n\n  %s  \n", a, b);
+    write_text(man, list);
+
+    char **paths;
+    ASSERT_EQ(driver_read_manifest(man, &paths), 2);
+    ASSERT_STR_EQ(paths[0], a);
+    ASSERT_STR_EQ(paths[1], b);
+    for (int i = 0; i < 2; i++) free(paths[i]);
+    free(paths);
+
+    char at[136];
+    snprintf(at, sizeof(at), "@%s", man);
+    char *argv[] = {"-j", "2", "-o", out, at};
+    ASSERT_EQ(driver_main(5, argv), 0);
+
+    FILE *f = fopen(out, "rb");
+    ASSERT_NOT_NULL(f);
+    unsigned char code[256];
+    size_t n = fread(code, 1, sizeof(code), f);
+    fclose(f);
+    ASSERT_GT((int)n, 2);
+    vm_memory_reset();
+    vm_run(code, n);
+    ASSERT_EQ(vm_get_result(), 6);
+
+    char *bad_argv[] = {"--manifest", "/nonexistent/list"};
+    ASSERT_EQ(driver_main(2, bad_argv), 1);
+
+    /* --link exits non-zero when the image outgrows 1-byte targets */
+    FILE *mf = fopen(man, "w");
+    for (int i = 0; i < 13; i++) {
+        char path[160], text[128];
+        snprintf(path, sizeof(path), "%s/g%d.c", dir, i);
+        snprintf(text, sizeof(text), "int g%d(int x) { while (x < %d) { x = x + 1; } return x; }\n", i, i);
+        write_text(path, text);
+        fprintf(mf, "%s\n", path);
+    }
+    fprintf(mf, "%s\n", b);
+    fclose(mf);
+    char *big_argv[] = {at};
+    ASSERT_EQ(driver_main(1, big_argv), 1);
+    for (int i = 0; i < 13; i++) {
+        char path[160];
+        snprintf(path, sizeof(path), "%s/g%d.c", dir, i);
+        unlink(path);
+    }
+
+    unlink(a);
+    unlink(b);
+    unlink(man);
+    unlink(out);
+    rmdir(dir);
+}
+
+int main(void) {
+    TEST_SUITE_BEGIN("Parallel Driver");
+
+    make_sources();
+
+    RUN_TEST(test_object_exports_imports);
+    RUN_TEST(test_object_matches_buffer_compile);
+    RUN_TEST(test_driver_deterministic_across_jobs);
+    RUN_TEST(test_driver_entry_runs_main);
+    RUN_TEST(test_driver_errors);
+    RUN_TEST(test_driver_manifest_and_main);
+
+    for (int i = 0; i < N_MODULES; i++) free(module_src[i]);
+
+    TEST_SUITE_END();
+}
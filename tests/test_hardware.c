@@ -158,6 +158,34 @@ TEST(test_trit_word_sub_via_negate) {
     ASSERT_EQ(trit_word_to_int(res), 7);
 }
 
+TEST(test_trit_word_shifts) {
+    /* Every 9-trit value: shifts agree with * 3^k and C's truncating / */
+    trit_word a, res;
+    for (int v = -9841; v <= 9841; v++) {
+        int_to_trit_word(v, a);
+        for (int k = 0, p = 1; k <= 4; k++, p *= 3) {
+            trit_word_shr(a, k, res);
+            ASSERT_EQ(trit_word_to_int(res), v / p);
+            if (v * p >= -9841 && v * p <= 9841) {
+                trit_word_shl(a, k, res);
+                ASSERT_EQ(trit_word_to_int(res), v * p);
+            }
+        }
+    }
+    int_to_trit_word(-9841, a);
+    trit_word_shr(a, WORD_SIZE, res);
+    ASSERT_EQ(trit_word_to_int(res), 0);
+
+    ASSERT_EQ(trit_pow3_log(3), 1);
+    ASSERT_EQ(trit_pow3_log(-27), 3);
+    ASSERT_EQ(trit_pow3_log(1162261467), 19);
+    ASSERT_EQ(trit_pow3_log(1), 0);
+    ASSERT_EQ(trit_pow3_log(-1), 0);
+    ASSERT_EQ(trit_pow3_log(0), 0);
+    ASSERT_EQ(trit_pow3_log(6), 0);
+    ASSERT_EQ(trit_pow3_log(-2147483647 - 1), 0);
+}
+
 /* ---- ALU simulation tests (C equivalent of Verilog ALU) ---- */
 
 /* C simulation of ALU operations matching hw/ternary_alu.v */
@@ -488,6 +516,7 @@ int main(void) {
     RUN_TEST(test_trit_word_mul);
     RUN_TEST(test_trit_word_conversion_roundtrip);
     RUN_TEST(test_trit_word_sub_via_negate);
+    RUN_TEST(test_trit_word_shifts);
     /* ALU simulation */
     RUN_TEST(test_alu_sim_add);
     RUN_TEST(test_alu_sim_sub);
@@ -0,0 +1,254 @@
+/*
+ * test_incremental.c - Function-granularity incremental rebuild tests
+ *
+ * Every build is checked byte-for-byte against a whole-program
+ * bootstrap_compile() of the same source, at the default -O0.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/test_harness.h"
+#include "../include/incremental.h"
+#include "../include/bootstrap.h"
+
+/* Small enough that the image fits 1-byte jump and call targets */
+#define N_FUNCS 5
+
+static char src[8192];
+
+/* Program text with function k's constant set to values[k]; function
+ * grow (if >= 0) gets one extra statement */
+static void make_program(const int *values, int n, int grow) {
+    size_t len = 0;
+    for (int k = 0; k < n; k++) {
+        char extra[48] = "";
+        if (k == grow) snprintf(extra, sizeof(extra), "    x = x - 1;\n");
+        len += (size_t)snprintf(src + len, sizeof(src) - len,
+            "int f%d(int x) {\n    while (x < %d) { x = x + 1; }\n%s    return x * 2;\n}\n\n",
+            k, values[k], extra);
+    }
+}
+
+static int matches_full(const IncrBuild *ib, const char *source) {
+    static unsigned char full[8192];
+    int len = bootstrap_compile(source, full, sizeof(full));
+    return len == ib->lnk.output_len && memcmp(full, ib->lnk.output, (size_t)len) == 0;
+}
+
+static void default_values(int *values) {
+    for (int k = 0; k < N_FUNCS; k++) values[k] = k;
+}
+
+TEST(test_incr_first_build) {
+    int v[N_FUNCS];
+    default_values(v);
+    make_program(v, N_FUNCS, -1);
+    IncrBuild ib;
+    incr_init(&ib);
+    ASSERT_GT(incr_build(&ib, src), 0);
+    ASSERT_EQ(ib.compiled, N_FUNCS);
+    ASSERT_EQ(ib.reused, 0);
+    ASSERT_TRUE(matches_full(&ib, src));
+
+    /* Unchanged rebuild compiles nothing */
+    ASSERT_GT(incr_build(&ib, src), 0);
+    ASSERT_EQ(ib.compiled, 0);
+    ASSERT_EQ(ib.reused, N_FUNCS);
+    incr_free(&ib);
+}
+
+TEST(test_incr_edit_one_function) {
+    int v[N_FUNCS];
+    default_values(v);
+    make_program(v, N_FUNCS, -1);
+    IncrBuild ib;
+    incr_init(&ib);
+    ASSERT_GT(incr_build(&ib, src), 0);
+
+    /* Same size: only that module is patched into the image */
+    v[3] = 7;
+    make_program(v, N_FUNCS, -1);
+    ASSERT_GT(incr_build(&ib, src), 0);
+    ASSERT_EQ(ib.compiled, 1);
+    ASSERT_EQ(ib.reused, N_FUNCS - 1);
+    ASSERT_EQ(ib.partial_link, 1);
+    ASSERT_TRUE(matches_full(&ib, src));
+
+    /* Different size: full relink, still one compile */
+    make_program(v, N_FUNCS, 3);
+    ASSERT_GT(incr_build(&ib, src), 0);
+    ASSERT_EQ(ib.compiled, 1);
+    ASSERT_EQ(ib.partial_link, 0);
+    ASSERT_TRUE(matches_full(&ib, src));
+    incr_free(&ib);
+}
+
+TEST(test_incr_whitespace_only) {
+    IncrBuild ib;
+    incr_init(&ib);
+    ASSERT_GT(incr_build(&ib, "int f() { int a = 1; return a; } int g() { return 2; }"), 0);
+    ASSERT_GT(incr_build(&ib, "int f() {\n\tint a = 1;\n\treturn a;\n}\n\nint g() {  return 2;  }\n"), 0);
+    ASSERT_EQ(ib.compiled, 0);
+    ASSERT_GT(incr_build(&ib, "int f() { int a = 1; return a; } int g() { return 3; }"), 0);
+    ASSERT_EQ(ib.compiled, 1);
+    incr_free(&ib);
+}
+
+TEST(test_incr_slot_dependency) {
+    /* A new local in f shifts g's slots, so g recompiles; h has no locals
+     * but also starts one slot later */
+    IncrBuild ib;
+    incr_init(&ib);
+    const char *before = "int f() { int a = 1; return a; } int g() { int b = 2; return b; } "
+                         "int h() { return 3; }";
+    const char *after = "int f() { int a = 1; int c = 4; return a + c; } "
+                        "int g() { int b = 2; return b; } int h() { return 3; }";
+    ASSERT_GT(incr_build(&ib, before), 0);
+    ASSERT_GT(incr_build(&ib, after), 0);
+    ASSERT_EQ(ib.compiled, 3);
+    ASSERT_TRUE(matches_full(&ib, after));
+    ASSERT_EQ(ib.units[1].slot_base, 2);
+    incr_free(&ib);
+}
+
+TEST(test_incr_add_remove_reorder) {
+    int v[N_FUNCS];
+    default_values(v);
+    make_program(v, N_FUNCS, -1);
+    IncrBuild ib;
+    incr_init(&ib);
+    ASSERT_GT(incr_build(&ib, src), 0);
+
+    /* Drop the last function: everything else is reused */
+    make_program(v, N_FUNCS - 1, -1);
+    ASSERT_GT(incr_build(&ib, src), 0);
+    ASSERT_EQ(ib.compiled, 0);
+    ASSERT_EQ(ib.reused, N_FUNCS - 1);
+    ASSERT_TRUE(matches_full(&ib, src));
+
+    /* Append a function with no locals: only it is compiled */
+    static char grown[sizeof(src) + 64];
+    snprintf(grown, sizeof(grown), "%sint extra() { return 42; }\n", src);
+    ASSERT_GT(incr_build(&ib, grown), 0);
+    ASSERT_EQ(ib.compiled, 1);
+    ASSERT_TRUE(matches_full(&ib, grown));
+
+    /* Swap two functions that use no locals: both reused at new offsets */
+    const char *ab = "int a() { return 1; } int b() { while (1 < 0) { } return 2; }";
+    const char *ba = "int b() { while (1 < 0) { } return 2; } int a() { return 1; }";
+    ASSERT_GT(incr_build(&ib, ab), 0);
+    ASSERT_GT(incr_build(&ib, ba), 0);
+    ASSERT_EQ(ib.compiled, 0);
+    ASSERT_EQ(ib.reused, 2);
+    ASSERT_TRUE(matches_full(&ib, ba));
+    incr_free(&ib);
+}
+
+TEST(test_incr_errors_recover) {
+    IncrBuild ib;
+    incr_init(&ib);
+    const char *good = "int f() { return 1; } int g() { return f(); }";
+    ASSERT_GT(incr_build(&ib, good), 0);
+
+    /* Parse error in one function leaves the previous build untouched */
+    ASSERT_EQ(incr_build(&ib, "int f() { return 1; } int g() { return ; }"), -1);
+    ASSERT_GT(incr_build(&ib, good), 0);
+    ASSERT_EQ(ib.compiled, 0);
+    ASSERT_TRUE(matches_full(&ib, good));
+
+    /* Call to a function that no longer exists */
+    ASSERT_EQ(incr_build(&ib, "int f2() { return 1; } int g() { return f(); }"), -1);
+    ASSERT_GT(ib.lnk.error_count, 0);
+    ASSERT_GT(incr_build(&ib, good), 0);
+    ASSERT_EQ(ib.lnk.error_count, 0);
+    ASSERT_TRUE(matches_full(&ib, good));
+    incr_free(&ib);
+}
+
+TEST(test_incr_split_matches_fresh) {
+    /* Random insertions and deletions, including braces and unbalanced
+     * text: the split reusing the previous one equals a fresh split */
+    static const char pieces[][24] = {"}", "{", " ", "\n\n", "int q() { return 1; }", "x", "} int r() {"};
+    static char text[4096];
+    int v[4] = {1, 2, 3, 4};
+    make_program(v, 4, -1);
+    strcpy(text, src);
+    IncrBuild ib;
+    incr_init(&ib);
+    srand(45);
+    for (int step = 0; step < 300; step++) {
+        size_t len = strlen(text);
+        size_t at = (size_t)rand() % (len + 1);
+        if (rand() % 2 && len > 0) {
+            size_t del = 1 + (size_t)rand() % 6;
+            if (at + del > len) del = len - at;
+            memmove(text + at, text + at + del, len - at - del + 1);
+        } else {
+            const char *p = pieces[rand() % (int)(sizeof(pieces) / sizeof(pieces[0]))];
+            size_t plen = strlen(p);
+            if (len + plen >= sizeof(text)) continue;
+            memmove(text + at + plen, text + at, len - at + 1);
+            memcpy(text + at, p, plen);
+        }
+        if (incr_build(&ib, text) > 0) ASSERT_TRUE(matches_full(&ib, text));
+
+        IncrBuild fresh;
+        incr_init(&fresh);
+        incr_build(&fresh, text);
+        ASSERT_EQ(ib.span_count, fresh.span_count);
+        for (int k = 0; k < ib.span_count; k++) {
+            ASSERT_EQ(ib.spans[k].start, fresh.spans[k].start);
+            ASSERT_EQ(ib.spans[k].len, fresh.spans[k].len);
+            ASSERT_TRUE(ib.spans[k].hash == fresh.spans[k].hash);
+        }
+        incr_free(&fresh);
+    }
+    incr_free(&ib);
+}
+
+TEST(test_relink_patches_only_replaced) {
+    /* linker_relink on its own: same-size replacement keeps other bytes */
+    Linker lnk;
+    linker_init(&lnk);
+    unsigned char a[3] = {OP_PUSH, 1, OP_JMP}, b[2] = {0, OP_HALT};
+    linker_add_module(&lnk, a, 3);
+    int mb = linker_add_module(&lnk, b, 2);
+    linker_add_symbol(&lnk, mb, "b_entry", 1, SYM_EXPORT);
+    ASSERT_EQ(linker_link(&lnk), 0);
+
+    ObjectModule obj;
+    object_init(&obj);
+    object_emit(&obj, OP_DUP);
+    object_emit(&obj, OP_HALT);
+    object_add_symbol_id(&obj, intern("b_entry"), 1, SYM_EXPORT);
+    ASSERT_EQ(linker_replace_object(&lnk, mb, &obj), 0);
+    ASSERT_EQ(lnk.linked, 1);
+    ASSERT_EQ(linker_relink(&lnk), 0);
+    ASSERT_EQ(lnk.output[3], OP_DUP);
+    ASSERT_EQ(lnk.output[0], OP_PUSH);
+
+    /* Moving the export forces a full link */
+    object_emit(&obj, OP_HALT);
+    object_add_symbol_id(&obj, intern("b_entry"), 0, SYM_EXPORT);
+    linker_replace_object(&lnk, mb, &obj);
+    ASSERT_EQ(lnk.linked, 0);
+    ASSERT_EQ(linker_relink(&lnk), 0);
+    ASSERT_EQ(linker_resolve(&lnk, "b_entry"), 3);
+    linker_free(&lnk);
+}
+
+int main(void) {
+    TEST_SUITE_BEGIN("Incremental Rebuild");
+
+    RUN_TEST(test_incr_first_build);
+    RUN_TEST(test_incr_edit_one_function);
+    RUN_TEST(test_incr_whitespace_only);
+    RUN_TEST(test_incr_slot_dependency);
+    RUN_TEST(test_incr_add_remove_reorder);
+    RUN_TEST(test_incr_errors_recover);
+    RUN_TEST(test_incr_split_matches_fresh);
+    RUN_TEST(test_relink_patches_only_replaced);
+
+    TEST_SUITE_END();
+}
@@ -0,0 +1,135 @@
+/*
+ * test_intern.c - Unit tests for identifier interning
+ *
+ * Tests: intern, intern_n, intern_find, intern_str
+ * Coverage: stable IDs, distinct names, non-terminated input,
+ *           lookup without insertion, table growth
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "../include/test_harness.h"
+#include "../include/intern.h"
+
+TEST(test_intern_same_id) {
+    int a = intern("alpha");
+    int b = intern("alpha");
+    ASSERT_TRUE(a != INTERN_NONE);
+    ASSERT_EQ(a, b);
+    ASSERT_STR_EQ(intern_str(a), "alpha");
+}
+
+TEST(test_intern_distinct) {
+    int a = intern("x");
+    int b = intern("y");
+    int c = intern("xy");
+    ASSERT_TRUE(a != b);
+    ASSERT_TRUE(a != c);
+    ASSERT_TRUE(b != c);
+}
+
+TEST(test_intern_n_prefix) {
+    /* "count" inside a larger buffer interns to the same ID */
+    const char *src = "count = count + 1";
+    int a = intern_n(src, 5);
+    int b = intern_n(src + 8, 5);
+    ASSERT_EQ(a, b);
+    ASSERT_EQ(a, intern("count"));
+    ASSERT_STR_EQ(intern_str(a), "count");
+}
+
+TEST(test_intern_find_no_insert) {
+    int before = intern_count();
+    ASSERT_EQ(intern_find("never_interned_name"), INTERN_NONE);
+    ASSERT_EQ(intern_count(), before);
+    int id = intern("now_interned");
+    ASSERT_EQ(intern_find("now_interned"), id);
+}
+
+TEST(test_intern_none) {
+    ASSERT_TRUE(intern_str(INTERN_NONE) == NULL);
+    ASSERT_TRUE(intern_str(-5) == NULL);
+}
+
+TEST(test_intern_growth_stable) {
+    /* Strings stay valid and IDs stay fixed across table growth */
+    int first = intern("v0");
+    const char *first_str = intern_str(first);
+    int ids[2000];
+    for (int i = 0; i < 2000; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "v%d", i);
+        ids[i] = intern(name);
+    }
+    ASSERT_EQ(ids[0], first);
+    ASSERT_TRUE(intern_str(first) == first_str);
+    for (int i = 0; i < 2000; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "v%d", i);
+        ASSERT_EQ(intern_find(name), ids[i]);
+        ASSERT_STR_EQ(intern_str(ids[i]), name);
+    }
+}
+
+TEST(test_intern_long_name) {
+    char name[3000];
+    memset(name, 'q', sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    int id = intern(name);
+    ASSERT_EQ(intern(name), id);
+    ASSERT_EQ((int)strlen(intern_str(id)), (int)sizeof(name) - 1);
+}
+
+/* Threads interning overlapping name sets must agree on every ID */
+#define MT_THREADS 4
+#define MT_NAMES   4999    /* prime, so every stride visits all names */
+
+static int mt_ids[MT_THREADS][MT_NAMES];
+
+static void *intern_worker(void *arg) {
+    int t = (int)(intptr_t)arg;
+    char name[24];
+    for (int i = 0; i < MT_NAMES; i++) {
+        /* Each thread walks the names in a different order */
+        int k = (i * (2 * t + 1)) % MT_NAMES;
+        snprintf(name, sizeof(name), "mt_%d", k);
+        mt_ids[t][k] = intern(name);
+    }
+    return NULL;
+}
+
+TEST(test_intern_threads) {
+    pthread_t th[MT_THREADS];
+    for (int t = 0; t < MT_THREADS; t++) {
+        pthread_create(&th[t], NULL, intern_worker, (void *)(intptr_t)t);
+    }
+    for (int t = 0; t < MT_THREADS; t++) pthread_join(th[t], NULL);
+
+    int ok = 1;
+    char name[24];
+    for (int k = 0; k < MT_NAMES; k++) {
+        for (int t = 1; t < MT_THREADS; t++) {
+            if (mt_ids[t][k] != mt_ids[0][k]) ok = 0;
+        }
+        snprintf(name, sizeof(name), "mt_%d", k);
+        if (strcmp(intern_str(mt_ids[0][k]), name) != 0) ok = 0;
+    }
+    ASSERT_TRUE(ok);
+}
+
+int main(void) {
+    TEST_SUITE_BEGIN("Identifier Interning");
+
+    RUN_TEST(test_intern_same_id);
+    RUN_TEST(test_intern_distinct);
+    RUN_TEST(test_intern_n_prefix);
+    RUN_TEST(test_intern_find_no_insert);
+    RUN_TEST(test_intern_none);
+    RUN_TEST(test_intern_growth_stable);
+    RUN_TEST(test_intern_long_name);
+    RUN_TEST(test_intern_threads);
+
+    TEST_SUITE_END();
+}
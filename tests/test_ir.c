@@ -3,11 +3,13 @@
  *
  * Tests: create_const, create_var, create_binop, optimize, expr_free
  * Coverage: folding add, folding mul, nested fold, no-fold with vars,
- *           single const passthrough, chained operations
+ *           single const passthrough, chained operations, inlining,
+ *           common subexpression elimination
  */
 
 #include "../include/test_harness.h"
 #include "../include/ir.h"
+#include "../include/compact_ast.h"
 
 /* ---- Constant folding: addition ---- */
 
@@ -231,6 +233,474 @@ TEST(test_create_block) {
     expr_free(block);
 }
 
+/* ---- Arena allocator ---- */
+
+TEST(test_arena_nodes) {
+    IRArena arena;
+    ir_arena_init(&arena, 0);
+    IRArena *prev = ir_arena_activate(&arena);
+    ASSERT_TRUE(ir_arena_current() == &arena);
+
+    Expr *e = create_binop(OP_IR_ADD, create_var("x"), create_const(2));
+    ASSERT_EQ(e->in_arena, 1);
+    ASSERT_EQ(e->left->in_arena, 1);
+    ASSERT_STR_EQ(e->left->name, "x");
+    ASSERT_EQ(arena.chunk_count, 1);
+    ASSERT_GT(arena.bytes_used, 0);
+
+    ir_arena_activate(prev);
+    ASSERT_TRUE(ir_arena_current() == prev);
+    expr_free(e); /* no-op for arena nodes */
+    ir_arena_release(&arena);
+    ASSERT_EQ(arena.chunk_count, 0);
+    ASSERT_EQ(arena.bytes_used, 0);
+}
+
+TEST(test_arena_fold) {
+    /* optimize() frees folded children; must be safe inside an arena */
+    IRArena arena;
+    ir_arena_init(&arena, 0);
+    IRArena *prev = ir_arena_activate(&arena);
+    Expr *e = create_binop(OP_IR_MUL,
+        create_binop(OP_IR_ADD, create_const(1), create_const(2)),
+        create_const(7));
+    optimize(e);
+    ir_arena_activate(prev);
+    ASSERT_EQ(e->type, NODE_CONST);
+    ASSERT_EQ(e->val, 21);
+    ir_arena_release(&arena);
+}
+
+TEST(test_arena_block_growth) {
+    /* Small chunks force multiple chunks and list regrowth */
+    IRArena arena;
+    ir_arena_init(&arena, 256);
+    IRArena *prev = ir_arena_activate(&arena);
+    Expr *block = create_block();
+    for (int i = 0; i < 100; i++) {
+        block_add_stmt(block, create_const(i));
+    }
+    ir_arena_activate(prev);
+    ASSERT_EQ(block->param_count, 100);
+    for (int i = 0; i < 100; i++) {
+        ASSERT_EQ(block->params[i]->val, i);
+    }
+    ASSERT_GT(arena.chunk_count, 1);
+    ir_arena_release(&arena);
+}
+
+TEST(test_arena_takes_heap_list) {
+    /* Constructors adopt malloc'd child lists into the arena */
+    IRArena arena;
+    ir_arena_init(&arena, 0);
+    IRArena *prev = ir_arena_activate(&arena);
+    Expr **args = (Expr **)malloc(2 * sizeof(Expr *));
+    args[0] = create_const(3);
+    args[1] = create_var("y");
+    Expr *call = create_func_call("f", args, 2);
+    ir_arena_activate(prev);
+    ASSERT_EQ(call->param_count, 2);
+    ASSERT_EQ(call->params[0]->val, 3);
+    ASSERT_STR_EQ(call->params[1]->name, "y");
+    ir_arena_release(&arena);
+}
+
+TEST(test_arena_reset_keeps_chunk) {
+    IRArena arena;
+    ir_arena_init(&arena, 0);
+    ir_arena_alloc(&arena, 100);
+    ir_arena_alloc(&arena, IR_ARENA_CHUNK_SIZE * 2); /* dedicated chunk */
+    ASSERT_EQ(arena.chunk_count, 2);
+    ir_arena_reset(&arena);
+    ASSERT_EQ(arena.chunk_count, 1);
+    ASSERT_EQ(arena.bytes_used, 0);
+    ir_arena_release(&arena);
+}
+
+/* ---- Compact AST ---- */
+
+TEST(test_compact_flatten_postorder) {
+    /* (1 + x) * 2 */
+    Expr *e = create_binop(OP_IR_MUL,
+        create_binop(OP_IR_ADD, create_const(1), create_var("x")),
+        create_const(2));
+    CompactAST ca;
+    cast_init(&ca);
+    NodeRef root = cast_from_expr(&ca, e);
+    ASSERT_EQ(ca.count, 5);
+    ASSERT_EQ(root, 4);
+    ASSERT_EQ(ca.kind[root], NODE_BINOP);
+    /* Children always precede their parent */
+    ASSERT_TRUE(cast_kid(&ca, root, 0) < root);
+    ASSERT_TRUE(cast_kid(&ca, root, 1) < root);
+    ASSERT_STR_EQ(cast_name(&ca, 1), "x");
+    ASSERT_EQ(cast_kid(&ca, root, 2), CAST_NONE);
+    cast_free(&ca);
+    expr_free(e);
+}
+
+TEST(test_compact_fold) {
+    /* (2 + 3) * (10 - 4) == 30, x + (1 + 1) keeps x */
+    Expr *e = create_binop(OP_IR_MUL,
+        create_binop(OP_IR_ADD, create_const(2), create_const(3)),
+        create_binop(OP_IR_SUB, create_const(10), create_const(4)));
+    Expr *p = create_binop(OP_IR_ADD, create_var("x"),
+        create_binop(OP_IR_ADD, create_const(1), create_const(1)));
+    CompactAST ca;
+    cast_init(&ca);
+    NodeRef r1 = cast_from_expr(&ca, e);
+    NodeRef r2 = cast_from_expr(&ca, p);
+    cast_optimize(&ca);
+    ASSERT_EQ(ca.kind[r1], NODE_CONST);
+    ASSERT_EQ(ca.val[r1], 30);
+    ASSERT_EQ(ca.kind[r2], NODE_BINOP);
+    ASSERT_EQ(ca.val[cast_kid(&ca, r2, 1)], 2);
+    cast_free(&ca);
+    expr_free(e);
+    expr_free(p);
+}
+
+TEST(test_compact_roundtrip) {
+    Expr *body = create_block();
+    block_add_stmt(body, create_var_decl("i", create_const(0)));
+    block_add_stmt(body, create_while(
+        create_binop(OP_IR_CMP_LT, create_var("i"), create_const(3)),
+        create_assign(create_var("i"),
+            create_binop(OP_IR_ADD, create_var("i"), create_const(1)))));
+    Expr *fn = create_func_def("main", NULL, 0, body);
+
+    CompactAST ca;
+    cast_init(&ca);
+    NodeRef root = cast_from_expr(&ca, fn);
+    Expr *back = cast_to_expr(&ca, root);
+    ASSERT_EQ(back->type, NODE_FUNC_DEF);
+    ASSERT_STR_EQ(back->name, "main");
+    ASSERT_EQ(back->body->type, NODE_BLOCK);
+    ASSERT_EQ(back->body->param_count, 2);
+    Expr *loop = back->body->params[1];
+    ASSERT_EQ(loop->type, NODE_WHILE);
+    ASSERT_EQ(loop->condition->op, OP_IR_CMP_LT);
+    ASSERT_STR_EQ(loop->body->left->name, "i");
+    cast_free(&ca);
+    expr_free(back);
+    expr_free(fn);
+}
+
+/* ---- Inlining ---- */
+
+/* int name(int p) { stmts...; return ret; } (p may be NULL) */
+static Expr *make_func(const char *name, const char *p, Expr **stmts, int n, Expr *ret) {
+    int total = (p ? 1 : 0) + n;
+    Expr **list = total ? (Expr **)malloc((size_t)total * sizeof(Expr *)) : NULL;
+    int k = 0;
+    if (p) list[k++] = create_var(p);
+    for (int i = 0; i < n; i++) list[k++] = stmts[i];
+    return create_func_def(name, list, total, create_return(ret));
+}
+
+static Expr *call1(const char *name, Expr *arg) {
+    Expr **args = (Expr **)malloc(sizeof(Expr *));
+    args[0] = arg;
+    return create_func_call(name, args, 1);
+}
+
+/* int sq(int x) { return x * x; } */
+static Expr *make_sq(void) {
+    return make_func("sq", "x", NULL, 0,
+                     create_binop(OP_IR_MUL, create_var("x"), create_var("x")));
+}
+
+/* int g(int v) { int t = v * 3; return t + 1; } */
+static Expr *make_g(void) {
+    Expr *st[1] = { create_var_decl("t", create_binop(OP_IR_MUL, create_var("v"), create_const(3))) };
+    return make_func("g", "v", st, 1, create_binop(OP_IR_ADD, create_var("t"), create_const(1)));
+}
+
+TEST(test_inline_expression_callee) {
+    /* main() { int a = 2; return sq(a); } -> return a * a */
+    Expr *prog = create_program();
+    program_add_func(prog, make_sq());
+    Expr *st[1] = { create_var_decl("a", create_const(2)) };
+    Expr *main_fn = make_func("main", NULL, st, 1, call1("sq", create_var("a")));
+    program_add_func(prog, main_fn);
+
+    ASSERT_EQ(inline_calls(prog, NULL), 1);
+    ASSERT_EQ(main_fn->param_count, 1);
+    Expr *r = main_fn->body->left;
+    ASSERT_EQ(r->type, NODE_BINOP);
+    ASSERT_EQ(r->op, OP_IR_MUL);
+    ASSERT_STR_EQ(r->left->name, "a");
+    ASSERT_STR_EQ(r->right->name, "a");
+    expr_free(prog);
+}
+
+TEST(test_inline_materializes_shared_arg) {
+    /* return sq(a + 1): x is read twice, so a + 1 gets a variable */
+    Expr *prog = create_program();
+    program_add_func(prog, make_sq());
+    Expr *main_fn = make_func("main", "a", NULL, 0,
+                              call1("sq", create_binop(OP_IR_ADD, create_var("a"), create_const(1))));
+    program_add_func(prog, main_fn);
+
+    ASSERT_EQ(inline_calls(prog, NULL), 1);
+    ASSERT_EQ(main_fn->param_count, 2);
+    Expr *decl = main_fn->params[1];
+    ASSERT_EQ(decl->type, NODE_VAR_DECL);
+    ASSERT_STR_EQ(decl->name, "sq$1$x");
+    ASSERT_EQ(decl->left->type, NODE_BINOP);
+    ASSERT_STR_EQ(main_fn->body->left->left->name, "sq$1$x");
+    expr_free(prog);
+}
+
+TEST(test_inline_statements_and_chains) {
+    /* h(n) { return g(n) + 0 } inlines g, then main inlines h */
+    Expr *prog = create_program();
+    program_add_func(prog, make_g());
+    Expr *h = make_func("h", "n", NULL, 0,
+                        create_binop(OP_IR_ADD, call1("g", create_var("n")), create_const(0)));
+    program_add_func(prog, h);
+    Expr *st[1] = { create_var_decl("b", call1("h", create_const(4))) };
+    Expr *main_fn = make_func("main", NULL, st, 1, create_var("b"));
+    program_add_func(prog, main_fn);
+
+    ASSERT_EQ(inline_calls(prog, NULL), 2);
+    /* h: int g$1$t = n * 3; return g$1$t + 1 + 0 */
+    ASSERT_EQ(h->param_count, 2);
+    ASSERT_STR_EQ(h->params[1]->name, "g$1$t");
+    ASSERT_STR_EQ(h->params[1]->left->left->name, "n");
+    /* main: int h$2$g$1$t = 4 * 3; int b = h$2$g$1$t + 1 + 0; return b */
+    ASSERT_EQ(main_fn->param_count, 2);
+    ASSERT_STR_EQ(main_fn->params[0]->name, "h$2$g$1$t");
+    ASSERT_EQ(main_fn->params[0]->left->left->type, NODE_CONST);
+    ASSERT_STR_EQ(main_fn->params[1]->name, "b");
+    ASSERT_EQ(main_fn->params[1]->left->left->left->type, NODE_VAR);
+    expr_free(prog);
+}
+
+TEST(test_inline_refusals) {
+    /* Recursive: f(x) { return f(x) } */
+    Expr *prog = create_program();
+    program_add_func(prog, make_func("f", "x", NULL, 0, call1("f", create_var("x"))));
+    program_add_func(prog, make_func("main", NULL, NULL, 0, call1("f", create_const(1))));
+    ASSERT_EQ(inline_calls(prog, NULL), 0);
+    expr_free(prog);
+
+    /* g's statement cannot leave a loop condition; int v = g(v) reads
+     * v before it exists; a callee reading a caller's name is not closed */
+    prog = create_program();
+    program_add_func(prog, make_g());
+    program_add_func(prog, make_func("k", NULL, NULL, 0, create_var("outer")));
+    Expr *st[3] = {
+        create_while(create_binop(OP_IR_CMP_LT, create_var("i"), call1("g", create_const(1))),
+                     create_assign(create_var("i"), create_const(9))),
+        create_var_decl("v", call1("g", create_var("v"))),
+        create_var_decl("w", create_func_call("k", NULL, 0)),
+    };
+    program_add_func(prog, make_func("main", NULL, st, 3, create_const(0)));
+    ASSERT_EQ(inline_calls(prog, NULL), 0);
+    expr_free(prog);
+}
+
+TEST(test_inline_cost_model) {
+    /* g costs 9 - 2 = 5 nodes */
+    InlineOptions io;
+    inline_options_default(&io);
+    io.max_cost = 4;
+    io.hot_cost = 5;
+
+    /* Cold site over max_cost: kept */
+    Expr *prog = create_program();
+    program_add_func(prog, make_g());
+    Expr *st[1] = { create_var_decl("b", call1("g", create_const(2))) };
+    program_add_func(prog, make_func("main", NULL, st, 1, create_var("b")));
+    ASSERT_EQ(inline_calls(prog, &io), 0);
+
+    /* A profile that saw g called often makes the site hot */
+    InlineProfile hot = { prog->params[0]->name_id, 1000 };
+    io.profile = &hot;
+    io.profile_count = 1;
+    ASSERT_EQ(inline_calls(prog, &io), 1);
+    expr_free(prog);
+
+    /* Inside a loop the site is hot without a profile */
+    io.profile = NULL;
+    io.profile_count = 0;
+    prog = create_program();
+    program_add_func(prog, make_g());
+    Expr *body = create_block();
+    block_add_stmt(body, create_assign(create_var("s"), call1("g", create_var("s"))));
+    Expr *st2[2] = {
+        create_var_decl("s", create_const(0)),
+        create_while(create_binop(OP_IR_CMP_LT, create_var("s"), create_const(50)), body),
+    };
+    program_add_func(prog, make_func("main", NULL, st2, 2, create_var("s")));
+    ASSERT_EQ(inline_calls(prog, &io), 1);
+    ASSERT_EQ(body->param_count, 2);   /* int g$1$t = s * 3; s = g$1$t + 1 */
+    ASSERT_STR_EQ(body->params[0]->name, "g$1$t");
+    expr_free(prog);
+
+    /* No room for g's local under the slot budget */
+    io.slot_budget = 1;
+    prog = create_program();
+    program_add_func(prog, make_g());
+    Expr *st3[1] = { create_var_decl("b", call1("g", create_const(2))) };
+    program_add_func(prog, make_func("main", NULL, st3, 1, create_var("b")));
+    io.max_cost = 16;
+    ASSERT_EQ(inline_calls(prog, &io), 0);
+    io.slot_budget = 3;
+    ASSERT_EQ(inline_calls(prog, &io), 1);
+    expr_free(prog);
+}
+
+static int node_count(const Expr *e) {
+    if (e == NULL) return 0;
+    int n = 1 + node_count(e->left) + node_count(e->right) + node_count(e->body) +
+            node_count(e->condition) + node_count(e->else_body) + node_count(e->increment);
+    for (int i = 0; i < e->param_count; i++) n += node_count(e->params[i]);
+    return n;
+}
+
+/* c0..c7 return x + k; main returns c0(1) + ... + c7(1) */
+static Expr *many_callees(void) {
+    Expr *prog = create_program();
+    char name[8];
+    Expr *sum = NULL;
+    for (int k = 0; k < 8; k++) {
+        snprintf(name, sizeof(name), "c%d", k);
+        program_add_func(prog, make_func(name, "x", NULL, 0,
+                                         create_binop(OP_IR_ADD, create_var("x"), create_const(k))));
+        Expr *call = call1(name, create_const(1));
+        sum = sum == NULL ? call : create_binop(OP_IR_ADD, sum, call);
+    }
+    program_add_func(prog, make_func("main", NULL, NULL, 0, sum));
+    return prog;
+}
+
+TEST(test_inline_size_budget) {
+    /* Each copy adds a node: c(1) becomes 1 + k */
+    InlineOptions io;
+    inline_options_default(&io);
+    Expr *prog = many_callees();
+    int start = node_count(prog);
+    ASSERT_EQ(inline_calls(prog, &io), 8);
+    ASSERT_EQ(node_count(prog), start + 8);
+    expr_free(prog);
+
+    /* Inlining stops at the budget, whatever the per-call cost allows */
+    prog = many_callees();
+    io.size_budget = 3;
+    ASSERT_EQ(inline_calls(prog, &io), 3);
+    ASSERT_TRUE(node_count(prog) <= start + io.size_budget);
+    expr_free(prog);
+
+    prog = many_callees();
+    io.size_budget = 0;
+    ASSERT_EQ(inline_calls(prog, &io), 0);
+    expr_free(prog);
+}
+
+/* ---- Common subexpression elimination ---- */
+
+/* a * b + c, operands in the order given */
+static Expr *mul_add(const char *x, const char *y, const char *z) {
+    return create_binop(OP_IR_ADD, create_binop(OP_IR_MUL, create_var(x), create_var(y)),
+                        create_var(z));
+}
+
+TEST(test_cse_shares_values) {
+    /* int x = a * b + c; return (c + b * a) * 2 */
+    Expr *prog = create_program();
+    Expr *st[1] = { create_var_decl("x", mul_add("a", "b", "c")) };
+    Expr *swapped = create_binop(OP_IR_ADD, create_var("c"),
+                                 create_binop(OP_IR_MUL, create_var("b"), create_var("a")));
+    Expr *main_fn = make_func("main", NULL, st, 1,
+                              create_binop(OP_IR_MUL, swapped, create_const(2)));
+    program_add_func(prog, main_fn);
+
+    int ops = -1;
+    ASSERT_EQ(cse_exprs(prog, -1, &ops), 1);
+    ASSERT_EQ(ops, 2);   /* 2 * 8 instructions become 8 + 2 + 2 * 2 */
+    ASSERT_EQ(main_fn->param_count, 2);
+    Expr *decl = main_fn->params[0];
+    ASSERT_EQ(decl->type, NODE_VAR_DECL);
+    ASSERT_STR_EQ(decl->name, "cse$1");
+    ASSERT_EQ(decl->left->op, OP_IR_ADD);
+    ASSERT_STR_EQ(main_fn->params[1]->left->name, "cse$1");
+    ASSERT_STR_EQ(main_fn->body->left->left->name, "cse$1");
+    expr_free(prog);
+
+    /* a * b twice is cheaper recomputed; three times it is not */
+    prog = create_program();
+    Expr *twice = create_binop(OP_IR_ADD, create_binop(OP_IR_MUL, create_var("a"), create_var("b")),
+                               create_binop(OP_IR_MUL, create_var("a"), create_var("b")));
+    program_add_func(prog, make_func("f", "a", NULL, 0, twice));
+    ASSERT_EQ(cse_exprs(prog, -1, NULL), 0);
+    Expr *thrice = create_binop(OP_IR_SUB, create_binop(OP_IR_MUL, create_var("b"), create_var("a")),
+                                create_binop(OP_IR_MUL, create_var("a"), create_var("b")));
+    main_fn = make_func("main", "a", NULL, 0, create_binop(OP_IR_ADD, thrice, create_binop(
+                            OP_IR_MUL, create_var("a"), create_var("b"))));
+    program_add_func(prog, main_fn);
+    ASSERT_EQ(cse_exprs(prog, -1, &ops), 2);
+    ASSERT_EQ(ops, 2);
+    ASSERT_EQ(main_fn->param_count, 2);   /* a, then int cse$1 = b * a */
+    ASSERT_EQ(main_fn->params[1]->left->op, OP_IR_MUL);
+    expr_free(prog);
+}
+
+TEST(test_cse_respects_writes) {
+    /* int x = a * b + c; a = 1; return a * b + c */
+    Expr *prog = create_program();
+    Expr *st[2] = {
+        create_var_decl("x", mul_add("a", "b", "c")),
+        create_assign(create_var("a"), create_const(1)),
+    };
+    program_add_func(prog, make_func("main", NULL, st, 2, mul_add("a", "b", "c")));
+    ASSERT_EQ(cse_exprs(prog, -1, NULL), 0);
+    expr_free(prog);
+
+    /* A call ends the run; so does a loop */
+    prog = create_program();
+    Expr *st2[2] = {
+        create_var_decl("x", mul_add("a", "b", "c")),
+        create_var_decl("y", create_func_call("g", NULL, 0)),
+    };
+    program_add_func(prog, make_func("main", NULL, st2, 2, mul_add("a", "b", "c")));
+    Expr *st3[2] = {
+        create_var_decl("x", mul_add("a", "b", "c")),
+        create_while(create_var("x"), create_assign(create_var("x"), create_const(0))),
+    };
+    program_add_func(prog, make_func("h", NULL, st3, 2, mul_add("a", "b", "c")));
+    ASSERT_EQ(cse_exprs(prog, -1, NULL), 0);
+    expr_free(prog);
+
+    /* v[i + 1] * 2 survives a store to another array, not one to v */
+    for (int same = 0; same <= 1; same++) {
+        prog = create_program();
+        Expr *load[2];
+        for (int k = 0; k < 2; k++) {
+            load[k] = create_binop(OP_IR_MUL,
+                                   create_array_access("v", create_binop(OP_IR_ADD, create_var("i"),
+                                                                         create_const(1))),
+                                   create_const(2));
+        }
+        Expr *st4[2] = {
+            create_var_decl("x", load[0]),
+            create_array_assign(same ? "v" : "w", create_const(0), create_const(5)),
+        };
+        program_add_func(prog, make_func("main", "i", st4, 2, load[1]));
+        ASSERT_EQ(cse_exprs(prog, -1, NULL), same ? 0 : 1);
+        expr_free(prog);
+    }
+
+    /* No slot left for a temp */
+    prog = create_program();
+    Expr *st5[1] = { create_var_decl("x", mul_add("a", "b", "c")) };
+    program_add_func(prog, make_func("main", NULL, st5, 1, mul_add("b", "a", "c")));
+    ASSERT_EQ(cse_exprs(prog, 1, NULL), 0);
+    ASSERT_EQ(cse_exprs(prog, 2, NULL), 1);
+    expr_free(prog);
+}
+
 int main(void) {
     TEST_SUITE_BEGIN("IR / Constant Folding");
 
@@ -259,5 +729,29 @@ int main(void) {
     RUN_TEST(test_create_for);
     RUN_TEST(test_create_block);
 
+    /* Arena allocator */
+    RUN_TEST(test_arena_nodes);
+    RUN_TEST(test_arena_fold);
+    RUN_TEST(test_arena_block_growth);
+    RUN_TEST(test_arena_takes_heap_list);
+    RUN_TEST(test_arena_reset_keeps_chunk);
+
+    /* Compact AST */
+    RUN_TEST(test_compact_flatten_postorder);
+    RUN_TEST(test_compact_fold);
+    RUN_TEST(test_compact_roundtrip);
+
+    /* Inlining */
+    RUN_TEST(test_inline_expression_callee);
+    RUN_TEST(test_inline_materializes_shared_arg);
+    RUN_TEST(test_inline_statements_and_chains);
+    RUN_TEST(test_inline_refusals);
+    RUN_TEST(test_inline_cost_model);
+    RUN_TEST(test_inline_size_budget);
+
+    /* Common subexpression elimination */
+    RUN_TEST(test_cse_shares_values);
+    RUN_TEST(test_cse_respects_writes);
+
     TEST_SUITE_END();
 }
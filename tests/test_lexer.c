@@ -1,11 +1,12 @@
 /*
  * test_lexer.c - Unit tests for the tokenizer/lexer
  *
- * Tests: tokenize() from parser.c
+ * Tests: tokenize() and the streaming Lexer from parser.c
  * Coverage: valid expressions, whitespace, multi-digit ints,
  *           edge cases, invalid characters
  */
 
+#include <stdlib.h>
 #include "../include/test_harness.h"
 #include "../include/parser.h"
 
@@ -188,6 +189,17 @@ TEST(test_invalid_loop_keyword) {
     ASSERT_EQ(tokens[1].type, TOK_EOF);
 }
 
+TEST(test_unexpected_char) {
+    /* Reported as a token; scanning goes on past it */
+    tokenize("1 / 2 @");
+    ASSERT_EQ(tokens[0].type, TOK_INT);
+    ASSERT_EQ(tokens[1].type, TOK_ERROR);
+    ASSERT_EQ(tokens[1].value, '/');
+    ASSERT_EQ(tokens[2].value, 2);
+    ASSERT_EQ(tokens[3].type, TOK_ERROR);
+    ASSERT_EQ(tokens[4].type, TOK_EOF);
+}
+
 /* ---- Return keyword and comma (TASK-004 support) ---- */
 
 TEST(test_return_keyword) {
@@ -216,6 +228,98 @@ TEST(test_ident_name_storage) {
     ASSERT_EQ(tokens[1].type, TOK_EOF);
 }
 
+TEST(test_ident_interned) {
+    /* Repeated identifiers share one intern ID and one string */
+    tokenize("a = a + b");
+    ASSERT_EQ(tokens[0].type, TOK_IDENT);
+    ASSERT_EQ(tokens[2].type, TOK_IDENT);
+    ASSERT_EQ(tokens[0].value, tokens[2].value);
+    ASSERT_TRUE(token_names[0] == token_names[2]);
+    ASSERT_TRUE(tokens[4].value != tokens[0].value);
+}
+
+TEST(test_keyword_lookalikes) {
+    /* Prefixes, extensions and case variants of keywords are identifiers */
+    tokenize("if iff i fo form forr whil whiles Int intx tri trits retur returns elsee");
+    for (int i = 0; i < 15; i++) {
+        if (i == 0) ASSERT_EQ(tokens[i].type, TOK_IF);
+        else ASSERT_EQ(tokens[i].type, TOK_IDENT);
+    }
+    ASSERT_EQ(tokens[15].type, TOK_EOF);
+    tokenize("for while if else int trit return");
+    ASSERT_EQ(tokens[0].type, TOK_FOR);
+    ASSERT_EQ(tokens[1].type, TOK_WHILE);
+    ASSERT_EQ(tokens[2].type, TOK_IF);
+    ASSERT_EQ(tokens[3].type, TOK_ELSE);
+    ASSERT_EQ(tokens[4].type, TOK_INT_KW);
+    ASSERT_EQ(tokens[5].type, TOK_TRIT_KW);
+    ASSERT_EQ(tokens[6].type, TOK_RETURN);
+}
+
+TEST(test_long_runs) {
+    /* Whitespace and identifier runs spanning several vector blocks */
+    tokenize("   \t\n\r\v\f                                       "
+             "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789"
+             "+\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n\n"
+             "x[1]");
+    ASSERT_EQ(tokens[0].type, TOK_IDENT);
+    ASSERT_STR_EQ(token_names[0],
+        "abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ_0123456789");
+    ASSERT_EQ(tokens[1].type, TOK_PLUS);
+    ASSERT_EQ(tokens[2].type, TOK_IDENT);
+    ASSERT_STR_EQ(token_names[2], "x");
+    ASSERT_EQ(tokens[3].type, TOK_LBRACKET);
+    ASSERT_EQ(tokens[5].type, TOK_RBRACKET);
+    ASSERT_EQ(tokens[6].type, TOK_EOF);
+}
+
+/* ---- Streaming lexer ---- */
+
+TEST(test_lexer_peek_next) {
+    Lexer lx;
+    lexer_init(&lx, "x = 1 + 2;");
+    ASSERT_EQ(lexer_peek(&lx, 2).type, TOK_INT);
+    ASSERT_EQ(lexer_peek(&lx, 0).type, TOK_IDENT);
+    ASSERT_EQ(lexer_next(&lx).type, TOK_IDENT);
+    ASSERT_EQ(lexer_next(&lx).type, TOK_EQ);
+    ASSERT_EQ(lexer_peek(&lx, 3).type, TOK_SEMI);
+    Token one = lexer_next(&lx);
+    ASSERT_EQ(one.value, 1);
+    ASSERT_EQ(lexer_next(&lx).type, TOK_PLUS);
+    ASSERT_EQ(lexer_next(&lx).value, 2);
+    ASSERT_EQ(lexer_next(&lx).type, TOK_SEMI);
+    ASSERT_EQ(lexer_next(&lx).type, TOK_EOF);
+    ASSERT_EQ(lexer_peek(&lx, 3).type, TOK_EOF); /* EOF repeats */
+    ASSERT_EQ(lx.consumed, 7);
+}
+
+TEST(test_lexer_unbounded) {
+    /* Far more tokens than MAX_TOKENS, constant lexer state */
+    const int n = 20 * MAX_TOKENS;
+    char *src = (char *)malloc((size_t)n * 2 + 1);
+    for (int i = 0; i < n; i++) {
+        src[2 * i] = (char)('0' + i % 10);
+        src[2 * i + 1] = ' ';
+    }
+    src[2 * n] = '\0';
+
+    Lexer lx;
+    lexer_init(&lx, src);
+    int count = 0, ok = 1;
+    for (Token t = lexer_next(&lx); t.type != TOK_EOF; t = lexer_next(&lx)) {
+        if (t.type != TOK_INT || t.value != count % 10) ok = 0;
+        count++;
+    }
+    ASSERT_TRUE(ok);
+    ASSERT_EQ(count, n);
+
+    /* Batch tokenizer truncates instead of overrunning tokens[] */
+    tokenize(src);
+    ASSERT_EQ(token_idx, MAX_TOKENS);
+    ASSERT_EQ(tokens[MAX_TOKENS - 1].type, TOK_EOF);
+    free(src);
+}
+
 int main(void) {
     TEST_SUITE_BEGIN("Lexer/Tokenizer");
 
@@ -236,9 +340,15 @@ int main(void) {
     RUN_TEST(test_while_keyword);
     RUN_TEST(test_for_loop_structure);
     RUN_TEST(test_invalid_loop_keyword);
+    RUN_TEST(test_unexpected_char);
     RUN_TEST(test_return_keyword);
     RUN_TEST(test_comma_token);
     RUN_TEST(test_ident_name_storage);
+    RUN_TEST(test_ident_interned);
+    RUN_TEST(test_keyword_lookalikes);
+    RUN_TEST(test_long_runs);
+    RUN_TEST(test_lexer_peek_next);
+    RUN_TEST(test_lexer_unbounded);
 
     TEST_SUITE_END();
 }
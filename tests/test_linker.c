@@ -8,6 +8,7 @@
 #include <string.h>
 #include "../include/test_harness.h"
 #include "../include/linker.h"
+#include "../include/intern.h"
 #include "../include/vm.h"
 
 /* === Basic module management === */
@@ -174,6 +175,40 @@ TEST(test_unresolved_import_error) {
     ASSERT_TRUE(errs >= 1); /* unresolved import */
 }
 
+TEST(test_address_overflow_error) {
+    /* Targets past 255 don't fit the 1-byte operand: an error, not a
+     * truncated jump */
+    Linker lnk;
+    linker_init(&lnk);
+
+    unsigned char call[] = {OP_CALL, 0, OP_HALT};
+    static unsigned char pad[300];
+    unsigned char far[] = {OP_JMP, 0};
+    int m0 = linker_add_module(&lnk, call, 3);
+    linker_add_module(&lnk, pad, 300);
+    int m2 = linker_add_module(&lnk, far, 2);
+    linker_add_symbol(&lnk, m2, "far", 0, SYM_EXPORT);
+    linker_add_reloc(&lnk, m0, 1, "far");
+    ASSERT_EQ(linker_link(&lnk), 1);
+    ASSERT_TRUE(strstr(lnk.errors[0], "303") != NULL);
+
+    /* Module-relative target rebased past 255 */
+    object_add_reloc_id(&lnk.modules[m2], 1, INTERN_NONE);
+    ASSERT_EQ(linker_link(&lnk), 2);
+    linker_free(&lnk);
+
+    /* Up to 255 still links */
+    linker_init(&lnk);
+    m0 = linker_add_module(&lnk, call, 3);
+    linker_add_module(&lnk, pad, 252);
+    m2 = linker_add_module(&lnk, far, 2);
+    linker_add_symbol(&lnk, m2, "far", 0, SYM_EXPORT);
+    linker_add_reloc(&lnk, m0, 1, "far");
+    ASSERT_EQ(linker_link(&lnk), 0);
+    ASSERT_EQ(lnk.output[1], 255);
+    linker_free(&lnk);
+}
+
 /* === Symbol resolution === */
 
 TEST(test_resolve_after_link) {
@@ -210,6 +245,31 @@ TEST(test_local_symbol_not_global) {
     ASSERT_EQ(linker_resolve(&lnk, "internal"), -1);
 }
 
+/* === Large symbol tables === */
+
+TEST(test_link_many_symbols) {
+    Linker lnk;
+    linker_init(&lnk);
+
+    static unsigned char code[1000];
+    int m0 = linker_add_module(&lnk, code, 1000);
+    int m1 = linker_add_module(&lnk, code, 10);
+    char name[16];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "f%d", i);
+        linker_add_symbol(&lnk, m0, name, i, SYM_EXPORT);
+    }
+    linker_add_symbol(&lnk, m1, "f500", 0, SYM_EXPORT); /* duplicate */
+    linker_add_reloc(&lnk, m1, 0, "f200");
+
+    int errs = linker_link(&lnk);
+    ASSERT_EQ(errs, 1);
+    ASSERT_EQ(lnk.global_count, 1000);
+    ASSERT_EQ(linker_resolve(&lnk, "f999"), 999);
+    ASSERT_EQ(lnk.output[1000], 200);
+    linker_free(&lnk);
+}
+
 int main(void) {
     TEST_SUITE_BEGIN("Linker");
 
@@ -224,8 +284,10 @@ int main(void) {
     RUN_TEST(test_duplicate_symbol_error);
     RUN_TEST(test_undefined_symbol_error);
     RUN_TEST(test_unresolved_import_error);
+    RUN_TEST(test_address_overflow_error);
     RUN_TEST(test_resolve_after_link);
     RUN_TEST(test_local_symbol_not_global);
+    RUN_TEST(test_link_many_symbols);
 
     TEST_SUITE_END();
 }
@@ -6,6 +6,8 @@
  *           multiple functions, error handling, operator precedence
  */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include "../include/test_harness.h"
 #include "../include/parser.h"
 #include "../include/ir.h"
@@ -130,6 +132,14 @@ TEST(test_parse_invalid_func) {
     ASSERT_NULL(prog);
 }
 
+TEST(test_parse_unexpected_char) {
+    ASSERT_NULL(parse_program("int main() { return 1 / 2; }"));
+    ASSERT_NULL(parse_program("int main() { return 1; } $"));
+    Expr *prog = parse_program("int main() { return 1; }");
+    ASSERT_TRUE(prog != NULL);
+    expr_free(prog);
+}
+
 /* ---- Parse return with operator precedence (* > +) ---- */
 
 TEST(test_parse_return_precedence) {
@@ -295,6 +305,29 @@ TEST(test_parse_comparison_gt) {
     expr_free(prog);
 }
 
+/* ---- Large input (streaming lexer) ---- */
+
+TEST(test_parse_large_program) {
+    /* Tens of thousands of tokens; no fixed token buffer */
+    const int n = 5000;
+    size_t cap = (size_t)n * 32 + 64;
+    char *src = (char *)malloc(cap);
+    size_t len = (size_t)sprintf(src, "int main() { ");
+    for (int i = 0; i < n; i++) {
+        len += (size_t)sprintf(src + len, "int v%d = %d + 1; ", i, i);
+    }
+    sprintf(src + len, "return v%d; }", n - 1);
+
+    Expr *prog = parse_program(src);
+    free(src);
+    ASSERT_NOT_NULL(prog);
+    ASSERT_EQ(prog->param_count, 1);
+    Expr *fn = prog->params[0];
+    ASSERT_EQ(fn->param_count, n);
+    ASSERT_EQ(fn->body->type, NODE_RETURN);
+    expr_free(prog);
+}
+
 int main(void) {
     TEST_SUITE_BEGIN("Parser (Functions)");
 
@@ -304,6 +337,7 @@ int main(void) {
     RUN_TEST(test_parse_func_call);
     RUN_TEST(test_parse_multi_func);
     RUN_TEST(test_parse_invalid_func);
+    RUN_TEST(test_parse_unexpected_char);
     RUN_TEST(test_parse_return_precedence);
 
     /* Phase 3: Control flow parsing */
@@ -314,6 +348,7 @@ int main(void) {
     RUN_TEST(test_parse_comparison_eq);
     RUN_TEST(test_parse_comparison_lt);
     RUN_TEST(test_parse_comparison_gt);
+    RUN_TEST(test_parse_large_program);
 
     TEST_SUITE_END();
 }
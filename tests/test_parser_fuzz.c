@@ -100,25 +100,22 @@ TEST(test_parser_edge_cases) {
 }
 
 TEST(test_parser_large_input) {
-    // Generate a moderately large input (within token limits)
-    // Each variable decl is ~15 chars: "int x0 = 0; "
-    // MAX_TOKENS is 512, so limit to ~200 declarations
-    size_t buf_size = 200 * 20 + 100;
+    // Generate a large input: ~5000 declarations, well past the old
+    // 512-token batch buffer. The parser streams tokens on demand.
+    const int decls = 5000;
+    size_t buf_size = (size_t)decls * 24 + 100;
     char* large_code = (char*)malloc(buf_size);
-    strcpy(large_code, "int main() { ");
-
-    for (int i = 0; i < 50; i++) {
-        char decl[32];
-        sprintf(decl, "int x%d = %d; ", i, i);
-        if (strlen(large_code) + strlen(decl) + 20 < buf_size) {
-            strcat(large_code, decl);
-        }
+    size_t len = (size_t)sprintf(large_code, "int main() { ");
+
+    for (int i = 0; i < decls; i++) {
+        len += (size_t)sprintf(large_code + len, "int x%d = %d; ", i, i);
     }
 
-    strcat(large_code, "return 0; }");
+    strcpy(large_code + len, "return 0; }");
 
     struct Expr* ast = parse_program(large_code);
-    (void)ast;
+    ASSERT_NOT_NULL(ast);
+    expr_free(ast);
 
     free(large_code);
 }
@@ -4,10 +4,36 @@
  * Tests: Execution speed, memory usage, scaling
  */
 
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/wait.h>
 #include "../include/test_harness.h"
 #include "../include/ternary.h"
 #include "../include/parser.h"
 #include "../include/ir.h"
+#include "../include/compact_ast.h"
+#include "../include/typechecker.h"
+#include "../include/linker.h"
+#include "../include/server.h"
+#include "../include/incremental.h"
+#include "../include/reparse.h"
+#include "../include/bootstrap.h"
+#include "../include/vm.h"
+#include "../include/postfix_ir.h"
+#include "../include/ssa.h"
+
+extern char **environ;
+
+static double now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
 
 /* ---- Ternary arithmetic performance ---- */
 
@@ -62,6 +88,749 @@ TEST(test_parser_perf) {
     }
 }
 
+/* Parse the same program with malloc'd nodes vs. an arena per compile */
+TEST(test_arena_parse_perf) {
+    const int iterations = 2000;
+    const char *code =
+        "int main() { int a = 1; int b = 2; int c = a + b * 3;"
+        " if (c > 4) { c = c - 1; } else { c = c + 1; }"
+        " while (a < 10) { a = a + 1; } return c; }";
+
+    double t0 = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        struct Expr *ast = parse_program(code);
+        ASSERT_NOT_NULL(ast);
+        optimize(ast);
+        expr_free(ast);
+    }
+    double t_heap = now_sec() - t0;
+
+    IRArena arena;
+    ir_arena_init(&arena, 0);
+    t0 = now_sec();
+    for (int i = 0; i < iterations; i++) {
+        IRArena *prev = ir_arena_activate(&arena);
+        struct Expr *ast = parse_program(code);
+        ir_arena_activate(prev);
+        ASSERT_NOT_NULL(ast);
+        optimize(ast);
+        ir_arena_reset(&arena);
+    }
+    double t_arena = now_sec() - t0;
+    ir_arena_release(&arena);
+
+    printf("\n    malloc: %.0f parses/s, arena: %.0f parses/s ... ",
+           iterations / t_heap, iterations / t_arena);
+}
+
+/* ---- Compact AST layout ---- */
+
+/* Build a large synthetic function: n declarations of (i + 2) * (3 - x) */
+static Expr *build_big_func(int n) {
+    Expr *block = create_block();
+    for (int i = 0; i < n; i++) {
+        Expr *sum = create_binop(OP_IR_ADD, create_const(i), create_const(2));
+        Expr *diff = create_binop(OP_IR_SUB, create_const(3), create_var("x"));
+        block_add_stmt(block, create_var_decl("v", create_binop(OP_IR_MUL, sum, diff)));
+    }
+    return create_func_def("main", NULL, 0, block);
+}
+
+TEST(test_compact_ast_perf) {
+    const int stmts = 20000;
+    Expr *ast = build_big_func(stmts);
+
+    CompactAST ca;
+    cast_init(&ca);
+    double t0 = now_sec();
+    cast_from_expr(&ca, ast);
+    double t_flat = now_sec() - t0;
+
+    /* One Expr per compact node, plus the block's child pointer list */
+    size_t expr_bytes = (size_t)ca.count * sizeof(Expr) + (size_t)stmts * sizeof(Expr *);
+    size_t cast_bytes = cast_memory_bytes(&ca);
+    ASSERT_TRUE(cast_bytes * 3 < expr_bytes);
+
+    t0 = now_sec();
+    optimize(ast);
+    double t_expr = now_sec() - t0;
+
+    t0 = now_sec();
+    cast_optimize(&ca);
+    double t_cast = now_sec() - t0;
+
+    printf("\n    %u nodes: Expr %zu KB, compact %zu KB; "
+           "fold Expr %.2f ms, compact %.2f ms (flatten %.2f ms) ... ",
+           ca.count, expr_bytes / 1024, cast_bytes / 1024,
+           t_expr * 1e3, t_cast * 1e3, t_flat * 1e3);
+    cast_free(&ca);
+    expr_free(ast);
+}
+
+/* ---- Symbol table scaling ---- */
+
+/* n distinct declarations s<i> = s<i-1> + 1 inside one function */
+static Expr *build_symbol_func(int n) {
+    char name[16], prev[16];
+    Expr *block = create_block();
+    for (int i = 0; i < n; i++) {
+        snprintf(name, sizeof(name), "s%d", i);
+        Expr *init = i == 0 ? create_const(0)
+                            : create_binop(OP_IR_ADD, create_var(prev), create_const(1));
+        block_add_stmt(block, create_var_decl(name, init));
+        memcpy(prev, name, sizeof(name));
+    }
+    return create_func_def("main", NULL, 0, block);
+}
+
+TEST(test_symbol_table_perf) {
+    /* Per-symbol cost should stay flat as the table grows (best of 3) */
+    /* Both modules within the 1-byte targets the linker can patch */
+    static unsigned char code[256];
+    const int span = (int)sizeof(code) / 2;
+    char name[16];
+
+    printf("\n");
+    for (int size = 10; size <= 10000; size *= 10) {
+        double t_tc = 1e9, t_link = 1e9;
+        for (int rep = 0; rep < 3; rep++) {
+            Expr *func = build_symbol_func(size);
+            TypeChecker tc;
+            typechecker_init(&tc);
+            double t0 = now_sec();
+            ASSERT_EQ(typechecker_check(&tc, func), 0);
+            double t = now_sec() - t0;
+            if (t < t_tc) t_tc = t;
+            typechecker_free(&tc);
+            expr_free(func);
+
+            Linker lnk;
+            linker_init(&lnk);
+            int m0 = linker_add_module(&lnk, code, span);
+            int m1 = linker_add_module(&lnk, code, span);
+            for (int i = 0; i < size; i++) {
+                snprintf(name, sizeof(name), "f%d", i);
+                linker_add_symbol(&lnk, m0, name, i % span, SYM_EXPORT);
+                linker_add_reloc(&lnk, m1, i % span, name);
+            }
+            t0 = now_sec();
+            ASSERT_EQ(linker_link(&lnk), 0);
+            t = now_sec() - t0;
+            if (t < t_link) t_link = t;
+            linker_free(&lnk);
+        }
+        printf("    %5d symbols: typecheck %.0f ns/sym, link %.0f ns/sym\n",
+               size, t_tc * 1e9 / size, t_link * 1e9 / size);
+    }
+    printf("    ... ");
+}
+
+/* ---- Lexer throughput ---- */
+
+/* Generate n functions of typical seT5-C (loops, arrays, calls) */
+static char *build_source(int n, size_t *out_len) {
+    static const char *tmpl =
+        "int func_%d(int count, int limit) {\n"
+        "    int total_sum = 0;\n"
+        "    trit state_flags[8] = {1, 0, 1, 0, 1, 0, 1, 0};\n"
+        "    for (int index = 0; index < count; index++) {\n"
+        "        if (state_flags[index] == 1) {\n"
+        "            total_sum = total_sum + index * 3;\n"
+        "        } else {\n"
+        "            total_sum = total_sum - limit;\n"
+        "        }\n"
+        "    }\n"
+        "    while (total_sum > limit) {\n"
+        "        total_sum = helper_%d(total_sum, 27);\n"
+        "    }\n"
+        "    return total_sum;\n"
+        "}\n\n";
+    size_t cap = (size_t)n * 512;
+    char *src = (char *)malloc(cap);
+    size_t len = 0;
+    for (int i = 0; i < n; i++) {
+        len += (size_t)snprintf(src + len, cap - len, tmpl, i, i);
+    }
+    *out_len = len;
+    return src;
+}
+
+TEST(test_lexer_throughput) {
+    size_t len;
+    char *src = build_source(8000, &len);
+    const int iterations = 5;
+
+    long ntok = 0;
+    double t0 = now_sec();
+    for (int it = 0; it < iterations; it++) {
+        Lexer lx;
+        lexer_init(&lx, src);
+        while (lexer_next(&lx).type != TOK_EOF) ntok++;
+    }
+    double elapsed = now_sec() - t0;
+    free(src);
+
+    ASSERT_TRUE(ntok > 0);
+    printf("\n    %.1f MB source: %.1f Mtokens/s, %.0f MB/s ... ",
+           len / 1e6, ntok / elapsed / 1e6,
+           (double)len * iterations / elapsed / 1e6);
+}
+
+/* ---- Incremental reparse ---- */
+
+TEST(test_reparse_latency) {
+    const int funcs = 2000, edits = 200;
+    size_t len;
+    char *src = build_source(funcs, &len);
+
+    double t0 = now_sec();
+    Expr *full = parse_program(src);
+    double t_full = now_sec() - t0;
+    ASSERT_NOT_NULL(full);
+    int count = full->param_count;
+    expr_free(full);
+
+    ParseDoc doc;
+    ASSERT_EQ(parse_doc_open(&doc, src), 0);
+    ASSERT_EQ(doc.program->param_count, count);
+
+    /* Type and delete a digit inside a function in the middle */
+    size_t at = (size_t)(strstr(doc.text + len / 2, "index * 3") - doc.text) + strlen("index * 3");
+    t0 = now_sec();
+    for (int i = 0; i < edits; i++) {
+        int rc = (i & 1) ? parse_doc_edit(&doc, at, 1, "") : parse_doc_edit(&doc, at, 0, "7");
+        ASSERT_EQ(rc, 0);
+        ASSERT_EQ(doc.reparsed, 1);
+    }
+    double t_edit = (now_sec() - t0) / edits;
+    ASSERT_EQ(doc.program->param_count, count);
+    ASSERT_STR_EQ(doc.text, src);
+
+    parse_doc_free(&doc);
+    free(src);
+    printf("\n    %.0f KB, %d functions: parse_program %.0f us, edit-to-AST %.1f us (%.0fx) ... ",
+           len / 1e3, count, t_full * 1e6, t_edit * 1e6, t_full / t_edit);
+}
+
+/* ---- Compile server vs per-process invocation ---- */
+
+#define SERVER_BENCH_SRC "int main() { int s = 0; for (int i = 0; i < 5; i++) { s = s + i; } return s; }"
+
+static void *bench_serve(void *arg) {
+    server_serve((Server *)arg);
+    return NULL;
+}
+
+/* Run ./ternary_compiler --link on one file with output discarded */
+static int spawn_compiler(const char *file) {
+    posix_spawn_file_actions_t fa;
+    posix_spawn_file_actions_init(&fa);
+    posix_spawn_file_actions_addopen(&fa, 1, "/dev/null", O_WRONLY, 0);
+    char *argv[] = {"./ternary_compiler", "--link", "-j", "1", "-o", "/dev/null",
+                    (char *)file, NULL};
+    pid_t pid;
+    int rc = posix_spawn(&pid, argv[0], &fa, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&fa);
+    if (rc != 0) return -1;
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+TEST(test_server_latency) {
+    const int requests = 200;
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_perf_%d.sock", (int)getpid());
+    Server s;
+    ASSERT_EQ(server_open(&s, path, 4), 0);
+    pthread_t th;
+    pthread_create(&th, NULL, bench_serve, &s);
+
+    /* Connection per request */
+    int ok = 0;
+    double t0 = now_sec();
+    for (int i = 0; i < requests; i++) {
+        int fd = client_connect(path);
+        ServerReply r;
+        if (fd >= 0 && client_request(fd, SERVER_OP_COMPILE, SERVER_BENCH_SRC, &r) == 0 &&
+            r.status == SERVER_OK) ok++;
+        client_reply_free(&r);
+        if (fd >= 0) close(fd);
+    }
+    double per_conn = (now_sec() - t0) / requests;
+
+    /* One persistent connection */
+    int fd = client_connect(path);
+    ASSERT_TRUE(fd >= 0);
+    t0 = now_sec();
+    for (int i = 0; i < requests; i++) {
+        ServerReply r;
+        if (client_request(fd, SERVER_OP_COMPILE, SERVER_BENCH_SRC, &r) == 0 &&
+            r.status == SERVER_OK) ok++;
+        client_reply_free(&r);
+    }
+    double persistent = (now_sec() - t0) / requests;
+
+    ServerReply r;
+    client_request(fd, SERVER_OP_SHUTDOWN, NULL, &r);
+    close(fd);
+    pthread_join(th, NULL);
+    server_close(&s);
+    ASSERT_EQ(ok, 2 * requests);
+
+    /* Process per compile (same bootstrap path), when the binary has been built */
+    const int spawns = 50;
+    double per_process = 0;
+    char src_path[64];
+    snprintf(src_path, sizeof(src_path), "/tmp/test_perf_%d.c", (int)getpid());
+    FILE *f = fopen(src_path, "w");
+    if (f != NULL && access("./ternary_compiler", X_OK) == 0) {
+        fputs(SERVER_BENCH_SRC, f);
+        fclose(f);
+        t0 = now_sec();
+        for (int i = 0; i < spawns; i++) ASSERT_EQ(spawn_compiler(src_path), 0);
+        per_process = (now_sec() - t0) / spawns;
+    } else if (f != NULL) {
+        fclose(f);
+    }
+    unlink(src_path);
+
+    printf("\n    server: %.1f us/req (connect each), %.1f us/req (persistent), "
+           "%.0f req/s", per_conn * 1e6, persistent * 1e6, 1.0 / persistent);
+    if (per_process > 0) {
+        printf("; process per compile: %.1f us (%.0fx) ... ",
+               per_process * 1e6, per_process / persistent);
+    } else {
+        printf(" ... ");
+    }
+}
+
+/* ---- Incremental rebuild ---- */
+
+/* As many as keep the linked image within 1-byte jump and call targets */
+#define INCR_BENCH_FUNCS 18
+
+/* Functions without locals, so the program stays under the slot cap.
+ * Function edit returns value instead of 1, plus an extra term if grow */
+static char *build_incr_source(int edit, int value, int grow) {
+    size_t cap = (size_t)INCR_BENCH_FUNCS * 96, len = 0;
+    char *src = (char *)malloc(cap);
+    for (int k = 0; k < INCR_BENCH_FUNCS; k++) {
+        len += (size_t)snprintf(src + len, cap - len,
+            "int f%d() {\n    while (%d < 0) { }\n    return %d * 2 + %d%s;\n}\n",
+            k, k % 9, k % 9, k == edit ? value : 1, k == edit && grow ? " + 1" : "");
+    }
+    return src;
+}
+
+TEST(test_incremental_rebuild_perf) {
+    const int reps = 20;
+    static unsigned char full[1 << 18];
+    char *base = build_incr_source(-1, 0, 0);
+    char *same = build_incr_source(INCR_BENCH_FUNCS / 2, 3, 0);
+    char *grown = build_incr_source(INCR_BENCH_FUNCS / 2, 3, 1);
+
+    double t0 = now_sec();
+    int len = 0;
+    for (int i = 0; i < reps; i++) len = bootstrap_compile(same, full, sizeof(full));
+    double t_full = (now_sec() - t0) / reps;
+    ASSERT_GT(len, 0);
+
+    IncrBuild ib;
+    incr_init(&ib);
+    ASSERT_GT(incr_build(&ib, base), 0);
+
+    /* Edit one function and back again, same code size each time */
+    double t_same = 0;
+    for (int i = 0; i < reps; i++) {
+        t0 = now_sec();
+        incr_build(&ib, (i & 1) ? base : same);
+        t_same += now_sec() - t0;
+        ASSERT_EQ(ib.compiled, 1);
+        ASSERT_EQ(ib.partial_link, 1);
+    }
+    t_same /= reps;
+    ASSERT_EQ(incr_build(&ib, same), len);
+    ASSERT_TRUE(memcmp(ib.lnk.output, full, (size_t)len) == 0);
+
+    /* Size change: one compile, full relink */
+    double t_grow = 0;
+    for (int i = 0; i < reps; i++) {
+        t0 = now_sec();
+        incr_build(&ib, (i & 1) ? base : grown);
+        t_grow += now_sec() - t0;
+        ASSERT_EQ(ib.compiled, 1);
+    }
+    t_grow /= reps;
+    len = bootstrap_compile(grown, full, sizeof(full));
+    ASSERT_EQ(incr_build(&ib, grown), len);
+    ASSERT_TRUE(memcmp(ib.lnk.output, full, (size_t)len) == 0);
+
+    incr_free(&ib);
+    free(base);
+    free(same);
+    free(grown);
+    printf("\n    %d functions: full %.0f us, one-function edit %.0f us (%.0fx), "
+           "with size change %.0f us (%.0fx) ... ", INCR_BENCH_FUNCS,
+           t_full * 1e6, t_same * 1e6, t_full / t_same, t_grow * 1e6, t_full / t_grow);
+}
+
+/* ---- Call-heavy execution ---- */
+
+/* Run code reps times with the VM's "Result:" lines discarded; returns
+ * the last result */
+static int run_silent(unsigned char *code, int len, int reps) {
+    int devnull = open("/dev/null", O_WRONLY);
+    int saved = dup(STDOUT_FILENO);
+    fflush(stdout);
+    if (devnull >= 0) dup2(devnull, STDOUT_FILENO);
+    for (int i = 0; i < reps; i++) {
+        vm_memory_reset();
+        vm_run(code, (size_t)len);
+    }
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    if (devnull >= 0) close(devnull);
+    return vm_get_result();
+}
+
+TEST(test_fib_call_perf) {
+    /* Recursive fib: every call saves n, so both branches see their own */
+    const char *src = "int fib(int n) { if (n < 2) { return n; } "
+                      "return fib(n - 1) + fib(n - 2); } "
+                      "int main() { return fib(15); }";
+    const int reps = 20;
+    printf("\n");
+    for (int level = 0; level <= 1; level++) {
+        BootstrapCtx bc;
+        bootstrap_ctx_init(&bc);
+        bc.cache = NULL;
+        bc.opt_level = level;
+        unsigned char code[512];
+        int len = bootstrap_compile_ctx(&bc, src, code, sizeof(code));
+        bootstrap_ctx_free(&bc);
+        ASSERT_GT(len, 0);
+
+        double t0 = now_sec();
+        ASSERT_EQ(run_silent(code, len, reps), 610);
+        double t = (now_sec() - t0) / reps;
+        printf("    fib(15) -O%d: %d bytes, %ld steps, %.0f us ... \n",
+               level, len, vm_get_steps(), t * 1e6);
+    }
+}
+
+/* ---- Peephole optimizer ---- */
+
+/* Statements whose constant chains fold one link at a time:
+ * x = v + ((1 + 2 - 1) + 2 - 1) ... + 0 */
+static void build_peephole_seq(PostfixSeq *seq, int count) {
+    srand(44);
+    int label = 0;
+    while (seq->count < count) {
+        pf_emit(seq, PF_ADDR_OF, rand() % 32, NULL);
+        pf_emit(seq, PF_PUSH_VAR, rand() % 32, NULL);
+        pf_emit(seq, PF_PUSH_CONST, 1, NULL);
+        for (int k = rand() % 64; k > 0; k--) {
+            pf_emit(seq, PF_PUSH_CONST, 2, NULL);
+            pf_emit(seq, PF_ADD, 0, NULL);
+            pf_emit(seq, PF_PUSH_CONST, 1, NULL);
+            pf_emit(seq, PF_SUB, 0, NULL);
+        }
+        pf_emit(seq, PF_ADD, 0, NULL);
+        pf_emit(seq, PF_PUSH_CONST, 0, NULL);
+        pf_emit(seq, PF_ADD, 0, NULL);
+        pf_emit(seq, PF_STORE, 0, NULL);
+        pf_emit(seq, PF_LABEL, label++, NULL);
+    }
+}
+
+/* The rescanning optimizer pf_optimize replaced: one fold per chain per
+ * pass, compacting after each pass */
+static void pf_optimize_rescan(PostfixSeq *seq) {
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i = 1; i < seq->count - 1; i++) {
+            PostfixInstr *prev = &seq->instrs[i - 1], *a = &seq->instrs[i], *b = &seq->instrs[i + 1];
+            if (a->op == PF_PUSH_CONST && a->operand == 0 && b->op == PF_ADD) {
+                a->op = b->op = PF_NOP;
+                changed = 1;
+            } else if (prev->op == PF_PUSH_CONST && a->op == PF_PUSH_CONST &&
+                       (b->op == PF_ADD || b->op == PF_SUB)) {
+                prev->operand = b->op == PF_ADD ? prev->operand + a->operand
+                                                : prev->operand - a->operand;
+                a->op = b->op = PF_NOP;
+                changed = 1;
+            }
+        }
+        int w = 0;
+        for (int r = 0; r < seq->count; r++) {
+            if (seq->instrs[r].op != PF_NOP) seq->instrs[w++] = seq->instrs[r];
+        }
+        seq->count = w;
+    }
+}
+
+TEST(test_peephole_perf) {
+    printf("\n");
+    for (int n = 10000; n <= 1000000; n *= 10) {
+        PostfixSeq seq;
+        pf_init(&seq);
+        build_peephole_seq(&seq, n);
+        int before = seq.count;
+        double t0 = now_sec();
+        pf_optimize(&seq);
+        double t = now_sec() - t0;
+        /* Every chain folds to one constant: 6 instructions a statement */
+        ASSERT_EQ(seq.count % 6, 0);
+        printf("    %7d instrs -> %6d: %.2f ms (%.1f ns/instr)", before, seq.count,
+               t * 1e3, t * 1e9 / before);
+
+        if (n <= 100000) {
+            PostfixSeq ref;
+            pf_init(&ref);
+            build_peephole_seq(&ref, n);
+            t0 = now_sec();
+            pf_optimize_rescan(&ref);
+            double t_ref = now_sec() - t0;
+            ASSERT_EQ(ref.count, seq.count);
+            printf(", rescanning %.2f ms (%.0fx)", t_ref * 1e3, t_ref / t);
+            pf_free(&ref);
+        }
+        printf(" ...\n");
+        pf_free(&seq);
+    }
+}
+
+/* ---- Label resolution ---- */
+
+/* Index of label id by scanning, as pf_find_label did before the
+ * label table */
+static int find_label_scan(const PostfixSeq *seq, int id) {
+    for (int i = 0; i < seq->count; i++) {
+        if (seq->instrs[i].op == PF_LABEL && seq->instrs[i].operand == id) return i;
+    }
+    return -1;
+}
+
+TEST(test_label_perf) {
+    printf("\n");
+    for (int n = 1000; n <= 100000; n *= 10) {
+        /* n ifs: PUSH_VAR, BRZ, body, LABEL */
+        PostfixSeq seq;
+        pf_init(&seq);
+        for (int i = 0; i < n; i++) {
+            int skip = pf_alloc_label(&seq);
+            pf_emit(&seq, PF_PUSH_VAR, i % 32, NULL);
+            pf_emit(&seq, PF_BRZ, skip, NULL);
+            pf_emit(&seq, PF_ADDR_OF, i % 32, NULL);
+            pf_emit(&seq, PF_PUSH_CONST, 1, NULL);
+            pf_emit(&seq, PF_STORE, 0, NULL);
+            pf_emit(&seq, PF_LABEL, skip, NULL);
+        }
+        double t0 = now_sec();
+        long sum = 0;
+        for (int id = 0; id < n; id++) sum += pf_find_label(&seq, id);
+        double t = now_sec() - t0;
+        ASSERT_EQ(sum, 6L * n * (n - 1) / 2 + 5L * n);
+
+        ObjectModule obj;
+        object_init(&obj);
+        t0 = now_sec();
+        ASSERT_GT(pf_lower(&seq, &obj), 0);
+        double t_lower = now_sec() - t0;
+        printf("    %6d labels: %.2f ms (%.1f ns/label), lowering %.2f ms",
+               n, t * 1e3, t * 1e9 / n, t_lower * 1e3);
+
+        if (n <= 10000) {
+            t0 = now_sec();
+            long ref = 0;
+            for (int id = 0; id < n; id++) ref += find_label_scan(&seq, id);
+            double t_ref = now_sec() - t0;
+            ASSERT_EQ(ref, sum);
+            printf(", scanning %.2f ms (%.0fx)", t_ref * 1e3, t_ref / t);
+        }
+        printf(" ...\n");
+        object_free(&obj);
+        pf_free(&seq);
+    }
+}
+
+/* ---- Stack scheduling ---- */
+
+/* main of source through the -O1 pipeline as a runnable image, with
+ * common subexpressions eliminated or not, stack scheduled or not and
+ * peepholes from rules (NULL: the default ones); returns the code
+ * length or -1 */
+static int o1_image(const char *source, int cse, int schedule, const PfMatcher *rules,
+                    ObjectModule *obj, int *shared, int *loads) {
+    Expr *prog = parse_program(source);
+    if (prog == NULL || prog->param_count == 0) {
+        expr_free(prog);
+        return -1;
+    }
+    *shared = cse ? cse_exprs(prog, MAX_SYMBOLS, NULL) : 0;
+    SsaFunc f;
+    PostfixSeq seq;
+    pf_init(&seq);
+    int rc = ssa_build_expr(&f, prog->params[0], 0, MAX_SYMBOLS);
+    expr_free(prog);
+    if (rc == 0) ssa_optimize(&f, 1);
+    if (rc == 0) rc = ssa_lower(&f, &seq, MAX_SYMBOLS, 2 * MAX_SYMBOLS);
+    ssa_free(&f);
+    if (rc == 0) {
+        if (rules != NULL) pf_optimize_with(&seq, rules);
+        else pf_optimize(&seq);
+        *loads = schedule ? pf_schedule_stack(&seq, 1) : 0;
+        pf_emit(&seq, PF_HALT, 0, NULL);
+        rc = pf_lower(&seq, obj);
+    }
+    pf_free(&seq);
+    return rc;
+}
+
+TEST(test_stack_sched_perf) {
+    /* Loops in the style of the selfhost roundtrip programs */
+    static const char *progs[] = {
+        "int main() { int s = 0; int i = 0; while (i < 50) { int q = i * i; "
+        "s = s + q * 2 + q; i = i + 1; } return s; }",
+        "int main() { int a = 0; int b = 1; int i = 0; while (i < 20) { "
+        "int t = a + b; a = b; b = t; i = i + 1; } return a; }",
+        "int main() { int r = 1; int i = 1; while (i < 30) { int d = r + i; "
+        "r = d * 2 - d - i; i = i + 1; } return r; }",
+        "int main() { int x = 3; int y = 4; int n = 0; while (n < 40) { "
+        "int z = x + y; x = y - n; y = z - x * 2 + n; n = n + 1; } return x + y; }",
+    };
+    const int reps = 2000;
+    printf("\n");
+    for (size_t p = 0; p < sizeof(progs) / sizeof(progs[0]); p++) {
+        int len[2], result[2], loads = 0;
+        long steps[2];
+        double t[2];
+        for (int sched = 0; sched <= 1; sched++) {
+            ObjectModule obj;
+            object_init(&obj);
+            int shared;
+            len[sched] = o1_image(progs[p], 0, sched, NULL, &obj, &shared, &loads);
+            ASSERT_GT(len[sched], 0);
+            ASSERT_TRUE(len[sched] < 256);
+            double t0 = now_sec();
+            result[sched] = run_silent(obj.code, obj.code_len, reps);
+            t[sched] = (now_sec() - t0) / reps;
+            steps[sched] = vm_get_steps();
+            object_free(&obj);
+        }
+        ASSERT_EQ(result[1], result[0]);
+        ASSERT_TRUE(steps[1] <= steps[0]);
+        printf("    program %zu: %d loads/stores removed, %d -> %d bytes, %ld -> %ld steps, "
+               "%.1f -> %.1f us ...\n", p + 1, loads, len[0], len[1], steps[0], steps[1],
+               t[0] * 1e6, t[1] * 1e6);
+    }
+}
+
+/* ---- Common subexpression elimination ---- */
+
+TEST(test_cse_perf) {
+    /* Index arithmetic and products that loops evaluate repeatedly */
+    static const char *progs[] = {
+        "int main() { int g[9] = {0}; int r = 0; int s = 0; while (r < 4) { "
+        "g[r * 2 + 1] = r; s = s + g[r * 2 + 1] * g[r * 2 + 1] + r * 2 + 1; "
+        "r = r + 1; } return s; }",
+        "int main() { int x = 7; int y = 2; int k = 0; int d = 0; while (k < 40) { "
+        "d = d + k * x * y + k * x * y + k * x * y + k; k = k + 1; } return d; }",
+        "int main() { int a[6] = {1}; int i = 0; int s = 0; while (i < 5) { "
+        "a[i + 1] = a[i] * 2 + a[i] * 2 + 1; s = s + a[i + 1] - a[i] * 2; "
+        "i = i + 1; } return s; }",
+        "int main() { int x = 3; int y = 5; int n = 0; int d = 0; while (n < 30) { "
+        "int e = x * x - 2 * x * y + y * y; d = d + e + x * x + y * y; "
+        "x = x + 1; n = n + 1; } return d; }",
+        "int main() { int v[8] = {0}; int i = 0; while (i < 3) { "
+        "v[i * 2 + 1] = v[i * 2 + 1] + i * 2 + 1; v[i * 2] = v[i * 2 + 1] - i; "
+        "i = i + 1; } return v[0] + v[1] + v[2] + v[3] + v[4] + v[5]; }",
+    };
+    const int reps = 2000;
+    int total_shared = 0, total_ops = 0;
+    printf("\n");
+    for (size_t p = 0; p < sizeof(progs) / sizeof(progs[0]); p++) {
+        int len[2], result[2], shared = 0, loads;
+        long steps[2];
+        double t[2];
+        Expr *prog = parse_program(progs[p]);
+        int ops;
+        ASSERT_TRUE(prog != NULL);
+        total_shared += cse_exprs(prog, MAX_SYMBOLS, &ops);
+        total_ops += ops;
+        expr_free(prog);
+        for (int cse = 0; cse <= 1; cse++) {
+            ObjectModule obj;
+            object_init(&obj);
+            len[cse] = o1_image(progs[p], cse, 1, NULL, &obj, &shared, &loads);
+            ASSERT_GT(len[cse], 0);
+            ASSERT_TRUE(len[cse] < 256);
+            double t0 = now_sec();
+            result[cse] = run_silent(obj.code, obj.code_len, reps);
+            t[cse] = (now_sec() - t0) / reps;
+            steps[cse] = vm_get_steps();
+            object_free(&obj);
+        }
+        ASSERT_EQ(result[1], result[0]);
+        ASSERT_TRUE(steps[1] <= steps[0]);
+        printf("    program %zu: %d evaluations removed (%d ops at -O0), %d -> %d bytes, "
+               "%ld -> %ld steps, %.1f -> %.1f us ...\n", p + 1, shared, ops, len[0], len[1],
+               steps[0], steps[1], t[0] * 1e6, t[1] * 1e6);
+    }
+    printf("    corpus: %d evaluations, %d ops per pass removed ...\n", total_shared, total_ops);
+}
+
+TEST(test_trit_shift_perf) {
+    /* Index arithmetic on 3^k-sized arrays and power-of-3 scaling */
+    static const char *progs[] = {
+        "int main() { int g[9] = {0}; int i = 0; int s = 0; while (i < 3) { "
+        "g[i * 3] = i; g[i * 3 + 1] = i * 9; s = s + g[i * 3] + g[i * 3 + 1] * 3; "
+        "i = i + 1; } return s; }",
+        "int main() { int k = 0; int d = 0; while (k < 40) { "
+        "d = d + k * 27 - k * 9 + 3 * k; k = k + 1; } return d; }",
+        "int main() { int a = 5; int n = 0; int s = 0; while (n < 20) { "
+        "s = s + a * 81 - a * 27 + n * 9; a = a + 1; n = n + 1; } return s; }",
+    };
+    /* The default rules without the ones that make trit shifts */
+    PfRule rules[128];
+    int count = 0;
+    for (int i = 0; i < pf_default_rule_count; i++) {
+        if (strstr(pf_default_rules[i].name, "pow3") == NULL) rules[count++] = pf_default_rules[i];
+    }
+    ASSERT_EQ(count, pf_default_rule_count - 4);
+    PfMatcher *no_shifts = pf_compile_rules(rules, count);
+    ASSERT_TRUE(no_shifts != NULL);
+    const int reps = 2000;
+    printf("\n");
+    for (size_t p = 0; p < sizeof(progs) / sizeof(progs[0]); p++) {
+        int len[2], result[2], shared, loads;
+        long steps[2];
+        double t[2];
+        for (int shifts = 0; shifts <= 1; shifts++) {
+            ObjectModule obj;
+            object_init(&obj);
+            len[shifts] = o1_image(progs[p], 1, 1, shifts ? NULL : no_shifts, &obj, &shared, &loads);
+            ASSERT_GT(len[shifts], 0);
+            ASSERT_TRUE(len[shifts] < 256);
+            double t0 = now_sec();
+            result[shifts] = run_silent(obj.code, obj.code_len, reps);
+            t[shifts] = (now_sec() - t0) / reps;
+            steps[shifts] = vm_get_steps();
+            object_free(&obj);
+        }
+        ASSERT_EQ(result[1], result[0]);
+        ASSERT_TRUE(len[1] < len[0]);
+        ASSERT_TRUE(steps[1] < steps[0]);
+        printf("    program %zu: MUL -> trit shifts %d -> %d bytes, %ld -> %ld steps, "
+               "%.1f -> %.1f us ...\n", p + 1, len[0], len[1], steps[0], steps[1],
+               t[0] * 1e6, t[1] * 1e6);
+    }
+    pf_free_rules(no_shifts);
+}
+
 /* ---- Scaling test ---- */
 
 TEST(test_scaling_perf) {
@@ -92,6 +861,19 @@ int main(void) {
     RUN_TEST(test_trit_arithmetic_perf);
     RUN_TEST(test_trit_word_perf);
     RUN_TEST(test_parser_perf);
+    RUN_TEST(test_arena_parse_perf);
+    RUN_TEST(test_compact_ast_perf);
+    RUN_TEST(test_symbol_table_perf);
+    RUN_TEST(test_lexer_throughput);
+    RUN_TEST(test_reparse_latency);
+    RUN_TEST(test_server_latency);
+    RUN_TEST(test_incremental_rebuild_perf);
+    RUN_TEST(test_fib_call_perf);
+    RUN_TEST(test_peephole_perf);
+    RUN_TEST(test_label_perf);
+    RUN_TEST(test_stack_sched_perf);
+    RUN_TEST(test_cse_perf);
+    RUN_TEST(test_trit_shift_perf);
     RUN_TEST(test_scaling_perf);
 
     TEST_SUITE_END();
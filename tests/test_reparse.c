@@ -0,0 +1,219 @@
+/*
+ * test_reparse.c - Incremental reparsing tests
+ *
+ * After every edit the document's AST is compared node-for-node with
+ * parse_program() of the edited text.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/test_harness.h"
+#include "../include/reparse.h"
+#include "../include/parser.h"
+#include "../include/ir.h"
+
+static int same_tree(const Expr *a, const Expr *b) {
+    if (a == NULL || b == NULL) return a == b;
+    if (a->type != b->type || a->val != b->val || a->name_id != b->name_id ||
+        a->op != b->op || a->array_size != b->array_size ||
+        a->param_count != b->param_count) return 0;
+    for (int i = 0; i < a->param_count; i++) {
+        if (!same_tree(a->params[i], b->params[i])) return 0;
+    }
+    return same_tree(a->left, b->left) && same_tree(a->right, b->right) &&
+           same_tree(a->body, b->body) && same_tree(a->condition, b->condition) &&
+           same_tree(a->else_body, b->else_body) && same_tree(a->increment, b->increment);
+}
+
+/* doc's AST equals a full parse of its text, or both report a syntax error */
+static int matches_full(const ParseDoc *doc) {
+    Expr *full = parse_program(doc->text);
+    int same = full == NULL ? doc->error : !doc->error && same_tree(doc->program, full);
+    expr_free(full);
+    return same;
+}
+
+static const char *three =
+    "int f(int x) { return x + 1; }\n"
+    "int g(int y) { int a = 2; while (a < y) { a = a + 1; } return a; }\n"
+    "int h() { return g(f(3)); }\n";
+
+static size_t find(const ParseDoc *doc, const char *needle) {
+    return (size_t)(strstr(doc->text, needle) - doc->text);
+}
+
+TEST(test_reparse_open) {
+    ParseDoc doc;
+    ASSERT_EQ(parse_doc_open(&doc, three), 0);
+    ASSERT_EQ(doc.program->param_count, 3);
+    ASSERT_EQ(doc.reparsed, 3);
+    ASSERT_EQ((int)doc.extents[0].start, 0);
+    ASSERT_EQ((int)doc.extents[1].start, (int)doc.extents[0].end);
+    ASSERT_EQ(doc.text[doc.extents[2].end - 1], '}');
+    ASSERT_TRUE(matches_full(&doc));
+    parse_doc_free(&doc);
+}
+
+TEST(test_reparse_edit_inside_function) {
+    ParseDoc doc;
+    parse_doc_open(&doc, three);
+    Expr *f = doc.program->params[0], *h = doc.program->params[2];
+
+    /* "a < y" -> "a < y + 7": only g is reparsed */
+    ASSERT_EQ(parse_doc_edit(&doc, find(&doc, "a < y") + 5, 0, " + 7"), 0);
+    ASSERT_EQ(doc.reparsed, 1);
+    ASSERT_EQ(doc.reused, 2);
+    ASSERT_TRUE(doc.program->params[0] == f);
+    ASSERT_TRUE(doc.program->params[2] == h);
+    ASSERT_TRUE(matches_full(&doc));
+
+    /* Shrinking edit shifts the extents after it */
+    size_t h_start = doc.extents[2].start;
+    ASSERT_EQ(parse_doc_edit(&doc, find(&doc, " + 7"), 4, ""), 0);
+    ASSERT_EQ((int)doc.extents[2].start, (int)h_start - 4);
+    ASSERT_TRUE(matches_full(&doc));
+    parse_doc_free(&doc);
+}
+
+TEST(test_reparse_add_remove_function) {
+    ParseDoc doc;
+    parse_doc_open(&doc, three);
+
+    /* Insert between f and g */
+    ASSERT_EQ(parse_doc_edit(&doc, doc.extents[0].end, 0, "\nint k() { return 5; }"), 0);
+    ASSERT_EQ(doc.program->param_count, 4);
+    ASSERT_EQ(doc.reparsed, 1);
+    ASSERT_EQ(doc.reused, 3);
+    ASSERT_TRUE(matches_full(&doc));
+
+    /* Delete it again: the function after it is parsed to resynchronize */
+    size_t at = doc.extents[1].start;
+    ASSERT_EQ(parse_doc_edit(&doc, at, doc.extents[1].end - at, ""), 0);
+    ASSERT_EQ(doc.program->param_count, 3);
+    ASSERT_TRUE(doc.reparsed <= 1);
+    ASSERT_TRUE(matches_full(&doc));
+
+    /* Append at the end */
+    ASSERT_EQ(parse_doc_edit(&doc, doc.len, 0, "int z() { return 0; }"), 0);
+    ASSERT_EQ(doc.program->param_count, 4);
+    ASSERT_EQ(doc.reused, 3);
+    ASSERT_TRUE(matches_full(&doc));
+    parse_doc_free(&doc);
+}
+
+TEST(test_reparse_syntax_error_recovers) {
+    ParseDoc doc;
+    parse_doc_open(&doc, three);
+
+    /* Drop f's closing brace: f swallows g and fails, keeping the tree */
+    Expr *g = doc.program->params[1];
+    size_t brace = doc.extents[0].end - 1;
+    ASSERT_EQ(parse_doc_edit(&doc, brace, 1, ""), -1);
+    ASSERT_TRUE(doc.error);
+    ASSERT_EQ(doc.program->param_count, 3);
+    ASSERT_TRUE(doc.program->params[1] == g);
+
+    /* Restore it: a full parse rebuilds the document */
+    ASSERT_EQ(parse_doc_edit(&doc, brace, 0, "}"), 0);
+    ASSERT_EQ(doc.program->param_count, 3);
+    ASSERT_STR_EQ(doc.text, three);
+    ASSERT_TRUE(matches_full(&doc));
+
+    /* Out-of-range edits are rejected without touching the text */
+    ASSERT_EQ(parse_doc_edit(&doc, doc.len + 1, 0, "x"), -2);
+    ASSERT_EQ(parse_doc_edit(&doc, doc.len - 2, 3, ""), -2);
+    ASSERT_STR_EQ(doc.text, three);
+    parse_doc_free(&doc);
+}
+
+TEST(test_reparse_unexpected_char) {
+    /* A character the lexer rejects is a syntax error like any other */
+    ParseDoc doc;
+    parse_doc_open(&doc, three);
+    Expr *f = doc.program->params[0];
+    Expr *h = doc.program->params[2];
+
+    ASSERT_EQ(parse_doc_edit(&doc, find(&doc, "x + 1") + 5, 0, " / 2"), -1);
+    ASSERT_TRUE(doc.error);
+    ASSERT_TRUE(doc.program->params[0] == f);
+    ASSERT_TRUE(matches_full(&doc));
+
+    /* Edits elsewhere still fail, and still keep the last good tree */
+    ASSERT_EQ(parse_doc_edit(&doc, find(&doc, "g(f(3))") + 4, 1, "4"), -1);
+    ASSERT_TRUE(doc.program->params[2] == h);
+    ASSERT_EQ(parse_doc_edit(&doc, doc.len, 0, "@"), -1);
+    ASSERT_EQ(doc.program->param_count, 3);
+
+    /* Removing the bad characters parses the whole text again */
+    ASSERT_EQ(parse_doc_edit(&doc, doc.len - 1, 1, ""), -1);
+    ASSERT_EQ(parse_doc_edit(&doc, find(&doc, " / 2"), 4, ""), 0);
+    ASSERT_TRUE(!doc.error);
+    ASSERT_EQ(doc.reparsed, 3);
+    ASSERT_TRUE(matches_full(&doc));
+
+    /* Incremental edits resume */
+    ASSERT_EQ(parse_doc_edit(&doc, find(&doc, "x + 1") + 4, 1, "5"), 0);
+    ASSERT_EQ(doc.reparsed, 1);
+    ASSERT_TRUE(matches_full(&doc));
+    parse_doc_free(&doc);
+}
+
+TEST(test_reparse_brace_moves_boundary) {
+    /* Moving text across a function boundary changes which tokens belong
+     * to which function; the result still equals a full parse */
+    ParseDoc doc;
+    parse_doc_open(&doc, "int a() { return 1; } int b() { return 2; } int c() { return 3; }");
+    ASSERT_EQ(parse_doc_edit(&doc, find(&doc, "} int b"), 1, ""), -1);
+    ASSERT_EQ(parse_doc_edit(&doc, find(&doc, "int b"), 0, "} "), 0);
+    ASSERT_TRUE(matches_full(&doc));
+
+    /* Merge b into a: "return 1; } int b() {" -> "return 1;" */
+    size_t at = find(&doc, "} int b");
+    ASSERT_EQ(parse_doc_edit(&doc, at, strlen("} int b() {"), ""), 0);
+    ASSERT_EQ(doc.program->param_count, 2);
+    ASSERT_EQ(doc.reused, 1);
+    ASSERT_TRUE(matches_full(&doc));
+    parse_doc_free(&doc);
+}
+
+TEST(test_reparse_random_edits) {
+    /* Random insertions and deletions of whole tokens and statements */
+    static const char *pieces[] = {
+        " ", "\n", "}", "{", "1", "x", " return 4; ", " int q = 2; ",
+        "int n() { return 9; }", "} int m() {", " + 3", ";", "@",
+    };
+    ParseDoc doc;
+    parse_doc_open(&doc, three);
+    srand(46);
+    for (int step = 0; step < 400; step++) {
+        size_t at = (size_t)rand() % (doc.len + 1);
+        if (rand() % 3 == 0 && doc.len > 0) {
+            size_t del = 1 + (size_t)rand() % 8;
+            if (at + del > doc.len) del = doc.len - at;
+            parse_doc_edit(&doc, at, del, "");
+        } else {
+            parse_doc_edit(&doc, at, 0, pieces[rand() % (int)(sizeof(pieces) / sizeof(pieces[0]))]);
+        }
+        ASSERT_TRUE(matches_full(&doc));
+        if (doc.len > 2000) {
+            parse_doc_free(&doc);
+            parse_doc_open(&doc, three);
+        }
+    }
+    parse_doc_free(&doc);
+}
+
+int main(void) {
+    TEST_SUITE_BEGIN("Incremental Reparse");
+
+    RUN_TEST(test_reparse_open);
+    RUN_TEST(test_reparse_edit_inside_function);
+    RUN_TEST(test_reparse_add_remove_function);
+    RUN_TEST(test_reparse_syntax_error_recovers);
+    RUN_TEST(test_reparse_unexpected_char);
+    RUN_TEST(test_reparse_brace_moves_boundary);
+    RUN_TEST(test_reparse_random_edits);
+
+    TEST_SUITE_END();
+}
@@ -126,8 +126,10 @@ TEST(test_selfhost_tokenizer_compiles) {
     unsigned char bytecode[MAX_BYTECODE];
     int len = selfhost_compile_tokenizer(bytecode, MAX_BYTECODE);
     ASSERT_GT(len, 0);
-    /* Last byte should be HALT */
-    ASSERT_EQ(bytecode[len - 1], OP_HALT);
+    /* Entry stub (CALL main; HALT), then functions ending in RET */
+    ASSERT_EQ(bytecode[0], OP_CALL);
+    ASSERT_EQ(bytecode[2], OP_HALT);
+    ASSERT_EQ(bytecode[len - 1], OP_RET);
 }
 
 TEST(test_selfhost_tokenizer_bytecode_reasonable) {
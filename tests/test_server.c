@@ -0,0 +1,285 @@
+/*
+ * test_server.c - Compile server tests
+ *
+ * Tests: compile/run requests, compile and lexer errors, persistent connections,
+ *        run step budget, concurrent clients, malformed requests, socket path,
+ *        accept errors, shutdown
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "../include/test_harness.h"
+#include "../include/server.h"
+#include "../include/bootstrap.h"
+
+static Server server;
+static pthread_t server_thread;
+static char sock_path[64];
+
+static void *serve_thread(void *arg) {
+    (void)arg;
+    server_serve(&server);
+    return NULL;
+}
+
+/* ---- Requests ---- */
+
+TEST(test_server_compile_matches_local) {
+    const char *src = "int main() { int x = 5; int y = x * 3; return y; }";
+    unsigned char local[256];
+    int len = bootstrap_compile(src, local, 256);
+
+    int fd = client_connect(sock_path);
+    ASSERT_TRUE(fd >= 0);
+    ServerReply r;
+    ASSERT_EQ(client_request(fd, SERVER_OP_COMPILE, src, &r), 0);
+    ASSERT_EQ(r.status, SERVER_OK);
+    ASSERT_EQ(r.code_len, len);
+    ASSERT_TRUE(memcmp(r.code, local, (size_t)len) == 0);
+    client_reply_free(&r);
+    close(fd);
+}
+
+TEST(test_server_run) {
+    int fd = client_connect(sock_path);
+    ASSERT_TRUE(fd >= 0);
+    ServerReply r;
+    ASSERT_EQ(client_request(fd, SERVER_OP_RUN,
+              "int main() { int x = 0; while (x < 4) { x = x + 1; } return x * 2; }", &r), 0);
+    ASSERT_EQ(r.status, SERVER_OK);
+    ASSERT_EQ(r.result, 8);
+    ASSERT_GT(r.code_len, 0);
+    client_reply_free(&r);
+    close(fd);
+}
+
+TEST(test_server_persistent_connection) {
+    /* Errors don't end the connection; later requests still work */
+    int fd = client_connect(sock_path);
+    ASSERT_TRUE(fd >= 0);
+    ServerReply r;
+    ASSERT_EQ(client_request(fd, SERVER_OP_COMPILE, "int f( {", &r), 0);
+    ASSERT_EQ(r.status, SERVER_ERR_COMPILE);
+    ASSERT_EQ(r.code_len, 0);
+    for (int i = 0; i < 20; i++) {
+        char src[64];
+        snprintf(src, sizeof(src), "int main() { return %d + 1; }", i);
+        ASSERT_EQ(client_request(fd, SERVER_OP_RUN, src, &r), 0);
+        ASSERT_EQ(r.status, SERVER_OK);
+        ASSERT_EQ(r.result, i + 1);
+        client_reply_free(&r);
+    }
+    close(fd);
+}
+
+TEST(test_server_unexpected_char) {
+    /* A character the lexer rejects fails that compile, not the server */
+    int fd = client_connect(sock_path);
+    ASSERT_TRUE(fd >= 0);
+    ServerReply r;
+    ASSERT_EQ(client_request(fd, SERVER_OP_RUN, "int main() { return 1 / 2; }", &r), 0);
+    ASSERT_EQ(r.status, SERVER_ERR_COMPILE);
+    ASSERT_EQ(r.code_len, 0);
+    close(fd);
+
+    fd = client_connect(sock_path);
+    ASSERT_TRUE(fd >= 0);
+    ASSERT_EQ(client_request(fd, SERVER_OP_RUN, "int main() { return 7; }", &r), 0);
+    ASSERT_EQ(r.status, SERVER_OK);
+    ASSERT_EQ(r.result, 7);
+    client_reply_free(&r);
+    close(fd);
+}
+
+static void *loop_client(void *arg) {
+    ServerReply *r = (ServerReply *)arg;
+    int fd = client_connect(sock_path);
+    if (fd < 0 || client_request(fd, SERVER_OP_RUN,
+                                 "int main() { int x = 9; while (x > 1) { x = x * 1; } return x; }", r) < 0) {
+        r->status = -1;
+    }
+    if (fd >= 0) close(fd);
+    return NULL;
+}
+
+TEST(test_server_run_step_budget) {
+    /* A program that never halts is cut off and releases the VM */
+    pthread_t th;
+    ServerReply loop;
+    pthread_create(&th, NULL, loop_client, &loop);
+
+    int fd = client_connect(sock_path);
+    ASSERT_TRUE(fd >= 0);
+    ServerReply r;
+    ASSERT_EQ(client_request(fd, SERVER_OP_RUN, "int main() { return 3 * 4; }", &r), 0);
+    ASSERT_EQ(r.status, SERVER_OK);
+    ASSERT_EQ(r.result, 12);
+    client_reply_free(&r);
+
+    pthread_join(th, NULL);
+    ASSERT_EQ(loop.status, SERVER_ERR_RUN);
+    client_reply_free(&loop);
+
+    ASSERT_EQ(client_request(fd, SERVER_OP_RUN, "int main() { return 5; }", &r), 0);
+    ASSERT_EQ(r.status, SERVER_OK);
+    ASSERT_EQ(r.result, 5);
+    client_reply_free(&r);
+
+    /* A run that was cut off has no result to report */
+    ASSERT_EQ(client_request(fd, SERVER_OP_RUN,
+                             "int main() { int x = 9; while (x > 1) { x = x * 1; } return x; }", &r), 0);
+    ASSERT_EQ(r.status, SERVER_ERR_RUN);
+    ASSERT_EQ(r.result, 0);
+    client_reply_free(&r);
+    close(fd);
+}
+
+TEST(test_server_bad_request) {
+    int fd = client_connect(sock_path);
+    ASSERT_TRUE(fd >= 0);
+    ServerReply r;
+    ASSERT_EQ(client_request(fd, 99, "int main() { return 1; }", &r), 0);
+    ASSERT_EQ(r.status, SERVER_ERR_REQUEST);
+    ASSERT_EQ(client_request(fd, SERVER_OP_COMPILE, "int main() { return 1; }", &r), 0);
+    ASSERT_EQ(r.status, SERVER_OK);
+    client_reply_free(&r);
+    close(fd);
+}
+
+/* ---- Concurrency ---- */
+
+#define CLIENT_THREADS 4
+#define CLIENT_ROUNDS  50
+
+static void *client_thread(void *arg) {
+    int id = (int)(long)arg;
+    int fd = client_connect(sock_path);
+    if (fd < 0) return (void *)1L;
+    long bad = 0;
+    for (int i = 0; i < CLIENT_ROUNDS; i++) {
+        char src[128];
+        snprintf(src, sizeof(src), "int main() { int a = %d; int b = %d; return a * 3 + b; }", id, i);
+        unsigned char local[256];
+        int len = bootstrap_compile(src, local, 256);
+        ServerReply r;
+        if (client_request(fd, i % 5 == 0 ? SERVER_OP_RUN : SERVER_OP_COMPILE, src, &r) < 0 ||
+            r.status != SERVER_OK || r.code_len != len ||
+            memcmp(r.code, local, (size_t)len) != 0 ||
+            (i % 5 == 0 && r.result != id * 3 + i)) {
+            bad++;
+        }
+        client_reply_free(&r);
+    }
+    close(fd);
+    return (void *)bad;
+}
+
+TEST(test_server_concurrent_clients) {
+    pthread_t th[CLIENT_THREADS];
+    for (long i = 0; i < CLIENT_THREADS; i++) {
+        pthread_create(&th[i], NULL, client_thread, (void *)i);
+    }
+    long bad = 0;
+    for (int i = 0; i < CLIENT_THREADS; i++) {
+        void *ret;
+        pthread_join(th[i], &ret);
+        bad += (long)ret;
+    }
+    ASSERT_EQ(bad, 0);
+}
+
+/* ---- Socket path ---- */
+
+TEST(test_server_open_refuses_non_socket) {
+    /* A mistyped --socket must not delete the file it names */
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_server_%d.txt", (int)getpid());
+    FILE *f = fopen(path, "w");
+    ASSERT_NOT_NULL(f);
+    fputs("keep me\n", f);
+    fclose(f);
+
+    Server other;
+    ASSERT_EQ(server_open(&other, path, 1), -1);
+    ASSERT_EQ(access(path, F_OK), 0);
+    unlink(path);
+}
+
+TEST(test_server_open_replaces_stale_socket) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_server_%d.stale", (int)getpid());
+    Server other;
+    ASSERT_EQ(server_open(&other, path, 1), 0);
+    close(other.listen_fd);
+    other.listen_fd = -1;
+    free(other.active);
+    pthread_mutex_destroy(&other.lock);
+
+    /* The socket file outlives its listener; a new server takes it over */
+    ASSERT_EQ(access(path, F_OK), 0);
+    ASSERT_EQ(server_open(&other, path, 1), 0);
+    server_close(&other);
+    ASSERT_EQ(access(path, F_OK), -1);
+}
+
+TEST(test_server_accept_error_stops) {
+    /* accept() failing on a worker stops the whole server, not just it */
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/test_server_%d.err", (int)getpid());
+    Server other;
+    ASSERT_EQ(server_open(&other, path, 2), 0);
+    int pipefd[2];
+    ASSERT_EQ(pipe(pipefd), 0);
+    close(other.listen_fd);
+    other.listen_fd = pipefd[0];   /* ENOTSOCK */
+    server_serve(&other);
+    ASSERT_EQ(atomic_load(&other.stopping), 1);
+    server_close(&other);
+    close(pipefd[1]);
+}
+
+/* ---- Shutdown ---- */
+
+TEST(test_server_shutdown) {
+    long before = atomic_load(&server.requests);
+    ASSERT_GT((int)before, CLIENT_THREADS * CLIENT_ROUNDS);
+
+    int fd = client_connect(sock_path);
+    ASSERT_TRUE(fd >= 0);
+    ServerReply r;
+    ASSERT_EQ(client_request(fd, SERVER_OP_SHUTDOWN, NULL, &r), 0);
+    ASSERT_EQ(r.status, SERVER_OK);
+    close(fd);
+
+    pthread_join(server_thread, NULL);
+    server_close(&server);
+    ASSERT_EQ(client_connect(sock_path), -1);
+}
+
+int main(void) {
+    TEST_SUITE_BEGIN("Compile Server");
+
+    snprintf(sock_path, sizeof(sock_path), "/tmp/test_server_%d.sock", (int)getpid());
+    if (server_open(&server, sock_path, 3) < 0) {
+        printf("cannot open server socket\n");
+        return 1;
+    }
+    pthread_create(&server_thread, NULL, serve_thread, NULL);
+
+    RUN_TEST(test_server_compile_matches_local);
+    RUN_TEST(test_server_run);
+    RUN_TEST(test_server_persistent_connection);
+    RUN_TEST(test_server_unexpected_char);
+    RUN_TEST(test_server_run_step_budget);
+    RUN_TEST(test_server_bad_request);
+    RUN_TEST(test_server_concurrent_clients);
+    RUN_TEST(test_server_open_refuses_non_socket);
+    RUN_TEST(test_server_open_replaces_stale_socket);
+    RUN_TEST(test_server_accept_error_stops);
+    RUN_TEST(test_server_shutdown);
+
+    TEST_SUITE_END();
+}
@@ -0,0 +1,1162 @@
+/*
+ * test_ssa.c - SSA mid-level IR tests
+ *
+ * Construction and analyses are checked on small functions; the
+ * lowering is checked by running every program compiled at -O0 and -O1
+ * on the VM and comparing results.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "../include/test_harness.h"
+#include "../include/ssa.h"
+#include "../include/postfix_ir.h"
+#include "../include/bootstrap.h"
+#include "../include/parser.h"
+#include "../include/vm.h"
+
+/* Build the first function of source */
+static int build(SsaFunc *f, const char *source) {
+    Expr *prog = parse_program(source);
+    if (prog == NULL || prog->param_count == 0) {
+        expr_free(prog);
+        ssa_init(f);
+        return -2;
+    }
+    int rc = ssa_build_expr(f, prog->params[0], 0, MAX_SYMBOLS);
+    expr_free(prog);
+    return rc;
+}
+
+static int count_op(const SsaFunc *f, SsaOp op) {
+    int n = 0;
+    for (int b = 0; b < f->block_count; b++) {
+        for (int i = 0; i < f->blocks[b].count; i++) {
+            n += f->instrs[f->blocks[b].code[i]].op == op;
+        }
+    }
+    return n;
+}
+
+static int compile_at(const char *source, int level, unsigned char *out, int max) {
+    BootstrapCtx bc;
+    bootstrap_ctx_init(&bc);
+    bc.cache = NULL;
+    bc.opt_level = level;
+    int len = bootstrap_compile_ctx(&bc, source, out, max);
+    bootstrap_ctx_free(&bc);
+    return len;
+}
+
+/* Run code on fresh memory with the "Result:" line discarded */
+static int run_quiet(unsigned char *code, int len) {
+    FILE *devnull = fopen("/dev/null", "w");
+    int saved = dup(fileno(stdout));
+    fflush(stdout);
+    if (devnull != NULL) dup2(fileno(devnull), fileno(stdout));
+    vm_memory_reset();
+    vm_run(code, (size_t)len);
+    fflush(stdout);
+    dup2(saved, fileno(stdout));
+    close(saved);
+    if (devnull != NULL) fclose(devnull);
+    return vm_get_result();
+}
+
+/* Every level gives the -O0 result; all must fit one-byte branch
+ * targets. Returns 1 if they agree, 0 if not, -1 if too large to run. */
+static int same_result(const char *source) {
+    unsigned char c0[MAX_BYTECODE], c[MAX_BYTECODE];
+    int n0 = compile_at(source, 0, c0, MAX_BYTECODE);
+    if (n0 < 0) return 0;
+    if (n0 > 255) return -1;
+    int r0 = run_quiet(c0, n0);
+    for (int level = 1; level <= 2; level++) {
+        int n = compile_at(source, level, c, MAX_BYTECODE);
+        if (n < 0) return 0;
+        if (n > 255) return -1;
+        int r = run_quiet(c, n);
+        if (r != r0) {
+            printf("    -O0 %d, -O%d %d:\n%s\n", r0, level, r, source);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Result and executed instruction count of source at level */
+static int run_at(const char *source, int level, long *steps) {
+    unsigned char code[MAX_BYTECODE];
+    int n = compile_at(source, level, code, MAX_BYTECODE);
+    if (n < 0 || n > 255) return -99999;
+    int r = run_quiet(code, n);
+    *steps = vm_get_steps();
+    return r;
+}
+
+TEST(test_ssa_straight_line) {
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int main() { int a = 1 + 2; int b = a * 3; return b - a; }"), 0);
+    ASSERT_EQ(f.block_count, 1);
+    ASSERT_EQ(f.var_count, 2);
+    ASSERT_EQ(f.slot_end, 2);
+    ASSERT_EQ(count_op(&f, SSA_PHI), 0);
+    ASSERT_EQ(count_op(&f, SSA_OUT), 1);
+    ASSERT_EQ(count_op(&f, SSA_LOAD), 0);   /* Both promoted */
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ssa_free(&f);
+}
+
+TEST(test_ssa_if_phi) {
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int main() { int x = 1; int y = 5; "
+                        "if (y > 3) { x = 2; } else { x = 3; y = 0; } return x + y; }"), 0);
+    /* entry, then, join, else */
+    ASSERT_EQ(f.block_count, 4);
+    ASSERT_EQ(count_op(&f, SSA_PHI), 2);
+    /* The join's phis have one operand per predecessor */
+    int join = -1;
+    for (int b = 0; b < f.block_count; b++) {
+        if (f.blocks[b].npreds == 2) join = b;
+    }
+    ASSERT_TRUE(join >= 0);
+    ASSERT_EQ(f.instrs[f.blocks[join].code[0]].op, SSA_PHI);
+    ASSERT_EQ(f.instrs[f.blocks[join].code[0]].nargs, 2);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ssa_free(&f);
+
+    /* Only one branch assigns: still one phi for x */
+    ASSERT_EQ(build(&f, "int main() { int x = 1; if (x == 1) { x = 7; } return x; }"), 0);
+    ASSERT_EQ(count_op(&f, SSA_PHI), 1);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ssa_free(&f);
+}
+
+TEST(test_ssa_loop_phi_and_dominators) {
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int main() { int i = 0; int s = 0; int k = 4; "
+                        "while (i < 10) { s = s + i * k; i = i + 1; } return s; }"), 0);
+    /* i and s change in the loop; k does not and needs no phi */
+    ASSERT_EQ(count_op(&f, SSA_PHI), 2);
+    ASSERT_EQ(ssa_verify(&f), 0);
+
+    /* entry -> header -> body | exit; body -> header */
+    int header = f.blocks[0].succs[0];
+    ASSERT_EQ(f.blocks[header].npreds, 2);
+    int body = f.blocks[header].succs[0], exit_b = f.blocks[header].succs[1];
+    ASSERT_EQ(f.blocks[body].idom, header);
+    ASSERT_EQ(f.blocks[exit_b].idom, header);
+    ASSERT_EQ(f.blocks[header].idom, 0);
+    ASSERT_TRUE(ssa_dominates(&f, header, body));
+    ASSERT_TRUE(!ssa_dominates(&f, body, exit_b));
+    ASSERT_EQ(f.rpo[0], 0);
+    ASSERT_EQ(f.rpo_count, f.block_count);
+    ssa_free(&f);
+}
+
+TEST(test_ssa_def_use) {
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int main() { int i = 0; while (i < 3) { i = i + 1; } return i; }"), 0);
+    ssa_build_uses(&f);
+    int phi = -1;
+    for (int v = 0; v < f.count; v++) {
+        if (f.instrs[v].op == SSA_PHI) phi = v;
+    }
+    ASSERT_TRUE(phi >= 0);
+    /* i's phi feeds the compare, the increment and the return */
+    ASSERT_EQ(ssa_use_count(&f, phi), 3);
+    for (int u = f.use_start[phi]; u < f.use_start[phi + 1]; u++) {
+        const SsaInstr *in = &f.instrs[f.uses[u]];
+        ASSERT_TRUE(in->a == phi || in->b == phi);
+    }
+
+    /* The increment flows back into the phi */
+    int inc = f.instrs[phi].args[1];
+    ASSERT_EQ(f.instrs[inc].op, SSA_ADD);
+    ASSERT_EQ(ssa_use_count(&f, inc), 1);
+    ASSERT_EQ(f.uses[f.use_start[inc]], phi);
+
+    /* Replacing uses rewrites operands everywhere */
+    int zero = ssa_const(&f, 0);
+    ssa_replace_uses(&f, inc, zero);
+    ssa_build_uses(&f);
+    ASSERT_EQ(ssa_use_count(&f, inc), 0);
+    ASSERT_EQ(f.instrs[phi].args[1], zero);
+    ssa_free(&f);
+}
+
+TEST(test_ssa_critical_edges) {
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int main() { int x = 1; if (x == 1) { x = 2; } return x; }"), 0);
+    int blocks = f.block_count;
+    /* entry -> join is critical: entry branches, join merges */
+    ASSERT_EQ(ssa_split_critical_edges(&f), 1);
+    ASSERT_EQ(f.block_count, blocks + 1);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ASSERT_EQ(ssa_split_critical_edges(&f), 0);
+    ssa_free(&f);
+}
+
+TEST(test_ssa_memory_vars) {
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int main() { int a[3] = {4, 5, 6}; int x = 2; int y = 3; int p = &x; "
+                        "a[1] = x; x = *p + a[2]; return x + y; }"), 0);
+    ASSERT_EQ(f.var_count, 4);
+    ASSERT_EQ(f.vars[0].slot, 0);
+    ASSERT_EQ(f.vars[0].size, 3);
+    ASSERT_EQ(f.vars[0].in_memory, 1);
+    ASSERT_EQ(f.vars[1].slot, 3);
+    ASSERT_EQ(f.vars[1].in_memory, 1);   /* Address taken */
+    ASSERT_EQ(f.vars[2].in_memory, 0);
+    ASSERT_EQ(f.slot_end, 6);
+    /* Three initializers, a[1] = x and two stores of x */
+    ASSERT_EQ(count_op(&f, SSA_STORE), 6);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ssa_free(&f);
+}
+
+TEST(test_ssa_unsupported) {
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int main() { return f(1); }"), -1);
+    ssa_free(&f);
+    ASSERT_EQ(build(&f, "int main() { int a = 7; int b = g(a); return b; }"), -1);
+    ssa_free(&f);
+
+    /* Such functions are emitted directly at -O1: identical bytes. (g's
+     * statements cannot be inlined into a loop condition.) */
+    const char *src = "int g() { int x = 1; int y = x + 2; return y; } "
+                      "int main() { int a = 2; while (a < g()) { a = a + 1; } return a; }";
+    unsigned char c0[256], c1[256];
+    int n0 = compile_at(src, 0, c0, sizeof(c0));
+    int n1 = compile_at(src, 1, c1, sizeof(c1));
+    ASSERT_GT(n1, 0);
+    ASSERT_TRUE(n0 != n1 || memcmp(c0, c1, (size_t)n0) != 0);   /* g goes through SSA */
+    ASSERT_EQ(memcmp(c0 + n0 - 12, c1 + n1 - 12, 12), 0);       /* main does not */
+}
+
+/* The value f returns: the operand of its only OUT */
+static int out_operand(const SsaFunc *f) {
+    for (int b = 0; b < f->block_count; b++) {
+        for (int i = 0; i < f->blocks[b].count; i++) {
+            const SsaInstr *in = &f->instrs[f->blocks[b].code[i]];
+            if (in->op == SSA_OUT) return in->a;
+        }
+    }
+    return -1;
+}
+
+TEST(test_ssa_sccp_folds_variables) {
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int main() { int a = 3; int b = a + 4; int c = b * b - a; return c; }"), 0);
+    ASSERT_GT(ssa_sccp(&f), 0);
+    int v = out_operand(&f);
+    ASSERT_EQ(f.instrs[v].op, SSA_CONST);
+    ASSERT_EQ(f.instrs[v].imm, 46);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ssa_free(&f);
+
+    /* Comparisons fold as the VM computes them */
+    ASSERT_EQ(build(&f, "int main() { int a = 9; int b = 2; return a < b; }"), 0);
+    ssa_sccp(&f);
+    ASSERT_EQ(f.instrs[out_operand(&f)].imm, -1);
+    ssa_free(&f);
+}
+
+TEST(test_ssa_sccp_dead_branches) {
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int main() { int x = 4; if (0) { x = 7; } else { x = x + 1; } return x; }"), 0);
+    ASSERT_EQ(f.block_count, 4);
+    ssa_sccp(&f);
+    ASSERT_EQ(count_op(&f, SSA_BR), 0);
+    ASSERT_EQ(count_op(&f, SSA_PHI), 0);
+    ASSERT_EQ(f.instrs[out_operand(&f)].imm, 5);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ASSERT_EQ(ssa_merge_blocks(&f), 2);
+    ASSERT_EQ(f.block_count, 1);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ssa_free(&f);
+
+    /* Only conditional propagation sees that x never leaves 1 */
+    ASSERT_EQ(build(&f, "int main() { int x = 1; int i = 0; while (i < 3) { "
+                        "if (x == 1) { x = 1; } else { x = 2; } i = i + 1; } return x; }"), 0);
+    ssa_sccp(&f);
+    ASSERT_EQ(f.instrs[out_operand(&f)].op, SSA_CONST);
+    ASSERT_EQ(f.instrs[out_operand(&f)].imm, 1);
+    ASSERT_EQ(count_op(&f, SSA_BR), 1);     /* The loop test stays */
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ssa_free(&f);
+}
+
+TEST(test_ssa_dce) {
+    SsaFunc f;
+    /* a[0] = 1 and a[0] = 5 are overwritten before any load */
+    ASSERT_EQ(build(&f, "int main() { int a[2] = {1, 2}; a[0] = 5; a[0] = 6; int b = a[1] * 2; "
+                        "int c = a[0]; a[1] = c; return a[0]; }"), 0);
+    ASSERT_EQ(count_op(&f, SSA_STORE), 5);
+    ssa_sccp(&f);
+    ASSERT_GT(ssa_dce(&f), 2);
+    ASSERT_EQ(count_op(&f, SSA_STORE), 3);
+    ASSERT_EQ(count_op(&f, SSA_LOAD), 2);   /* b's load is unused */
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ssa_free(&f);
+
+    /* A load in between keeps the first store */
+    ASSERT_EQ(build(&f, "int main() { int a[1] = {1}; int b = a[0]; a[0] = b + 1; return a[0]; }"), 0);
+    ssa_optimize(&f, 1);
+    ASSERT_EQ(count_op(&f, SSA_STORE), 2);
+    ssa_free(&f);
+
+    ASSERT_EQ(build(&f, "int main() { int a = 1; return a; }"), 0);
+    ASSERT_EQ(ssa_optimize(&f, 0), 0);
+    ssa_free(&f);
+}
+
+TEST(test_ssa_optimized_code_is_smaller) {
+    const char *src = "int main() { int a = 3; int b = a + 4; if (b == 0) { b = 9; } "
+                      "int i = 0; while (i < b) { i = i + 1; } return i; }";
+    unsigned char c0[256], c1[256];
+    int n0 = compile_at(src, 0, c0, sizeof(c0));
+    int n1 = compile_at(src, 1, c1, sizeof(c1));
+    ASSERT_GT(n1, 0);
+    ASSERT_TRUE(n1 < n0);
+    ASSERT_EQ(run_quiet(c1, n1), 7);
+    ASSERT_EQ(same_result(src), 1);
+}
+
+/* Block holding the first instruction with op, or -1 */
+static int block_of(const SsaFunc *f, SsaOp op) {
+    for (int b = 0; b < f->block_count; b++) {
+        for (int i = 0; i < f->blocks[b].count; i++) {
+            if (f->instrs[f->blocks[b].code[i]].op == op) return b;
+        }
+    }
+    return -1;
+}
+
+TEST(test_ssa_licm) {
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int main() { int a[2] = {3, 4}; int x = a[0]; int y = a[1]; int s = 0; int i = 0; "
+                        "while (i < 5) { s = s + x * y; i = i + 1; } return s; }"), 0);
+    ssa_optimize(&f, 1);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ASSERT_EQ(block_of(&f, SSA_MUL), 0);     /* In the preheader */
+    ssa_free(&f);
+
+    /* Loads hoist only out of loops that store nothing */
+    ASSERT_EQ(build(&f, "int main() { int a[2] = {3, 4}; int s = 0; int i = 0; "
+                        "while (i < 5) { s = s + a[1]; i = i + 1; } return s; }"), 0);
+    ssa_sccp(&f);
+    ssa_merge_blocks(&f);
+    ASSERT_EQ(ssa_licm(&f), 1);
+    ASSERT_EQ(block_of(&f, SSA_LOAD), 0);
+    ssa_free(&f);
+    ASSERT_EQ(build(&f, "int main() { int a[2] = {3, 4}; int s = 0; int i = 0; "
+                        "while (i < 5) { s = s + a[1]; a[0] = s; i = i + 1; } return s; }"), 0);
+    ssa_sccp(&f);
+    ssa_merge_blocks(&f);
+    ASSERT_EQ(ssa_licm(&f), 0);
+    ssa_free(&f);
+
+    long s0, s1;
+    const char *src = "int main() { int a[2] = {3, 4}; int x = a[0]; int y = a[1]; int s = 0; int i = 0; "
+                      "while (i < 9) { s = s + x * y + a[1]; i = i + 1; } return s; }";
+    ASSERT_EQ(run_at(src, 0, &s0), 144);
+    ASSERT_EQ(run_at(src, 1, &s1), 144);
+    ASSERT_TRUE(s1 < s0);
+}
+
+TEST(test_ssa_strength_reduction) {
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int main() { int s = 0; int i = 2; "
+                        "while (i < 10) { s = s + i * 3; i = i + 2; } return s; }"), 0);
+    ssa_optimize(&f, 2);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    /* i * 3 became j = 6, 12, ...: no multiply left at all */
+    ASSERT_EQ(count_op(&f, SSA_MUL), 0);
+    ASSERT_EQ(count_op(&f, SSA_PHI), 3);
+    ssa_free(&f);
+
+    /* Level 1 leaves it alone; a variable stride is hoisted */
+    ASSERT_EQ(build(&f, "int main() { int s = 0; int i = 2; "
+                        "while (i < 10) { s = s + i * 3; i = i + 2; } return s; }"), 0);
+    ssa_optimize(&f, 1);
+    ASSERT_EQ(count_op(&f, SSA_MUL), 1);
+    ssa_free(&f);
+    ASSERT_EQ(build(&f, "int main() { int a[1] = {5}; int k = a[0]; int s = 0; int i = 0; "
+                        "while (i < 4) { s = s + k * i; i = i + 1; } return s; }"), 0);
+    ASSERT_EQ(ssa_optimize(&f, 2) > 0, 1);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ASSERT_EQ(block_of(&f, SSA_MUL), 0);
+    ssa_free(&f);
+
+    /* Subtracting counters, and every level agrees */
+    ASSERT_EQ(same_result("int main() { int s = 0; int i = 9; "
+                          "while (i > 0) { s = s + i * 5 - i * 2; i = i - 3; } return s; }"), 1);
+    ASSERT_EQ(same_result("int main() { int a[1] = {5}; int k = a[0]; int s = 0; int i = 0; "
+                          "while (i < 4) { s = s + k * i; i = i + 1; } return s; }"), 1);
+}
+
+TEST(test_ssa_loop_kernel) {
+    /* Nested loops over an array: -O0 cannot run these (see above), so
+     * the levels are checked against each other and a C model */
+    const char *src =
+        "int main() { int a[6] = {1, 2, 3, 4, 5, 6}; int n = a[5]; int s = 0; int r = 0; "
+        "while (r < 3) { int c = 0; while (c < 2) { s = s + a[r * 2 + c] * n + r * 4; c = c + 1; } "
+        "r = r + 1; } return s; }";
+    int model = 0;
+    int a[6] = {1, 2, 3, 4, 5, 6};
+    for (int r = 0; r < 3; r++) {
+        for (int c = 0; c < 2; c++) model += a[r * 2 + c] * 6 + r * 4;
+    }
+    long steps;
+    ASSERT_EQ(run_at(src, 1, &steps), model);
+    ASSERT_EQ(run_at(src, 2, &steps), model);
+
+    /* r * 2 and r * 4 are stepped by addition: only a[...] * n is left */
+    SsaFunc f;
+    ASSERT_EQ(build(&f, src), 0);
+    ASSERT_EQ(count_op(&f, SSA_MUL), 3);
+    ssa_optimize(&f, 2);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ASSERT_EQ(count_op(&f, SSA_MUL), 1);
+    ssa_free(&f);
+}
+
+TEST(test_ssa_inlined_calls) {
+    /* At -O1 step is inlined into the loop, so main takes the SSA path
+     * and computes what the hand-inlined loop does at -O0 */
+    const char *src =
+        "int step(int v, int k) { int t = v * k; return t + 1; } "
+        "int main() { int s = 0; int i = 0; while (i < 10) { s = s + step(i, 3); i = i + 1; } "
+        "return s; }";
+    const char *by_hand =
+        "int main() { int s = 0; int i = 0; while (i < 10) { int t = i * 3; s = s + t + 1; i = i + 1; } "
+        "return s; }";
+    long steps;
+    ASSERT_EQ(run_at(by_hand, 0, &steps), 145);
+    ASSERT_EQ(run_at(src, 1, &steps), 145);
+    ASSERT_EQ(run_at(src, 2, &steps), 145);
+}
+
+TEST(test_ssa_common_subexprs) {
+    /* Values cse_exprs() computes once at -O1, and one it must not */
+    static const struct { const char *src; int expect; } cases[] = {
+        { "int main() { int a = 3; int b = 4; int c = 5; int x = a * b + c; "
+          "int y = c + b * a; return x * 2 + y; }", 51 },
+        { "int main() { int g[9] = {0}; int r = 0; int s = 0; while (r < 4) { "
+          "g[r * 2 + 1] = r; s = s + g[r * 2 + 1] * g[r * 2 + 1] + r * 2 + 1; "
+          "r = r + 1; } return s; }", 30 },
+        { "int sq(int x) { return x * x; } "
+          "int main() { int a = 2; int b = 5; return sq(a + b) + sq(a + b) + sq(a + b); }", 147 },
+        { "int main() { int x = 7; int y = 2; int k = 0; int d = 0; while (k < 6) { "
+          "d = d + k * x * y + k * x * y + k * x * y + k; k = k + 1; } return d; }", 645 },
+        /* x = 2 changes *p */
+        { "int main() { int x = 5; int p = &x; int a = *p * 3 + 1; x = 2; "
+          "int b = *p * 3 + 1; return a * 10 + b; }", 167 },
+    };
+    for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+        long steps;
+        ASSERT_EQ(run_at(cases[i].src, 0, &steps), cases[i].expect);
+        ASSERT_EQ(run_at(cases[i].src, 1, &steps), cases[i].expect);
+        ASSERT_EQ(same_result(cases[i].src), 1);
+    }
+}
+
+TEST(test_ssa_wide_constants) {
+    /* Constants past the one-byte PUSH operand, literal or folded by
+     * inline_calls() and SCCP, keep their value at every level */
+    static const struct { const char *src; int expect; } cases[] = {
+        { "int main() { return 127; }", 127 },
+        { "int main() { return 128; }", 128 },
+        { "int main() { return 0 - 128; }", -128 },
+        { "int main() { return 0 - 129; }", -129 },
+        { "int main() { int x = 300; return x + 1; }", 301 },
+        { "int main() { int x = 2; return x * 150; }", 300 },
+        { "int main() { int x = 0 - 5000; return x - 1; }", -5001 },
+        { "int k() { return 100; } int main() { return k() + 100; }", 200 },
+        { "int k() { return 0 - 100; } int main() { return k() - 29; }", -129 },
+        { "int f0(int a, int b) { return 56; } "
+          "int main() { int v3 = 2; return f0(v3, v3) * 9 * v3; }", 1008 },
+    };
+    for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+        long steps;
+        ASSERT_EQ(run_at(cases[i].src, 0, &steps), cases[i].expect);
+        ASSERT_EQ(run_at(cases[i].src, 1, &steps), cases[i].expect);
+        ASSERT_EQ(same_result(cases[i].src), 1);
+    }
+}
+
+TEST(test_ssa_folded_compares) {
+    /* < and > give 1, -1 or 0 on the VM; cast_optimize() must fold them
+     * the same way once inline_calls() has made their operands constant */
+    static const struct { const char *src; int expect; } cases[] = {
+        { "int f0(int x) { return 2 < x * x > x; } int main() { return f0(7); }", -1 },
+        { "int lt(int a, int b) { return a < b; } int main() { return lt(5, 3) * 10 + lt(3, 3); }", -10 },
+        { "int gt(int a, int b) { return a > b; } int main() { return gt(2, 9) * 10 + gt(9, 2); }", -9 },
+        { "int main() { return 4 > 6; }", -1 },
+    };
+    for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+        long steps;
+        ASSERT_EQ(run_at(cases[i].src, 0, &steps), cases[i].expect);
+        ASSERT_EQ(run_at(cases[i].src, 1, &steps), cases[i].expect);
+        ASSERT_EQ(same_result(cases[i].src), 1);
+    }
+}
+
+TEST(test_ssa_inline_size_budget) {
+    /* Ten small calls that fit at -O0: inlining every one would push the
+     * image past the 1-byte jump targets, so -O1 stops short of that */
+    const char *src =
+        "int a(int x) { return x * 3 + 1; } int b(int x) { return x * 5 + 2; } "
+        "int c(int x) { return x * 7 + 3; } int d(int x) { return x - 4; } "
+        "int e(int x) { return x * 2 - 1; } "
+        "int main() { int s = 0; int i = 0; while (i < 3) { "
+        "s = s + a(i) + b(i) + c(i) + d(i) + e(i) + a(s) + b(s) + c(s) + d(s) + e(s); "
+        "i = i + 1; } return s; }";
+    unsigned char code[MAX_BYTECODE];
+    int n0 = compile_at(src, 0, code, MAX_BYTECODE);
+    int n1 = compile_at(src, 1, code, MAX_BYTECODE);
+    ASSERT_GT(n0, 0);
+    ASSERT_TRUE(n0 <= 255);
+    ASSERT_GT(n1, 0);
+    ASSERT_TRUE(n1 <= 255);
+    long steps;
+    ASSERT_EQ(run_at(src, 0, &steps), 1140);
+    ASSERT_EQ(run_at(src, 1, &steps), 1140);
+    ASSERT_EQ(same_result(src), 1);
+}
+
+/* Instructions op in code, stepping over operand bytes */
+static int count_vm_op(const unsigned char *code, int len, int op) {
+    int n = 0;
+    for (int pc = 0; pc < len; pc++) {
+        n += code[pc] == op;
+        switch (code[pc]) {
+            case OP_PUSH: case OP_JMP: case OP_COND_JMP: case OP_BRZ: case OP_BRN:
+            case OP_BRP: case OP_CALL: case OP_PUSH_TRYTE: case OP_TSHL: case OP_TSHR:
+                pc++;
+                break;
+            case OP_PUSH_WORD:
+                pc += 2;
+                break;
+        }
+    }
+    return n;
+}
+
+TEST(test_ssa_trit_shifts) {
+    /* Multiplies by 3^k are trit shifts at every level */
+    static const struct { const char *src; int expect; } cases[] = {
+        { "int main() { int x = 5; return x * 9; }", 45 },
+        { "int main() { int x = 0 - 4; return 27 * x; }", -108 },
+        { "int main() { int x = 0 - 2; return x * 243 + 729 * x; }", -1944 },
+        { "int main() { int x = 0 - 2; int y = x * 81; return y - 3 * x * 27 + x; }", -2 },
+        { "int main() { int s = 0; int i = 0 - 5; while (i < 6) { s = s + i * 3 + 81 * i; i = i + 1; } "
+          "return s; }", 0 },
+        { "int main() { int g[9] = {0}; int r = 0; while (r < 3) { g[r * 3] = r + 1; r = r + 1; } "
+          "return g[0] + g[3] * 10 + g[6] * 100; }", 321 },
+    };
+    for (int i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++) {
+        long steps;
+        ASSERT_EQ(run_at(cases[i].src, 0, &steps), cases[i].expect);
+        ASSERT_EQ(run_at(cases[i].src, 1, &steps), cases[i].expect);
+        ASSERT_EQ(same_result(cases[i].src), 1);
+    }
+
+    unsigned char code[MAX_BYTECODE];
+    for (int level = 0; level <= 1; level++) {
+        int n = compile_at("int main() { int s = 0; int i = 0; while (i < 4) { "
+                           "s = s + i * 9 + 3 * i * 3; i = i + 1; } return s; }",
+                           level, code, MAX_BYTECODE);
+        ASSERT_GT(n, 0);
+        ASSERT_EQ(count_vm_op(code, n, OP_MUL), 0);
+        ASSERT_EQ(count_vm_op(code, n, OP_TSHL), 3);
+        ASSERT_EQ(run_quiet(code, n), 108);
+    }
+}
+
+TEST(test_ssa_params_and_returns) {
+    /* SSA functions take their arguments from the parameter slots and
+     * return from anywhere; too big to inline, called from a recursive
+     * (direct) function */
+    const char *src =
+        "int clamp(int v, int hi) { int i = 0; while (i < v) { if (i == hi) { return hi; } i = i + 1; } "
+        "return v * 2; } "
+        "int walk(int n) { if (n == 0) { return 0; } return clamp(n, 3) + walk(n - 1); } "
+        "int main() { return walk(5); }";
+    long steps;
+    ASSERT_EQ(run_at(src, 0, &steps), 18);
+    ASSERT_EQ(run_at(src, 1, &steps), 18);
+    ASSERT_EQ(run_at(src, 2, &steps), 18);
+    SsaFunc f;
+    ASSERT_EQ(build(&f, "int f(int a, int b) { if (a < b) { return b; } return a; }"), 0);
+    ASSERT_EQ(count_op(&f, SSA_LOAD), 2);
+    ASSERT_EQ(count_op(&f, SSA_EXIT), 2);
+    ASSERT_EQ(ssa_verify(&f), 0);
+    ssa_free(&f);
+}
+
+TEST(test_ssa_lower_matches_direct) {
+    static const char *corpus[] = {
+        "int main() { int a = 1 + 2; int b = a * 3; return b; }",
+        "int main() { int i = 0; int s = 0; while (i < 10) { s = s + i; i = i + 1; } return s; }",
+        "int main() { int s = 0; for (int i = 0; i < 5; i = i + 1) { s = s + i * i; } return s; }",
+        "int main() { int x = 3; int y = 0; if (x > 2) { y = 10; } else { y = 20; } return y + x; }",
+        "int main() { int x = 3; if (x < 2) { x = 9; } return x; }",
+        "int main() { int a[4] = {1, 2, 3, 4}; int s = 0; int i = 0; "
+        "while (i < 4) { s = s + a[i]; a[i] = s; i = i + 1; } return a[3] + s; }",
+        "int main() { int x = 5; int p = &x; x = 7; return *p; }",
+        /* Loop-carried swap: parallel phi copies */
+        "int main() { int a = 1; int b = 2; int i = 0; "
+        "while (i < 5) { int t = a; a = b; b = t; i = i + 1; } return a * 10 + b; }",
+        /* Fibonacci with rotation through three variables */
+        "int main() { int a = 0; int b = 1; int n = 0; "
+        "while (n < 10) { int c = a + b; a = b; b = c; n = n + 1; } return a; }",
+        /* Consecutive loops and a conditional update (-O0 loops
+         * cannot nest: LOOP_BEGIN leaves its address on the return stack) */
+        "int main() { int s = 0; int i = 0; while (i < 4) { "
+        "if (i == 2) { s = s + 100; } else { s = s + i; } i = i + 1; } "
+        "int j = 0; while (j < s) { j = j + 30; } return s + j; }",
+        /* Variable read before its declaration executes in a loop */
+        "int main() { int i = 0; int last = 0; while (i < 3) { int k = i * 2; last = k; i = i + 1; } "
+        "return last; }",
+        /* Several functions share the slot space */
+        "int f() { int a = 4; return a; } int main() { int b = 6; int c = b * 2; return c; }",
+        "int main(int n) { int x = 2; x = x + n; return x; }",
+    };
+    for (int i = 0; i < (int)(sizeof(corpus) / sizeof(corpus[0])); i++) {
+        ASSERT_EQ(same_result(corpus[i]), 1);
+    }
+}
+
+/* ---- Random structured programs ---- */
+
+static char prog[4096];
+static size_t plen;
+static int loop_id;
+static int cur_loop;
+
+static void put(const char *fmt, int a, int b) {
+    plen += (size_t)snprintf(prog + plen, sizeof(prog) - plen, fmt, a, b);
+}
+
+static void gen_expr(int depth) {
+    int r = rand() % (depth > 0 ? 6 : 3);
+    if (r == 0) put("%d", rand() % 9, 0);
+    else if (r == 1 && cur_loop >= 0 && rand() % 2) put("i%d", cur_loop, 0);
+    else if (r == 1) put("v%d", rand() % 4, 0);
+    else if (r == 2) put("a[%d]", rand() % 3, 0);
+    else {
+        static const char *ops[] = {" + ", " - ", " * "};
+        gen_expr(depth - 1);
+        put(ops[r - 3], 0, 0);
+        if (r == 5) put("%d", rand() % 3, 0);
+        else gen_expr(depth - 1);
+    }
+}
+
+static void gen_cond(void) {
+    static const char *cmps[] = {" < ", " > ", " == "};
+    gen_expr(1);
+    put(cmps[rand() % 3], 0, 0);
+    gen_expr(1);
+}
+
+static void gen_stmts(int depth, int count, int in_loop) {
+    for (int k = 0; k < count; k++) {
+        int r = rand() % (depth > 0 ? 6 - in_loop : 3);
+        if (r <= 1) {
+            put("v%d = ", rand() % 4, 0);
+            gen_expr(1);
+            put("; ", 0, 0);
+        } else if (r == 2) {
+            put("a[%d] = ", rand() % 3, 0);
+            gen_expr(1);
+            put("; ", 0, 0);
+        } else if (r <= 4) {
+            put("if (", 0, 0);
+            gen_cond();
+            put(") { ", 0, 0);
+            gen_stmts(depth - 1, 1 + rand() % 2, in_loop);
+            if (rand() % 2) {
+                put("} else { ", 0, 0);
+                gen_stmts(depth - 1, 1, in_loop);
+            }
+            put("} ", 0, 0);
+        } else {
+            int id = loop_id++;
+            put("int i%d = 0; while (i%d < ", id, id);
+            put("%d) { ", 1 + rand() % 3, 0);
+            cur_loop = id;
+            gen_stmts(depth - 1, 1 + rand() % 2, 1);
+            cur_loop = -1;
+            put("i%d = i%d + 1; } ", id, id);
+        }
+    }
+}
+
+TEST(test_ssa_random_programs_match) {
+    srand(47);
+    int ran = 0;
+    for (int n = 0; n < 400; n++) {
+        plen = 0;
+        loop_id = 0;
+        cur_loop = -1;
+        put("int main() { int a[3] = {1, 2, 3}; int v0 = %d; int v1 = %d; ", rand() % 5, rand() % 5);
+        put("int v2 = 0; int v3 = %d; ", rand() % 3, 0);
+        if (rand() % 4 == 0) put("int p = &v%d; ", rand() % 4, 0);
+        gen_stmts(2, 2 + rand() % 2, 0);
+        put("return v0 + v1 * 3 + v2 * 5 + v3 * 7 + a[0] + a[1] * 2 + a[2] * 4; }", 0, 0);
+
+        SsaFunc f;
+        if (build(&f, prog) == 0) {
+            ASSERT_EQ(ssa_verify(&f), 0);
+            ssa_optimize(&f, 1);
+            ASSERT_EQ(ssa_verify(&f), 0);
+        }
+        ssa_free(&f);
+        int r = same_result(prog);
+        ASSERT_TRUE(r != 0);
+        ran += r > 0;
+    }
+    /* Most programs fit the one-byte branch range, slot saves included */
+    ASSERT_GT(ran, 200);
+}
+
+TEST(test_ssa_slots_match_direct) {
+    /* Unit compiles hand out the same slots at either level */
+    const char *src = "int f() { int a[5] = {1}; int b = 2; int c = &b; "
+                      "while (b < 9) { b = b + 1; } return b; }";
+    for (int level = 0; level <= 1; level++) {
+        BootstrapCtx bc;
+        bootstrap_ctx_init(&bc);
+        bc.opt_level = level;
+        ObjectModule obj;
+        int end = -1;
+        ASSERT_GT(bootstrap_compile_unit(&bc, src, 10, &obj, &end), 0);
+        ASSERT_EQ(end, 17);
+        object_free(&obj);
+        bootstrap_ctx_free(&bc);
+    }
+}
+
+TEST(test_pf_lower) {
+    PostfixSeq seq;
+    pf_init(&seq);
+    int skip = pf_alloc_label(&seq);
+    pf_emit(&seq, PF_ADDR_OF, 70, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 1000, NULL);
+    pf_emit(&seq, PF_STORE, 0, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 0, NULL);
+    pf_emit(&seq, PF_BRZ, skip, NULL);
+    pf_emit(&seq, PF_ADDR_OF, 70, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 1, NULL);
+    pf_emit(&seq, PF_STORE, 0, NULL);
+    pf_emit(&seq, PF_LABEL, skip, NULL);
+    pf_emit(&seq, PF_PUSH_VAR, 70, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, -300, NULL);
+    pf_emit(&seq, PF_ADD, 0, NULL);
+    pf_emit(&seq, PF_HALT, 0, NULL);
+
+    ObjectModule obj;
+    object_init(&obj);
+    int len = pf_lower(&seq, &obj);
+    ASSERT_GT(len, 0);
+    ASSERT_EQ(obj.reloc_count, 1);
+    ASSERT_EQ(run_quiet(obj.code, obj.code_len), 700);
+
+    /* Nor can a branch to a label that is not placed */
+    PostfixSeq dangling;
+    pf_init(&dangling);
+    pf_emit(&dangling, PF_JMP, pf_alloc_label(&dangling), NULL);
+    ObjectModule none;
+    object_init(&none);
+    ASSERT_EQ(pf_lower(&dangling, &none), -1);
+    object_free(&none);
+    pf_free(&dangling);
+
+    /* Unresolved names cannot be lowered */
+    pf_emit(&seq, PF_PUSH_VAR, 0, "x");
+    ObjectModule bad;
+    object_init(&bad);
+    ASSERT_EQ(pf_lower(&seq, &bad), -1);
+    object_free(&bad);
+    object_free(&obj);
+    pf_free(&seq);
+}
+
+TEST(test_pf_relax) {
+    PostfixSeq seq;
+    pf_init(&seq);
+    int l1 = pf_alloc_label(&seq), l2 = pf_alloc_label(&seq), l3 = pf_alloc_label(&seq);
+    pf_emit(&seq, PF_PUSH_CONST, 5, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 0, NULL);
+    pf_emit(&seq, PF_BRZ, l1, NULL);        /* Threaded through l1 to l2 */
+    pf_emit(&seq, PF_PUSH_CONST, 9, NULL);
+    pf_emit(&seq, PF_ADD, 0, NULL);
+    pf_emit(&seq, PF_LABEL, l1, NULL);
+    pf_emit(&seq, PF_JMP, l2, NULL);        /* To the next code: elided */
+    pf_emit(&seq, PF_NOP, 0, NULL);
+    pf_emit(&seq, PF_LABEL, l2, NULL);
+    pf_emit(&seq, PF_JMP, l3, NULL);        /* Likewise */
+    pf_emit(&seq, PF_LABEL, l3, NULL);
+    pf_emit(&seq, PF_HALT, 0, NULL);
+
+    ObjectModule obj;
+    object_init(&obj);
+    PfPcMap map;
+    ASSERT_EQ(pf_lower_map(&seq, &obj, &map), 10);
+    ASSERT_EQ(obj.reloc_count, 1);
+    ASSERT_EQ(obj.code[4], OP_BRZ);
+    ASSERT_EQ(obj.code[5], 9);
+    ASSERT_EQ(run_quiet(obj.code, obj.code_len), 5);
+
+    /* The map takes offsets back to instructions */
+    ASSERT_EQ(map.count, seq.count);
+    ASSERT_EQ(map.pc[map.count], 10);
+    ASSERT_EQ(map.pc[3], 6);
+    ASSERT_EQ(pf_pc_map_find(&map, 0), 0);
+    ASSERT_EQ(pf_pc_map_find(&map, 5), 2);
+    ASSERT_EQ(pf_pc_map_find(&map, 8), 4);
+    ASSERT_EQ(pf_pc_map_find(&map, 9), 11);
+    ASSERT_EQ(pf_pc_map_find(&map, 10), -1);
+    pf_pc_map_free(&map);
+    object_free(&obj);
+
+    /* Shrinking cascades: once the JMP is elided, the BRZ targets the
+     * next code and only drops its condition */
+    seq.count = 0;
+    int skip = pf_alloc_label(&seq), next = pf_alloc_label(&seq);
+    pf_emit(&seq, PF_PUSH_CONST, 7, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 1, NULL);
+    pf_emit(&seq, PF_BRZ, skip, NULL);
+    pf_emit(&seq, PF_JMP, next, NULL);
+    pf_emit(&seq, PF_LABEL, next, NULL);
+    pf_emit(&seq, PF_LABEL, skip, NULL);
+    pf_emit(&seq, PF_HALT, 0, NULL);
+    object_init(&obj);
+    ASSERT_EQ(pf_lower(&seq, &obj), 6);
+    ASSERT_EQ(obj.reloc_count, 0);
+    ASSERT_EQ(obj.code[4], OP_DROP);
+    ASSERT_EQ(run_quiet(obj.code, obj.code_len), 7);
+    object_free(&obj);
+    pf_free(&seq);
+}
+
+/* Ops of seq as a string of letters, for compact comparisons */
+static const char *pf_ops(const PostfixSeq *seq) {
+    static char buf[64];
+    static const char letter[] = {
+        [PF_PUSH_CONST] = 'c', [PF_PUSH_VAR] = 'v', [PF_ADD] = '+', [PF_SUB] = '-',
+        [PF_MUL] = '*', [PF_DROP] = 'd', [PF_LABEL] = ':', [PF_STORE] = 's',
+        [PF_NEG] = '~', [PF_ADDR_OF] = 'a', [PF_STORE_VAR] = '=', [PF_DUP] = '^',
+        [PF_SWAP] = 'x', [PF_OVER] = 'o', [PF_ROT] = 'r', [PF_HALT] = 'h',
+        [PF_TSHL] = '<', [PF_TSHR] = '>',
+    };
+    int n = 0;
+    for (int i = 0; i < seq->count && n < 63; i++) {
+        char c = letter[seq->instrs[i].op];
+        buf[n++] = c ? c : '?';
+    }
+    buf[n] = '\0';
+    return buf;
+}
+
+TEST(test_pf_optimize) {
+    PostfixSeq seq;
+    pf_init(&seq);
+    /* Folds cascade: 1 + (2 + 3) */
+    pf_emit(&seq, PF_PUSH_CONST, 1, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 2, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 3, NULL);
+    pf_emit(&seq, PF_ADD, 0, NULL);
+    pf_emit(&seq, PF_ADD, 0, NULL);
+    pf_optimize(&seq);
+    ASSERT_STR_EQ(pf_ops(&seq), "c");
+    ASSERT_EQ(seq.instrs[0].operand, 6);
+
+    /* A fold exposing an identity: x + (1 - 1) -> x */
+    seq.count = 0;
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 1, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 1, NULL);
+    pf_emit(&seq, PF_SUB, 0, NULL);
+    pf_emit(&seq, PF_ADD, 0, NULL);
+    pf_emit(&seq, PF_NOP, 0, NULL);
+    pf_optimize(&seq);
+    ASSERT_STR_EQ(pf_ops(&seq), "v");
+
+    /* x * 0 is 0 (loading x has no effect); a label stops folding */
+    seq.count = 0;
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 0, NULL);
+    pf_emit(&seq, PF_MUL, 0, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 2, NULL);
+    pf_emit(&seq, PF_LABEL, 0, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 3, NULL);
+    pf_emit(&seq, PF_ADD, 0, NULL);
+    pf_optimize(&seq);
+    ASSERT_STR_EQ(pf_ops(&seq), "cc:c+");
+    pf_free(&seq);
+}
+
+TEST(test_pf_rules) {
+    PostfixSeq seq;
+    pf_init(&seq);
+    /* Strength reduction, and a fold that exposes an identity */
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 2, NULL);
+    pf_emit(&seq, PF_MUL, 0, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 3, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 3, NULL);
+    pf_emit(&seq, PF_CMP_LT, 0, NULL);
+    pf_emit(&seq, PF_ADD, 0, NULL);
+    pf_optimize(&seq);
+    ASSERT_EQ(seq.count, 3);
+    ASSERT_EQ(seq.instrs[1].op, PF_DUP);
+    ASSERT_EQ(seq.instrs[2].op, PF_ADD);
+
+    /* A constant branch becomes a jump, and a jump to the next label
+     * goes; -x - -x cascades down to 0 */
+    seq.count = 0;
+    pf_emit(&seq, PF_PUSH_CONST, 0, NULL);
+    pf_emit(&seq, PF_BRZ, 7, NULL);
+    pf_emit(&seq, PF_LABEL, 7, NULL);
+    pf_emit(&seq, PF_PUSH_VAR, 4, NULL);
+    pf_emit(&seq, PF_PUSH_VAR, 4, NULL);
+    pf_emit(&seq, PF_NEG, 0, NULL);
+    pf_emit(&seq, PF_NEG, 0, NULL);
+    pf_emit(&seq, PF_SWAP, 0, NULL);
+    pf_emit(&seq, PF_SUB, 0, NULL);
+    pf_optimize(&seq);
+    ASSERT_EQ(seq.count, 2);
+    ASSERT_EQ(seq.instrs[0].op, PF_LABEL);
+    ASSERT_EQ(seq.instrs[1].op, PF_PUSH_CONST);
+    ASSERT_EQ(seq.instrs[1].operand, 0);
+
+    /* The longest match wins: a comparison result needs no
+     * normalizing, but a lone CMP_EQ 1 stays */
+    seq.count = 0;
+    pf_emit(&seq, PF_CMP_EQ, 0, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 1, NULL);
+    pf_emit(&seq, PF_CMP_EQ, 0, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 1, NULL);
+    pf_emit(&seq, PF_CMP_EQ, 0, NULL);
+    pf_optimize(&seq);
+    ASSERT_EQ(seq.count, 1);
+    pf_free(&seq);
+
+    /* Malformed rules are rejected */
+    PfRule grows = {"grows", {{PF_DUP, PF_ARG_ANY, 0}}, 1,
+                    {{PF_DUP, PF_OUT_LIT, 0}, {PF_DUP, PF_OUT_LIT, 0}}, 2};
+    PfRule forward = {"forward", {{PF_PUSH_VAR, PF_ARG_SAME, 1}, {PF_PUSH_VAR, PF_ARG_ANY, 0}}, 2,
+                      {{PF_DUP, PF_OUT_LIT, 0}}, 1};
+    PfRule bad_fold = {"bad-fold", {{PF_PUSH_VAR, PF_ARG_ANY, 0}, {PF_NEG, PF_ARG_ANY, 0}}, 2,
+                       {{PF_PUSH_CONST, PF_OUT_FOLD, 0}}, 1};
+    ASSERT_TRUE(pf_compile_rules(&grows, 1) == NULL);
+    ASSERT_TRUE(pf_compile_rules(&forward, 1) == NULL);
+    ASSERT_TRUE(pf_compile_rules(&bad_fold, 1) == NULL);
+    PfMatcher *m = pf_compile_rules(pf_default_rules, pf_default_rule_count);
+    ASSERT_TRUE(m != NULL);
+    ASSERT_GT(pf_default_rule_count, 30);
+    pf_free_rules(m);
+}
+
+/* Lower seq and run it on fresh memory */
+static int run_seq(const PostfixSeq *seq) {
+    ObjectModule obj;
+    object_init(&obj);
+    int len = pf_lower(seq, &obj);
+    int result = len < 0 ? -999 : run_quiet(obj.code, len);
+    object_free(&obj);
+    return result;
+}
+
+TEST(test_pf_trit_shifts) {
+    PostfixSeq seq;
+    pf_init(&seq);
+    /* x * 9 and 9 * x shift two trits; x * -27 shifts and negates */
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 9, NULL);
+    pf_emit(&seq, PF_MUL, 0, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 9, NULL);
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_MUL, 0, NULL);
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, -27, NULL);
+    pf_emit(&seq, PF_MUL, 0, NULL);
+    pf_optimize(&seq);
+    ASSERT_STR_EQ(pf_ops(&seq), "v<v<v<~");
+    ASSERT_EQ(seq.instrs[1].operand, 2);
+    ASSERT_EQ(seq.instrs[3].operand, 2);
+    ASSERT_EQ(seq.instrs[5].operand, 3);
+
+    /* Other factors stay multiplies; shifts of constants fold */
+    seq.count = 0;
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 6, NULL);
+    pf_emit(&seq, PF_MUL, 0, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, -7, NULL);
+    pf_emit(&seq, PF_TSHR, 1, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 5, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 3, NULL);
+    pf_emit(&seq, PF_MUL, 0, NULL);
+    pf_optimize(&seq);
+    ASSERT_STR_EQ(pf_ops(&seq), "vc*cc");
+    ASSERT_EQ(seq.instrs[3].operand, -2);
+    ASSERT_EQ(seq.instrs[4].operand, 15);
+
+    /* Lowered and run: slot 5 = -7, then slot 5 * -27 + slot 5 / 3 */
+    seq.count = 0;
+    pf_emit(&seq, PF_ADDR_OF, 5, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, -7, NULL);
+    pf_emit(&seq, PF_STORE, 0, NULL);
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, -27, NULL);
+    pf_emit(&seq, PF_MUL, 0, NULL);
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_TSHR, 1, NULL);
+    pf_emit(&seq, PF_ADD, 0, NULL);
+    pf_emit(&seq, PF_HALT, 0, NULL);
+    pf_optimize(&seq);
+    ASSERT_EQ(run_seq(&seq), 187);
+    pf_free(&seq);
+
+    /* Division by +-3^k converts straight to a shift */
+    Expr *div = create_binop(OP_IR_DIV, create_var("x"), create_const(-9));
+    pf_init(&seq);
+    pf_from_ast(&seq, div);
+    ASSERT_STR_EQ(pf_ops(&seq), "v>~");
+    ASSERT_EQ(seq.instrs[1].operand, 2);
+    pf_free(&seq);
+    expr_free(div);
+
+    /* LOG3 must name a PF_ARG_POW3 instruction */
+    PfRule bad_log3 = {"bad-log3", {{PF_PUSH_CONST, PF_ARG_ANY, 0}, {PF_MUL, PF_ARG_ANY, 0}}, 2,
+                       {{PF_TSHL, PF_OUT_LOG3, 0}}, 1};
+    ASSERT_TRUE(pf_compile_rules(&bad_log3, 1) == NULL);
+}
+
+/* slot 5 = 7, then slot 5 + 2 * slot 5 */
+static void emit_twice(PostfixSeq *seq) {
+    seq->count = 0;
+    pf_emit(seq, PF_ADDR_OF, 5, NULL);
+    pf_emit(seq, PF_PUSH_CONST, 7, NULL);
+    pf_emit(seq, PF_STORE, 0, NULL);
+    pf_emit(seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(seq, PF_PUSH_CONST, 2, NULL);
+    pf_emit(seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(seq, PF_MUL, 0, NULL);
+    pf_emit(seq, PF_ADD, 0, NULL);
+    pf_emit(seq, PF_HALT, 0, NULL);
+}
+
+TEST(test_pf_schedule_stack) {
+    PostfixSeq seq;
+    pf_init(&seq);
+    /* The slot is dead at the end: the store and both loads go */
+    emit_twice(&seq);
+    ASSERT_EQ(pf_schedule_stack(&seq, 1), 3);
+    ASSERT_STR_EQ(pf_ops(&seq), "cco*+h");
+    ASSERT_EQ(run_seq(&seq), 21);
+
+    /* Live at the end: the store stays, leaving a copy */
+    emit_twice(&seq);
+    ASSERT_EQ(pf_schedule_stack(&seq, 0), 2);
+    ASSERT_STR_EQ(pf_ops(&seq), "c^=co*+h");
+    ASSERT_EQ(run_seq(&seq), 21);
+    ASSERT_EQ(vm_memory_read(5), 7);
+
+    /* A load's copy is tucked under code that consumes it: -x - x */
+    seq.count = 0;
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_NEG, 0, NULL);
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_SUB, 0, NULL);
+    ASSERT_EQ(pf_schedule_stack(&seq, 1), 1);
+    ASSERT_STR_EQ(pf_ops(&seq), "v^~x-");
+
+    /* A store through an unknown address or a label ends the search */
+    seq.count = 0;
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_PUSH_VAR, 9, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 1, NULL);
+    pf_emit(&seq, PF_STORE, 0, NULL);
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    pf_emit(&seq, PF_LABEL, 0, NULL);
+    pf_emit(&seq, PF_PUSH_VAR, 5, NULL);
+    ASSERT_EQ(pf_schedule_stack(&seq, 1), 0);
+    ASSERT_EQ(seq.count, 7);
+    pf_free(&seq);
+}
+
+TEST(test_pf_labels) {
+    PostfixSeq seq;
+    pf_init(&seq);
+    int top = pf_alloc_label(&seq), out = pf_alloc_label(&seq);
+    pf_emit(&seq, PF_LABEL, top, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 1, NULL);
+    pf_emit(&seq, PF_PUSH_CONST, 1, NULL);
+    pf_emit(&seq, PF_SUB, 0, NULL);
+    pf_emit(&seq, PF_BRZ, out, NULL);
+    pf_emit(&seq, PF_JMP, top, NULL);
+    pf_emit(&seq, PF_LABEL, out, NULL);
+    pf_emit(&seq, PF_HALT, 0, NULL);
+    ASSERT_EQ(pf_find_label(&seq, top), 0);
+    ASSERT_EQ(pf_find_label(&seq, out), 6);
+    ASSERT_EQ(pf_find_label(&seq, 9), -1);
+
+    /* Compaction moves labels and the table follows: 1 - 1 folds, the
+     * taken branch becomes a jump and the dead JMP stays */
+    pf_optimize(&seq);
+    ASSERT_EQ(pf_find_label(&seq, top), 0);
+    ASSERT_EQ(pf_find_label(&seq, out), 3);
+    ASSERT_EQ(seq.instrs[pf_find_label(&seq, out)].operand, out);
+
+    /* Direct edits fall back to a scan */
+    seq.instrs[0] = seq.instrs[3];
+    seq.instrs[3].op = PF_NOP;
+    ASSERT_EQ(pf_find_label(&seq, out), 0);
+    ASSERT_EQ(pf_find_label(&seq, top), -1);
+    pf_free(&seq);
+}
+
+int main(void) {
+    TEST_SUITE_BEGIN("SSA IR");
+
+    RUN_TEST(test_ssa_straight_line);
+    RUN_TEST(test_ssa_if_phi);
+    RUN_TEST(test_ssa_loop_phi_and_dominators);
+    RUN_TEST(test_ssa_def_use);
+    RUN_TEST(test_ssa_critical_edges);
+    RUN_TEST(test_ssa_memory_vars);
+    RUN_TEST(test_ssa_unsupported);
+    RUN_TEST(test_ssa_sccp_folds_variables);
+    RUN_TEST(test_ssa_sccp_dead_branches);
+    RUN_TEST(test_ssa_dce);
+    RUN_TEST(test_ssa_optimized_code_is_smaller);
+    RUN_TEST(test_ssa_licm);
+    RUN_TEST(test_ssa_strength_reduction);
+    RUN_TEST(test_ssa_loop_kernel);
+    RUN_TEST(test_ssa_inlined_calls);
+    RUN_TEST(test_ssa_common_subexprs);
+    RUN_TEST(test_ssa_wide_constants);
+    RUN_TEST(test_ssa_folded_compares);
+    RUN_TEST(test_ssa_inline_size_budget);
+    RUN_TEST(test_ssa_trit_shifts);
+    RUN_TEST(test_ssa_params_and_returns);
+    RUN_TEST(test_ssa_lower_matches_direct);
+    RUN_TEST(test_ssa_random_programs_match);
+    RUN_TEST(test_ssa_slots_match_direct);
+    RUN_TEST(test_pf_lower);
+    RUN_TEST(test_pf_relax);
+    RUN_TEST(test_pf_optimize);
+    RUN_TEST(test_pf_rules);
+    RUN_TEST(test_pf_trit_shifts);
+    RUN_TEST(test_pf_labels);
+    RUN_TEST(test_pf_schedule_stack);
+
+    TEST_SUITE_END();
+}
@@ -0,0 +1,117 @@
+/*
+ * test_symhash.c - Unit tests for the scoped symbol hash table
+ *
+ * Tests: symhash_insert, symhash_find/get, push/pop scope, in_scope
+ * Coverage: shadowing, scope restore, growth with live scopes,
+ *           clearing slots after pops (no stale probe chains)
+ */
+
+#include "../include/test_harness.h"
+#include "../include/symhash.h"
+
+TEST(test_symhash_insert_get) {
+    SymHash h;
+    symhash_init(&h);
+    ASSERT_EQ(symhash_get(&h, 7, -1), -1);
+    symhash_insert(&h, 7, 70);
+    symhash_insert(&h, 8, 80);
+    ASSERT_EQ(symhash_get(&h, 7, -1), 70);
+    ASSERT_EQ(symhash_get(&h, 8, -1), 80);
+    ASSERT_EQ(symhash_get(&h, 9, -1), -1);
+    symhash_free(&h);
+}
+
+TEST(test_symhash_shadow_and_pop) {
+    SymHash h;
+    symhash_init(&h);
+    symhash_insert(&h, 1, 10);
+    symhash_push_scope(&h);
+    symhash_insert(&h, 1, 11);
+    symhash_insert(&h, 2, 20);
+    ASSERT_EQ(symhash_get(&h, 1, -1), 11);
+    ASSERT_TRUE(symhash_in_scope(&h, 1));
+    symhash_pop_scope(&h);
+    ASSERT_EQ(symhash_get(&h, 1, -1), 10);
+    ASSERT_EQ(symhash_get(&h, 2, -1), -1);
+    ASSERT_EQ(h.key_count, 1);
+    symhash_free(&h);
+}
+
+TEST(test_symhash_in_scope) {
+    SymHash h;
+    symhash_init(&h);
+    symhash_insert(&h, 5, 0);
+    symhash_push_scope(&h);
+    ASSERT_FALSE(symhash_in_scope(&h, 5));
+    symhash_insert(&h, 6, 0);
+    ASSERT_TRUE(symhash_in_scope(&h, 6));
+    symhash_pop_scope(&h);
+    ASSERT_TRUE(symhash_in_scope(&h, 5));
+    symhash_free(&h);
+}
+
+TEST(test_symhash_growth_nested) {
+    /* Grow the slot array while scopes are open, then unwind */
+    SymHash h;
+    symhash_init(&h);
+    for (int depth = 0; depth < 10; depth++) {
+        symhash_push_scope(&h);
+        for (int k = 1; k <= 500; k++) {
+            symhash_insert(&h, k * 10 + depth % 3, depth * 1000 + k);
+        }
+    }
+    ASSERT_EQ(symhash_get(&h, 10, -1), 9000 + 1);
+    for (int depth = 9; depth >= 0; depth--) {
+        for (int k = 1; k <= 500; k++) {
+            int key = k * 10 + depth % 3;
+            ASSERT_EQ(symhash_get(&h, key, -1), depth * 1000 + k);
+        }
+        symhash_pop_scope(&h);
+    }
+    ASSERT_EQ(h.count, 0);
+    ASSERT_EQ(h.key_count, 0);
+    for (int k = 1; k <= 5010; k++) {
+        ASSERT_EQ(symhash_find(&h, k), -1);
+    }
+    symhash_free(&h);
+}
+
+TEST(test_symhash_colliding_pop) {
+    /* Keys that probe past each other: popping the later one must not
+     * hide the earlier one */
+    SymHash h;
+    symhash_init(&h);
+    for (int k = 1; k <= 7; k++) symhash_insert(&h, k, k);
+    symhash_push_scope(&h);
+    for (int k = 100; k < 108; k++) symhash_insert(&h, k, k);
+    symhash_pop_scope(&h);
+    for (int k = 1; k <= 7; k++) ASSERT_EQ(symhash_get(&h, k, -1), k);
+    for (int k = 100; k < 108; k++) ASSERT_EQ(symhash_get(&h, k, -1), -1);
+    symhash_free(&h);
+}
+
+TEST(test_symhash_clear) {
+    SymHash h;
+    symhash_init(&h);
+    symhash_push_scope(&h);
+    symhash_insert(&h, 3, 3);
+    symhash_clear(&h);
+    ASSERT_EQ(h.depth, 0);
+    ASSERT_EQ(symhash_find(&h, 3), -1);
+    symhash_insert(&h, 3, 4);
+    ASSERT_EQ(symhash_get(&h, 3, -1), 4);
+    symhash_free(&h);
+}
+
+int main(void) {
+    TEST_SUITE_BEGIN("Scoped Symbol Hash");
+
+    RUN_TEST(test_symhash_insert_get);
+    RUN_TEST(test_symhash_shadow_and_pop);
+    RUN_TEST(test_symhash_in_scope);
+    RUN_TEST(test_symhash_growth_nested);
+    RUN_TEST(test_symhash_colliding_pop);
+    RUN_TEST(test_symhash_clear);
+
+    TEST_SUITE_END();
+}
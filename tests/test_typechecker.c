@@ -206,6 +206,42 @@ TEST(test_too_many_initializers) {
     expr_free(prog);
 }
 
+TEST(test_function_scope_popped) {
+    /* Locals of one function are not visible in the next */
+    TypeChecker tc;
+    typechecker_init(&tc);
+
+    const char *src =
+        "int f() { int a = 1; return a; }"
+        "int main() { return a; }";
+    Expr *prog = parse_program(src);
+    ASSERT_NOT_NULL(prog);
+
+    int errs = typechecker_check(&tc, prog);
+    ASSERT_EQ(errs, 1); /* 'a' undeclared in main */
+    ASSERT_NULL(typechecker_lookup(&tc, "a"));
+    expr_free(prog);
+    typechecker_free(&tc);
+}
+
+TEST(test_many_symbols) {
+    /* No fixed symbol limit; innermost binding wins */
+    TypeChecker tc;
+    typechecker_init(&tc);
+    TypeDesc int_t = {TYPE_INT, 0};
+    TypeDesc arr_t = {TYPE_ARRAY, 4};
+    char name[16];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "s%d", i);
+        typechecker_add_symbol(&tc, name, int_t);
+    }
+    typechecker_add_symbol(&tc, "s10", arr_t);
+    ASSERT_EQ(tc.env.count, 1001);
+    ASSERT_EQ(typechecker_lookup(&tc, "s999")->type.kind, TYPE_INT);
+    ASSERT_EQ(typechecker_lookup(&tc, "s10")->type.kind, TYPE_ARRAY);
+    typechecker_free(&tc);
+}
+
 int main(void) {
     TEST_SUITE_BEGIN("TypeChecker");
 
@@ -224,6 +260,8 @@ int main(void) {
     RUN_TEST(test_check_simple_program);
     RUN_TEST(test_check_array_program);
     RUN_TEST(test_too_many_initializers);
+    RUN_TEST(test_function_scope_popped);
+    RUN_TEST(test_many_symbols);
 
     TEST_SUITE_END();
 }
@@ -324,6 +324,38 @@ TEST(test_vm_accept_any) {
     ASSERT_EQ(vm_get_result(), 12);
 }
 
+/* ====== Phase 6: Trit shifts ====== */
+
+TEST(test_vm_tshl) {
+    vm_memory_reset();
+    unsigned char code[] = {OP_PUSH, 5, OP_TSHL, 2, OP_HALT};
+    run_and_capture(code, sizeof(code));
+    ASSERT_EQ(vm_get_result(), 45);
+
+    vm_memory_reset();
+    unsigned char neg[] = {OP_PUSH, (unsigned char)-7, OP_TSHL, 1, OP_HALT};
+    run_and_capture(neg, sizeof(neg));
+    ASSERT_EQ(vm_get_result(), -21);
+}
+
+TEST(test_vm_tshr) {
+    vm_memory_reset();
+    unsigned char code[] = {OP_PUSH, 100, OP_TSHR, 2, OP_HALT};
+    run_and_capture(code, sizeof(code));
+    ASSERT_EQ(vm_get_result(), 11);
+
+    /* Truncated toward zero, as C division: -7 / 3 == -2 */
+    vm_memory_reset();
+    unsigned char neg[] = {OP_PUSH, (unsigned char)-7, OP_TSHR, 1, OP_HALT};
+    run_and_capture(neg, sizeof(neg));
+    ASSERT_EQ(vm_get_result(), -2);
+
+    vm_memory_reset();
+    unsigned char all[] = {OP_PUSH, 5, OP_TSHR, 9, OP_HALT};
+    run_and_capture(all, sizeof(all));
+    ASSERT_EQ(vm_get_result(), 0);
+}
+
 /* ====== Phase 3: BRZ/BRN/BRP structured branching ====== */
 
 TEST(test_vm_brz_taken) {
@@ -402,6 +434,38 @@ TEST(test_vm_loop) {
     ASSERT_STR_EQ(output_buf, "Result: 6\n");
 }
 
+/* ====== Instruction count ====== */
+
+TEST(test_vm_steps) {
+    vm_memory_reset();
+    unsigned char code[] = {
+        OP_PUSH, 0, OP_BRZ, 6,      /* Taken: skips the PUSH 9 */
+        OP_PUSH, 9,
+        OP_PUSH, 4, OP_HALT
+    };
+    run_and_capture(code, sizeof(code));
+    ASSERT_STR_EQ(output_buf, "Result: 4\n");
+    ASSERT_EQ(vm_get_steps(), 4);
+
+    /* Reset by every run */
+    unsigned char halt[] = {OP_PUSH, 1, OP_HALT};
+    run_and_capture(halt, sizeof(halt));
+    ASSERT_EQ(vm_get_steps(), 2);
+}
+
+TEST(test_vm_run_limit) {
+    /* JMP 0 forever: stops after exactly the budget */
+    vm_memory_reset();
+    unsigned char spin[] = {OP_JMP, 0};
+    ASSERT_EQ(vm_run_limit(spin, sizeof(spin), 1000), -1);
+    ASSERT_EQ(vm_get_steps(), 1000);
+
+    /* A program within budget runs as vm_run does */
+    unsigned char halt[] = {OP_PUSH, 1, OP_PUSH, 2, OP_ADD, OP_HALT};
+    ASSERT_EQ(vm_run_limit(halt, sizeof(halt), 4), 0);
+    ASSERT_EQ(vm_get_result(), 3);
+}
+
 int main(void) {
     TEST_SUITE_BEGIN("VM Execution");
 
@@ -442,6 +506,10 @@ int main(void) {
     RUN_TEST(test_vm_consensus);
     RUN_TEST(test_vm_accept_any);
 
+    /* Phase 6: Trit shifts */
+    RUN_TEST(test_vm_tshl);
+    RUN_TEST(test_vm_tshr);
+
     /* Phase 3: Structured branching */
     RUN_TEST(test_vm_brz_taken);
     RUN_TEST(test_vm_brz_not_taken);
@@ -452,5 +520,8 @@ int main(void) {
     /* Phase 3: Loop */
     RUN_TEST(test_vm_loop);
 
+    RUN_TEST(test_vm_steps);
+    RUN_TEST(test_vm_run_limit);
+
     TEST_SUITE_END();
 }
@@ -15,6 +15,7 @@
  */
 
 #include <stdio.h>
+#include <limits.h>
 #include "../include/vm.h"
 #include "../include/logger.h"
 
@@ -33,6 +34,9 @@ static int heap_top = MEMORY_SIZE / 2;
 /* === Last result for testing === */
 static int last_result = 0;
 
+/* === Instructions executed by the last vm_run === */
+static long steps = 0;
+
 /* --- Operand stack operations --- */
 static void push(int val) {
     if (sp < STACK_SIZE) stack[sp++] = val;
@@ -69,7 +73,8 @@ const char *opcode_names[] = {
     "BRZ", "BRN", "BRP", "LOOP_BEGIN", "LOOP_END", "BREAK",
     "CMP_EQ", "CMP_LT", "CMP_GT",
     "NEG", "CONSENSUS", "ACCEPT_ANY",
-    "PUSH_TRYTE", "PUSH_WORD"
+    "PUSH_TRYTE", "PUSH_WORD",
+    "TSHL", "TSHR"
 };
 
 /* === Public API === */
@@ -99,6 +104,27 @@ int vm_get_result(void) {
     return last_result;
 }
 
+long vm_get_steps(void) {
+    return steps;
+}
+
+/* === Trit shift helpers === */
+
+#define POW3_INT 20     /* 3^0 .. 3^19 fit an int */
+
+static const unsigned int pow3[POW3_INT] = {
+    1u, 3u, 9u, 27u, 81u, 243u, 729u, 2187u, 6561u, 19683u, 59049u,
+    177147u, 531441u, 1594323u, 4782969u, 14348907u, 43046721u,
+    129140163u, 387420489u, 1162261467u
+};
+
+/* 3^k modulo 2^32, for shifts past the table */
+static unsigned int pow3_mod(int k) {
+    unsigned int p = pow3[POW3_INT - 1];
+    for (k -= POW3_INT - 1; k > 0; k--) p *= 3u;
+    return p;
+}
+
 /* === Ternary logic helpers (trit-level, applied to int values) === */
 
 /* Ternary negation: flip sign. For balanced ternary, this flips all trits. */
@@ -134,12 +160,22 @@ static int ternary_accept_any(int a, int b) {
 /* === Main VM execution loop === */
 
 void vm_run(unsigned char *bytecode, size_t len) {
+    vm_run_limit(bytecode, len, LONG_MAX);
+}
+
+int vm_run_limit(unsigned char *bytecode, size_t len, long max_steps) {
     sp = 0;
     rsp = 0;
+    steps = 0;
     LOG_DEBUG_MSG("VM", "TASK-006", "vm_run entered (two-stack model)");
 
     for (size_t pc = 0; pc < len; ) {
+        if (steps == max_steps) {
+            LOG_DEBUG_MSG("VM", "TASK-006", "vm_run step budget exhausted");
+            return -1;
+        }
         unsigned char op = bytecode[pc++];
+        steps++;
 
         switch (op) {
 
@@ -204,7 +240,7 @@ void vm_run(unsigned char *bytecode, size_t len) {
                 switch (sysno) {
                     case 0: /* t_exit */
                         LOG_DEBUG_MSG("VM", "TASK-016", "t_exit");
-                        return;
+                        return 0;
                     case 1: { /* t_write */
                         int fd = pop(), addr = pop(), slen = pop();
                         (void)fd; (void)addr;
@@ -248,7 +284,7 @@ void vm_run(unsigned char *bytecode, size_t len) {
                 last_result = pop();
                 printf("Result: %d\n", last_result);
                 LOG_DEBUG_MSG("VM", "TASK-006", "vm_run HALT");
-                return;
+                return 0;
 
             /* === Phase 3: Stack manipulation (Setun-70 postfix) === */
 
@@ -390,7 +426,8 @@ void vm_run(unsigned char *bytecode, size_t len) {
                     if (skip_op == OP_PUSH || skip_op == OP_JMP ||
                         skip_op == OP_COND_JMP || skip_op == OP_BRZ ||
                         skip_op == OP_BRN || skip_op == OP_BRP ||
-                        skip_op == OP_CALL || skip_op == OP_PUSH_TRYTE) {
+                        skip_op == OP_CALL || skip_op == OP_PUSH_TRYTE ||
+                        skip_op == OP_TSHL || skip_op == OP_TSHR) {
                         pc++; /* skip 1-byte operand */
                     } else if (skip_op == OP_PUSH_WORD) {
                         pc += 2; /* skip 2-byte operand */
@@ -457,10 +494,31 @@ void vm_run(unsigned char *bytecode, size_t len) {
                 break;
             }
 
+            /* === Phase 6: Trit shifts === */
+
+            case OP_TSHL: {
+                /* Shifting in k zero trits multiplies by 3^k (wrapping
+                 * like MUL) */
+                int k = bytecode[pc++];
+                unsigned int val = (unsigned int)pop();
+                push((int)(val * (k < POW3_INT ? pow3[k] : pow3_mod(k))));
+                break;
+            }
+
+            case OP_TSHR: {
+                /* Dropping k trits divides by 3^k; truncated toward
+                 * zero as C division is, so x*3^k/3^k == x */
+                int k = bytecode[pc++];
+                int val = pop();
+                push(k < POW3_INT ? val / (int)pow3[k] : 0);
+                break;
+            }
+
             default:
                 fprintf(stderr, "VM: unknown opcode %d at pc=%zu\n",
                         op, pc - 1);
-                return;
+                return 0;
         }
     }
+    return 0;
 }